@@ -140,7 +140,600 @@ def comment_on_smoking_histories(people, key, year):
     print 'Fraction of switchers = {fraction_of_switchers}'.format(**locals())
 
 
+# Layout of the binary columnar output (Output_Type 5), see source/output_writer.h
+BINARY_HEADER = np.dtype([('magic', 'S8'), ('version', '<i4'), ('header_size', '<i4'),
+                          ('batch_header_size', '<i4'), ('row_size', '<i4'), ('byte_order', '<u4'),
+                          ('reserved', '<i4'), ('seeds', '<u8', 4),
+                          ('data_hash', '<u8'), ('prng_type', '<i2'), ('cutoff_year', '<i2'),
+                          ('cessation_year', '<i2'), ('indexed_mode', '<i2')])
+BINARY_BATCH = np.dtype([('num_people', '<i4'), ('num_values', '<i4'), ('value_bytes', 'u1'), ('reserved', 'u1', 7)])
+BINARY_ROW = np.dtype([('race', 'i1'), ('sex', 'i1'), ('yob', '<i2'), ('init_age', '<i2'),
+                       ('cess_age', '<i2'), ('ocd_age', '<i2'), ('history_length', '<i2'),
+                       ('history_offset', '<i4')])
+
+
+def read_binary_results(filename):
+    # Returns the header, the person table and the CPD values of the whole file.
+    # The batches are concatenated and history_offset is made relative to the returned CPD values.
+    data = np.memmap(filename, dtype='u1', mode='r')
+    header = np.frombuffer(data, BINARY_HEADER, 1, 0)[0]
+    if header['magic'] != b'LBCSHGB' or header['version'] != 2:
+        raise ValueError(filename + ' is not a binary smoking history file')
+    if header['byte_order'] != 0x01020304 or header['header_size'] != BINARY_HEADER.itemsize or \
+       header['batch_header_size'] != BINARY_BATCH.itemsize or header['row_size'] != BINARY_ROW.itemsize:
+        raise ValueError(filename + ' was written by a big endian host or a build with a different layout')
+    pos = int(header['header_size'])
+    rows, values = [], []
+    num_values = 0
+    while pos < len(data):
+        batch = np.frombuffer(data, BINARY_BATCH, 1, pos)[0]
+        pos += BINARY_BATCH.itemsize
+        batch_rows = np.frombuffer(data, BINARY_ROW, int(batch['num_people']), pos).copy()
+        pos += BINARY_ROW.itemsize * int(batch['num_people'])
+        value_type = 'u1' if batch['value_bytes'] == 1 else '<f4'
+        batch_values = np.frombuffer(data, value_type, int(batch['num_values']), pos)
+        pos += (int(batch['num_values']) * int(batch['value_bytes']) + 7) // 8 * 8
+        batch_rows['history_offset'] += num_values
+        num_values += int(batch['num_values'])
+        rows.append(batch_rows)
+        values.append(batch_values.astype('f8'))
+    return header, np.concatenate(rows), np.concatenate(values)
+
+
+def check_binary_matches_text(exe, year, n):
+    # The binary output must hold the same results as the data style output for the same seeds
+    make_input_file(year, n)
+    os.system(exe + ' data/shg2p0 1 2 3 4 test.in test.out 1 0')
+    os.system(exe + ' data/shg2p0 1 2 3 4 test.in test.bin 5 0')
+    header, rows, values = read_binary_results('test.bin')
+    lines = open('test.out', 'r').read().split('\n')[0:-1]
+    print 'Output size: ' + str(os.path.getsize('test.out')) + ' bytes as text, ' + \
+          str(os.path.getsize('test.bin')) + ' bytes as binary'
+    if len(lines) != len(rows):
+        print 'FAILED: ' + str(len(rows)) + ' people in the binary output, ' + str(len(lines)) + ' in the text'
+        return False
+    for line, row in zip(lines, rows):
+        fields = [str(row[key]) for key in ('race', 'sex', 'yob', 'init_age', 'cess_age', 'ocd_age')]
+        offset = row['history_offset']
+        for i in range(row['history_length']):
+            fields.append(str(row['init_age'] + i))
+            fields.append('%.2f' % values[offset + i])
+        if ';'.join(fields) + ';' != line:
+            print 'FAILED: binary output differs from the text for ' + line
+            return False
+    print 'Binary output matches the text output'
+    return True
+
+
+def check_arrow_matches_text(exe, year, n):
+    # The Arrow output (read with pyarrow) must hold the same results as the data style output
+    import pyarrow.ipc
+    make_input_file(year, n)
+    os.system(exe + ' data/shg2p0 1 2 3 4 test.in test.out 1 0')
+    os.system(exe + ' data/shg2p0 1 2 3 4 test.in test.arrows 6 0 --arrow-batch 5000')
+    table = pyarrow.ipc.open_stream(open('test.arrows', 'rb')).read_all()
+    table.validate(full=True)
+    lines = open('test.out', 'r').read().split('\n')[0:-1]
+    if len(lines) != table.num_rows:
+        print 'FAILED: ' + str(table.num_rows) + ' people in the Arrow output, ' + str(len(lines)) + ' in the text'
+        return False
+    for line, row in zip(lines, table.to_pylist()):
+        fields = [str(row[key]) for key in ('race', 'sex', 'yob', 'init_age', 'cess_age', 'ocd_age')]
+        for item in row['smoking_history']:
+            fields.append(str(item['age']))
+            fields.append('%.2f' % item['cpd'])
+        if ';'.join(fields) + ';' != line:
+            print 'FAILED: Arrow output differs from the text for ' + line
+            return False
+    print 'Arrow output matches the text output'
+    return True
+
+
+AGE_COLUMNS = {'init_age': 3, 'cess_age': 4, 'ocd_age': 5}
+
+
+def age_counts(exe, key, options):
+    # Number of people by age (-999 = none) of one of the age columns in a data style run of test.in
+    os.system(exe + ' data/shg2p0 ' + ' '.join([str(int(random() * 10000)) for i in range(4)]) +
+              ' test.in test.out 1 ' + options)
+    ages = [int(line.split(';')[AGE_COLUMNS[key]]) for line in open('test.out', 'r').read().split('\n')[0:-1]]
+    values, counts = np.unique(ages, return_counts=True)
+    return dict(zip(values, counts))
+
+
+def check_age_distribution(exe, year, n, key, options, fast_option):
+    # Ages sampled with a cdf option (--initiation cdf, --other-cod cdf) must follow the same distribution as
+    # the exact per year draws. Two sample chi-square test over the ages (ages with few people are pooled).
+    make_input_file(year, n)
+    exact = age_counts(exe, key, options)
+    fast = age_counts(exe, key, options + ' ' + fast_option)
+    ages = sorted(set(exact.keys()) | set(fast.keys()))
+    bins, pooled = [], [0, 0]
+    for age in ages:
+        pooled[0] += exact.get(age, 0)
+        pooled[1] += fast.get(age, 0)
+        if pooled[0] + pooled[1] >= 20:
+            bins.append(pooled)
+            pooled = [0, 0]
+    if bins:
+        bins[-1] = [bins[-1][0] + pooled[0], bins[-1][1] + pooled[1]]
+    counts = np.array(bins, dtype='f8')
+    stat = np.sum((counts[:, 0] - counts[:, 1]) ** 2 / (counts[:, 0] + counts[:, 1]))
+    df = max(len(bins) - 1, 1)
+    # 99.9% point of the chi-square distribution (Wilson-Hilferty approximation)
+    limit = df * (1 - 2 / (9 * df) + 3.09 * np.sqrt(2 / (9 * df))) ** 3
+    print key + ' YOB ' + str(year) + ' (' + options + '): chi-square ' + ('%.1f' % stat) + ' with ' + str(df) + \
+          ' degrees of freedom, limit ' + ('%.1f' % limit) + ', -999 for ' + str(exact.get(-999, 0)) + \
+          ' exact, ' + str(fast.get(-999, 0)) + ' cdf'
+    if stat > limit:
+        print 'FAILED: ' + key + ' from ' + fast_option + ' does not match the exact sampling'
+        return False
+    return True
+
+
+def peak_rss_of_run(exe, year, n):
+    # Peak resident memory of the largest child process run so far
+    import resource
+    make_input_file(year, n)
+    os.system(exe + ' data/shg2p0 1 2 3 4 test.in /dev/null 1 0')
+    return resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+
+
+def check_memory_is_flat(exe, year, n_small, n_large):
+    # Memory used by a run should not grow with the number of people simulated.
+    # Children are waited for in order, so the second peak only exceeds the first if the large run used more.
+    # Years of birth after 1950 have smoking histories that run past the cutoff year.
+    small_rss = peak_rss_of_run(exe, year, n_small)
+    large_rss = peak_rss_of_run(exe, year, n_large)
+    print 'Peak RSS: ' + str(small_rss) + ' for ' + str(n_small) + ' people, ' + \
+          str(large_rss) + ' for ' + str(n_large) + ' people'
+    if large_rss > small_rss * 1.1:
+        print 'FAILED: memory grows with the number of people simulated'
+        return False
+    print 'Memory is flat'
+    return True
+
+
+# Output type and cessation year of the runs the equivalence checks compare
+COMPARED_RUNS = (('1', '0'), ('5', '0'), ('1', '1990'), ('7', '0'))
+
+
+def shg_command(exe, data_dir, output_file, output_type, options, input_file='test.in'):
+    # Command line of a run of input_file with the seeds 1 2 3 4
+    return exe + ' ' + data_dir + ' 1 2 3 4 ' + input_file + ' ' + output_file + ' ' + output_type + ' ' + options
+
+
+def outputs_match(cmd_a, file_a, cmd_b, file_b):
+    # Run the two command lines (None = the file has already been written) and check that the files they
+    # write have the same bytes. A missing file does not match.
+    for cmd in (cmd_a, cmd_b):
+        if cmd is not None:
+            os.system(cmd + ' > /dev/null')
+    if not os.path.exists(file_a) or not os.path.exists(file_b):
+        return False
+    return open(file_a, 'rb').read() == open(file_b, 'rb').read()
+
+
+def remove_files(names):
+    for name in names:
+        if os.path.exists(name):
+            os.remove(name)
+
+
+def check_bundle_matches_directory(exe, year, n):
+    # Runs using a compiled data bundle must give the same results as runs using the data directory
+    make_input_file(year, n)
+    passed = True
+    if os.system(exe + ' Compile-Data data/shg2p0 test.bundle') != 0:
+        print 'FAILED: the data bundle could not be compiled'
+        return False
+    for output_type, options in COMPARED_RUNS:
+        if not outputs_match(shg_command(exe, 'data/shg2p0', 'test.out', output_type, options), 'test.out',
+                             shg_command(exe, 'test.bundle', 'test.bundle.out', output_type, options), 'test.bundle.out'):
+            print 'FAILED: bundle output differs for output type ' + output_type + ', cessation year ' + options
+            passed = False
+    # A damaged bundle must be rejected
+    data = bytearray(open('test.bundle', 'rb').read())
+    data[len(data) // 2] ^= 1
+    open('test.bundle', 'wb').write(data)
+    if os.system(exe + ' test.bundle 1 2 3 4 test.in test.bundle.out 1 0 2> /dev/null') == 0:
+        print 'FAILED: a damaged data bundle was used'
+        passed = False
+    remove_files(('test.bundle', 'test.bundle.out'))
+    if passed:
+        print 'Bundle output matches the data directory output'
+    return passed
+
+
+def check_sweep_matches_separate_runs(exe, year, n):
+    # Each year of a --cessation-sweep run must give the same results as an indexed run with that cessation year
+    make_input_file(year, n)
+    passed = True
+    years = ('0', '1950', '1975', '1990', '2030')
+    for output_type in ('1', '5', '7'):
+        os.system(shg_command(exe, 'data/shg2p0', 'sweep.out', output_type, '0 --cessation-sweep ' + ','.join(years)) +
+                  ' > /dev/null')
+        for cessation_year in years:
+            sweep_name = 'sweep_' + cessation_year + '.out'
+            if not outputs_match(shg_command(exe, 'data/shg2p0', 'test.out', output_type, cessation_year + ' --indexed 0'),
+                                 'test.out', None, sweep_name):
+                print 'FAILED: sweep output differs for output type ' + output_type + ', cessation year ' + cessation_year
+                passed = False
+            remove_files((sweep_name,))
+    if passed:
+        print 'Cessation sweep output matches the separate runs'
+    return passed
+
+
+AGG_NUM_AGES = 100
+
+
+def aggregate_from_data(filename, cutoff_year):
+    # Cohort tables of output type 7 counted from a data style (type 1) output file, by race;sex;yob;year;age
+    # (see Aggregate Output in HelpFile.txt). Each value is [people, alive, never, current, former, initiated,
+    # quit, died, cpd in hundredths summed over the current smokers].
+    tables = {}
+    for line in open(filename, 'r'):
+        fields = [int(round(float(value) * 100)) if i > 6 and i % 2 == 1 else int(value)
+                  for i, value in enumerate(line.strip().rstrip(';').split(';'))]
+        race, sex, yob, init_age, cess_age, death_age = fields[0:6]
+        cpd = dict(zip(fields[6::2], fields[7::2]))
+        for age in range(min(cutoff_year - yob, AGG_NUM_AGES - 1) + 1):
+            row = tables.setdefault((race, sex, yob, yob + age, age), [0] * 9)
+            row[0] += 1
+            if death_age != -999 and death_age < age:
+                continue
+            row[1] += 1
+            row[7] += (age == death_age)
+            if init_age == -999 or age < init_age:
+                row[2] += 1
+            elif cess_age == -999 or age < cess_age:
+                row[3] += 1
+                row[8] += cpd.get(age, 0)
+            else:
+                row[4] += 1
+            row[5] += (age == init_age)
+            row[6] += (age == cess_age)
+    return tables
+
+
+def check_aggregate_matches_data(exe):
+    # The aggregate tables (output type 7) must hold the counts of the people in the data style output, serial and threaded
+    passed = True
+    ofile = open('test.in', 'w')
+    for i in range(3000):
+        ofile.write('0;' + str(int(random() * 2)) + ';' + str(1890 + int(random() * 61)) + '\n')
+    ofile.close()
+    for options in ('0', '0 --threads 3'):
+        os.system(shg_command(exe, 'data/shg2p0', 'test.out', '1', options) + ' > /dev/null')
+        os.system(shg_command(exe, 'data/shg2p0', 'test.agg', '7', options) + ' > /dev/null')
+        expected = aggregate_from_data('test.out', 2050)
+        lines = open('test.agg', 'r').read().split('\n')[1:-1]
+        if len(lines) != len(expected):
+            print 'FAILED: ' + str(len(lines)) + ' aggregate rows, ' + str(len(expected)) + ' expected with options ' + options
+            passed = False
+        for line in lines:
+            fields = line.split(';')
+            row = expected.get(tuple([int(value) for value in fields[0:5]]))
+            if row is None:
+                print 'FAILED: unexpected aggregate row ' + line
+                passed = False
+                break
+            mean_cpd = ('%.4f' % (row[8] / (100.0 * row[3]))) if row[3] > 0 else '-999'
+            if fields[5:] != [str(value) for value in row[0:8]] + [mean_cpd]:
+                print 'FAILED: aggregate row ' + line + ' with options ' + options + ' should be ' + \
+                      ';'.join([str(value) for value in row[0:8]] + [mean_cpd])
+                passed = False
+                break
+    remove_files(('test.agg',))
+    if passed:
+        print 'Aggregate tables match the data style output'
+    return passed
+
+
+def check_counted_input(exe):
+    # Records with a count must give the same results as the people written one per line, and the records of a
+    # population pyramid file must get the year of birth Year - Age
+    passed = True
+    counted = open('test.in', 'w')
+    expanded = open('test_expanded.in', 'w')
+    for i in range(60):
+        record = '%d;%d;%d' % (int(random() * 2), int(random() * 2), 1900 + int(random() * 100))
+        count = int(random() * 400)
+        if i % 10 == 0:
+            counted.write(record + ';\n')   # Blank count, one person
+            count = 1
+        else:
+            counted.write(record + ';' + str(count) + '\n')
+        expanded.write((record + '\n') * count)
+    counted.close()
+    expanded.close()
+    for options in ('0', '0 --threads 3', '0 --indexed 0', '0 --threads 3 --indexed 0', '1990'):
+        if not outputs_match(shg_command(exe, 'data/shg2p0', 'test.out', '1', options), 'test.out',
+                             shg_command(exe, 'data/shg2p0', 'test_expanded.out', '1', options, 'test_expanded.in'),
+                             'test_expanded.out'):
+            print 'FAILED: counted input differs from the expanded input with options ' + options
+            passed = False
+
+    open('test.in', 'w').write('PYRAMID;2000\n0;0;50;3\n0;1;20;2\n')
+    os.system(shg_command(exe, 'data/shg2p0', 'test.out', '1', '0') + ' > /dev/null')
+    people = [line.split(';')[1:3] for line in open('test.out', 'r').read().split('\n')[0:-1]]
+    if people != [['0', '1950']] * 3 + [['1', '1980']] * 2:
+        print 'FAILED: unexpected sex and year of birth from the population pyramid: ' + str(people)
+        passed = False
+
+    for invalid in ('0;0;1950;abc\n', '0;0;1980;5;7\n', 'PYRAMID;2020abc\n0;0;50;3\n'):
+        open('test.in', 'w').write(invalid)
+        if os.system(shg_command(exe, 'data/shg2p0', 'test.out', '1', '0') + ' > /dev/null 2>&1') == 0:
+            print 'FAILED: the invalid input ' + repr(invalid) + ' was accepted'
+            passed = False
+    remove_files(('test_expanded.in', 'test_expanded.out'))
+    if passed:
+        print 'Counted and population pyramid input match the expanded input'
+    return passed
+
+
+def double_male_cessation(data_dir):
+    # Double the male cessation probabilities in the cessation file of data_dir
+    name = os.path.join(data_dir, 'lbc_smokehist_cessation.txt')
+    lines = open(name, 'r').read().split('\n')
+    for i in range(len(lines)):
+        fields = lines[i].split(',')
+        if len(fields) > 4 and fields[0] == '0' and fields[1] == '0':
+            lines[i] = ','.join(fields[0:3] + [str(2 * float(value)) for value in fields[3:]])
+    open(name, 'w').write('\n'.join(lines))
+
+
+def check_scenarios_match_separate_runs(exe, year, n):
+    # Each scenario of a --scenarios run must give the same results as a separate run with its data directory
+    make_input_file(year, n)
+    shutil.rmtree('test_data', True)
+    shutil.copytree('data/shg2p0', 'test_data')
+    passed = True
+
+    # Only the cessation file changes, the other files are shared with the first scenario
+    double_male_cessation('test_data')
+
+    directories = ('data/shg2p0', 'test_data', 'data/shg2p0')
+    scenario_names = ['scenario_s' + str(i) + '.out' for i in range(len(directories))]
+    for output_type, options in COMPARED_RUNS:
+        os.system(shg_command(exe, 'data/shg2p0', 'scenario.out', output_type, options) +
+                  ' --scenarios ' + ','.join(directories[1:]) + ' > /dev/null')
+        for i in range(len(directories)):
+            if not outputs_match(shg_command(exe, directories[i], 'test.out', output_type, options), 'test.out',
+                                 None, scenario_names[i]):
+                print 'FAILED: scenario ' + str(i) + ' output differs for output type ' + output_type + \
+                      ', cessation year ' + options
+                passed = False
+        if outputs_match(None, scenario_names[0], None, scenario_names[1]):
+            print 'FAILED: the changed cessation probabilities were not used for output type ' + output_type
+            passed = False
+        remove_files(scenario_names)
+    shutil.rmtree('test_data')
+    if passed:
+        print 'Scenario output matches the separate runs'
+    return passed
+
+
+def check_overlays(exe, year, n):
+    # An overlay must give the same results as a data directory with the transform applied to the file,
+    # and capping the smoking intensity group must remove the heavier cigarettes per day values
+    make_input_file(year, n)
+    shutil.rmtree('test_data', True)
+    shutil.copytree('data/shg2p0', 'test_data')
+    passed = True
+
+    # No male initiation from 2005 on
+    lines = open('test_data/lbc_smokehist_initiation.txt', 'r').read().split('\n')
+    cohorts = []
+    for i in range(len(lines)):
+        fields = lines[i].split(',')
+        if fields[0] == 'Race':
+            cohorts = [int(cohort.split('-')[0]) for cohort in fields[3:]]
+        elif len(fields) > 4 and fields[0] == '0' and fields[1] == '0' and len(cohorts) > 0:
+            age = int(fields[2])
+            lines[i] = ','.join(fields[0:3] + [('0' if value.strip() != '.' and cohorts[j] + age >= 2005 else value)
+                                               for j, value in enumerate(fields[3:])])
+    open('test_data/lbc_smokehist_initiation.txt', 'w').write('\n'.join(lines))
+    open('test_overlay1.txt', 'w').write('* No male initiation from 2005 on\nINITIATION;SEX=0;YEAR=2005-2100;SCALE=0\n')
+    open('test_overlay2.txt', 'w').write('CPD;MAX_GROUP=2\n')
+
+    for output_type, options in (('1', '0'), ('3', '0'), ('1', '2020')):
+        if not outputs_match(shg_command(exe, 'data/shg2p0', 'overlay.out', output_type, options) +
+                             ' --overlays test_overlay1.txt,test_overlay2.txt', 'overlay_s1.out',
+                             shg_command(exe, 'test_data', 'test.out', output_type, options), 'test.out'):
+            print 'FAILED: initiation overlay differs from the changed data file for output type ' + output_type + \
+                  ', cessation year ' + options
+            passed = False
+        if output_type == '1' and os.path.exists('overlay_s2.out'):
+            for line in open('overlay_s2.out', 'r'):
+                fields = line.strip().rstrip(';').split(';')
+                if len([value for value in fields[7::2] if float(value) > 20]) > 0:
+                    print 'FAILED: cigarettes per day above the capped group: ' + line.strip()
+                    passed = False
+                    break
+        remove_files(['overlay_s' + str(i) + '.out' for i in range(3)])
+    remove_files(('test_overlay1.txt', 'test_overlay2.txt'))
+    shutil.rmtree('test_data')
+    if passed:
+        print 'Overlay output matches the changed data files'
+    return passed
+
+
+def check_former_risk_sweep(exe, year, n):
+    # Each coefficient set of a --former-risk-sweep run must give the same results as an indexed run with
+    # --former-risk set to it, the first set is the default coefficients
+    make_input_file(year, n)
+    passed = True
+    coefficient_sets = ('-0.1711,0.00102,0.00171,1.08', '-0.5,0.002,0.003,1.0', '0,0,0,1')
+    open('test_risk.txt', 'w').write('* B0,B1,B2,B3\n' + '\n'.join(coefficient_sets) + '\n')
+    for output_type, options in COMPARED_RUNS:
+        os.system(shg_command(exe, 'data/shg2p0', 'risk.out', output_type, options) +
+                  ' --former-risk-sweep test_risk.txt > /dev/null')
+        for i in range(len(coefficient_sets)):
+            risk_option = ' --former-risk ' + coefficient_sets[i] if i > 0 else ''
+            sweep_name = 'risk_r' + str(i) + '.out'
+            if not outputs_match(shg_command(exe, 'data/shg2p0', 'test.out', output_type, options + ' --indexed 0' + risk_option),
+                                 'test.out', None, sweep_name):
+                print 'FAILED: former smoker risk sweep output differs for output type ' + output_type + \
+                      ', cessation year ' + options + ', coefficients ' + coefficient_sets[i]
+                passed = False
+            remove_files((sweep_name,))
+    remove_files(('test_risk.txt',))
+    if passed:
+        print 'Former smoker risk sweep output matches the separate runs'
+    return passed
+
+
+def server_request(socket_path, text):
+    # Send one request to a server mode process and return everything it writes back
+    import socket
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(socket_path)
+    client.sendall(text.encode('ascii'))
+    chunks = []
+    while True:
+        chunk = client.recv(65536)
+        if not chunk:
+            break
+        chunks.append(chunk)
+    client.close()
+    return b''.join(chunks).decode('ascii')
+
+
+def start_server(exe, data_dir):
+    # Start a server mode process for data_dir and wait until it listens, returns the process and its socket path
+    import subprocess
+    import time
+    socket_path = os.path.abspath('test.sock')
+    server = subprocess.Popen([exe, 'SERVE', data_dir, socket_path])
+    while not os.path.exists(socket_path) and server.poll() is None:
+        time.sleep(0.1)
+    return server, socket_path
+
+
+def stop_server(server, socket_path):
+    server_request(socket_path, 'SHUTDOWN\n')
+    server.wait()
+
+
+def check_server_matches_command_line(exe, n):
+    # A request to the server must give the same results as the command line mode with the same seeds
+    server, socket_path = start_server(exe, 'data/shg2p0')
+    passed = True
+    seeds = 'SEED_INIT=1\nSEED_CESS=2\nSEED_OCD=3\nSEED_MISC=4\n'
+    ofile = open('test.in', 'w')
+    ofile.write('0;0;1950;' + str(n) + '\n0;1;1970;' + str(n) + '\n')
+    ofile.close()
+    # Threaded runs start a new PRNG stream for each block of people, so compare them to threaded command lines
+    for output_type, options in (('1', '0'), ('3', '0'), ('1', '1990'), ('7', '0')):
+        for threads in ('0', '3'):
+            open('test.server.out', 'w').write(
+                server_request(socket_path, seeds + 'RACE=0\nSEX=0,1\nYOB=1950,1970\nREPEAT=' + str(n) +
+                               '\nIMMEDIATECESS=' + options + '\nOUTPUT_TYPE=' + output_type +
+                               '\nTHREADS=' + threads + '\nRUN\n'))
+            if not outputs_match(shg_command(exe, 'data/shg2p0', 'test.out', output_type, options) +
+                                 (' --threads ' + threads if threads != '0' else ''), 'test.out',
+                                 None, 'test.server.out'):
+                print 'FAILED: server output differs for output type ' + output_type + ', cessation year ' + \
+                      options + ', ' + threads + ' threads'
+                passed = False
+    if not server_request(socket_path, seeds + 'RACE=0\nSEX=0\nYOB=1700\nRUN\n').startswith('ERROR:'):
+        print 'FAILED: an invalid request did not return an error'
+        passed = False
+    if not server_request(socket_path, seeds + 'RACE=0\nSEX=65536\nYOB=67436\nRUN\n').startswith('ERROR:'):
+        print 'FAILED: a request with values beyond the short range did not return an error'
+        passed = False
+    if not server_request(socket_path, seeds + 'RACE=0\nSEX=0,1\nYOB=1950\nREPEAT=5000000,5000001\nRUN\n').startswith('ERROR:'):
+        print 'FAILED: a request with too many people did not return an error'
+        passed = False
+    stop_server(server, socket_path)
+    remove_files(('test.server.out',))
+    if passed:
+        print 'Server output matches the command line output'
+    return passed
+
+
+def check_server_reload(exe, n):
+    # After a data file changes, RELOAD must parse only that file and give the results of a fresh start
+    shutil.rmtree('test_data', True)
+    shutil.copytree('data/shg2p0', 'test_data')
+    server, socket_path = start_server(exe, 'test_data')
+    passed = True
+    request = 'SEED_INIT=1\nSEED_CESS=2\nSEED_OCD=3\nSEED_MISC=4\nRACE=0\nSEX=0\nYOB=1950\nREPEAT=' + str(n) + '\nRUN\n'
+    ofile = open('test.in', 'w')
+    ofile.write('0;0;1950;' + str(n) + '\n')
+    ofile.close()
+
+    double_male_cessation('test_data')
+    reply = server_request(socket_path, 'RELOAD\n')
+    if reply != 'OK 1 data files parsed\n':
+        print 'FAILED: unexpected reply to RELOAD: ' + reply
+        passed = False
+    open('test.server.out', 'w').write(server_request(socket_path, request))
+    if not outputs_match(shg_command(exe, 'test_data', 'test.out', '1', '0'), 'test.out', None, 'test.server.out'):
+        print 'FAILED: server output after RELOAD differs from the command line output'
+        passed = False
+    stop_server(server, socket_path)
+    remove_files(('test.server.out',))
+    shutil.rmtree('test_data')
+    if passed:
+        print 'Server reload matches the command line output'
+    return passed
+
+
+def check_initiation_cdf(exe):
+    # --initiation cdf must give the same initiation age distributions as the exact initiation sampling
+    passed = True
+    for year, options in ((1930, '0'), (1960, '0'), (1990, '0'), (1970, '2000'), (2000, '0 -c 2030')):
+        passed = check_age_distribution(exe, year, 200000, 'init_age', options, '--initiation cdf') and passed
+    if passed:
+        print 'Initiation age distributions match'
+    return passed
+
+
+def check_other_cod_cdf(exe):
+    # --other-cod cdf must give the same other COD age distributions as the exact other COD sampling
+    passed = True
+    for year, options in ((1900, '0'), (1930, '0'), (1960, '0'), (1990, '0'), (1970, '2000')):
+        passed = check_age_distribution(exe, year, 200000, 'ocd_age', options, '--other-cod cdf') and passed
+    if passed:
+        print 'Other COD age distributions match'
+    return passed
+
+
+def check_server(exe, n):
+    passed = check_server_matches_command_line(exe, n)
+    return check_server_reload(exe, n) and passed
+
+
+# python run_tests.py MODE [executable] : the check of each MODE, its arguments after the executable
+# and the files it leaves to remove
+TEST_MODES = {
+    'aggregate':  (check_aggregate_matches_data, (), ('test.in', 'test.out')),               # output type 7
+    'counts':     (check_counted_input, (), ('test.in', 'test.out')),                        # Race;Sex;YOB;Count and PYRAMID input
+    'memory':     (check_memory_is_flat, (1990, 100000, 10000000), ('test.in',)),            # memory stays flat for 10M people
+    'binary':     (check_binary_matches_text, (1990, 20000), ('test.in', 'test.out', 'test.bin')),
+    'arrow':      (check_arrow_matches_text, (1990, 20000), ('test.in', 'test.out', 'test.arrows')),  # needs pyarrow
+    'initiation': (check_initiation_cdf, (), ('test.in', 'test.out')),                       # --initiation cdf
+    'othercod':   (check_other_cod_cdf, (), ('test.in', 'test.out')),                        # --other-cod cdf
+    'bundle':     (check_bundle_matches_directory, (1970, 20000), ('test.in', 'test.out')),  # compiled data bundle
+    'sweep':      (check_sweep_matches_separate_runs, (1940, 20000), ('test.in', 'test.out')),  # --cessation-sweep
+    'scenarios':  (check_scenarios_match_separate_runs, (1940, 20000), ('test.in', 'test.out')),  # --scenarios
+    'overlays':   (check_overlays, (1990, 20000), ('test.in', 'test.out')),                  # --overlays
+    'formerrisk': (check_former_risk_sweep, (1940, 20000), ('test.in', 'test.out')),         # --former-risk-sweep
+    'server':     (check_server, (5000,), ('test.in', 'test.out')),                          # server mode and RELOAD
+}
+
+
 if __name__ == '__main__':
+    if len(sys.argv) > 1 and sys.argv[1] in TEST_MODES:
+        check, arguments, temporary_files = TEST_MODES[sys.argv[1]]
+        exe = sys.argv[2] if len(sys.argv) > 2 else './lbc_smokehist_osx64.exe'
+        passed = check(exe, *arguments)
+        remove_files(temporary_files)
+        sys.exit(0 if passed else 1)
+
     n = 20000
     #recompile_source()
     for year in range(1990, 2020, 10):
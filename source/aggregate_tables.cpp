@@ -0,0 +1,148 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: aggregate_tables.cpp
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contact: Rocky Feuer
+// Version 6.2.3
+
+#include "aggregate_tables.h"
+#include "sim_exception.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// Counters that hold the difference from the previous age (see AggregateTables)
+static const bool AGG_IS_SPAN[AGG_NumCounters] = {true, true, true, true, true, false, false, false, false};
+
+// Count a person for the ages wFirstAge to wLastAge in a span counter
+static inline void AddSpan(long long *pCounters, AggregateCounter eCounter, short wFirstAge, short wLastAge) {
+   if (wFirstAge <= wLastAge) {
+      pCounters[wFirstAge * AGG_NumCounters + eCounter]++;
+      pCounters[(wLastAge + 1) * AGG_NumCounters + eCounter]--;
+   }
+}
+
+// Constructor, tables for every race, sex and year of birth from wMinYOB to wMaxYOB
+AggregateTables::AggregateTables(short wNumRaces, short wNumSexes, short wMinYOB, short wMaxYOB) {
+   gwNumRaces  = wNumRaces;
+   gwNumSexes  = wNumSexes;
+   gwMinYOB    = wMinYOB;
+   gwNumYOBs   = wMaxYOB - wMinYOB + 1;
+   gllCounters = new long long[GetNumValues()];
+   Clear();
+}
+
+// Destructor
+AggregateTables::~AggregateTables() {
+   delete [] gllCounters;
+}
+
+// Number of counters in the tables
+long AggregateTables::GetNumValues() const {
+   return (long)gwNumRaces * gwNumSexes * gwNumYOBs * (AGG_NUM_AGES + 1) * AGG_NumCounters;
+}
+
+// Set all counters to zero
+void AggregateTables::Clear() {
+   memset(gllCounters, 0, sizeof(long long) * GetNumValues());
+}
+
+// Counters for age 0 of a cohort, the counters for age a follow at a * AGG_NumCounters
+long long* AggregateTables::GetAgeCounters(short wRace, short wSex, short wYOB) {
+   if (wRace < 0 || wRace >= gwNumRaces || wSex < 0 || wSex >= gwNumSexes ||
+       wYOB < gwMinYOB || wYOB >= gwMinYOB + gwNumYOBs) {
+      throw SimException("AggregateTables::GetAgeCounters()", "Race, sex or year of birth is outside of the aggregate tables.");
+   }
+   return &gllCounters[(((long)wRace * gwNumSexes + wSex) * gwNumYOBs + (wYOB - gwMinYOB)) * (AGG_NUM_AGES + 1) * AGG_NumCounters];
+}
+
+// Add the tables of another simulator (same dimensions)
+void AggregateTables::Add(const AggregateTables &tables) {
+   long lNumValues = GetNumValues(),
+        i;
+   for (i = 0; i < lNumValues; i++)
+      gllCounters[i] += tables.gllCounters[i];
+}
+
+// Count a person at every age from birth to the cutoff year (or age AGG_NUM_AGES-1).
+// A person is alive up to and including the age at death, never smoked before the initiation age,
+// is a current smoker from the initiation age until the year before the cessation age and a former smoker after.
+// dCPDbyAge holds wNumValues cigarettes per day values for the ages from wInitAge (as written by WriteAsData).
+void AggregateTables::AddPerson(short wRace, short wSex, short wYOB, short wInitAge, short wCessAge, short wAgeAtDeath,
+                                const double *dCPDbyAge, short wNumValues, short wCutoffYear) {
+   long long *pCounters  = GetAgeCounters(wRace, wSex, wYOB);
+   short      wMaxAge    = wCutoffYear - wYOB,
+              wLastAlive,
+              wLastSmoking,
+              wAge;
+
+   if (wMaxAge > AGG_NUM_AGES - 1)
+      wMaxAge = AGG_NUM_AGES - 1;
+   if (wMaxAge < 0)
+      return;
+   wLastAlive = (wAgeAtDeath == -999 || wAgeAtDeath > wMaxAge) ? wMaxAge : wAgeAtDeath;
+
+   AddSpan(pCounters, AGG_People, 0, wMaxAge);
+   AddSpan(pCounters, AGG_Alive, 0, wLastAlive);
+   if (wAgeAtDeath != -999 && wAgeAtDeath <= wMaxAge)
+      pCounters[wAgeAtDeath * AGG_NumCounters + AGG_Died]++;
+
+   if (wInitAge == -999) {
+      AddSpan(pCounters, AGG_Never, 0, wLastAlive);
+      return;
+   }
+
+   AddSpan(pCounters, AGG_Never, 0, min(wInitAge - 1, (int)wLastAlive));
+   if (wInitAge <= wLastAlive)
+      pCounters[wInitAge * AGG_NumCounters + AGG_Initiated]++;
+   wLastSmoking = (wCessAge == -999) ? wLastAlive : min(wCessAge - 1, (int)wLastAlive);
+   AddSpan(pCounters, AGG_Current, wInitAge, wLastSmoking);
+   if (wCessAge != -999) {
+      AddSpan(pCounters, AGG_Former, wCessAge, wLastAlive);
+      if (wCessAge <= wLastAlive)
+         pCounters[wCessAge * AGG_NumCounters + AGG_Quit]++;
+   }
+
+   for (wAge = wInitAge; wAge <= wLastSmoking && wAge - wInitAge < wNumValues; wAge++)
+      pCounters[wAge * AGG_NumCounters + AGG_CPDSum] += (long long)floor(dCPDbyAge[wAge - wInitAge] * 100.0 + 0.5);
+}
+
+// Write the tables as semicolon delimited text, one line per race, sex, year of birth and age
+// for every cohort with simulated people. mean_cpd is -999 when there are no current smokers.
+void AggregateTables::Write(FILE *pOutStream, short wCutoffYear) {
+   long long *pCounters,
+              llTotals[AGG_NumCounters],
+              llValue;
+   short      wRace, wSex, wYOBIndex, wAge, i;
+
+   fprintf(pOutStream, "race;sex;yob;year;age;people;alive;never;current;former;initiated;quit;died;mean_cpd\n");
+   for (wRace = 0; wRace < gwNumRaces; wRace++) {
+      for (wSex = 0; wSex < gwNumSexes; wSex++) {
+         for (wYOBIndex = 0; wYOBIndex < gwNumYOBs; wYOBIndex++) {
+            pCounters = GetAgeCounters(wRace, wSex, gwMinYOB + wYOBIndex);
+            if (pCounters[AGG_People] == 0)
+               continue;
+            memset(llTotals, 0, sizeof(llTotals));
+            for (wAge = 0; wAge < AGG_NUM_AGES && gwMinYOB + wYOBIndex + wAge <= wCutoffYear; wAge++, pCounters += AGG_NumCounters) {
+               for (i = 0; i < AGG_NumCounters; i++) {
+                  llValue     = pCounters[i];
+                  llTotals[i] = AGG_IS_SPAN[i] ? llTotals[i] + llValue : llValue;
+               }
+               fprintf(pOutStream, "%d;%d;%d;%d;%d;%lld;%lld;%lld;%lld;%lld;%lld;%lld;%lld;", wRace, wSex,
+                       gwMinYOB + wYOBIndex, gwMinYOB + wYOBIndex + wAge, wAge,
+                       llTotals[AGG_People], llTotals[AGG_Alive], llTotals[AGG_Never], llTotals[AGG_Current],
+                       llTotals[AGG_Former], llTotals[AGG_Initiated], llTotals[AGG_Quit], llTotals[AGG_Died]);
+               if (llTotals[AGG_Current] > 0)
+                  fprintf(pOutStream, "%.4f\n", (double)llTotals[AGG_CPDSum] / (100.0 * llTotals[AGG_Current]));
+               else
+                  fprintf(pOutStream, "-999\n");
+            }
+         }
+      }
+   }
+}
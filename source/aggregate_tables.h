@@ -0,0 +1,60 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: aggregate_tables.h
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contacts: Rocky Feuer
+// Version 6.2.3
+
+#ifndef _AGGREGATE_TABLES_H
+#define _AGGREGATE_TABLES_H
+
+#include <stdio.h>
+
+// Ages counted by the tables (0 to AGG_NUM_AGES-1, the ages written in the data style output)
+#define AGG_NUM_AGES 100
+
+// Counters kept for each race, sex, year of birth and age
+enum AggregateCounter {AGG_People = 0,   // People simulated in the cohort
+                       AGG_Alive,        // Alive at the start of the age (age <= age at death from other causes)
+                       AGG_Never,        // Alive and not yet started smoking
+                       AGG_Current,      // Alive, started smoking at or before the age and not yet quit
+                       AGG_Former,       // Alive and quit at or before the age
+                       AGG_Initiated,    // Started smoking at the age
+                       AGG_Quit,         // Quit smoking at the age
+                       AGG_Died,         // Died from other causes at the age
+                       AGG_CPDSum,       // Sum of cigarettes per day of the current smokers, in hundredths
+                       AGG_NumCounters};
+
+// Cohort summary tables built from the simulated people instead of writing each person (Output_Type 7).
+// Only ages up to the cutoff year are counted. All counters are integers, so the tables do not depend on
+// the order people are added in (tables from several threads can be added together).
+// The counters for a span of ages (people, alive, never, current, former) are kept as differences between
+// consecutive ages, so adding a person is +1 at the first age and -1 after the last. Write adds them up.
+class AggregateTables {
+
+ 	// Private Member Variables
+   private:
+      long long *gllCounters;     // [race][sex][yob][age 0 to AGG_NUM_AGES][counter]
+      short      gwNumRaces;
+      short      gwNumSexes;
+      short      gwMinYOB;
+      short      gwNumYOBs;
+
+      long long* GetAgeCounters(short wRace, short wSex, short wYOB);
+      long       GetNumValues() const;
+
+   public:
+      AggregateTables(short wNumRaces, short wNumSexes, short wMinYOB, short wMaxYOB);
+      ~AggregateTables();
+
+      void Add(const AggregateTables &tables);
+      void AddPerson(short wRace, short wSex, short wYOB, short wInitAge, short wCessAge, short wAgeAtDeath,
+                     const double *dCPDbyAge, short wNumValues, short wCutoffYear);
+      void Clear();
+      void Write(FILE *pOutStream, short wCutoffYear);
+};
+
+#endif
@@ -0,0 +1,402 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: arrow_writer.cpp
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contact: Rocky Feuer
+// Version 6.2.3
+
+#include "arrow_writer.h"
+#include <string.h>
+
+// Values from the Arrow format flatbuffer schemas (Message.fbs and Schema.fbs)
+#define ARROW_METADATA_V5        4
+#define ARROW_HEADER_SCHEMA      1
+#define ARROW_HEADER_RECORDBATCH 3
+#define ARROW_PRECISION_SINGLE   1
+enum ArrowTypeId {ARROW_Int = 2, ARROW_FloatingPoint = 3, ARROW_List = 12, ARROW_Struct = 13};
+
+// A column of the schema and its child fields
+struct ArrowColumn {
+   const char        *sName;
+   ArrowTypeId        eType;
+   short              wBitWidth;     // Int bit width or FloatingPoint precision
+   int                nNumChildren;
+   const ArrowColumn *pChildren;
+};
+
+static const ArrowColumn HISTORY_ITEM_FIELDS[2] = {
+   {"age", ARROW_Int,           8,                      0, 0},
+   {"cpd", ARROW_FloatingPoint, ARROW_PRECISION_SINGLE, 0, 0}};
+static const ArrowColumn HISTORY_ITEM[1] = {
+   {"item", ARROW_Struct, 0, 2, HISTORY_ITEM_FIELDS}};
+static const ArrowColumn ARROW_COLUMNS[7] = {
+   {"race",            ARROW_Int,  8, 0, 0},
+   {"sex",             ARROW_Int,  8, 0, 0},
+   {"yob",             ARROW_Int, 16, 0, 0},
+   {"init_age",        ARROW_Int, 16, 0, 0},
+   {"cess_age",        ARROW_Int, 16, 0, 0},
+   {"ocd_age",         ARROW_Int, 16, 0, 0},
+   {"smoking_history", ARROW_List, 0, 1, HISTORY_ITEM}};
+
+static const char ARROW_ZEROS[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+// Number of bytes after nBytes needed to reach a multiple of 8
+static inline long long Padding8(long long nBytes) {
+   return (8 - nBytes % 8) % 8;
+}
+
+// ArrowFlatBuffer ------------------------------------------------------------
+
+// Constructor, the buffer starts with the offset of the root table (see SetOffset(0, ...))
+ArrowFlatBuffer::ArrowFlatBuffer() {
+   gnLength = 0;
+   Put(0, 4);
+}
+
+// Append a little endian value
+void ArrowFlatBuffer::Put(long long llValue, int nBytes) {
+   int i;
+   if (gnLength + nBytes > ARROW_MAX_METADATA)
+      return;
+   for (i = 0; i < nBytes; i++)
+      gsData[gnLength++] = (unsigned char)((unsigned long long)llValue >> (8 * i));
+}
+
+// Pad with zeros to a multiple of nBytes
+void ArrowFlatBuffer::Align(int nBytes) {
+   while (gnLength % nBytes != 0)
+      Put(0, 1);
+}
+
+// Set the offset stored at nPos to point to the object at nTarget (nTarget is after nPos)
+void ArrowFlatBuffer::SetOffset(int nPos, int nTarget) {
+   int i;
+   for (i = 0; i < 4; i++)
+      gsData[nPos + i] = (unsigned char)((unsigned int)(nTarget - nPos) >> (8 * i));
+}
+
+// Append a string, returns its position
+int ArrowFlatBuffer::AddString(const char* sValue) {
+   int nPos, nLength = (int)strlen(sValue);
+   Align(4);
+   nPos = gnLength;
+   Put(nLength, 4);
+   while (*sValue != '\0')
+      Put(*sValue++, 1);
+   Put(0, 1);
+   return nPos;
+}
+
+// Append a vector of nCount offsets (set later with SetOffset), returns its position.
+// Element i is at the returned position + 4 + 4 * i.
+int ArrowFlatBuffer::AddOffsetVector(int nCount) {
+   int nPos, i;
+   Align(4);
+   nPos = gnLength;
+   Put(nCount, 4);
+   for (i = 0; i < nCount; i++)
+      Put(0, 4);
+   return nPos;
+}
+
+// Append a vector of nCount structs made of nValuesPerStruct 8 byte values, returns its position
+int ArrowFlatBuffer::AddStructVector(const long long* llValues, int nCount, int nValuesPerStruct) {
+   int nPos, i;
+   while ((gnLength + 4) % 8 != 0)
+      Put(0, 1);
+   nPos = gnLength;
+   Put(nCount, 4);
+   for (i = 0; i < nCount * nValuesPerStruct; i++)
+      Put(llValues[i], 8);
+   return nPos;
+}
+
+// Append a table (preceded by its vtable), returns its position.
+// The position of each field is returned in nFieldPos so offsets can be set once their targets are written.
+// Fields are placed largest first after the vtable offset, 8 byte fields start on a multiple of 8.
+int ArrowFlatBuffer::AddTable(const ArrowFbField* pFields, int nFields, int* nFieldPos) {
+   int   nNumSlots = 0, nVTable, nTable, nSize, i;
+   bool  bHasLongs = false;
+
+   for (i = 0; i < nFields; i++) {
+      if (pFields[i].wId + 1 > nNumSlots)
+         nNumSlots = pFields[i].wId + 1;
+      if (pFields[i].wSize == 8)
+         bHasLongs = true;
+   }
+
+   // vtable: its size, the table size and the position of each field within the table (0 = not present)
+   Align(2);
+   nVTable = gnLength;
+   for (i = 0; i < 2 + nNumSlots; i++)
+      Put(0, 2);
+
+   Align(4);
+   if (bHasLongs && gnLength % 8 == 0)
+      Put(0, 4);
+   nTable = gnLength;
+   Put(nTable - nVTable, 4);
+
+   for (nSize = 8; nSize >= 1; nSize /= 2) {
+      for (i = 0; i < nFields; i++) {
+         if (pFields[i].wSize == nSize) {
+            nFieldPos[i] = gnLength;
+            gsData[nVTable + 4 + 2 * pFields[i].wId]     = (unsigned char)((gnLength - nTable) & 0xff);
+            gsData[nVTable + 4 + 2 * pFields[i].wId + 1] = (unsigned char)((gnLength - nTable) >> 8);
+            Put(pFields[i].bOffset ? 0 : pFields[i].llValue, nSize);
+         }
+      }
+   }
+
+   gsData[nVTable]     = (unsigned char)((4 + 2 * nNumSlots) & 0xff);
+   gsData[nVTable + 1] = (unsigned char)((4 + 2 * nNumSlots) >> 8);
+   gsData[nVTable + 2] = (unsigned char)((gnLength - nTable) & 0xff);
+   gsData[nVTable + 3] = (unsigned char)((gnLength - nTable) >> 8);
+   return nTable;
+}
+
+// Schema and message helpers -------------------------------------------------
+
+// Append a Field table for the column and its children, returns the table position
+static int AddArrowField(ArrowFlatBuffer &fb, const ArrowColumn &column) {
+   ArrowFbField fields[5] = {{0, 4, true,  0},               // name
+                             {1, 1, false, 0},               // nullable
+                             {2, 1, false, column.eType},    // type_type
+                             {3, 4, true,  0},               // type
+                             {5, 4, true,  0}};              // children
+   ArrowFbField intFields[2]   = {{0, 4, false, column.wBitWidth}, {1, 1, false, 1}};  // bitWidth, is_signed
+   ArrowFbField floatFields[1] = {{0, 2, false, column.wBitWidth}};                    // precision
+   int          nFieldPos[5], nTypePos[2], nTable, nType, nChildren, i;
+
+   nTable = fb.AddTable(fields, 5, nFieldPos);
+   fb.SetOffset(nFieldPos[0], fb.AddString(column.sName));
+   if (column.eType == ARROW_Int)
+      nType = fb.AddTable(intFields, 2, nTypePos);
+   else if (column.eType == ARROW_FloatingPoint)
+      nType = fb.AddTable(floatFields, 1, nTypePos);
+   else
+      nType = fb.AddTable(0, 0, nTypePos);
+   fb.SetOffset(nFieldPos[3], nType);
+
+   // Arrow readers expect the children vector even when it is empty
+   nChildren = fb.AddOffsetVector(column.nNumChildren);
+   fb.SetOffset(nFieldPos[4], nChildren);
+   for (i = 0; i < column.nNumChildren; i++)
+      fb.SetOffset(nChildren + 4 + 4 * i, AddArrowField(fb, column.pChildren[i]));
+   return nTable;
+}
+
+// Append the Message table as the root of the buffer, returns the position of its header offset
+static int AddArrowMessage(ArrowFlatBuffer &fb, unsigned char ucHeaderType, long long llBodyLength) {
+   ArrowFbField fields[4] = {{0, 2, false, ARROW_METADATA_V5},  // version
+                             {1, 1, false, ucHeaderType},       // header_type
+                             {2, 4, true,  0},                  // header
+                             {3, 8, false, llBodyLength}};      // bodyLength
+   int          nFieldPos[4];
+
+   fb.SetOffset(0, fb.AddTable(fields, 4, nFieldPos));
+   return nFieldPos[2];
+}
+
+// ArrowStreamWriter ----------------------------------------------------------
+
+// Constructor, lMaxRows people are held before the batch is written
+ArrowStreamWriter::ArrowStreamWriter(long lMaxRows) {
+   if (lMaxRows < 1)
+      lMaxRows = 1;
+   glMaxRows        = lMaxRows;
+   glNumRows        = 0;
+   gcRace           = new signed char[lMaxRows];
+   gcSex            = new signed char[lMaxRows];
+   gwYOB            = new short[lMaxRows];
+   gwInitAge        = new short[lMaxRows];
+   gwCessAge        = new short[lMaxRows];
+   gwAgeAtDeath     = new short[lMaxRows];
+   glHistoryOffsets = new int[lMaxRows + 1];
+   glHistoryOffsets[0] = 0;
+   glValueCapacity  = lMaxRows * 16;
+   gcAges           = new signed char[glValueCapacity];
+   gfCPD            = new float[glValueCapacity];
+   glNumValues      = 0;
+   gpStream         = 0;
+}
+
+// Destructor, people that have not been flushed are discarded (the stream may already be closed)
+ArrowStreamWriter::~ArrowStreamWriter() {
+   delete [] gcRace;
+   delete [] gcSex;
+   delete [] gwYOB;
+   delete [] gwInitAge;
+   delete [] gwCessAge;
+   delete [] gwAgeAtDeath;
+   delete [] glHistoryOffsets;
+   delete [] gcAges;
+   delete [] gfCPD;
+}
+
+// Select the stream for the following people, people held for another stream are written first
+void ArrowStreamWriter::SetStream(FILE *pStream) {
+   if (pStream != gpStream) {
+      Flush();
+      gpStream = pStream;
+   }
+}
+
+// Add a person to the current batch, the batch is written when it is full
+void ArrowStreamWriter::AddPerson(short wRace, short wSex, short wYOB, short wInitAge, short wCessAge, short wAgeAtDeath,
+                                  const double *dCPDbyAge, short wNumValues) {
+   signed char *cNewAges;
+   float       *fNewCPD;
+   short        i;
+
+   if (wNumValues < 0)
+      wNumValues = 0;
+   if (glNumValues + wNumValues > glValueCapacity) {
+      while (glNumValues + wNumValues > glValueCapacity)
+         glValueCapacity *= 2;
+      cNewAges = new signed char[glValueCapacity];
+      fNewCPD  = new float[glValueCapacity];
+      memcpy(cNewAges, gcAges, glNumValues * sizeof(signed char));
+      memcpy(fNewCPD, gfCPD, glNumValues * sizeof(float));
+      delete [] gcAges;
+      delete [] gfCPD;
+      gcAges = cNewAges;
+      gfCPD  = fNewCPD;
+   }
+
+   gcRace[glNumRows]       = (signed char)wRace;
+   gcSex[glNumRows]        = (signed char)wSex;
+   gwYOB[glNumRows]        = wYOB;
+   gwInitAge[glNumRows]    = wInitAge;
+   gwCessAge[glNumRows]    = wCessAge;
+   gwAgeAtDeath[glNumRows] = wAgeAtDeath;
+   for (i = 0; i < wNumValues; i++) {
+      gcAges[glNumValues] = (signed char)(wInitAge + i);
+      gfCPD[glNumValues]  = (float)dCPDbyAge[i];
+      glNumValues++;
+   }
+   glNumRows++;
+   glHistoryOffsets[glNumRows] = (int)glNumValues;
+
+   if (glNumRows == glMaxRows)
+      Flush();
+}
+
+// Write an encapsulated message: continuation marker, metadata size and the metadata padded to 8 bytes
+void ArrowStreamWriter::WriteMessage(FILE *pStream, const ArrowFlatBuffer &metadata) {
+   unsigned int uiMarker = 0xFFFFFFFF;
+   int          nLength  = metadata.GetLength(),
+                nPadding = (int)Padding8(nLength);
+   unsigned char sLength[4];
+   int          i;
+
+   for (i = 0; i < 4; i++)
+      sLength[i] = (unsigned char)((unsigned int)(nLength + nPadding) >> (8 * i));
+   fwrite(&uiMarker, 4, 1, pStream);
+   fwrite(sLength, 1, 4, pStream);
+   fwrite(metadata.GetData(), 1, nLength, pStream);
+   fwrite(ARROW_ZEROS, 1, nPadding, pStream);
+}
+
+// Write the current batch to its stream as a RecordBatch message
+void ArrowStreamWriter::Flush() {
+   ArrowFlatBuffer metadata;
+   ArrowFbField    fields[3] = {{0, 8, false, glNumRows},   // length
+                                {1, 4, true,  0},           // nodes
+                                {2, 4, true,  0}};          // buffers
+   const void     *pBuffers[ARROW_NUM_BUFFERS];
+   long long       llSizes[ARROW_NUM_BUFFERS],
+                   llBufferSpecs[2 * ARROW_NUM_BUFFERS],
+                   llNodes[2 * ARROW_NUM_NODES],
+                   llBodyLength = 0;
+   int             nFieldPos[3], nHeaderPos, nBatch, i;
+
+   if (glNumRows == 0 || gpStream == 0) {
+      glNumRows   = 0;
+      glNumValues = 0;
+      return;
+   }
+
+   // Buffers in column order, the validity buffers are empty as there are no nulls
+   for (i = 0; i < ARROW_NUM_BUFFERS; i++) {
+      pBuffers[i] = 0;
+      llSizes[i]  = 0;
+   }
+   pBuffers[1]  = gcRace;           llSizes[1]  = glNumRows * sizeof(signed char);
+   pBuffers[3]  = gcSex;            llSizes[3]  = glNumRows * sizeof(signed char);
+   pBuffers[5]  = gwYOB;            llSizes[5]  = glNumRows * sizeof(short);
+   pBuffers[7]  = gwInitAge;        llSizes[7]  = glNumRows * sizeof(short);
+   pBuffers[9]  = gwCessAge;        llSizes[9]  = glNumRows * sizeof(short);
+   pBuffers[11] = gwAgeAtDeath;     llSizes[11] = glNumRows * sizeof(short);
+   pBuffers[13] = glHistoryOffsets; llSizes[13] = (glNumRows + 1) * sizeof(int);   // 12 = list validity
+   pBuffers[16] = gcAges;           llSizes[16] = glNumValues * sizeof(signed char); // 14 = struct validity
+   pBuffers[18] = gfCPD;            llSizes[18] = glNumValues * sizeof(float);
+
+   for (i = 0; i < ARROW_NUM_BUFFERS; i++) {
+      llBufferSpecs[2 * i]     = llBodyLength;
+      llBufferSpecs[2 * i + 1] = llSizes[i];
+      llBodyLength += llSizes[i] + Padding8(llSizes[i]);
+   }
+
+   // Field nodes (length, null count) for the columns, the list's struct and the struct's fields
+   for (i = 0; i < ARROW_NUM_NODES; i++) {
+      llNodes[2 * i]     = (i < 7) ? glNumRows : glNumValues;
+      llNodes[2 * i + 1] = 0;
+   }
+
+   nHeaderPos = AddArrowMessage(metadata, ARROW_HEADER_RECORDBATCH, llBodyLength);
+   nBatch     = metadata.AddTable(fields, 3, nFieldPos);
+   metadata.SetOffset(nHeaderPos, nBatch);
+   metadata.SetOffset(nFieldPos[1], metadata.AddStructVector(llNodes, ARROW_NUM_NODES, 2));
+   metadata.SetOffset(nFieldPos[2], metadata.AddStructVector(llBufferSpecs, ARROW_NUM_BUFFERS, 2));
+
+   WriteMessage(gpStream, metadata);
+   for (i = 0; i < ARROW_NUM_BUFFERS; i++) {
+      if (llSizes[i] > 0) {
+         fwrite(pBuffers[i], 1, (size_t)llSizes[i], gpStream);
+         fwrite(ARROW_ZEROS, 1, (size_t)Padding8(llSizes[i]), gpStream);
+      }
+   }
+
+   glNumRows   = 0;
+   glNumValues = 0;
+}
+
+// Write the Schema message that starts the stream, sMetadata holds key/value pairs stored with the schema
+void ArrowStreamWriter::WriteSchema(FILE *pStream, const char* sMetadata[][2], int nNumMetadata) {
+   ArrowFlatBuffer metadata;
+   ArrowFbField    schemaFields[3] = {{0, 2, false, 0},     // endianness (Little)
+                                      {1, 4, true,  0},     // fields
+                                      {2, 4, true,  0}};    // custom_metadata
+   ArrowFbField    keyValueFields[2] = {{0, 4, true, 0}, {1, 4, true, 0}};
+   int             nFieldPos[3], nKeyValuePos[2], nHeaderPos, nSchema, nVector, nKeyValue, i;
+
+   nHeaderPos = AddArrowMessage(metadata, ARROW_HEADER_SCHEMA, 0);
+   nSchema    = metadata.AddTable(schemaFields, 3, nFieldPos);
+   metadata.SetOffset(nHeaderPos, nSchema);
+
+   nVector = metadata.AddOffsetVector(7);
+   metadata.SetOffset(nFieldPos[1], nVector);
+   for (i = 0; i < 7; i++)
+      metadata.SetOffset(nVector + 4 + 4 * i, AddArrowField(metadata, ARROW_COLUMNS[i]));
+
+   nVector = metadata.AddOffsetVector(nNumMetadata);
+   metadata.SetOffset(nFieldPos[2], nVector);
+   for (i = 0; i < nNumMetadata; i++) {
+      nKeyValue = metadata.AddTable(keyValueFields, 2, nKeyValuePos);
+      metadata.SetOffset(nVector + 4 + 4 * i, nKeyValue);
+      metadata.SetOffset(nKeyValuePos[0], metadata.AddString(sMetadata[i][0]));
+      metadata.SetOffset(nKeyValuePos[1], metadata.AddString(sMetadata[i][1]));
+   }
+
+   WriteMessage(pStream, metadata);
+}
+
+// Write the end of stream marker
+void ArrowStreamWriter::WriteEndOfStream(FILE *pStream) {
+   unsigned char sMarker[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+   fwrite(sMarker, 1, 8, pStream);
+}
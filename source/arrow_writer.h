@@ -0,0 +1,96 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: arrow_writer.h
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contacts: Rocky Feuer
+// Version 6.2.3
+
+#ifndef _ARROW_WRITER_H
+#define _ARROW_WRITER_H
+
+#include <stdio.h>
+
+// Arrow IPC stream output (Output_Type 6), written without the Arrow libraries.
+// The stream is a Schema message, one RecordBatch message per batch of people and the end of stream marker.
+// Columns (no nulls, -999 is kept for missing ages as in the data style output):
+//    race int8, sex int8, yob int16, init_age int16, cess_age int16, ocd_age int16,
+//    smoking_history list<item: struct<age: int8, cpd: float>>
+// The smoking history holds the same ages and cigarettes per day as the data style output.
+
+#define ARROW_DEFAULT_BATCH_SIZE 65536  // People per record batch unless SetArrowBatchSize is used
+#define ARROW_MAX_METADATA       4096   // Size of the buffer used to build a message's flatbuffer
+#define ARROW_NUM_BUFFERS        19     // Buffers in a record batch (validity + data for each column)
+#define ARROW_NUM_NODES          10     // Field nodes in a record batch (columns and their children)
+
+// A field of a flatbuffer table: its id in the schema, size in bytes and value.
+// Offset fields (bOffset) are written as 0 and set with ArrowFlatBuffer::SetOffset once the target is written.
+struct ArrowFbField {
+   short     wId;
+   short     wSize;
+   bool      bOffset;
+   long long llValue;
+};
+
+// Builds the flatbuffer metadata of an Arrow message.
+// Objects are written front to back: vtable, table, then the objects the table refers to, so every
+// offset points forward as flatbuffers require.
+class ArrowFlatBuffer {
+
+ 	// Private Member Variables
+   private:
+      unsigned char gsData[ARROW_MAX_METADATA];
+      int           gnLength;
+
+      void Put(long long llValue, int nBytes);
+
+   public:
+      ArrowFlatBuffer();
+
+      int  AddOffsetVector(int nCount);
+      int  AddString(const char* sValue);
+      int  AddStructVector(const long long* llValues, int nCount, int nValuesPerStruct);
+      int  AddTable(const ArrowFbField* pFields, int nFields, int* nFieldPos);
+      void Align(int nBytes);
+      void SetOffset(int nPos, int nTarget);
+      const unsigned char* GetData() const { return gsData;};
+      int  GetLength() const { return gnLength;};
+};
+
+// Collects people in memory and writes them to the stream as one Arrow record batch
+class ArrowStreamWriter {
+
+ 	// Private Member Variables
+   private:
+      long         glMaxRows;        // Batch is written when it holds this many people
+      long         glNumRows;
+      signed char *gcRace;
+      signed char *gcSex;
+      short       *gwYOB;
+      short       *gwInitAge;
+      short       *gwCessAge;
+      short       *gwAgeAtDeath;
+      int         *glHistoryOffsets; // Start of each person's history in gcAges/gfCPD (glMaxRows + 1 values)
+      signed char *gcAges;
+      float       *gfCPD;
+      long         glNumValues;
+      long         glValueCapacity;
+      FILE        *gpStream;         // Stream the batch belongs to
+
+      static void WriteMessage(FILE *pStream, const ArrowFlatBuffer &metadata);
+
+   public:
+      ArrowStreamWriter(long lMaxRows);
+      ~ArrowStreamWriter();
+
+      void AddPerson(short wRace, short wSex, short wYOB, short wInitAge, short wCessAge, short wAgeAtDeath,
+                     const double *dCPDbyAge, short wNumValues);
+      void Flush();
+      void SetStream(FILE *pStream);
+      static void WriteEndOfStream(FILE *pStream);
+      static void WriteSchema(FILE *pStream, const char* sMetadata[][2], int nNumMetadata);
+};
+
+#endif
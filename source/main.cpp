@@ -22,6 +22,7 @@
 #include <stdio.h>
 
 #include "smoking_sim.h"
+#include "sim_server.h"
 #include "sim_exception.h"
 
 #define MAX(x) (std::numeric_limits<x>::max())
@@ -42,22 +43,41 @@
 
 const short wMIN_IMMEDIATE_CESSATION_YEAR = 1910;  // Minimum Year Value that can be used as the Immediatte Cessation Year
 short wSIM_CUTOFF_YEAR = 2050;                     // Cut-off year for the application
+short wSIM_NUM_THREADS = 0;                        // Worker threads for command line runs (0 = single threaded)
+long lSIM_FIRST_INDEX = -1;                        // Indexed mode person number of the first input record (-1 = not indexed)
+short wSIM_PRNG_TYPE = PRNG_MersenneTwister;       // Generator used for command line runs
+long lSIM_ARROW_BATCH_SIZE = ARROW_DEFAULT_BATCH_SIZE; // People per record batch for Arrow output
+bool bSIM_FAST_INITIATION = false;                 // Sample initiation ages from their distribution (--initiation cdf)
+bool bSIM_FAST_OTHER_COD = false;                  // Sample other COD ages from survival curves (--other-cod cdf)
+char* sSIM_CESSATION_SWEEP = 0;                    // Comma separated cessation years to run in one pass (--cessation-sweep), 0 = no sweep
+char* sSIM_SCENARIOS = 0;                          // Comma separated data directories of the other scenarios (--scenarios), 0 = one scenario
+char* sSIM_OVERLAYS = 0;                           // Comma separated overlay files applied to Source_Dir for more scenarios (--overlays)
+double dSIM_FORMER_RISK[NUM_FORMER_RISK_COEFS] = {B0, B1, B2, B3}; // Former smoker excess risk coefficients (--former-risk)
+char* sSIM_FORMER_RISK_SWEEP = 0;                  // File of former smoker coefficient sets to run in one pass (--former-risk-sweep)
 
 const char sSEX_LABELS[2][7]  = {"Male", "Female"};
 const char sRACE_LABELS[2][10] = {"All Races", "White"};
 
 // Declaring Function prototypes
 char* AssignFilename(const char* sDirectory, const char * sFilename);
+char* AssignScenarioFilename(const char* sOutputFile, short wScenario);
 short CountVectorValues(char* sDataString);
 bool CreateDataFile(const char *sNumToSimulate, const char* sOutFileName, char*);
+bool ExtractOption(int& argc, char* argv[], const char* sOption, char** sValue);
 void Help(const char* sAppName, FILE* pHelpStream);
 bool IsPosLongInt(const char *sValue);
 bool IsPosShortInt(const char *sValue);
 bool IsValidNumReps(const char* sNumReps);
 bool IsValidSeed(const char* sSeedValue);
+bool IsValidCessationSweep(const char* sCessationYears);
+bool ParseFormerRiskCoefficients(const char* sValue, double* dCoefficients);
+double* LoadFormerRiskSets(const char* sFileName, short& wNumSets);
 void LoadValue(char* sDest, char* sSource, int iValueNum);
 void ModifyCutoffYear(char*);
 bool RunFromParameters(char*, char*, char*, char*, char*, char*, char*, char*, char*, char*);
+int RunServerFromDirectory(const char* sDataFileDir, const char* sSocketPath);
+int CompileDataBundle(const char* sDataFileDir, const char* sBundleFile);
+SmokingModel* LoadModel(const char* sDataFileDir, const SmokingModel* const* pLoadedModels = 0, short wNumModels = 0);
 void RunInfiniteLoop();
 void RunInterface();
 int RunWebVersion(const char *sInputFileName);
@@ -77,6 +97,124 @@ int main(int argc, char* argv[]) {
 	char sErrorMessage[500];
 	int iReturnValue;
    FILE* pHelpFile = 0;
+   char* sNumThreads = 0;
+   char* sFirstIndex = 0;
+   char* sPRNGName = 0;
+   char* sArrowBatchSize = 0;
+   char* sInitiationMode = 0;
+   char* sOtherCODMode = 0;
+   char* sFormerRisk = 0;
+
+   // Optional "--threads N" may appear anywhere on the command line, remove it before counting parameters
+   if (ExtractOption(argc, argv, "--threads", &sNumThreads)) {
+      if (sNumThreads == 0 || !IsPosShortInt(sNumThreads) || atoi(sNumThreads) < 1) {
+         fprintf(stderr, "The --threads option requires a positive integer value.\n");
+         return 1;
+      }
+      wSIM_NUM_THREADS = (short) atoi(sNumThreads);
+   }
+
+   // Optional "--indexed N", simulate in indexed mode with the first input record being person N
+   if (ExtractOption(argc, argv, "--indexed", &sFirstIndex)) {
+      if (sFirstIndex == 0 || !IsPosLongInt(sFirstIndex)) {
+         fprintf(stderr, "The --indexed option requires a person number (>= 0).\n");
+         return 1;
+      }
+      lSIM_FIRST_INDEX = atol(sFirstIndex);
+   }
+
+   // Optional "--prng NAME", generator to use for the PRNGs
+   if (ExtractOption(argc, argv, "--prng", &sPRNGName)) {
+      if (sPRNGName != 0 && strcmp(Str_tolower(sPRNGName), "mt") == 0) {
+         wSIM_PRNG_TYPE = PRNG_MersenneTwister;
+      } else if (sPRNGName != 0 && strcmp(Str_tolower(sPRNGName), "philox") == 0) {
+         wSIM_PRNG_TYPE = PRNG_Philox;
+      } else {
+         fprintf(stderr, "The --prng option requires a generator name, mt or philox.\n");
+         return 1;
+      }
+   }
+
+   // Optional "--arrow-batch N", people per record batch when writing Arrow output
+   if (ExtractOption(argc, argv, "--arrow-batch", &sArrowBatchSize)) {
+      if (sArrowBatchSize == 0 || !IsPosLongInt(sArrowBatchSize) || atol(sArrowBatchSize) < 1) {
+         fprintf(stderr, "The --arrow-batch option requires a positive integer value.\n");
+         return 1;
+      }
+      lSIM_ARROW_BATCH_SIZE = atol(sArrowBatchSize);
+   }
+
+   // Optional "--initiation MODE", how initiation ages are sampled
+   if (ExtractOption(argc, argv, "--initiation", &sInitiationMode)) {
+      if (sInitiationMode != 0 && strcmp(Str_tolower(sInitiationMode), "exact") == 0) {
+         bSIM_FAST_INITIATION = false;
+      } else if (sInitiationMode != 0 && strcmp(Str_tolower(sInitiationMode), "cdf") == 0) {
+         bSIM_FAST_INITIATION = true;
+      } else {
+         fprintf(stderr, "The --initiation option requires a mode, exact or cdf.\n");
+         return 1;
+      }
+   }
+
+   // Optional "--other-cod MODE", how ages of death from other causes are sampled
+   if (ExtractOption(argc, argv, "--other-cod", &sOtherCODMode)) {
+      if (sOtherCODMode != 0 && strcmp(Str_tolower(sOtherCODMode), "exact") == 0) {
+         bSIM_FAST_OTHER_COD = false;
+      } else if (sOtherCODMode != 0 && strcmp(Str_tolower(sOtherCODMode), "cdf") == 0) {
+         bSIM_FAST_OTHER_COD = true;
+      } else {
+         fprintf(stderr, "The --other-cod option requires a mode, exact or cdf.\n");
+         return 1;
+      }
+   }
+
+   // Optional "--cessation-sweep Y1,Y2,...", run the immediate cessation years in one pass (checked by ValidateParameters)
+   if (ExtractOption(argc, argv, "--cessation-sweep", &sSIM_CESSATION_SWEEP)) {
+      if (sSIM_CESSATION_SWEEP == 0) {
+         fprintf(stderr, "The --cessation-sweep option requires a list of cessation years.\n");
+         return 1;
+      }
+      if (wSIM_NUM_THREADS > 0) {
+         fprintf(stderr, "The --cessation-sweep option can not be used with --threads.\n");
+         return 1;
+      }
+   }
+
+   // Optional "--former-risk B0,B1,B2,B3", coefficients of the excess risk formula for former smokers
+   if (ExtractOption(argc, argv, "--former-risk", &sFormerRisk)) {
+      if (sFormerRisk == 0 || !ParseFormerRiskCoefficients(sFormerRisk, dSIM_FORMER_RISK)) {
+         fprintf(stderr, "The --former-risk option requires %d comma separated coefficients, B0,B1,B2,B3.\n", NUM_FORMER_RISK_COEFS);
+         return 1;
+      }
+   }
+
+   // Optional "--former-risk-sweep FILE", run each set of former smoker coefficients in FILE in one pass
+   if (ExtractOption(argc, argv, "--former-risk-sweep", &sSIM_FORMER_RISK_SWEEP)) {
+      if (sSIM_FORMER_RISK_SWEEP == 0) {
+         fprintf(stderr, "The --former-risk-sweep option requires a file of coefficient sets.\n");
+         return 1;
+      }
+      if (wSIM_NUM_THREADS > 0 || sSIM_CESSATION_SWEEP != 0 || sFormerRisk != 0) {
+         fprintf(stderr, "The --former-risk-sweep option can not be used with --threads, --cessation-sweep or --former-risk.\n");
+         return 1;
+      }
+   }
+
+   // Optional "--scenarios DIR1,DIR2,...", also simulate the input file with the data files of each directory
+   if (ExtractOption(argc, argv, "--scenarios", &sSIM_SCENARIOS)) {
+      if (sSIM_SCENARIOS == 0 || CountVectorValues(sSIM_SCENARIOS) == 0) {
+         fprintf(stderr, "The --scenarios option requires a list of data directories.\n");
+         return 1;
+      }
+   }
+
+   // Optional "--overlays FILE1,FILE2,...", also simulate the input file with the transforms of each file applied to Source_Dir
+   if (ExtractOption(argc, argv, "--overlays", &sSIM_OVERLAYS)) {
+      if (sSIM_OVERLAYS == 0 || CountVectorValues(sSIM_OVERLAYS) == 0) {
+         fprintf(stderr, "The --overlays option requires a list of overlay files.\n");
+         return 1;
+      }
+   }
 
    switch (argc) {
 
@@ -112,8 +250,14 @@ int main(int argc, char* argv[]) {
          } break;
 
       // 3 input parameters, Create a data file - FOR TESTING ONLY - NOT TO BE USED IN SIMULATIONS
+      // or a call to run the simulator as a server (data tables loaded once, requests over a Unix socket)
+      // or a call to compile the data files into a data bundle
       case 4:
-         if ( (strcmp(argv[1], "CREATE_DATA_FILE") == 0) && CreateDataFile(argv[2], argv[3], sErrorMessage) ) {
+         if (strcmp(Str_toupper(argv[1]), "SERVE") == 0) {
+            iReturnValue = RunServerFromDirectory(argv[2], argv[3]);
+         } else if (strcmp(Str_toupper(argv[1]), "COMPILE-DATA") == 0) {
+            iReturnValue = CompileDataBundle(argv[2], argv[3]);
+         } else if ( (strcmp(argv[1], "CREATE_DATA_FILE") == 0) && CreateDataFile(argv[2], argv[3], sErrorMessage) ) {
       		iReturnValue = 0;
          } else {   // Must have hit an error
       		fprintf(stderr, "%s\n", sErrorMessage);
@@ -174,6 +318,41 @@ int main(int argc, char* argv[]) {
 }
 
 
+// Looks for sOption in the command line parameters.
+// If found, the option and the value following it are removed from argv, argc is reduced
+// and sValue points to the value (0 if the option was the last parameter).
+// Returns true if the option was found.
+bool ExtractOption(int& argc, char* argv[], const char* sOption, char** sValue) {
+   int i, iNumRemoved;
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], sOption) == 0) {
+         *sValue = (i + 1 < argc) ? argv[i + 1] : 0;
+         iNumRemoved = (i + 1 < argc) ? 2 : 1;
+         for (; i + iNumRemoved < argc; i++) {
+            argv[i] = argv[i + iNumRemoved];
+         }
+         argc -= iNumRemoved;
+         argv[argc] = 0;
+         return true;
+      }
+   }
+   return false;
+}
+
+// Returns the output file name of scenario wScenario of a --scenarios run, _sN is added before the
+// extension of sOutputFile (results.txt -> results_s1.txt)
+char* AssignScenarioFilename(const char* sOutputFile, short wScenario) {
+   const char *sExtension = strrchr(sOutputFile, '.');
+   char       *sScenarioFile = new char[strlen(sOutputFile) + 16];
+
+   if (sExtension != 0 && strpbrk(sExtension, "/\\") == 0)
+      sprintf(sScenarioFile, "%.*s_s%d%s", (int)(sExtension - sOutputFile), sOutputFile, wScenario, sExtension);
+   else
+      sprintf(sScenarioFile, "%s_s%d", sOutputFile, wScenario);
+   return sScenarioFile;
+}
+
 // Returns a string containing the directory and filename concatenated together
 char* AssignFilename(const char* sDirectory, const char * sFilename) {
    int iCurrIndex, i;
@@ -246,14 +425,57 @@ void Help(const char* sAppName,FILE* pOutStream) {
    fprintf(pOutStream, "Type: %s Init_Seed Cess_Seed Oth_Cod_Seed Indiv_Seed Input_File Output_File Output_Type Immediate_Cessation\n",sAppName);
    fprintf(pOutStream, "Where:\n");
    fprintf(pOutStream, "\tSource_Dir     - Directory containing the NHIS or counterfactual inputs for the simulation model. Application will use the NHIS estiamtes if this value is ommitted.\n");
+   fprintf(pOutStream, "\t                 May also be a data bundle written by Compile-Data (section 5).\n");
    fprintf(pOutStream, "\tInit_Seed      - An integer seed for the Initiation Probability PRNG (>= 0)\n");
    fprintf(pOutStream, "\tCess_Seed      - An integer seed for the Cessation Probability PRNG (>= 0)\n");
    fprintf(pOutStream, "\tOth_Cod_Seed   - An integer seed for the Other Cause of Death Probability PRNG (>=0)\n");
    fprintf(pOutStream, "\tIndiv_Seed     - An integer seed for the PRNG that will be used for defining characteristics of the individual (>= 0).\n");
    fprintf(pOutStream, "\tInput_File     - Name of file containing the covariate combinations to simulate. Should be formatted using Input File Format 1 (defined below).\n");
    fprintf(pOutStream, "\tOutput_File    - Name of the output file that the application should write to.\n");
-   fprintf(pOutStream, "\tOutput_Type    - Style of output to write: 1 = Data ,  2 = Text,  3 = Timeline\n");
-   fprintf(pOutStream, "\tCessation_Year - 4-digit Year Value. All smokers will stop smoking on January 1st of year provided. Enter a value of '0' to disable the immediate cessation option.\n\n");
+   fprintf(pOutStream, "\tOutput_Type    - Style of output to write: 1 = Data ,  2 = Text,  3 = Timeline,  5 = Binary (data tables, see help file),  6 = Arrow IPC stream,  7 = Aggregate tables\n");
+   fprintf(pOutStream, "\tCessation_Year - 4-digit Year Value. All smokers will stop smoking on January 1st of year provided. Enter a value of '0' to disable the immediate cessation option.\n");
+   fprintf(pOutStream, "Options (may be placed anywhere after %s):\n",sAppName);
+   fprintf(pOutStream, "\t--threads N    - Simulate the input file with N worker threads. Results are the same for any value of N.\n");
+   fprintf(pOutStream, "\t                 Each block of %d records starts its PRNGs 2^%d draws after the previous block, so only\n", SIM_CHUNK_SIZE, SIM_CHUNK_STREAM_POWER);
+   fprintf(pOutStream, "\t                 the first block matches a run without this option.\n");
+   fprintf(pOutStream, "\t--indexed N    - Simulate in indexed mode, the first record in the input file is person number N (>= 0).\n");
+   fprintf(pOutStream, "\t                 Every person uses a fixed number of random numbers from each PRNG, so a person's results only\n");
+   fprintf(pOutStream, "\t                 depend on the seeds and the person number. A file split into parts can be run separately\n");
+   fprintf(pOutStream, "\t                 (passing the position of each part) and gives the same results as the whole file.\n");
+   fprintf(pOutStream, "\t                 Results differ from a run without this option. With --threads every block matches.\n");
+   fprintf(pOutStream, "\t--prng NAME    - Generator for the PRNGs: mt = Mersenne Twister (default, reproduces published results),\n");
+   fprintf(pOutStream, "\t                 philox = Philox4x32-10 counter based generator (small state, jumps are free).\n");
+   fprintf(pOutStream, "\t--arrow-batch N - People per record batch for Output_Type 6 (default %d). With --threads a batch\n", ARROW_DEFAULT_BATCH_SIZE);
+   fprintf(pOutStream, "\t                 also ends at the end of each block of %d records.\n", SIM_CHUNK_SIZE);
+   fprintf(pOutStream, "\t--initiation MODE - exact = one initiation draw per year of age (default, reproduces published results),\n");
+   fprintf(pOutStream, "\t                 cdf = one draw per person from the precomputed initiation age distribution. The\n");
+   fprintf(pOutStream, "\t                 initiation ages have the same distribution, the individual results differ from exact.\n");
+   fprintf(pOutStream, "\t--other-cod MODE - exact = one other COD draw per year of age (default, reproduces published results),\n");
+   fprintf(pOutStream, "\t                 cdf = one draw per smoking status from precomputed survival curves for never and\n");
+   fprintf(pOutStream, "\t                 current smokers (former smokers still draw every year). Same distribution, results differ.\n");
+   fprintf(pOutStream, "\t--cessation-sweep Y1,Y2,... - Simulate the input file for each of the immediate cessation years listed (0 = no\n");
+   fprintf(pOutStream, "\t                 immediate cessation) in one pass with common random numbers, Cessation_Year must be 0.\n");
+   fprintf(pOutStream, "\t                 The results for year Y are written to Output_File with _Y added before the extension\n");
+   fprintf(pOutStream, "\t                 (results.txt -> results_1990.txt). Runs in indexed mode, the results for each year are the\n");
+   fprintf(pOutStream, "\t                 same as a run with --indexed and that Cessation_Year. Can not be used with --threads.\n");
+   fprintf(pOutStream, "\t--scenarios DIR1,DIR2,... - Also simulate the input file with the data files (or data bundle) of each\n");
+   fprintf(pOutStream, "\t                 directory listed, with the same seeds. Scenario 0 is Source_Dir, the results of scenario K\n");
+   fprintf(pOutStream, "\t                 are written to Output_File with _sK added before the extension (results.txt -> results_s1.txt).\n");
+   fprintf(pOutStream, "\t                 A data file with the same contents as a file of an earlier scenario is only loaded once.\n");
+   fprintf(pOutStream, "\t--overlays FILE1,FILE2,... - Also simulate the input file for each overlay file, the transforms of the\n");
+   fprintf(pOutStream, "\t                 file applied to the data of Source_Dir, one per line: TABLE;KEY=VALUE;... with TABLE\n");
+   fprintf(pOutStream, "\t                 INITIATION or CESSATION (SCALE=F) or CPD (MAX_GROUP=G) and the filters RACE=, SEX=, YOB=,\n");
+   fprintf(pOutStream, "\t                 AGE= and YEAR= (value or range A-B). These scenarios come after the --scenarios\n");
+   fprintf(pOutStream, "\t                 directories and only copy the race/sex/cohort slices of the tables they change.\n");
+   fprintf(pOutStream, "\t--former-risk B0,B1,B2,B3 - Coefficients of the excess risk formula for the other COD of former smokers,\n");
+   fprintf(pOutStream, "\t                 exp((B0 + B1 * Average CPD + B2 * Cessation Age) * Years Quit^B3). Default %g,%g,%g,%g.\n", B0, B1, B2, B3);
+   fprintf(pOutStream, "\t--former-risk-sweep FILE - Simulate the input file for each coefficient set in FILE, one B0,B1,B2,B3 set\n");
+   fprintf(pOutStream, "\t                 per line (lines starting with * are comments), in one pass with common random numbers.\n");
+   fprintf(pOutStream, "\t                 The histories are simulated once, only the other COD of former smokers is simulated\n");
+   fprintf(pOutStream, "\t                 for each set. The results of set K (from 0) are written to Output_File with _rK added\n");
+   fprintf(pOutStream, "\t                 before the extension (results.txt -> results_r0.txt). Runs in indexed mode, the results\n");
+   fprintf(pOutStream, "\t                 of each set are the same as a run with --indexed and --former-risk with that set.\n");
+   fprintf(pOutStream, "\t                 Can not be used with --threads, --cessation-sweep or --former-risk.\n\n");
    fprintf(pOutStream, "3. Web Interface Mode\n");
    fprintf(pOutStream, "NOTE: This mode was designed for use with a website. It will provide the same results but it does have\n");
    fprintf(pOutStream, "\tdifferent requirements in terms of how the input to the program should be formatted and the results\n");
@@ -262,7 +484,39 @@ void Help(const char* sAppName,FILE* pOutStream) {
    fprintf(pOutStream, "Where:\n");
    fprintf(pOutStream, "\tINFILE_PATH = Path to the input file to be used for the application\n");
    fprintf(pOutStream, "\tThis input file must be formatted using Input File Format 2 (defined below).\n\n");
-   fprintf(pOutStream, "4. Additional calls\n");
+   fprintf(pOutStream, "4. Server Mode\n");
+   fprintf(pOutStream, "Loads the data files once and runs simulation requests sent over a Unix domain socket until it is stopped.\n");
+   fprintf(pOutStream, "Type: %s Serve Source_Dir Socket_Path\n",sAppName);
+   fprintf(pOutStream, "Where:\n");
+   fprintf(pOutStream, "\tSource_Dir     - Directory where the input data files are located.\n");
+   fprintf(pOutStream, "\tSocket_Path    - Path of the Unix domain socket to listen on (an existing file there is replaced).\n");
+   fprintf(pOutStream, "A request is one connection: KEY=VALUE lines ended by a line with RUN. Keys are not case-sensitive.\n");
+   fprintf(pOutStream, "\tSEED_INIT=, SEED_CESS=, SEED_OCD=, SEED_MISC= - PRNG seeds (required)\n");
+   fprintf(pOutStream, "\tRACE=, SEX=, YOB= - Values or comma separated vectors of values (required)\n");
+   fprintf(pOutStream, "\tREPEAT=        - Number of people for each set of values, or a vector (default 1)\n");
+   fprintf(pOutStream, "\tIMMEDIATECESS= - Immediate cessation year, 0 = not used (default 0)\n");
+   fprintf(pOutStream, "\tOUTPUT_TYPE=   - Output_Type of the command line mode (default 1)\n");
+   fprintf(pOutStream, "\tPRNG=          - mt or philox (default mt)\n");
+   fprintf(pOutStream, "\tTHREADS=       - Worker threads for the request (default 0, single threaded)\n");
+   fprintf(pOutStream, "The results are written back in the format of the output type and the connection is closed.\n");
+   fprintf(pOutStream, "Errors are written as a line starting with ERROR:. The request SHUTDOWN stops the server.\n");
+   fprintf(pOutStream, "The request RELOAD loads the data files again and replies OK n data files parsed. Only the files whose\n");
+   fprintf(pOutStream, "contents changed (and the files checked against them) are parsed, the initiation file changing reloads all.\n");
+   fprintf(pOutStream, "Requests after the reload use the new data, a Source_Dir given as a data bundle can not be reloaded.\n");
+   fprintf(pOutStream, "Requests are run one at a time and give the same results as the command line mode with the same seeds.\n");
+   fprintf(pOutStream, "A client that sends no request line, or reads no results, for %d seconds is sent an ERROR: line and closed.\n",
+           SERVER_TIMEOUT_SECONDS);
+   fprintf(pOutStream, "A request may simulate at most %ld people (the sum of the REPEAT values).\n\n", SERVER_MAX_PEOPLE);
+   fprintf(pOutStream, "5. Data Bundles\n");
+   fprintf(pOutStream, "Validates the data files once and writes them to a single binary file that later runs map instead of parsing\n");
+   fprintf(pOutStream, "the text files, so starting a run takes milliseconds. Use the bundle in place of any Source_Dir.\n");
+   fprintf(pOutStream, "Type: %s Compile-Data Source_Dir Bundle_File\n",sAppName);
+   fprintf(pOutStream, "Where:\n");
+   fprintf(pOutStream, "\tSource_Dir     - Directory where the input data files are located.\n");
+   fprintf(pOutStream, "\tBundle_File    - Name of the data bundle to write.\n");
+   fprintf(pOutStream, "A bundle is only read by the same version of the application built for the same kind of machine, and is\n");
+   fprintf(pOutStream, "checked against a checksum when it is loaded. Results are the same as with the data directory.\n\n");
+   fprintf(pOutStream, "6. Additional calls\n");
    fprintf(pOutStream, "Type: %s Loop\n",sAppName);
    fprintf(pOutStream, "\t- Force the application into an infinite loop\n");
    fprintf(pOutStream, "Type: %s Help\n",sAppName);
@@ -434,7 +688,76 @@ void LoadValue(char* sDest, char* sSource, int iValueNum) {
    delete [] sBuffer;
 }
 
+// Load the data tables from a data directory, or map them from a data bundle written by Compile-Data.
+// Data files with the same contents as a file loaded by one of the wNumModels models in pLoadedModels
+// use that model's tables (see SmokingModel), those models must be deleted after this one.
+SmokingModel* LoadModel(const char* sDataFileDir, const SmokingModel* const* pLoadedModels, short wNumModels) {
+   char         *sInitiationFile = 0,
+                *sCessationFile = 0,
+                *sOtherCODFile = 0,
+                *sCPDIntensityFile = 0,
+                *sCPDDataFile = 0;
+   SmokingModel *pModel = 0;
+
+   if (SmokingModel::IsBundleFile(sDataFileDir))
+      return new SmokingModel(sDataFileDir);
+
+   try {
+      sInitiationFile = AssignFilename(sDataFileDir, INITIATION_DATA_FILE);
+      sCessationFile = AssignFilename(sDataFileDir, CESSATION_DATA_FILE);
+      sOtherCODFile = AssignFilename(sDataFileDir, OTHER_COD_DATA_FILE);
+      sCPDIntensityFile = AssignFilename(sDataFileDir, CPD_INTENSITY_PROBS);
+      sCPDDataFile = AssignFilename(sDataFileDir, CPD_DATA_FILE);
+      if (wNumModels > 0)
+         pModel = new SmokingModel(sInitiationFile, sCessationFile, sOtherCODFile, sCPDIntensityFile, sCPDDataFile,
+                                   pLoadedModels, wNumModels);
+      else
+         pModel = new SmokingModel(sInitiationFile, sCessationFile, sOtherCODFile, sCPDIntensityFile, sCPDDataFile);
+   } catch (SimException ex) {
+      delete [] sInitiationFile; delete [] sCessationFile; delete [] sOtherCODFile; delete [] sCPDIntensityFile; delete [] sCPDDataFile;
+      throw ex;
+   }
+
+   delete [] sInitiationFile; delete [] sCessationFile; delete [] sOtherCODFile; delete [] sCPDIntensityFile; delete [] sCPDDataFile;
+   return pModel;
+}
+
+// Load and validate the data files in sDataFileDir and write them to the data bundle sBundleFile
+int CompileDataBundle(const char* sDataFileDir, const char* sBundleFile) {
+   SmokingModel *pModel = 0;
+   int           iReturnValue = 0;
+
+   try {
+      pModel = LoadModel(sDataFileDir);
+      pModel->WriteBundle(sBundleFile);
+   } catch (SimException ex) {
+      fprintf(stderr, "%s\n", ex.GetError());
+      iReturnValue = 1;
+   }
+
+   delete pModel;
+   return iReturnValue;
+}
+
+// Load the data tables from sDataFileDir once and serve simulation requests on the socket sSocketPath
+int RunServerFromDirectory(const char* sDataFileDir, const char* sSocketPath) {
+   SmokingModel *pModel = 0;
+   int           iReturnValue;
+
+   try {
+      pModel = LoadModel(sDataFileDir);
+      iReturnValue = RunServer(pModel, sSocketPath);
+   } catch (SimException ex) {
+      fprintf(stderr, "%s\n", ex.GetError());
+      iReturnValue = 1;
+   }
+
+   delete pModel;
+   return iReturnValue;
+}
+
 // Run the application using the seeds and input/output stream
+
 bool RunFromParameters(char* sDataFileDir, char* sInitiationSeed,
                       char* sCessationSeed, char* sOtherCODSeed,
                       char* sIndivRndSeed, char* sInputFile,
@@ -443,24 +766,52 @@ bool RunFromParameters(char* sDataFileDir, char* sInitiationSeed,
 
 	bool						bReturnValue = true;
    short                wOutputType,
-                        wCessationYear;
+                        wCessationYear,
+                        wNumSweepYears = 0,
+                       *wSweepYears    = 0,
+                        wNumScenarios  = 1,
+                        wNumDirectories = 1,
+                        wNumRiskSets   = 0,
+                        i;
+   char                 sSweepYear[100],
+                       *sScenarioDir   = 0,
+                       *sOverlayFile   = 0,
+                       *sScenarioFile  = 0;
 	unsigned long 			ulInitiationSeed,
 					  			ulCessationSeed,
                         ulOtherCODSeed,
                         ulIndivRndSeed;
-   char                *sInitiationFile = 0,
-                       *sCessationFile = 0,
-                       *sOtherCODFile = 0,
-                       *sCPDIntensityFile = 0,
-                       *sCPDDataFile = 0;
+   double              *dRiskSets = 0;
+   SmokingModel       **pModels = 0;
 	Smoking_Simulator	  *pSimulator  = 0;
 
 	try {
-      sInitiationFile = AssignFilename(sDataFileDir, INITIATION_DATA_FILE);
-      sCessationFile = AssignFilename(sDataFileDir, CESSATION_DATA_FILE);
-      sOtherCODFile = AssignFilename(sDataFileDir, OTHER_COD_DATA_FILE);
-      sCPDIntensityFile = AssignFilename(sDataFileDir, CPD_INTENSITY_PROBS);
-      sCPDDataFile = AssignFilename(sDataFileDir, CPD_DATA_FILE);
+      // Scenario 0 uses the data in sDataFileDir, scenario i the i-th directory of --scenarios,
+      // followed by a scenario for each --overlays file applied to the data in sDataFileDir
+      if (sSIM_SCENARIOS != 0)
+         wNumDirectories += CountVectorValues(sSIM_SCENARIOS);
+      wNumScenarios = wNumDirectories;
+      if (sSIM_OVERLAYS != 0)
+         wNumScenarios += CountVectorValues(sSIM_OVERLAYS);
+      pModels = new SmokingModel*[wNumScenarios];
+      for (i = 0; i < wNumScenarios; i++)
+         pModels[i] = 0;
+      pModels[0] = LoadModel(sDataFileDir);
+      if (sSIM_SCENARIOS != 0) {
+         sScenarioDir = new char[strlen(sSIM_SCENARIOS) + 1];
+         for (i = 1; i < wNumDirectories; i++) {
+            LoadValue(sScenarioDir, sSIM_SCENARIOS, i - 1);
+            pModels[i] = LoadModel(sScenarioDir, pModels, i);
+         }
+      }
+      if (sSIM_OVERLAYS != 0) {
+         sOverlayFile = new char[strlen(sSIM_OVERLAYS) + 1];
+         for (i = wNumDirectories; i < wNumScenarios; i++) {
+            LoadValue(sOverlayFile, sSIM_OVERLAYS, i - wNumDirectories);
+            pModels[i] = new SmokingModel(*pModels[0], sOverlayFile);
+         }
+      }
+
       ulInitiationSeed = (unsigned long) atol(sInitiationSeed);
       ulCessationSeed = (unsigned long) atol(sCessationSeed);
       ulOtherCODSeed = (unsigned long) atol(sOtherCODSeed);
@@ -468,12 +819,49 @@ bool RunFromParameters(char* sDataFileDir, char* sInitiationSeed,
       wOutputType = (short) atoi(sOutputType);
       wCessationYear = (short) atoi(sImmediateCess);
 
-  		pSimulator = new Smoking_Simulator(sInitiationFile, sCessationFile, sOtherCODFile, sCPDIntensityFile, sCPDDataFile, 
-                                         ulInitiationSeed, ulCessationSeed, ulOtherCODSeed, ulIndivRndSeed,  
-                                         wOutputType, wCessationYear);
-
+      if (sSIM_CESSATION_SWEEP != 0) {
+         wNumSweepYears = CountVectorValues(sSIM_CESSATION_SWEEP);
+         wSweepYears    = new short[wNumSweepYears];
+         for (i = 0; i < wNumSweepYears; i++) {
+            LoadValue(sSweepYear, sSIM_CESSATION_SWEEP, i);
+            wSweepYears[i] = (short) atoi(sSweepYear);
+         }
+      }
+      if (sSIM_FORMER_RISK_SWEEP != 0)
+         dRiskSets = LoadFormerRiskSets(sSIM_FORMER_RISK_SWEEP, wNumRiskSets);
+      // Each year, coefficient set or scenario has its own output file, drop the one created when the parameters were validated
+      if (sSIM_CESSATION_SWEEP != 0 || sSIM_FORMER_RISK_SWEEP != 0 || wNumScenarios > 1)
+         remove(sOutputFile);
+
+      // Every scenario simulates the input file with the same seeds
+      for (i = 0; i < wNumScenarios; i++) {
+         pSimulator = new Smoking_Simulator(pModels[i], ulInitiationSeed, ulCessationSeed, ulOtherCODSeed, ulIndivRndSeed,
+                                            wOutputType, wCessationYear);
+
+         pSimulator->SetPRNGType(wSIM_PRNG_TYPE);
+         pSimulator->SetArrowBatchSize(lSIM_ARROW_BATCH_SIZE);
+         pSimulator->SetFastInitiation(bSIM_FAST_INITIATION);
+         pSimulator->SetFastOtherCOD(bSIM_FAST_OTHER_COD);
+         pSimulator->SetFormerRiskCoefficients(dSIM_FORMER_RISK);
+         if (lSIM_FIRST_INDEX >= 0) {
+            pSimulator->SetIndexedMode(true);
+            pSimulator->SeekPerson((unsigned long) lSIM_FIRST_INDEX);
+         }
 
-      pSimulator->RunSimulation(sInputFile, sOutputFile, false);
+         delete [] sScenarioFile;
+         sScenarioFile = 0;
+         if (wNumScenarios > 1)
+            sScenarioFile = AssignScenarioFilename(sOutputFile, i);
+         if (wNumSweepYears > 0)
+            pSimulator->RunCessationSweep(sInputFile, (sScenarioFile != 0) ? sScenarioFile : sOutputFile, wSweepYears, wNumSweepYears);
+         else if (wNumRiskSets > 0)
+            pSimulator->RunFormerRiskSweep(sInputFile, (sScenarioFile != 0) ? sScenarioFile : sOutputFile, dRiskSets, wNumRiskSets);
+         else
+            pSimulator->RunSimulation(sInputFile, (sScenarioFile != 0) ? sScenarioFile : sOutputFile, false, wSIM_NUM_THREADS);
+
+         delete pSimulator;
+         pSimulator = 0;
+      }
 
    } catch (SimException ex) {
       sprintf(sErrorMessage, "%s", ex.GetError());
@@ -483,10 +871,16 @@ bool RunFromParameters(char* sDataFileDir, char* sInitiationSeed,
 		bReturnValue = false;
    }
 
-   /*
-	delete pSimulator;
-   delete [] sInitiationFile; delete [] sCessationFile; delete [] sOtherCODFile; delete [] sCPDIntensityFile; delete [] sCPDDataFile;
-   */
+   // Scenarios may use the tables of the scenarios before them, delete the models in reverse order
+   delete pSimulator;
+   for (i = wNumScenarios - 1; pModels != 0 && i >= 0; i--)
+      delete pModels[i];
+   delete [] pModels;
+   delete [] wSweepYears;
+   delete [] dRiskSets;
+   delete [] sScenarioDir;
+   delete [] sOverlayFile;
+   delete [] sScenarioFile;
 	return bReturnValue;
 }
 
@@ -538,6 +932,107 @@ bool IsValidSeed(const char* sSeedValue) {
    return bReturnValue;
 }
 
+// Verify the --cessation-sweep value, a comma separated list of cessation years that are each
+// 0 or a valid immediate cessation year
+bool IsValidCessationSweep(const char* sCessationYears) {
+   bool   bReturnValue = true;
+   short  wNumYears    = 0;
+   char  *pTokenPtr    = 0,
+         *sBuffer      = 0;
+
+   sBuffer = new char[strlen(sCessationYears) + 1];
+   strcpy(sBuffer, sCessationYears);
+   pTokenPtr = strtok(sBuffer, VECTOR_DELIMITER);
+   while (pTokenPtr != NULL) {
+      if (!IsPosShortInt(pTokenPtr) ||
+          ((atoi(pTokenPtr) != 0) &&
+           (atoi(pTokenPtr) < wMIN_IMMEDIATE_CESSATION_YEAR || atoi(pTokenPtr) > wSIM_CUTOFF_YEAR))) {
+         bReturnValue = false;
+      }
+      wNumYears++;
+      pTokenPtr = strtok(NULL, VECTOR_DELIMITER);
+   }
+   delete [] sBuffer;
+   return bReturnValue && (wNumYears > 0);
+}
+
+// Parse the --former-risk value, NUM_FORMER_RISK_COEFS comma separated numbers (B0,B1,B2,B3), into dCoefficients.
+// Returns false, leaving dCoefficients unchanged, if the value is not valid.
+bool ParseFormerRiskCoefficients(const char* sValue, double* dCoefficients) {
+   double      dValues[NUM_FORMER_RISK_COEFS];
+   const char *pTokenPtr = sValue;
+   char       *pEndPtr;
+   short       i;
+
+   for (i = 0; i < NUM_FORMER_RISK_COEFS; i++) {
+      dValues[i] = strtod(pTokenPtr, &pEndPtr);
+      if (pEndPtr == pTokenPtr || dValues[i] != dValues[i] || dValues[i] - dValues[i] != 0)  // Not a number or not finite
+         return false;
+      pEndPtr += strspn(pEndPtr, " \t\r\n");
+      if (i < NUM_FORMER_RISK_COEFS - 1 && *pEndPtr != ',')
+         return false;
+      pTokenPtr = pEndPtr + 1;
+   }
+   if (*pEndPtr != '\0')
+      return false;
+   for (i = 0; i < NUM_FORMER_RISK_COEFS; i++)
+      dCoefficients[i] = dValues[i];
+   return true;
+}
+
+// Load the coefficient sets of a --former-risk-sweep file, one B0,B1,B2,B3 set per line (blank lines and
+// lines starting with * are skipped). Returns the sets one after the other, the caller deletes the array.
+double* LoadFormerRiskSets(const char* sFileName, short& wNumSets) {
+   FILE   *pInputFile;
+   char    sCurrInputLine[501],
+           sErrorMessage[700];
+   double *dCoefSets = 0;
+   long    lLineNumber;
+   short   wPass;
+
+   pInputFile = fopen(sFileName, "r");
+   if (pInputFile == NULL) {
+      sprintf(sErrorMessage, "Coefficient file %.300s could not be opened for reading.\n", sFileName);
+      throw SimException("ERROR", sErrorMessage);
+   }
+
+   // Count the sets, then read them
+   for (wPass = 0; wPass < 2; wPass++) {
+      if (wPass == 1) {
+         dCoefSets = new double[wNumSets * NUM_FORMER_RISK_COEFS];
+         rewind(pInputFile);
+      }
+      wNumSets    = 0;
+      lLineNumber = 0;
+      while (fgets(sCurrInputLine, 500, pInputFile)) {
+         lLineNumber++;
+         if (sCurrInputLine[0] == '*' || strspn(sCurrInputLine, " \t\r\n") == strlen(sCurrInputLine))
+            continue;
+         if (wPass == 1 && !ParseFormerRiskCoefficients(sCurrInputLine, dCoefSets + wNumSets * NUM_FORMER_RISK_COEFS)) {
+            sprintf(sErrorMessage, "Line %ld of coefficient file %.300s is not %d comma separated coefficients (B0,B1,B2,B3).\n",
+                    lLineNumber, sFileName, NUM_FORMER_RISK_COEFS);
+            fclose(pInputFile);
+            delete [] dCoefSets;
+            throw SimException("ERROR", sErrorMessage);
+         }
+         if (wNumSets == MAX(short)) {
+            fclose(pInputFile);
+            delete [] dCoefSets;
+            throw SimException("ERROR", "Too many coefficient sets in the coefficient file.\n");
+         }
+         wNumSets++;
+      }
+   }
+   fclose(pInputFile);
+
+   if (wNumSets == 0) {
+      delete [] dCoefSets;
+      sprintf(sErrorMessage, "Coefficient file %.300s has no coefficient sets.\n", sFileName);
+      throw SimException("ERROR", sErrorMessage);
+   }
+   return dCoefSets;
+}
+
 // Testing function - Runs an infinite loop
 // Provided so that the calling function can tests its actions when this app does not respond after a set time
 void RunInfiniteLoop() {
@@ -1521,8 +2016,20 @@ void Usage(void) {
    fprintf(stderr, "    INDIV_SEED   - An integer seed for the PRNG that will be used for defining characteristics of the individual(>= 0)\n");
    fprintf(stderr, "    INPUT_FILE   - Name of file containing co-variates to use in simulation\n");
    fprintf(stderr, "    OUTPUT_FILE  - Path where output will be written\n");
-   fprintf(stderr, "    OUTPUT_TYPE  - Format for output file (1=Data, 2=Text, 3=Timeline)\n");
+   fprintf(stderr, "    OUTPUT_TYPE  - Format for output file (1=Data, 2=Text, 3=Timeline, 5=Binary, 6=Arrow, 7=Aggregate)\n");
    fprintf(stderr, "    CESS_YEAR    - 4-digit Year Value. All smokers will stop smoking on January 1st of year provided.\nEnter a value of '0' to disable the immediate cessation option.\n");
+   fprintf(stderr, "Options:\n");
+   fprintf(stderr, "    --threads N  - Simulate the input file with N worker threads\n");
+   fprintf(stderr, "    --indexed N  - Indexed mode, the first input record is person number N\n");
+   fprintf(stderr, "    --prng NAME  - Generator for the PRNGs (mt or philox)\n");
+   fprintf(stderr, "    --arrow-batch N - People per record batch for Arrow output (OUTPUT_TYPE 6)\n");
+   fprintf(stderr, "    --initiation MODE - Initiation age sampling (exact or cdf)\n");
+   fprintf(stderr, "    --other-cod MODE - Other cause of death age sampling (exact or cdf)\n");
+   fprintf(stderr, "    --cessation-sweep Y1,Y2,... - Run several cessation years in one pass (CESS_YEAR must be 0)\n");
+   fprintf(stderr, "    --scenarios DIR1,DIR2,... - Also run the data files of each directory (shares identical files)\n");
+   fprintf(stderr, "    --overlays FILE1,FILE2,... - Also run the transforms of each overlay file applied to SOURCE_DIR\n");
+   fprintf(stderr, "    --former-risk B0,B1,B2,B3 - Coefficients of the former smoker excess risk formula\n");
+   fprintf(stderr, "    --former-risk-sweep FILE - Run each coefficient set (line) of FILE in one pass\n");
    fprintf(stderr, "Press any key to close window");
    getc(stdin);
 }
@@ -1536,19 +2043,46 @@ bool ValidateParameters(char* sDataFileDir,
 
    bool bReturnValue = true;
    int i, iCurrIndex;
-   char *sTestDirStr;
+   char *sTestDirStr,
+        *sScenarioDir;
 	FILE *pTestInputStream  = 0;
 
-   sTestDirStr = AssignFilename(sDataFileDir, INITIATION_DATA_FILE);
-	pTestInputStream = fopen(sTestDirStr, "r");
+   // A data bundle holds all of the data files, it is checked when it is loaded
+   if (SmokingModel::IsBundleFile(sDataFileDir))
+      sTestDirStr = 0;
+   else
+      sTestDirStr = AssignFilename(sDataFileDir, INITIATION_DATA_FILE);
+	if (sTestDirStr != 0)
+      pTestInputStream = fopen(sTestDirStr, "r");
 
-	if (pTestInputStream == NULL) {
+	if (sTestDirStr != 0 && pTestInputStream == NULL) {
 		sprintf(sErrorMessage, "Input File %s could not be opened for reading.\n", sTestDirStr);
 		bReturnValue = false;
   	}
 	if (pTestInputStream != NULL) {
       fclose(pTestInputStream);
    }
+   delete [] sTestDirStr;
+
+   // The data directories (or bundles) of the other scenarios are checked the same way
+   if (bReturnValue && sSIM_SCENARIOS != 0) {
+      sScenarioDir = new char[strlen(sSIM_SCENARIOS) + 1];
+      for (i = 0; bReturnValue && i < CountVectorValues(sSIM_SCENARIOS); i++) {
+         LoadValue(sScenarioDir, sSIM_SCENARIOS, i);
+         if (SmokingModel::IsBundleFile(sScenarioDir))
+            continue;
+         sTestDirStr = AssignFilename(sScenarioDir, INITIATION_DATA_FILE);
+         pTestInputStream = fopen(sTestDirStr, "r");
+         if (pTestInputStream == NULL) {
+            sprintf(sErrorMessage, "Input File %s could not be opened for reading.\n", sTestDirStr);
+            bReturnValue = false;
+         } else {
+            fclose(pTestInputStream);
+         }
+         delete [] sTestDirStr;
+      }
+      delete [] sScenarioDir;
+   }
    if (bReturnValue) {
       bReturnValue = ValidateParameters(sInitiationSeed, sCessationSeed, sOtherCODSeed, sIndivRndSeed,
                                         sInputFile, sOutputFile, 
@@ -1590,11 +2124,15 @@ bool ValidateParameters(char* sInitiationSeed, char* sCessationSeed, char* sOthe
       sprintf(sErrorMessage, "Invalid value %s for Immediate Cessation Year. \nValid values are 0, %d-%d.\n", 
               sImmediateCess, wMIN_IMMEDIATE_CESSATION_YEAR, wSIM_CUTOFF_YEAR);
       bReturnValue = false;
+   } else if (sSIM_CESSATION_SWEEP != 0 && (atoi(sImmediateCess) != 0 || !IsValidCessationSweep(sSIM_CESSATION_SWEEP))) {
+      sprintf(sErrorMessage, "Invalid value %s for --cessation-sweep. \nValid values are 0, %d-%d separated by commas, and Cessation_Year must be 0.\n", 
+              sSIM_CESSATION_SWEEP, wMIN_IMMEDIATE_CESSATION_YEAR, wSIM_CUTOFF_YEAR);
+      bReturnValue = false;
    } else if (!IsPosShortInt(sOutputType) ||
            (atoi(sOutputType) < (short)Smoking_Simulator::OUT_DataOnly) ||
            (atoi(sOutputType) >= (short)Smoking_Simulator::OUT_Uninitialized)) {
-      sprintf(sErrorMessage,"Invalid Output Type: %d\nValid values are %d to %d.\n",
-              (short)Smoking_Simulator::OUT_DataOnly, ((short)Smoking_Simulator::OUT_Uninitialized-1));
+      sprintf(sErrorMessage,"Invalid Output Type: %s\nValid values are %d to %d.\n",
+              sOutputType, (short)Smoking_Simulator::OUT_DataOnly, ((short)Smoking_Simulator::OUT_Uninitialized-1));
 		bReturnValue = false;
   	}
 
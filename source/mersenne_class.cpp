@@ -43,6 +43,12 @@
 
 
 #include "mersenne_class.h"
+#include "sim_exception.h"
+#include <string.h>
+#include <pthread.h>
+#ifdef MT_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 //==============================================================================
 //Mersenne Twister Random Number Functions
@@ -76,31 +82,67 @@ void MersenneTwister::init_genrand(unsigned long s)
     }
 }
 
-/* generates a random number on [0,0xffffffff]-interval */
-unsigned long MersenneTwister::genrand_int32(void)
+/* generates the next N_SIZE words of the state vector */
+void MersenneTwister::next_state(void)
 {
     unsigned long y;
     static unsigned long mag01[2]={0x0UL, MATRIX_A};
     /* mag01[x] = x * MATRIX_A  for x=0,1 */
+    int kk = 0;
 
-    if (mti >= N_SIZE) { /* generate N_SIZE words at one time */
-        int kk;
+#ifdef MT_USE_SSE2
+    /* 4 words at a time, mt[kk+1..kk+4] are loaded before mt[kk..kk+3] is stored and */
+    /* mt[kk+M] (first loop) or mt[kk+M-N_SIZE] (second loop) is at least 4 words away */
+    const __m128i vUpper  = _mm_set1_epi32((int)UPPER_MASK),
+                  vLower  = _mm_set1_epi32((int)LOWER_MASK),
+                  vMatrix = _mm_set1_epi32((int)MATRIX_A),
+                  vOne    = _mm_set1_epi32(1);
+    __m128i       vY, vMag;
 
-        if (mti == N_SIZE+1)   /* if init_genrand() has not been called, */
-            init_genrand(5489UL); /* a default initial seed is used */
+    for (; kk+4<=N_SIZE-M; kk+=4) {
+        vY   = _mm_or_si128(_mm_and_si128(_mm_loadu_si128((const __m128i*)&mt[kk]), vUpper),
+                            _mm_and_si128(_mm_loadu_si128((const __m128i*)&mt[kk+1]), vLower));
+        vMag = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(vY, vOne), vOne), vMatrix);
+        _mm_storeu_si128((__m128i*)&mt[kk],
+                         _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)&mt[kk+M]),
+                                                     _mm_srli_epi32(vY, 1)), vMag));
+    }
+#endif
+    for (;kk<N_SIZE-M;kk++) {
+        y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+        mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+    }
+#ifdef MT_USE_SSE2
+    for (; kk+4<=N_SIZE-1; kk+=4) {
+        vY   = _mm_or_si128(_mm_and_si128(_mm_loadu_si128((const __m128i*)&mt[kk]), vUpper),
+                            _mm_and_si128(_mm_loadu_si128((const __m128i*)&mt[kk+1]), vLower));
+        vMag = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(vY, vOne), vOne), vMatrix);
+        _mm_storeu_si128((__m128i*)&mt[kk],
+                         _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)&mt[kk+(M-N_SIZE)]),
+                                                     _mm_srli_epi32(vY, 1)), vMag));
+    }
+    /* (N_SIZE-1) - (N_SIZE-M) = M-1 is a multiple of 4, the loop above ends at kk = N_SIZE-1 */
+#else
+    for (;kk<N_SIZE-1;kk++) {
+        y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+        mt[kk] = mt[kk+(M-N_SIZE)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+    }
+#endif
+    y = (mt[N_SIZE-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
+    mt[N_SIZE-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
 
-        for (kk=0;kk<N_SIZE-M;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        for (;kk<N_SIZE-1;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+(M-N_SIZE)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        y = (mt[N_SIZE-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-        mt[N_SIZE-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+    mti = 0;
+}
+
+/* generates a random number on [0,0xffffffff]-interval */
+unsigned long MersenneTwister::genrand_int32(void)
+{
+    unsigned long y;
 
-        mti = 0;
+    if (mti >= N_SIZE) { /* generate N_SIZE words at one time */
+        if (mti == N_SIZE+1)   /* if init_genrand() has not been called, */
+            init_genrand(5489UL); /* a default initial seed is used */
+        next_state();
     }
 
     y = mt[mti++];
@@ -127,6 +169,62 @@ double MersenneTwister::genrand_real1(void)
     /* divided by 2^32-1 */
 }
 
+/* generates n random numbers on [0,1]-real-interval, same values as n calls to genrand_real1() */
+/* the state is regenerated and tempered a whole block at a time */
+void MersenneTwister::fill_real1(double* pOut, size_t n)
+{
+    unsigned long y;
+    int i, iEnd;
+#ifdef MT_USE_SSE2
+    unsigned int uiTempered[4];
+    __m128i      vY;
+    const __m128i vTemperB = _mm_set1_epi32((int)0x9d2c5680UL),
+                  vTemperC = _mm_set1_epi32((int)0xefc60000UL);
+#endif
+
+    while (n > 0) {
+        if (mti >= N_SIZE) { /* generate N_SIZE words at one time */
+            if (mti == N_SIZE+1)   /* if init_genrand() has not been called, */
+                init_genrand(5489UL); /* a default initial seed is used */
+            next_state();
+        }
+
+        iEnd = (n < (size_t)(N_SIZE - mti)) ? mti + (int)n : N_SIZE;
+        i = mti;
+#ifdef MT_USE_SSE2
+        for (; i+4 <= iEnd; i+=4) {
+            vY = _mm_loadu_si128((const __m128i*)&mt[i]);
+
+            /* Tempering */
+            vY = _mm_xor_si128(vY, _mm_srli_epi32(vY, 11));
+            vY = _mm_xor_si128(vY, _mm_and_si128(_mm_slli_epi32(vY, 7), vTemperB));
+            vY = _mm_xor_si128(vY, _mm_and_si128(_mm_slli_epi32(vY, 15), vTemperC));
+            vY = _mm_xor_si128(vY, _mm_srli_epi32(vY, 18));
+
+            _mm_storeu_si128((__m128i*)uiTempered, vY);
+            pOut[0] = uiTempered[0]*(1.0/4294967295.0);
+            pOut[1] = uiTempered[1]*(1.0/4294967295.0);
+            pOut[2] = uiTempered[2]*(1.0/4294967295.0);
+            pOut[3] = uiTempered[3]*(1.0/4294967295.0);
+            pOut += 4;
+        }
+#endif
+        for (; i < iEnd; i++) {
+            y = mt[i];
+
+            /* Tempering */
+            y ^= (y >> 11);
+            y ^= (y << 7) & 0x9d2c5680UL;
+            y ^= (y << 15) & 0xefc60000UL;
+            y ^= (y >> 18);
+
+            *pOut++ = y*(1.0/4294967295.0);
+        }
+        n -= (size_t)(iEnd - mti);
+        mti = iEnd;
+    }
+}
+
 /* generates a random number on [0,1)-real-interval */
 double MersenneTwister::genrand_real2(void)
 {
@@ -134,4 +232,281 @@ double MersenneTwister::genrand_real2(void)
     /* divided by 2^32 */
 }
 
+/* returns to the first number after seeding */
+void MersenneTwister::Reset()
+{
+    init_genrand(gulSeed);
+}
+
+//==============================================================================
+//Jump Ahead
+//==============================================================================
+// Advancing the generator by J steps is the same as multiplying the state by the
+// polynomial x^J mod phi(x), where phi is the characteristic polynomial of MT19937
+// (see Haramoto, Matsumoto, Nishimura, Panneton, L'Ecuyer, "Efficient Jump Ahead for
+// F2-Linear Random Number Generators", 2008).
+// phi is recovered once from the output of the generator with the Berlekamp-Massey
+// algorithm and x^(2^k) mod phi is built by repeated squaring as larger jumps are needed.
+// Polynomials over GF(2) are stored as bit arrays, bit i holds the coefficient of x^i.
+
+#define JUMP_WORD_BITS   (8 * (int)sizeof(unsigned long))
+#define JUMP_POLY_WORDS  (MT_STATE_BITS / JUMP_WORD_BITS + 1)        /* words in a reduced polynomial */
+#define JUMP_SQR_WORDS   (2 * JUMP_POLY_WORDS + 1)                   /* words in a square before reduction */
+#define JUMP_TABLE_SIZE  (8 * (int)sizeof(unsigned long) + MT_MAX_JUMP_POWER + 16)
+#define JUMP_LIMBS       ((JUMP_TABLE_SIZE + 15) / 16)               /* 16 bit limbs for a jump length */
+#define JUMP_MIN_BLOCKS  8192  /* below this many blocks it is faster to generate the blocks */
+
+static unsigned long    gulJumpCharPoly[JUMP_SQR_WORDS];      // phi(x)
+static unsigned long   *gpJumpTable[JUMP_TABLE_SIZE];         // x^(2^k) mod phi(x)
+static int              giJumpTableSize = 0;
+static pthread_mutex_t  gJumpTableMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int GetPolyBit(const unsigned long* pPoly, long lBit) {
+   return (int)((pPoly[lBit / JUMP_WORD_BITS] >> (lBit % JUMP_WORD_BITS)) & 1UL);
+}
 
+// pDest ^= pSource * x^lShift, iNumWords is the number of words to take from pSource
+static void XorShiftedPoly(unsigned long* pDest, const unsigned long* pSource, int iNumWords, long lShift) {
+   int i,
+       iWordShift = (int)(lShift / JUMP_WORD_BITS),
+       iBitShift  = (int)(lShift % JUMP_WORD_BITS);
+   if (iBitShift == 0) {
+      for (i = 0; i < iNumWords; i++)
+         pDest[i + iWordShift] ^= pSource[i];
+   } else {
+      for (i = 0; i < iNumWords; i++) {
+         pDest[i + iWordShift]     ^= pSource[i] << iBitShift;
+         pDest[i + iWordShift + 1] ^= pSource[i] >> (JUMP_WORD_BITS - iBitShift);
+      }
+   }
+}
+
+// Find phi(x) with the Berlekamp-Massey algorithm on bit 0 of 2*MT_STATE_BITS outputs.
+// The first output is skipped so the sequence only depends on the 19937 bits of the state.
+static void ComputeCharPoly() {
+   const long     lSeqLength = 2 * MT_STATE_BITS;
+   const int      iSeqWords  = (int)(lSeqLength / JUMP_WORD_BITS) + 3;
+   unsigned long *pRevSeq    = new unsigned long[iSeqWords],  // sequence in reverse order
+                 *pConnect   = new unsigned long[iSeqWords],  // current connection polynomial C(x)
+                 *pPrevious  = new unsigned long[iSeqWords],  // connection polynomial before the last length change
+                 *pTemp      = new unsigned long[iSeqWords],
+                  ulSum, ulSeqWord;
+   long           lLength = 0, lShift = 1, n, lOffset, lBit;
+   int            i, iWords, iWordOffset, iBitOffset;
+   MersenneTwister mtGenerator(5489UL);
+
+   memset(pRevSeq, 0, iSeqWords * sizeof(unsigned long));
+   memset(pConnect, 0, iSeqWords * sizeof(unsigned long));
+   memset(pPrevious, 0, iSeqWords * sizeof(unsigned long));
+   mtGenerator.genrand_int32();
+   for (n = 0; n < lSeqLength; n++) {
+      lBit = lSeqLength - 1 - n;
+      pRevSeq[lBit / JUMP_WORD_BITS] |= (mtGenerator.genrand_int32() & 1UL) << (lBit % JUMP_WORD_BITS);
+   }
+   pConnect[0]  = 1;
+   pPrevious[0] = 1;
+
+   for (n = 0; n < lSeqLength; n++) {
+      // Discrepancy = sum of C_i * s(n-i) for i = 0..L, s(n-i) is bit (lOffset + i) of the reversed sequence
+      lOffset     = lSeqLength - 1 - n;
+      iWordOffset = (int)(lOffset / JUMP_WORD_BITS);
+      iBitOffset  = (int)(lOffset % JUMP_WORD_BITS);
+      iWords      = (int)(lLength / JUMP_WORD_BITS) + 1;
+      ulSum       = 0;
+      for (i = 0; i < iWords; i++) {
+         ulSeqWord = pRevSeq[iWordOffset + i] >> iBitOffset;
+         if (iBitOffset != 0)
+            ulSeqWord |= pRevSeq[iWordOffset + i + 1] << (JUMP_WORD_BITS - iBitOffset);
+         ulSum ^= pConnect[i] & ulSeqWord;
+      }
+      for (i = JUMP_WORD_BITS / 2; i > 0; i /= 2)
+         ulSum ^= ulSum >> i;
+
+      if ((ulSum & 1UL) == 0) {
+         lShift++;
+      } else if (2 * lLength <= n) {
+         memcpy(pTemp, pConnect, iSeqWords * sizeof(unsigned long));
+         XorShiftedPoly(pConnect, pPrevious, (int)((n + 1 - lShift) / JUMP_WORD_BITS) + 1, lShift);
+         lLength = n + 1 - lLength;
+         memcpy(pPrevious, pTemp, iSeqWords * sizeof(unsigned long));
+         lShift = 1;
+      } else {
+         XorShiftedPoly(pConnect, pPrevious, (int)((n + 1 - lShift) / JUMP_WORD_BITS) + 1, lShift);
+         lShift++;
+      }
+   }
+
+   // phi(x) is the reciprocal of the connection polynomial, lLength is MT_STATE_BITS
+   memset(gulJumpCharPoly, 0, sizeof(gulJumpCharPoly));
+   for (lBit = 0; lBit <= lLength; lBit++) {
+      if (GetPolyBit(pConnect, lBit))
+         gulJumpCharPoly[(lLength - lBit) / JUMP_WORD_BITS] |= 1UL << ((lLength - lBit) % JUMP_WORD_BITS);
+   }
+
+   delete [] pRevSeq; delete [] pConnect; delete [] pPrevious; delete [] pTemp;
+}
+
+// Reduce pPoly (degree <= lDegree) modulo phi(x)
+static void ReducePoly(unsigned long* pPoly, long lDegree) {
+   long lBit;
+   for (lBit = lDegree; lBit >= MT_STATE_BITS; lBit--) {
+      if (GetPolyBit(pPoly, lBit))
+         XorShiftedPoly(pPoly, gulJumpCharPoly, JUMP_POLY_WORDS, lBit - MT_STATE_BITS);
+   }
+}
+
+// Get x^(2^iPower) mod phi(x), building the table up to iPower if needed
+static const unsigned long* GetJumpPoly(int iPower) {
+   unsigned long *pSquare;
+   long           lBit;
+
+   pthread_mutex_lock(&gJumpTableMutex);
+   if (giJumpTableSize == 0) {
+      ComputeCharPoly();
+      gpJumpTable[0] = new unsigned long[JUMP_POLY_WORDS];
+      memset(gpJumpTable[0], 0, JUMP_POLY_WORDS * sizeof(unsigned long));
+      gpJumpTable[0][0] = 2UL;  // x
+      giJumpTableSize = 1;
+   }
+   while (giJumpTableSize <= iPower) {
+      // Squaring over GF(2) moves the coefficient of x^i to x^(2i)
+      pSquare = new unsigned long[JUMP_SQR_WORDS];
+      memset(pSquare, 0, JUMP_SQR_WORDS * sizeof(unsigned long));
+      for (lBit = 0; lBit < MT_STATE_BITS; lBit++) {
+         if (GetPolyBit(gpJumpTable[giJumpTableSize - 1], lBit))
+            pSquare[(2 * lBit) / JUMP_WORD_BITS] |= 1UL << ((2 * lBit) % JUMP_WORD_BITS);
+      }
+      ReducePoly(pSquare, 2 * (MT_STATE_BITS - 1));
+      gpJumpTable[giJumpTableSize] = new unsigned long[JUMP_POLY_WORDS];
+      memcpy(gpJumpTable[giJumpTableSize], pSquare, JUMP_POLY_WORDS * sizeof(unsigned long));
+      delete [] pSquare;
+      giJumpTableSize++;
+   }
+   pthread_mutex_unlock(&gJumpTableMutex);
+
+   return gpJumpTable[iPower];
+}
+
+// One step of the generator on a circular state buffer whose oldest word is at iHead
+static void StepState(unsigned long* pState, int& iHead) {
+   static unsigned long mag01[2]={0x0UL, MATRIX_A};
+   unsigned long y;
+   int iNext = (iHead + 1 == N_SIZE) ? 0 : iHead + 1,
+       iMid  = (iHead + M >= N_SIZE) ? iHead + M - N_SIZE : iHead + M;
+
+   y = (pState[iHead]&UPPER_MASK)|(pState[iNext]&LOWER_MASK);
+   pState[iHead] = pState[iMid] ^ (y >> 1) ^ mag01[y & 0x1UL];
+   iHead = iNext;
+}
+
+// Replace the state (oldest word first) with g(A) * state using Horner's rule,
+// where A is one step of the generator and g is a reduced polynomial.
+// Only the upper bit of the oldest word is part of the generator state, the lower
+// 31 bits of the oldest word of the result are not meaningful.
+static void ApplyJumpPoly(unsigned long* pState, const unsigned long* pPoly) {
+   unsigned long ulResult[N_SIZE];
+   int           iHead = 0, i, j;
+   long          lBit;
+
+   memset(ulResult, 0, sizeof(ulResult));
+   lBit = MT_STATE_BITS - 1;
+   while (lBit > 0 && !GetPolyBit(pPoly, lBit))
+      lBit--;
+
+   for (; lBit >= 0; lBit--) {
+      StepState(ulResult, iHead);
+      if (GetPolyBit(pPoly, lBit)) {
+         for (i = 0, j = N_SIZE - iHead; i < j; i++)
+            ulResult[iHead + i] ^= pState[i];
+         for (; i < N_SIZE; i++)
+            ulResult[i - j] ^= pState[i];
+      }
+   }
+   for (i = 0, j = iHead; i < N_SIZE; i++) {
+      pState[i] = ulResult[j];
+      if (++j == N_SIZE) j = 0;
+   }
+}
+
+// Advance the generator by ulNumDraws * 2^uiPower draws (uiPower <= MT_MAX_JUMP_POWER, larger powers throw),
+// the next value returned is the one that would follow after making that many calls.
+// The first call builds the jump tables and takes a fraction of a second,
+// later calls take a few milliseconds per bit set in the jump length.
+void MersenneTwister::Jump(unsigned long ulNumDraws, unsigned int uiPower)
+{
+    unsigned long ulSteps[JUMP_LIMBS],   /* 16 bit limbs, least significant first */
+                  ulCarry, ulBlocks;
+    unsigned long ulState[N_SIZE];
+    int           i, iBit, iHead, iNewPos;
+    bool          bSmallJump;
+
+    if (mti == N_SIZE+1)   /* if init_genrand() has not been called, */
+        init_genrand(5489UL); /* a default initial seed is used */
+    if (uiPower > MT_MAX_JUMP_POWER)
+        throw SimException("MersenneTwister::Jump()", "The jump power is larger than MT_MAX_JUMP_POWER.");
+
+    /* Draws counted from the start of the current block: mti + ulNumDraws * 2^uiPower */
+    memset(ulSteps, 0, sizeof(ulSteps));
+    for (i = 0; i < JUMP_WORD_BITS; i++) {
+        if ((ulNumDraws >> i) & 1UL) {
+            iBit = i + (int)uiPower;
+            ulSteps[iBit / 16] |= 1UL << (iBit % 16);
+        }
+    }
+    ulCarry = (unsigned long)mti;
+    for (i = 0; i < JUMP_LIMBS && ulCarry != 0; i++) {
+        ulCarry += ulSteps[i];
+        ulSteps[i] = ulCarry & 0xffffUL;
+        ulCarry >>= 16;
+    }
+
+    /* Number of blocks to generate and the position in the last block */
+    ulCarry = 0;
+    for (i = JUMP_LIMBS - 1; i >= 0; i--) {
+        ulCarry = (ulCarry << 16) | ulSteps[i];
+        ulSteps[i] = ulCarry / N_SIZE;
+        ulCarry %= N_SIZE;
+    }
+    iNewPos = (int)ulCarry;
+
+    bSmallJump = (ulSteps[0] < JUMP_MIN_BLOCKS);
+    for (i = 1; i < JUMP_LIMBS; i++) {
+        if (ulSteps[i] != 0) bSmallJump = false;
+    }
+
+    if (bSmallJump) {
+        for (ulBlocks = ulSteps[0]; ulBlocks > 0; ulBlocks--)
+            next_state();
+        mti = iNewPos;
+        return;
+    }
+
+    /* Jump N_SIZE * blocks - 1 steps, the last step is taken directly so the oldest word is exact */
+    ulCarry = 0;
+    for (i = 0; i < JUMP_LIMBS; i++) {
+        ulCarry += ulSteps[i] * N_SIZE;
+        ulSteps[i] = ulCarry & 0xffffUL;
+        ulCarry >>= 16;
+    }
+    for (i = 0; i < JUMP_LIMBS; i++) {
+        if (ulSteps[i] != 0) {
+            ulSteps[i]--;
+            break;
+        }
+        ulSteps[i] = 0xffffUL;
+    }
+
+    for (i = 0; i < N_SIZE; i++)
+        ulState[i] = mt[i];
+    for (iBit = 0; iBit < JUMP_LIMBS * 16; iBit++) {
+        if ((ulSteps[iBit / 16] >> (iBit % 16)) & 1UL)
+            ApplyJumpPoly(ulState, GetJumpPoly(iBit));
+    }
+
+    /* The oldest word of the jumped state belongs at the end of the block */
+    iHead = 0;
+    StepState(ulState, iHead);
+    for (i = 0; i < N_SIZE; i++)
+        mt[(i + N_SIZE - 1) % N_SIZE] = (unsigned int)(ulState[i] & 0xffffffffUL);
+    mti = iNewPos;
+}
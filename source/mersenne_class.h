@@ -5,6 +5,8 @@
 #ifndef _MERSENNE_H
 #define _MERSENNE_H
 
+#include "random_generator.h"
+
 //Note: This class was made based on code obtained for the Mersenne Twister PRNG
 // The program code was converted into a class to allow multiple PRNGs in the same program.
 // Copyright information for the Mersenne Twister code that is used in this class
@@ -53,25 +55,41 @@
 #define UPPER_MASK 0x80000000UL /* most significant w-r bits */
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
-class MersenneTwister{
+/* The state is regenerated and tempered 4 words at a time with SSE2 when it is available */
+/* (the values are the same as the scalar code), compile with MT_NO_SIMD to use the scalar code */
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(MT_NO_SIMD)
+#define MT_USE_SSE2
+#endif
+
+/* Jump ahead parameters */
+#define MT_STATE_BITS 19937        /* degree of the characteristic polynomial of the generator */
+#define MT_MAX_JUMP_POWER 64       /* largest power of two accepted by Jump() */
+
+class MersenneTwister : public RandomGenerator {
    private:
       unsigned long gulSeed; //Seed used to initialize generator
-      unsigned long mt[N_SIZE]; /* the array for the state vector  */
+      unsigned int  mt[N_SIZE]; /* the array for the state vector (32 bit words) */
       int mti; /* mti==N_SIZE+1 means mt[N_SIZE] is not initialized */
 
       void           init_genrand(unsigned long s);
+      void           next_state(void);
 
    public:
       MersenneTwister(unsigned long ulSeed);      //Constructor
       ~MersenneTwister();     //Destructor
 
+      void           Jump(unsigned long ulNumDraws, unsigned int uiPower = 0);
 
       unsigned long  genrand_int32(void);
       long           genrand_int31(void);
       double         genrand_real1(void);
+      void           fill_real1(double* pOut, size_t n);
       double         genrand_real2(void);
+      void           Reset();
+      RandomGenerator* Clone() const { return new MersenneTwister(*this);};
 
       unsigned long  GetSeed()            {return gulSeed;};
+      PRNGType       GetType()            {return PRNG_MersenneTwister;};
 
 };
 
@@ -0,0 +1,241 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: output_writer.cpp
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contact: Rocky Feuer
+// Version 6.2.3
+
+#include "output_writer.h"
+#include <math.h>
+#include <string.h>
+
+// Values at or above this size are formatted by sprintf
+#define OUTPUT_WRITER_FAST_LIMIT 1.0e7
+
+// Constructor
+OutputWriter::OutputWriter(size_t nCapacity) {
+   if (nCapacity < 2 * OUTPUT_WRITER_MAX_FIELD)
+      nCapacity = 2 * OUTPUT_WRITER_MAX_FIELD;
+   gsBuffer   = new char[nCapacity];
+   gnCapacity = nCapacity;
+   gnLength   = 0;
+   gpStream   = 0;
+}
+
+// Destructor, text that has not been flushed is discarded (the stream may already be closed)
+OutputWriter::~OutputWriter() {
+   delete [] gsBuffer;
+}
+
+// Write the buffered text to its stream
+void OutputWriter::Flush() {
+   if (gnLength > 0 && gpStream != 0)
+      fwrite(gsBuffer, 1, gnLength, gpStream);
+   gnLength = 0;
+}
+
+// Make sure nChars more chars fit in the buffer
+inline void OutputWriter::MakeRoom(size_t nChars) {
+   if (gnLength + nChars > gnCapacity)
+      Flush();
+}
+
+// Select the stream for the following text, text held for another stream is written first
+void OutputWriter::SetStream(FILE *pStream) {
+   if (pStream != gpStream) {
+      Flush();
+      gpStream = pStream;
+   }
+}
+
+void OutputWriter::WriteChar(char cValue) {
+   MakeRoom(1);
+   gsBuffer[gnLength++] = cValue;
+}
+
+// Digits of ulValue, no sign
+void OutputWriter::WriteUnsigned(unsigned long ulValue) {
+   char  sDigits[24];
+   short wNumDigits = 0;
+
+   do {
+      sDigits[wNumDigits++] = (char)('0' + ulValue % 10);
+      ulValue /= 10;
+   } while (ulValue != 0);
+
+   MakeRoom(wNumDigits);
+   while (wNumDigits > 0)
+      gsBuffer[gnLength++] = sDigits[--wNumDigits];
+}
+
+// Same text as "%d" / "%ld"
+void OutputWriter::WriteInt(long lValue) {
+   if (lValue < 0) {
+      WriteChar('-');
+      WriteUnsigned(0UL - (unsigned long)lValue);
+   } else {
+      WriteUnsigned((unsigned long)lValue);
+   }
+}
+
+// Same text as "%.2f".
+// printf rounds the exact binary value to the nearest hundredth. The value times 100 is only
+// off by a fraction of its last bit, so when it is not close to halfway between two integers
+// the nearest integer is the number of hundredths printf would show. Values close to halfway,
+// zeros (which may be -0), large values, NaN and infinity are left to sprintf.
+void OutputWriter::WriteFixed2(double dValue) {
+   char          sText[OUTPUT_WRITER_MAX_FIELD];
+   double        dHundredths, dRounded;
+   unsigned long ulHundredths;
+   int           nChars;
+
+   if (dValue != 0.0 && dValue > -OUTPUT_WRITER_FAST_LIMIT && dValue < OUTPUT_WRITER_FAST_LIMIT) {
+      dHundredths = fabs(dValue) * 100.0;
+      dRounded    = floor(dHundredths + 0.5);
+      if (fabs(dHundredths - dRounded) < 0.49) {
+         ulHundredths = (unsigned long)dRounded;
+         if (dValue < 0.0)
+            WriteChar('-');
+         WriteUnsigned(ulHundredths / 100);
+         MakeRoom(3);
+         gsBuffer[gnLength++] = '.';
+         gsBuffer[gnLength++] = (char)('0' + (ulHundredths / 10) % 10);
+         gsBuffer[gnLength++] = (char)('0' + ulHundredths % 10);
+         return;
+      }
+   }
+
+   nChars = sprintf(sText, "%.2f", dValue);
+   if (nChars > 0) {
+      MakeRoom(nChars);
+      for (int i = 0; i < nChars; i++)
+         gsBuffer[gnLength++] = sText[i];
+   }
+}
+
+// Constructor, lMaxRows people are held before the batch is written
+BinaryOutputWriter::BinaryOutputWriter(long lMaxRows) {
+   if (lMaxRows < 1)
+      lMaxRows = 1;
+   gpRows          = new BinaryPersonRow[lMaxRows];
+   glMaxRows       = lMaxRows;
+   glNumRows       = 0;
+   glValueCapacity = lMaxRows * 16;
+   gdValues        = new double[glValueCapacity];
+   gfPacked        = new float[glValueCapacity];
+   glNumValues     = 0;
+   gpStream        = 0;
+}
+
+// Destructor, people that have not been flushed are discarded (the stream may already be closed)
+BinaryOutputWriter::~BinaryOutputWriter() {
+   delete [] gpRows;
+   delete [] gdValues;
+   delete [] gfPacked;
+}
+
+// Select the stream for the following people, people held for another stream are written first
+void BinaryOutputWriter::SetStream(FILE *pStream) {
+   if (pStream != gpStream) {
+      Flush();
+      gpStream = pStream;
+   }
+}
+
+// Add a person to the current batch, the batch is written when it is full
+void BinaryOutputWriter::AddPerson(short wRace, short wSex, short wYOB, short wInitAge, short wCessAge, short wAgeAtDeath,
+                                   const double *dCPDbyAge, short wNumValues) {
+   BinaryPersonRow *pRow;
+   double          *dNewValues;
+
+   if (wNumValues < 0)
+      wNumValues = 0;
+   if (glNumValues + wNumValues > glValueCapacity) {
+      while (glNumValues + wNumValues > glValueCapacity)
+         glValueCapacity *= 2;
+      dNewValues = new double[glValueCapacity];
+      memcpy(dNewValues, gdValues, glNumValues * sizeof(double));
+      delete [] gdValues;
+      gdValues = dNewValues;
+      delete [] gfPacked;
+      gfPacked = new float[glValueCapacity];
+   }
+
+   pRow = &gpRows[glNumRows++];
+   pRow->cRace          = (signed char)wRace;
+   pRow->cSex           = (signed char)wSex;
+   pRow->wYOB           = wYOB;
+   pRow->wInitAge       = wInitAge;
+   pRow->wCessAge       = wCessAge;
+   pRow->wAgeAtDeath    = wAgeAtDeath;
+   pRow->wHistoryLength = wNumValues;
+   pRow->lHistoryOffset = (int)glNumValues;
+   if (wNumValues > 0) {
+      memcpy(&gdValues[glNumValues], dCPDbyAge, wNumValues * sizeof(double));
+      glNumValues += wNumValues;
+   }
+
+   if (glNumRows == glMaxRows)
+      Flush();
+}
+
+// Write the current batch to its stream.
+// The CPD values are written as bytes when they are all whole cigarettes that fit, otherwise as floats.
+void BinaryOutputWriter::Flush() {
+   BinaryBatchHeader batch;
+   unsigned char    *ucBytes;
+   long              i, lPadding;
+   bool              bWholeValues = true;
+   static const char sZeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+   if (glNumRows == 0 || gpStream == 0) {
+      glNumRows   = 0;
+      glNumValues = 0;
+      return;
+   }
+
+   for (i = 0; i < glNumValues && bWholeValues; i++) {
+      bWholeValues = (gdValues[i] >= 0.0 && gdValues[i] <= 255.0 && gdValues[i] == floor(gdValues[i]));
+   }
+
+   memset(&batch, 0, sizeof(batch));
+   batch.lNumPeople   = (int)glNumRows;
+   batch.lNumValues   = (int)glNumValues;
+   batch.ucValueBytes = (unsigned char)(bWholeValues ? sizeof(unsigned char) : sizeof(float));
+   fwrite(&batch, sizeof(batch), 1, gpStream);
+   fwrite(gpRows, sizeof(BinaryPersonRow), glNumRows, gpStream);
+
+   // The values are packed into gfPacked, bytes are stored through an unsigned char pointer
+   if (bWholeValues) {
+      ucBytes = (unsigned char*)gfPacked;
+      for (i = 0; i < glNumValues; i++)
+         ucBytes[i] = (unsigned char)gdValues[i];
+   } else {
+      for (i = 0; i < glNumValues; i++)
+         gfPacked[i] = (float)gdValues[i];
+   }
+   fwrite(gfPacked, batch.ucValueBytes, glNumValues, gpStream);
+   lPadding = (8 - (glNumValues * batch.ucValueBytes) % 8) % 8;
+   if (lPadding > 0)
+      fwrite(sZeros, 1, lPadding, gpStream);
+
+   glNumRows   = 0;
+   glNumValues = 0;
+}
+
+// Write the file header of the binary output
+void BinaryOutputWriter::WriteHeader(FILE *pStream, const BinaryOutputHeader &header) {
+   BinaryOutputHeader fileHeader = header;
+   memset(fileHeader.sMagic, 0, sizeof(fileHeader.sMagic));
+   strcpy(fileHeader.sMagic, BINARY_OUTPUT_MAGIC);
+   fileHeader.nVersion         = BINARY_OUTPUT_VERSION;
+   fileHeader.nHeaderSize      = sizeof(BinaryOutputHeader);
+   fileHeader.nBatchHeaderSize = sizeof(BinaryBatchHeader);
+   fileHeader.nRowSize         = sizeof(BinaryPersonRow);
+   fileHeader.uiByteOrder      = BINARY_OUTPUT_BYTE_ORDER;
+   fileHeader.nReserved        = 0;
+   fwrite(&fileHeader, sizeof(fileHeader), 1, pStream);
+}
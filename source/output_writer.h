@@ -0,0 +1,122 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: output_writer.h
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contacts: Rocky Feuer
+// Version 6.2.3
+
+#ifndef _OUTPUT_WRITER_H
+#define _OUTPUT_WRITER_H
+
+#include <stdio.h>
+
+// Size of the text buffer, the buffer is written to the stream when it is nearly full
+#define OUTPUT_WRITER_BUFFER_SIZE 262144
+
+// Room needed for the longest value written in one call (a "%.2f" of a large double)
+#define OUTPUT_WRITER_MAX_FIELD 400
+
+// Formats the data style output into a reusable buffer and writes it to the stream in large blocks.
+// Integers and 2 decimal values are formatted by hand, the text is identical to fprintf's "%d" and "%.2f".
+// Text is held until Flush() is called, the buffer fills up or text is written for a different stream,
+// so Flush() must be called before anything else writes to or closes the stream.
+class OutputWriter {
+
+ 	// Private Member Variables
+   private:
+      char   *gsBuffer;     // Text waiting to be written
+      size_t  gnLength;     // Number of chars in gsBuffer
+      size_t  gnCapacity;   // Size of gsBuffer
+      FILE   *gpStream;     // Stream the text in gsBuffer belongs to
+
+      void MakeRoom(size_t nChars);
+      void WriteUnsigned(unsigned long ulValue);
+
+   public:
+      OutputWriter(size_t nCapacity = OUTPUT_WRITER_BUFFER_SIZE);
+      ~OutputWriter();
+
+      void Flush();
+      void SetStream(FILE *pStream);
+      void WriteChar(char cValue);
+      void WriteFixed2(double dValue);
+      void WriteInt(long lValue);
+};
+
+// Binary columnar output (Output_Type 5), the structs are written as they are in memory, so the values are in the
+// byte order of the host (little endian on x86 and ARM) and readers check uiByteOrder and the struct sizes.
+// The file is a BinaryOutputHeader followed by batches of people, each batch is:
+//    BinaryBatchHeader
+//    lNumPeople BinaryPersonRow     (fixed width person table)
+//    lNumValues CPD values          (ucValueBytes each, padded to a multiple of 8 bytes)
+// The CPD values of a person are for ages InitAge, InitAge+1, ... (the same values as the data style output),
+// lHistoryOffset is the position of the person's first value within the batch and
+// wHistoryLength is the number of values. A 1 byte value is whole cigarettes per day,
+// a 4 byte value is a float (used when a batch has a value that is not a whole number from 0 to 255).
+#define BINARY_OUTPUT_MAGIC   "LBCSHGB"
+#define BINARY_OUTPUT_VERSION 2
+#define BINARY_OUTPUT_BYTE_ORDER 0x01020304
+
+struct BinaryOutputHeader {
+   char               sMagic[8];          // BINARY_OUTPUT_MAGIC
+   int                nVersion;           // BINARY_OUTPUT_VERSION
+   int                nHeaderSize;        // sizeof(BinaryOutputHeader)
+   int                nBatchHeaderSize;   // sizeof(BinaryBatchHeader)
+   int                nRowSize;           // sizeof(BinaryPersonRow)
+   unsigned int       uiByteOrder;        // BINARY_OUTPUT_BYTE_ORDER as stored by the host that wrote the file
+   int                nReserved;
+   unsigned long long ullSeeds[4];        // Initiation, cessation, other COD and individual PRNG seeds
+   unsigned long long ullDataHash;        // SmokingModel::GetDataHash() of the data files used
+   short              wPRNGType;          // PRNGType used for the run
+   short              wCutoffYear;
+   short              wCessationYear;     // Immediate cessation year (0 = not used)
+   short              wIndexedMode;       // 1 if the run used indexed mode
+};
+
+struct BinaryBatchHeader {
+   int                lNumPeople;         // Rows in the person table
+   int                lNumValues;         // CPD values in the batch
+   unsigned char      ucValueBytes;       // Size of each CPD value (1 or 4)
+   unsigned char      ucReserved[7];
+};
+
+struct BinaryPersonRow {
+   signed char        cRace;
+   signed char        cSex;
+   short              wYOB;
+   short              wInitAge;           // -999 = never smoked
+   short              wCessAge;           // -999 = did not quit
+   short              wAgeAtDeath;        // Age at death from other causes, -999 = alive at the cutoff year
+   short              wHistoryLength;     // Number of CPD values
+   int                lHistoryOffset;     // Position of the first CPD value within the batch
+};
+
+// Collects people in memory and writes them to the stream as one batch of the binary output
+class BinaryOutputWriter {
+
+ 	// Private Member Variables
+   private:
+      BinaryPersonRow *gpRows;           // Person table of the current batch
+      long             glNumRows;
+      long             glMaxRows;        // Batch is written when it holds this many people
+      double          *gdValues;         // CPD values of the current batch
+      float           *gfPacked;         // CPD values of the batch as written (floats, or bytes over the front)
+      long             glNumValues;
+      long             glValueCapacity;
+      FILE            *gpStream;         // Stream the batch belongs to
+
+   public:
+      BinaryOutputWriter(long lMaxRows);
+      ~BinaryOutputWriter();
+
+      void AddPerson(short wRace, short wSex, short wYOB, short wInitAge, short wCessAge, short wAgeAtDeath,
+                     const double *dCPDbyAge, short wNumValues);
+      void Flush();
+      void SetStream(FILE *pStream);
+      static void WriteHeader(FILE *pStream, const BinaryOutputHeader &header);
+};
+
+#endif
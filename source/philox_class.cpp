@@ -0,0 +1,99 @@
+//Class Author: Martin Krapcho, Information Manangement Services, Inc.
+//e-mail : KrapchoM@imsweb.com
+//Philox4x32-10 algorithm by: John Salmon, Mark Moraes, Ron Dror and David Shaw
+
+#include "philox_class.h"
+
+Philox4x32::Philox4x32(unsigned long ulSeed, unsigned int uiStream){
+   gulSeed   = ulSeed;
+   guiStream = uiStream;
+   Reset();
+}
+
+Philox4x32::~Philox4x32(){
+   ;
+}
+
+/* computes the four outputs of block ullBlock */
+void Philox4x32::GenerateBlock(unsigned long long ullBlock)
+{
+    unsigned int       c0, c1, c2, c3, k0, k1;
+    unsigned long long p0, p1;
+    int                i;
+
+    c0 = (unsigned int)(ullBlock & 0xffffffffUL);
+    c1 = (unsigned int)(ullBlock >> 32);
+    c2 = (unsigned int)(((unsigned long long)gulSeed >> 32) & 0xffffffffUL);
+    c3 = 0;
+    k0 = (unsigned int)(gulSeed & 0xffffffffUL);
+    k1 = guiStream;
+
+    for (i = 0; i < PHILOX_ROUNDS; i++) {
+        if (i > 0) { /* bump the key between rounds */
+            k0 += (unsigned int)PHILOX_W0;
+            k1 += (unsigned int)PHILOX_W1;
+        }
+        p0 = (unsigned long long)PHILOX_M0 * c0;
+        p1 = (unsigned long long)PHILOX_M1 * c2;
+        c0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+        c2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (unsigned int)p1;
+        c3 = (unsigned int)p0;
+    }
+
+    guiOutput[0] = c0;
+    guiOutput[1] = c1;
+    guiOutput[2] = c2;
+    guiOutput[3] = c3;
+    gullBlock     = ullBlock;
+    gbOutputValid = true;
+}
+
+/* generates a random number on [0,0xffffffff]-interval */
+unsigned long Philox4x32::genrand_int32(void)
+{
+    unsigned long y;
+
+    if (!gbOutputValid || gullBlock != (gullDraw >> 2))
+        GenerateBlock(gullDraw >> 2);
+    y = guiOutput[gullDraw & 3];
+    gullDraw++;
+
+    return y;
+}
+
+/* generates a random number on [0,1]-real-interval */
+double Philox4x32::genrand_real1(void)
+{
+    return genrand_int32()*(1.0/4294967295.0);
+    /* divided by 2^32-1 */
+}
+
+/* generates n random numbers on [0,1]-real-interval, same values as n calls to genrand_real1() */
+void Philox4x32::fill_real1(double* pOut, size_t n)
+{
+    while (n > 0) {
+        if (!gbOutputValid || gullBlock != (gullDraw >> 2))
+            GenerateBlock(gullDraw >> 2);
+        do {
+            *pOut++ = guiOutput[gullDraw & 3]*(1.0/4294967295.0);
+            gullDraw++;
+            n--;
+        } while (n > 0 && (gullDraw & 3) != 0);
+    }
+}
+
+/* skips ulNumDraws * 2^uiPower draws, the draw number wraps at 2^64 */
+void Philox4x32::Jump(unsigned long ulNumDraws, unsigned int uiPower)
+{
+    if (uiPower < 64)
+        gullDraw += (unsigned long long)ulNumDraws << uiPower;
+}
+
+/* back to the first draw of the stream */
+void Philox4x32::Reset()
+{
+    gullDraw      = 0;
+    gullBlock     = 0;
+    gbOutputValid = false;
+}
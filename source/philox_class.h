@@ -0,0 +1,49 @@
+//Class Author: Martin Krapcho, Information Manangement Services, Inc.
+//e-mail : KrapchoM@imsweb.com
+//Philox4x32-10 algorithm by: John Salmon, Mark Moraes, Ron Dror and David Shaw
+
+#ifndef _PHILOX_H
+#define _PHILOX_H
+
+//Note: Counter based PRNG from "Parallel Random Numbers: As Easy as 1, 2, 3"
+// (Salmon et al., SC11). Draw d of a stream is a pure function of (seed, stream, d):
+// the 64 bit block number d/4 and the upper seed bits form the counter, the lower
+// seed bits and the stream number form the key, and 10 Philox rounds turn them into
+// four 32 bit outputs. The only state is the draw number, so jumping is free.
+
+#include "random_generator.h"
+
+/* Philox4x32 round constants */
+#define PHILOX_M0 0xD2511F53UL
+#define PHILOX_M1 0xCD9E8D57UL
+#define PHILOX_W0 0x9E3779B9UL
+#define PHILOX_W1 0xBB67AE85UL
+#define PHILOX_ROUNDS 10
+
+class Philox4x32 : public RandomGenerator {
+   private:
+      unsigned long       gulSeed;      //Seed used to initialize generator
+      unsigned int        guiStream;    //Stream number, generators with the same seed and different streams are independent
+      unsigned long long  gullDraw;     //Number of the next draw
+      unsigned long long  gullBlock;    //Block held in guiOutput
+      unsigned int        guiOutput[4]; //Outputs of block gullBlock
+      bool                gbOutputValid;
+
+      void           GenerateBlock(unsigned long long ullBlock);
+
+   public:
+      Philox4x32(unsigned long ulSeed, unsigned int uiStream = 0);  //Constructor
+      ~Philox4x32();
+
+      unsigned long  genrand_int32(void);
+      double         genrand_real1(void);
+      void           fill_real1(double* pOut, size_t n);
+      void           Jump(unsigned long ulNumDraws, unsigned int uiPower = 0);
+      void           Reset();
+      RandomGenerator* Clone() const { return new Philox4x32(*this);};
+
+      unsigned long  GetSeed()            {return gulSeed;};
+      PRNGType       GetType()            {return PRNG_Philox;};
+};
+
+#endif
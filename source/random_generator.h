@@ -0,0 +1,29 @@
+//Class Author: Martin Krapcho, Information Manangement Services, Inc.
+//e-mail : KrapchoM@imsweb.com
+
+#ifndef _RANDOM_GENERATOR_H
+#define _RANDOM_GENERATOR_H
+
+#include <stddef.h>
+
+// Interface shared by the pseudo random number generators the simulator can use.
+// A SimulationContext only uses its PRNGs through this interface, so the generator
+// type can be chosen at run time (see SimulationContext::SetPRNGType).
+
+// Generators available to the simulator
+enum PRNGType {PRNG_MersenneTwister = 0, PRNG_Philox, PRNG_NumTypes};
+
+class RandomGenerator {
+   public:
+      virtual ~RandomGenerator() {};
+
+      virtual double           genrand_real1(void) = 0;  // Next random number on [0,1]
+      virtual void             fill_real1(double* pOut, size_t n) = 0;  // Next n random numbers on [0,1]
+      virtual void             Jump(unsigned long ulNumDraws, unsigned int uiPower = 0) = 0;  // Skip ulNumDraws * 2^uiPower draws
+      virtual void             Reset() = 0;              // Back to the first draw after seeding
+      virtual RandomGenerator* Clone() const = 0;        // New generator with the same state
+      virtual unsigned long    GetSeed() = 0;
+      virtual PRNGType         GetType() = 0;
+};
+
+#endif
@@ -0,0 +1,371 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: sim_server.cpp
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contact: Rocky Feuer
+// Version 6.2.3
+
+#include "sim_server.h"
+#include "smoking_sim.h"
+#include "sim_exception.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Keys of the seed and vector values of a request, in the order they are stored
+static const char* sSEED_KEYS[4]   = {"SEED_INIT=", "SEED_CESS=", "SEED_OCD=", "SEED_MISC="};
+static const char* sVECTOR_KEYS[4] = {"RACE=", "SEX=", "YOB=", "REPEAT="};
+// Largest value of each vector, race, sex and YOB are passed to the simulator as short
+static const long  lVECTOR_MAX[4]  = {32767L, 32767L, 32767L, SERVER_MAX_PEOPLE};
+
+// Values of one simulation request
+struct ServerRequest {
+   unsigned long  ulSeeds[4];      // Initiation, cessation, other COD and individual PRNG seeds
+   bool           bHaveSeed[4];
+   long          *lValues[4];      // Race, sex, YOB and repeat vectors
+   int            iNumValues[4];
+   short          wCessationYear;
+   short          wOutputType;
+   short          wPRNGType;
+   short          wNumThreads;
+   bool           bShutdown;
+   bool           bReload;
+};
+
+static void InitRequest(ServerRequest& request) {
+   int i;
+   for (i = 0; i < 4; i++) {
+      request.ulSeeds[i]    = 0;
+      request.bHaveSeed[i]  = false;
+      request.lValues[i]    = 0;
+      request.iNumValues[i] = 0;
+   }
+   request.wCessationYear = 0;
+   request.wOutputType    = Smoking_Simulator::OUT_DataOnly;
+   request.wPRNGType      = PRNG_MersenneTwister;
+   request.wNumThreads    = 0;
+   request.bShutdown      = false;
+   request.bReload        = false;
+}
+
+static void FreeRequest(ServerRequest& request) {
+   int i;
+   for (i = 0; i < 4; i++) {
+      delete [] request.lValues[i];
+      request.lValues[i] = 0;
+   }
+}
+
+// Parse a whole number, the value must be all digits (with an optional sign) and within lMin to lMax
+static long ParseRequestNumber(const char* sValue, const char* sKey, long lMin, long lMax) {
+   char  *pEndPtr,
+          sErrorMessage[300];
+   long   lValue;
+
+   lValue = strtol(sValue, &pEndPtr, 10);
+   if (pEndPtr == sValue || *pEndPtr != '\0' || lValue < lMin || lValue > lMax) {
+      sprintf(sErrorMessage, "Invalid value for %.40s%.100s\n", sKey, sValue);
+      throw SimException("ERROR", sErrorMessage);
+   }
+   return lValue;
+}
+
+// Parse one KEY=VALUE line of a request (spaces and the line ending have been removed)
+static void ParseRequestLine(ServerRequest& request, char* sLine) {
+   char  *sValue,
+         *pTokenPtr,
+          sErrorMessage[300];
+   int    i,
+          iNumValues;
+
+   for (i = 0; sLine[i] != '\0' && sLine[i] != '='; i++)
+      sLine[i] = toupper(sLine[i]);
+   sValue = strchr(sLine, '=');
+   if (sValue == NULL) {
+      sprintf(sErrorMessage, "Invalid request line: %.100s\n", sLine);
+      throw SimException("ERROR", sErrorMessage);
+   }
+   sValue++;
+
+   for (i = 0; i < 4; i++) {
+      if (strncmp(sLine, sSEED_KEYS[i], strlen(sSEED_KEYS[i])) == 0) {
+         request.ulSeeds[i]   = (unsigned long) ParseRequestNumber(sValue, sSEED_KEYS[i], 0, 2147483647L);
+         request.bHaveSeed[i] = true;
+         return;
+      }
+   }
+
+   for (i = 0; i < 4; i++) {
+      if (strncmp(sLine, sVECTOR_KEYS[i], strlen(sVECTOR_KEYS[i])) == 0) {
+         iNumValues = 1;
+         for (pTokenPtr = sValue; *pTokenPtr != '\0'; pTokenPtr++) {
+            if (*pTokenPtr == ',')
+               iNumValues++;
+         }
+         delete [] request.lValues[i];
+         request.lValues[i]    = new long[iNumValues];
+         request.iNumValues[i] = 0;
+         for (pTokenPtr = strtok(sValue, ","); pTokenPtr != NULL; pTokenPtr = strtok(NULL, ",")) {
+            request.lValues[i][request.iNumValues[i]++] = ParseRequestNumber(pTokenPtr, sVECTOR_KEYS[i], 0, lVECTOR_MAX[i]);
+         }
+         if (request.iNumValues[i] != iNumValues) {
+            sprintf(sErrorMessage, "Invalid vector for %s\n", sVECTOR_KEYS[i]);
+            throw SimException("ERROR", sErrorMessage);
+         }
+         return;
+      }
+   }
+
+   if (strncmp(sLine, "IMMEDIATECESS=", strlen("IMMEDIATECESS=")) == 0) {
+      request.wCessationYear = (short) ParseRequestNumber(sValue, "IMMEDIATECESS=", 0, 9999);
+   } else if (strncmp(sLine, "OUTPUT_TYPE=", strlen("OUTPUT_TYPE=")) == 0) {
+      request.wOutputType = (short) ParseRequestNumber(sValue, "OUTPUT_TYPE=", Smoking_Simulator::OUT_DataOnly,
+                                                       Smoking_Simulator::OUT_Uninitialized - 1);
+   } else if (strncmp(sLine, "THREADS=", strlen("THREADS=")) == 0) {
+      request.wNumThreads = (short) ParseRequestNumber(sValue, "THREADS=", 0, 256);
+   } else if (strncmp(sLine, "PRNG=", strlen("PRNG=")) == 0) {
+      if (strcmp(sValue, "mt") == 0 || strcmp(sValue, "MT") == 0) {
+         request.wPRNGType = PRNG_MersenneTwister;
+      } else if (strcmp(sValue, "philox") == 0 || strcmp(sValue, "PHILOX") == 0) {
+         request.wPRNGType = PRNG_Philox;
+      } else {
+         throw SimException("ERROR", "PRNG must be mt or philox.\n");
+      }
+   } else {
+      sprintf(sErrorMessage, "Unknown request key: %.100s\n", sLine);
+      throw SimException("ERROR", sErrorMessage);
+   }
+}
+
+// Read the lines of a request up to RUN (or SHUTDOWN or RELOAD), returns false if the connection ended first
+static bool ReadRequest(FILE* pInStream, ServerRequest& request) {
+   char  *sLine = new char[SERVER_MAX_LINE];
+   char  *pSource,
+         *pDest;
+   bool   bComplete = false;
+
+   try {
+      while (!bComplete && fgets(sLine, SERVER_MAX_LINE, pInStream) != NULL) {
+         // Remove the spaces and the line ending
+         for (pSource = pDest = sLine; *pSource != '\0'; pSource++) {
+            if (*pSource != ' ' && *pSource != '\t' && *pSource != '\r' && *pSource != '\n')
+               *pDest++ = *pSource;
+         }
+         *pDest = '\0';
+
+         if (sLine[0] == '\0') {
+            continue;
+         } else if (strcmp(sLine, "RUN") == 0 || strcmp(sLine, "run") == 0) {
+            bComplete = true;
+         } else if (strcmp(sLine, "SHUTDOWN") == 0 || strcmp(sLine, "shutdown") == 0) {
+            request.bShutdown = true;
+            bComplete = true;
+         } else if (strcmp(sLine, "RELOAD") == 0 || strcmp(sLine, "reload") == 0) {
+            request.bReload = true;
+            bComplete = true;
+         } else {
+            ParseRequestLine(request, sLine);
+         }
+      }
+      if (!bComplete && ferror(pInStream) && (errno == EAGAIN || errno == EWOULDBLOCK))
+         throw SimException("ERROR", "The request was not completed within the server timeout.\n");
+   } catch (SimException ex) {
+      delete [] sLine;
+      throw ex;
+   }
+   delete [] sLine;
+   return bComplete;
+}
+
+// Simulate a request, writing the results to pOutStream
+static void RunRequest(const SmokingModel* pModel, ServerRequest& request, FILE* pOutStream) {
+   Smoking_Simulator *pSimulator = 0;
+   FILE              *pInputFile = 0;
+   char               sErrorMessage[300];
+   long               lValue[4],
+                      lMinValue[3],
+                      lMaxValue[3],
+                      lTotalPeople = 0;
+   int                iNumPeople = 1,
+                      i,
+                      j;
+
+   try {
+      for (i = 0; i < 4; i++) {
+         if (i < 3 && request.iNumValues[i] == 0) {
+            sprintf(sErrorMessage, "The request has no value for %s\n", sVECTOR_KEYS[i]);
+            throw SimException("ERROR", sErrorMessage);
+         }
+         if (!request.bHaveSeed[i]) {
+            sprintf(sErrorMessage, "The request has no value for %s\n", sSEED_KEYS[i]);
+            throw SimException("ERROR", sErrorMessage);
+         }
+         if (request.iNumValues[i] > 1 && iNumPeople > 1 && request.iNumValues[i] != iNumPeople)
+            throw SimException("ERROR", "Vectors in a request must have the same number of values.\n");
+         if (request.iNumValues[i] > iNumPeople)
+            iNumPeople = request.iNumValues[i];
+      }
+
+      // Race, sex and YOB must be within the model's values (StartPerson() takes YOB up to 2020)
+      lMinValue[0] = 0;
+      lMaxValue[0] = pModel->GetNumRaceValues() - 1;
+      lMinValue[1] = 0;
+      lMaxValue[1] = pModel->GetNumSexValues() - 1;
+      lMinValue[2] = pModel->GetMinYearOfBirth();
+      lMaxValue[2] = 2020;
+      for (i = 0; i < 3; i++) {
+         for (j = 0; j < request.iNumValues[i]; j++) {
+            if (request.lValues[i][j] < lMinValue[i] || request.lValues[i][j] > lMaxValue[i]) {
+               sprintf(sErrorMessage, "Invalid value for %s%ld, the values are %ld to %ld\n", sVECTOR_KEYS[i],
+                       request.lValues[i][j], lMinValue[i], lMaxValue[i]);
+               throw SimException("ERROR", sErrorMessage);
+            }
+         }
+      }
+      for (j = 0; j < iNumPeople; j++) {
+         lTotalPeople += (request.iNumValues[3] == 0) ? 1 : request.lValues[3][(request.iNumValues[3] > 1) ? j : 0];
+         if (lTotalPeople > SERVER_MAX_PEOPLE) {
+            sprintf(sErrorMessage, "The request has more than %ld people\n", SERVER_MAX_PEOPLE);
+            throw SimException("ERROR", sErrorMessage);
+         }
+      }
+
+      // The people are handed to the simulator as counted input records
+      pInputFile = tmpfile();
+      if (pInputFile == NULL)
+         throw SimException("ERROR", "Unable to create a temporary file for the request.\n");
+      for (j = 0; j < iNumPeople; j++) {
+         for (i = 0; i < 4; i++) {
+            if (request.iNumValues[i] == 0)
+               lValue[i] = 1;
+            else
+               lValue[i] = request.lValues[i][(request.iNumValues[i] > 1) ? j : 0];
+         }
+         fprintf(pInputFile, "%ld;%ld;%ld;%ld\n", lValue[0], lValue[1], lValue[2], lValue[3]);
+      }
+      rewind(pInputFile);
+
+      pSimulator = new Smoking_Simulator(pModel, request.ulSeeds[0], request.ulSeeds[1], request.ulSeeds[2],
+                                         request.ulSeeds[3], request.wOutputType, request.wCessationYear);
+      pSimulator->SetPRNGType(request.wPRNGType);
+      pSimulator->RunSimulation(pInputFile, pOutStream, false, request.wNumThreads);
+
+      delete pSimulator;
+      fclose(pInputFile);
+
+   } catch (SimException ex) {
+      ex.AddCallPath("RunRequest()");
+      delete pSimulator;
+      if (pInputFile != NULL)
+         fclose(pInputFile);
+      throw ex;
+   }
+}
+
+int RunServer(const SmokingModel* pModel, const char* sSocketPath) {
+   struct sockaddr_un address;
+   struct timeval     timeout;
+   int                iListener,
+                      iConnection;
+   FILE              *pInStream,
+                     *pOutStream;
+   ServerRequest      request;
+   SmokingModel      *pReloadedModel = 0;   // Latest model loaded by a RELOAD request
+   SmokingModel      *pNewModel;
+   short              wNumFilesParsed;
+   bool               bRunning = true;
+
+   if (strlen(sSocketPath) >= sizeof(address.sun_path)) {
+      fprintf(stderr, "The socket path %s is too long.\n", sSocketPath);
+      return 1;
+   }
+
+   // A client that goes away should only end its own request
+   signal(SIGPIPE, SIG_IGN);
+
+   iListener = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (iListener < 0) {
+      fprintf(stderr, "Unable to create a socket: %s\n", strerror(errno));
+      return 1;
+   }
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path, sSocketPath);
+   unlink(sSocketPath);
+   if (bind(iListener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(iListener, 16) != 0) {
+      fprintf(stderr, "Unable to listen on %s: %s\n", sSocketPath, strerror(errno));
+      close(iListener);
+      return 1;
+   }
+   fprintf(stdout, "Listening on %s\n", sSocketPath);
+   fflush(stdout);
+
+   while (bRunning) {
+      iConnection = accept(iListener, NULL, NULL);
+      if (iConnection < 0) {
+         if (errno == EINTR)
+            continue;
+         fprintf(stderr, "Unable to accept a connection: %s\n", strerror(errno));
+         break;
+      }
+
+      // A client that stops sending or reading gets an error instead of holding up the other clients
+      timeout.tv_sec  = SERVER_TIMEOUT_SECONDS;
+      timeout.tv_usec = 0;
+      setsockopt(iConnection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(iConnection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+      pInStream  = fdopen(iConnection, "r");
+      pOutStream = fdopen(dup(iConnection), "w");
+      if (pInStream == NULL || pOutStream == NULL) {
+         fprintf(stderr, "Unable to open the connection streams.\n");
+         if (pInStream != NULL) fclose(pInStream); else close(iConnection);
+         if (pOutStream != NULL) fclose(pOutStream);
+         continue;
+      }
+
+      InitRequest(request);
+      try {
+         if (ReadRequest(pInStream, request)) {
+            if (request.bShutdown) {
+               fprintf(pOutStream, "OK\n");
+               bRunning = false;
+            } else if (request.bReload) {
+               // Requests run one at a time, so no simulation is using the model being replaced
+               pNewModel = pModel->Reload(wNumFilesParsed);
+               if (pNewModel != 0) {
+                  delete pReloadedModel;
+                  pReloadedModel = pNewModel;
+                  pModel         = pNewModel;
+               }
+               fprintf(pOutStream, "OK %d data files parsed\n", wNumFilesParsed);
+            } else {
+               RunRequest(pModel, request, pOutStream);
+            }
+         }
+      } catch (SimException ex) {
+         fprintf(pOutStream, "ERROR: %s", ex.GetError());
+         if (strchr(ex.GetError(), '\n') == NULL)
+            fprintf(pOutStream, "\n");
+      }
+      FreeRequest(request);
+      fclose(pOutStream);
+      fclose(pInStream);
+   }
+
+   close(iListener);
+   unlink(sSocketPath);
+   delete pReloadedModel;
+   return bRunning ? 1 : 0;
+}
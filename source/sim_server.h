@@ -0,0 +1,45 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: sim_server.h
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contacts: Rocky Feuer
+// Version 6.2.3
+
+#ifndef _SIM_SERVER_H
+#define _SIM_SERVER_H
+
+#include "smoking_model.h"
+
+// Longest request line the server accepts
+#define SERVER_MAX_LINE 65536
+
+// Seconds a connection may wait for the client to send a request line or read the results
+#define SERVER_TIMEOUT_SECONDS 30
+
+// Most people one request may simulate (the sum of the REPEAT values)
+#define SERVER_MAX_PEOPLE 10000000L
+
+// Serve simulation requests on the Unix domain socket sSocketPath until a SHUTDOWN request is received.
+// The data tables in pModel are loaded once and shared by every request.
+// A request is a list of KEY=VALUE lines ended by a line with RUN (keys are not case-sensitive):
+//   SEED_INIT=, SEED_CESS=, SEED_OCD=, SEED_MISC=  PRNG seeds (required)
+//   RACE=, SEX=, YOB=                              Values, or comma separated vectors of values (required)
+//   REPEAT=                                        Number of people for each set of values, or a vector (default 1)
+//   IMMEDIATECESS=                                 Immediate cessation year, 0 = not used (default 0)
+//   OUTPUT_TYPE=                                   Output type of the command line mode (default 1)
+//   PRNG=                                          mt or philox (default mt)
+//   THREADS=                                       Worker threads for the request, 0 = single threaded (default 0)
+// Vectors must have the same number of values, single values are used for every position.
+// The results are streamed back in the output type's format and the connection is closed when they are done.
+// Errors are sent as a line starting with "ERROR: ". A request with the line SHUTDOWN stops the server.
+// A request with the line RELOAD loads the data files again, parsing only the files that changed
+// (see SmokingModel::Reload), and replies "OK n data files parsed". Later requests use the new tables.
+// Requests are run one at a time, in the order the connections are made. A client that sends nothing, or reads
+// nothing, for SERVER_TIMEOUT_SECONDS is sent an error and closed, and a request may simulate at most
+// SERVER_MAX_PEOPLE people, so one client can not hold the server for long.
+int RunServer(const SmokingModel* pModel, const char* sSocketPath);
+
+#endif
@@ -0,0 +1,262 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: simulation_context.cpp
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contact: Rocky Feuer
+// Version 6.2.3
+
+#include "simulation_context.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+// Constructor
+SimulationContext::SimulationContext(unsigned long ulInitPRNGSeed, unsigned long ulCessPRNGSeed,
+                                     unsigned long ulLifeTabSeed,  unsigned long ulIndivRndsSeed) {
+   gpInitiationPRNG     = 0;
+   gpCessationPRNG      = 0;
+   gpLifeTablePRNG      = 0;
+   gpIndivRndsPRNG      = 0;
+   gdPersonsCPDbyAge    = 0;
+   gwCPDbyAgeCapacity   = 0;
+
+   gwPersonsYOB         = 0;
+   gwPersonsRace        = 0;
+   gwPersonsSex         = 0;
+   gwPersonsCohort      = 0;
+   glPersonsSlice       = 0;
+   glPersonsLifeTabOffset = 0;
+   gwPersonsInitAge     = -999;
+   gwPersonsCessAge     = -999;
+   gwPersonsAgeAtDeath  = -999;
+   gwPersonsSmkIntensity = 0;
+   gdPersonsAvgCPD      = 0;
+   gdTempIntensityProb  = 0;
+   ClearRandBuffers();
+   ResetDrawCounts();
+
+   gpInitiationPRNG = CreatePRNG(PRNG_MersenneTwister, ulInitPRNGSeed, 0);
+   gpCessationPRNG  = CreatePRNG(PRNG_MersenneTwister, ulCessPRNGSeed, 1);
+   gpLifeTablePRNG  = CreatePRNG(PRNG_MersenneTwister, ulLifeTabSeed, 2);
+   gpIndivRndsPRNG  = CreatePRNG(PRNG_MersenneTwister, ulIndivRndsSeed, 3);
+}
+
+// Destructor
+SimulationContext::~SimulationContext() {
+   Free();
+}
+
+//Free the dynamically allocated memory
+void SimulationContext::Free()
+{
+   delete [] gdPersonsCPDbyAge;    gdPersonsCPDbyAge    = 0;
+   delete gpInitiationPRNG;        gpInitiationPRNG     = 0;
+   delete gpCessationPRNG;         gpCessationPRNG      = 0;
+   delete gpLifeTablePRNG;         gpLifeTablePRNG      = 0;
+   delete gpIndivRndsPRNG;         gpIndivRndsPRNG      = 0;
+}
+
+// Generate the next SIM_RAND_BUFFER_SIZE values of pPRNG into an empty buffer
+void SimulationContext::RefillRands(RandomGenerator* pPRNG, SimRandBuffer& buffer, const char* sCaller) {
+   if (pPRNG == NULL)
+      throw SimException(sCaller, "Call to PRNG before PRNG has been initialized with a seed.");
+   pPRNG->fill_real1(buffer.dValues, SIM_RAND_BUFFER_SIZE);
+   buffer.wNext  = 0;
+   buffer.wCount = SIM_RAND_BUFFER_SIZE;
+}
+
+// Skip ulNumDraws * 2^uiPower draws of a buffered PRNG.
+// The buffered values are used up first, the PRNG only jumps over the rest.
+void SimulationContext::SkipRands(RandomGenerator* pPRNG, SimRandBuffer& buffer,
+                                  unsigned long ulNumDraws, unsigned int uiPower) {
+   unsigned long ulBuffered, ulBlocks;
+
+   ulBuffered = (unsigned long)(buffer.wCount - buffer.wNext);
+   if (ulNumDraws == 0) {
+      return;
+   } else if (ulBuffered == 0) {
+      pPRNG->Jump(ulNumDraws, uiPower);
+      return;
+   }
+
+   // The jump ends inside the buffer
+   if (uiPower < 31 && ulNumDraws <= (ulBuffered >> uiPower)) {
+      buffer.wNext += (short)(ulNumDraws << uiPower);
+      return;
+   }
+
+   // Otherwise the PRNG jumps ulNumDraws * 2^uiPower - ulBuffered draws.
+   // Split very large blocks until 2^uiPower can be counted in an unsigned long.
+   while (uiPower >= 31) {
+      pPRNG->Jump(ulNumDraws - 1, uiPower);
+      ulNumDraws = 2;
+      uiPower--;
+   }
+   ulBlocks = (ulBuffered + (1UL << uiPower) - 1) >> uiPower;  // Blocks holding the buffered values
+   pPRNG->Jump(ulNumDraws - ulBlocks, uiPower);
+   pPRNG->Jump((ulBlocks << uiPower) - ulBuffered);
+   buffer.wNext = buffer.wCount;
+}
+
+// Set all four PRNGs to the states of the PRNGs in source (same type, position and sequences)
+void SimulationContext::CopyPRNGs(const SimulationContext& source) {
+   if (gpInitiationPRNG == NULL || gpCessationPRNG == NULL || gpLifeTablePRNG == NULL || gpIndivRndsPRNG == NULL ||
+       source.gpInitiationPRNG == NULL || source.gpCessationPRNG == NULL ||
+       source.gpLifeTablePRNG == NULL || source.gpIndivRndsPRNG == NULL)
+      throw SimException("CopyPRNGs()", "Call to PRNG before PRNG has been initialized with a seed.");
+   delete gpInitiationPRNG;  gpInitiationPRNG = source.gpInitiationPRNG->Clone();
+   delete gpCessationPRNG;   gpCessationPRNG  = source.gpCessationPRNG->Clone();
+   delete gpLifeTablePRNG;   gpLifeTablePRNG  = source.gpLifeTablePRNG->Clone();
+   delete gpIndivRndsPRNG;   gpIndivRndsPRNG  = source.gpIndivRndsPRNG->Clone();
+   gInitRands    = source.gInitRands;
+   gCessRands    = source.gCessRands;
+   gLifeTabRands = source.gLifeTabRands;
+   gIndivRands   = source.gIndivRands;
+   ResetDrawCounts();
+}
+
+// Set the life table and individual PRNGs to the states of the ones in source, the PRNGs used after the
+// smoking history is known. The initiation and cessation PRNGs are not changed.
+void SimulationContext::CopyOutcomePRNGs(const SimulationContext& source) {
+   if (gpLifeTablePRNG == NULL || gpIndivRndsPRNG == NULL ||
+       source.gpLifeTablePRNG == NULL || source.gpIndivRndsPRNG == NULL)
+      throw SimException("CopyOutcomePRNGs()", "Call to PRNG before PRNG has been initialized with a seed.");
+   delete gpLifeTablePRNG;   gpLifeTablePRNG  = source.gpLifeTablePRNG->Clone();
+   delete gpIndivRndsPRNG;   gpIndivRndsPRNG  = source.gpIndivRndsPRNG->Clone();
+   gLifeTabRands = source.gLifeTabRands;
+   gIndivRands   = source.gIndivRands;
+   ResetDrawCounts();
+}
+
+// Copy the race, sex, YOB, cohort and array offsets of the person in source (no results)
+void SimulationContext::CopyPerson(const SimulationContext& source) {
+   gwPersonsYOB           = source.gwPersonsYOB;
+   gwPersonsRace          = source.gwPersonsRace;
+   gwPersonsSex           = source.gwPersonsSex;
+   gwPersonsCohort        = source.gwPersonsCohort;
+   glPersonsSlice         = source.glPersonsSlice;
+   glPersonsLifeTabOffset = source.glPersonsLifeTabOffset;
+}
+
+// Copy the person in source and all of their results
+void SimulationContext::CopyPersonResults(const SimulationContext& source) {
+   CopyPerson(source);
+   gwPersonsInitAge      = source.gwPersonsInitAge;
+   gwPersonsCessAge      = source.gwPersonsCessAge;
+   gwPersonsAgeAtDeath   = source.gwPersonsAgeAtDeath;
+   gwPersonsSmkIntensity = source.gwPersonsSmkIntensity;
+   gdPersonsAvgCPD       = source.gdPersonsAvgCPD;
+   gdTempIntensityProb   = source.gdTempIntensityProb;
+   if (source.gwCPDbyAgeCapacity > 0) {
+      ReserveCPDbyAge(source.gwCPDbyAgeCapacity);
+      memcpy(gdPersonsCPDbyAge, source.gdPersonsCPDbyAge, source.gwCPDbyAgeCapacity * sizeof(double));
+   }
+}
+
+// Advance all four PRNGs by ulNumDraws * 2^uiPower draws (see RandomGenerator::Jump)
+void SimulationContext::JumpPRNGs(unsigned long ulNumDraws, unsigned int uiPower) {
+   if (gpInitiationPRNG == NULL || gpCessationPRNG == NULL || gpLifeTablePRNG == NULL || gpIndivRndsPRNG == NULL)
+      throw SimException("JumpPRNGs()", "Call to PRNG before PRNG has been initialized with a seed.");
+   SkipRands(gpInitiationPRNG, gInitRands,    ulNumDraws, uiPower);
+   SkipRands(gpCessationPRNG,  gCessRands,    ulNumDraws, uiPower);
+   SkipRands(gpLifeTablePRNG,  gLifeTabRands, ulNumDraws, uiPower);
+   SkipRands(gpIndivRndsPRNG,  gIndivRands,   ulNumDraws, uiPower);
+}
+
+// Indexed mode: every person gets 2^uiBudgetPower draws from each PRNG.
+// Skip the draws the current person did not use so the PRNGs are at the start of the next person's budget.
+// Returns false if the person used more draws than the budget allows from any PRNG.
+bool SimulationContext::AlignPRNGs(unsigned int uiBudgetPower) {
+   unsigned long ulBudget = 1UL << uiBudgetPower;
+   bool          bWithinBudget;
+
+   if (gpInitiationPRNG == NULL || gpCessationPRNG == NULL || gpLifeTablePRNG == NULL || gpIndivRndsPRNG == NULL)
+      throw SimException("AlignPRNGs()", "Call to PRNG before PRNG has been initialized with a seed.");
+
+   bWithinBudget = (gulInitDraws <= ulBudget && gulCessDraws <= ulBudget &&
+                    gulLifeTabDraws <= ulBudget && gulIndivDraws <= ulBudget);
+   if (bWithinBudget) {
+      SkipRands(gpInitiationPRNG, gInitRands,    ulBudget - gulInitDraws,    0);
+      SkipRands(gpCessationPRNG,  gCessRands,    ulBudget - gulCessDraws,    0);
+      SkipRands(gpLifeTablePRNG,  gLifeTabRands, ulBudget - gulLifeTabDraws, 0);
+      SkipRands(gpIndivRndsPRNG,  gIndivRands,   ulBudget - gulIndivDraws,   0);
+   }
+   ResetDrawCounts();
+   return bWithinBudget;
+}
+
+// Indexed mode: position all four PRNGs at the start of person ulPersonIndex's budget,
+// ulPersonIndex * 2^uiBudgetPower draws after the PRNGs were seeded.
+void SimulationContext::SeekPRNGs(unsigned long ulPersonIndex, unsigned int uiBudgetPower) {
+   if (gpInitiationPRNG == NULL || gpCessationPRNG == NULL || gpLifeTablePRNG == NULL || gpIndivRndsPRNG == NULL)
+      throw SimException("SeekPRNGs()", "Call to PRNG before PRNG has been initialized with a seed.");
+   gpInitiationPRNG->Reset();
+   gpCessationPRNG->Reset();
+   gpLifeTablePRNG->Reset();
+   gpIndivRndsPRNG->Reset();
+   ClearRandBuffers();
+   JumpPRNGs(ulPersonIndex, uiBudgetPower);
+   ResetDrawCounts();
+}
+
+// Replace the four PRNGs with generators of type eType using the same seeds, positioned at the first draw.
+// Each PRNG is given its own stream number, so counter based generators give independent
+// sequences even when the seeds are the same.
+void SimulationContext::SetPRNGType(PRNGType eType) {
+   RandomGenerator *pInitiationPRNG, *pCessationPRNG, *pLifeTablePRNG, *pIndivRndsPRNG;
+
+   if (gpInitiationPRNG == NULL || gpCessationPRNG == NULL || gpLifeTablePRNG == NULL || gpIndivRndsPRNG == NULL)
+      throw SimException("SetPRNGType()", "Call to PRNG before PRNG has been initialized with a seed.");
+   if (eType < PRNG_MersenneTwister || eType >= PRNG_NumTypes)
+      throw SimException("SetPRNGType()", "Invalid PRNG type.");
+
+   pInitiationPRNG  = CreatePRNG(eType, gpInitiationPRNG->GetSeed(), 0);
+   pCessationPRNG   = CreatePRNG(eType, gpCessationPRNG->GetSeed(), 1);
+   pLifeTablePRNG   = CreatePRNG(eType, gpLifeTablePRNG->GetSeed(), 2);
+   pIndivRndsPRNG   = CreatePRNG(eType, gpIndivRndsPRNG->GetSeed(), 3);
+   delete gpInitiationPRNG;  gpInitiationPRNG = pInitiationPRNG;
+   delete gpCessationPRNG;   gpCessationPRNG  = pCessationPRNG;
+   delete gpLifeTablePRNG;   gpLifeTablePRNG  = pLifeTablePRNG;
+   delete gpIndivRndsPRNG;   gpIndivRndsPRNG  = pIndivRndsPRNG;
+   ClearRandBuffers();
+   ResetDrawCounts();
+}
+
+// Create a generator of type eType. uiStream is only used by counter based generators.
+RandomGenerator* SimulationContext::CreatePRNG(PRNGType eType, unsigned long ulSeed, unsigned int uiStream) {
+   if (eType == PRNG_Philox)
+      return new Philox4x32(ulSeed, uiStream);
+   return new MersenneTwister(ulSeed);
+}
+
+// Make sure gdPersonsCPDbyAge can hold wNumYears values.
+// The buffer only grows (to the longest smoking history seen), so once it has
+// reached that size simulating more people does not allocate any memory.
+void SimulationContext::ReserveCPDbyAge(short wNumYears) {
+   if (wNumYears > gwCPDbyAgeCapacity) {
+      delete [] gdPersonsCPDbyAge;
+      gdPersonsCPDbyAge  = 0;
+      gwCPDbyAgeCapacity = 0;
+      gdPersonsCPDbyAge  = new double[wNumYears];
+      gwCPDbyAgeCapacity = wNumYears;
+   }
+}
+
+void SimulationContext::ResetDrawCounts() {
+   gulInitDraws    = 0;
+   gulCessDraws    = 0;
+   gulLifeTabDraws = 0;
+   gulIndivDraws   = 0;
+}
+
+// Drop the values generated ahead, used when the PRNGs are repositioned
+void SimulationContext::ClearRandBuffers() {
+   gInitRands.wNext    = gInitRands.wCount    = 0;
+   gCessRands.wNext    = gCessRands.wCount    = 0;
+   gLifeTabRands.wNext = gLifeTabRands.wCount = 0;
+   gIndivRands.wNext   = gIndivRands.wCount   = 0;
+}
@@ -0,0 +1,133 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: simulation_context.h
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contacts: Rocky Feuer
+// Version 6.2.3
+
+#ifndef _SIMULATION_CONTEXT_H
+#define _SIMULATION_CONTEXT_H
+
+#include "mersenne_class.h"
+#include "philox_class.h"
+#include "sim_exception.h"
+
+// Number of random numbers generated ahead of use for each PRNG
+#define SIM_RAND_BUFFER_SIZE 64
+
+// Random numbers generated ahead of use for one PRNG.
+// The values are the next draws of the PRNG, the PRNG itself is positioned after the last value.
+struct SimRandBuffer {
+   double dValues[SIM_RAND_BUFFER_SIZE];
+   short  wNext;     // Next value to hand out
+   short  wCount;    // Number of values generated
+};
+
+// The mutable state of a Smoking_Simulator: the PRNGs and the results for the last person simulated.
+// Each thread running simulations needs its own context, the data tables live in a shared SmokingModel.
+class SimulationContext {
+
+   friend class Smoking_Simulator;
+
+ 	// Private Member Variables
+   private:
+
+      // Psuedo Random Number Generator Variables
+      RandomGenerator *gpInitiationPRNG;  // PRNG for Initiation Probabilities
+      RandomGenerator *gpCessationPRNG;   // PRNG for Cessation Probabilities
+      RandomGenerator *gpLifeTablePRNG;   // PRNG for Other COD Probabilities
+      RandomGenerator *gpIndivRndsPRNG;   // PRNG for all "random" variables that only
+                                          // need one value per individual (ie smoking intensity quintile)
+                                          // Program will allow 20 of these values per individual
+      SimRandBuffer    gInitRands;        // Values generated ahead for each PRNG
+      SimRandBuffer    gCessRands;
+      SimRandBuffer    gLifeTabRands;
+      SimRandBuffer    gIndivRands;
+
+      // Draws taken from each PRNG since the last call to AlignPRNGs (used by indexed mode)
+      unsigned long gulInitDraws;
+      unsigned long gulCessDraws;
+      unsigned long gulLifeTabDraws;
+      unsigned long gulIndivDraws;
+
+      // Person Variables, Store the results for the last person simulated
+      short gwPersonsYOB;          // Year Of Birth
+      short gwPersonsRace;         // Race
+      short gwPersonsSex;          // Sex
+      short gwPersonsCohort;       // Birth cohort group of the YOB
+      long  glPersonsSlice;        // Race/sex/cohort slice of the initiation, cessation and cigarettes per day tables
+      long  glPersonsLifeTabOffset; // Offset of the race/sex/YOB in the other COD life table array
+      short gwPersonsInitAge;      // Age of Smoking Initiation
+      short gwPersonsCessAge;      // Age of Smoking Cessation
+      short gwPersonsAgeAtDeath;   // Age at death from COD other than lung cancer
+      short gwPersonsSmkIntensity; // The smoking intesity group for the person (Smoking_Simulator::SmokingIntensity)
+      double *gdPersonsCPDbyAge;   // Cigarettes smoked per day by age (reused for every person)
+      short gwCPDbyAgeCapacity;    // Number of values gdPersonsCPDbyAge can hold
+      double gdPersonsAvgCPD;      // Average num of Cigarettes smoked per day (used for COD in former smokers)
+
+      double      gdTempIntensityProb; // Persons intensity prob, remove from final
+
+      void Free();
+      void ResetDrawCounts();
+      void ReserveCPDbyAge(short wNumYears);
+      void ClearRandBuffers();
+      static void RefillRands(RandomGenerator* pPRNG, SimRandBuffer& buffer, const char* sCaller);
+      static void SkipRands(RandomGenerator* pPRNG, SimRandBuffer& buffer, unsigned long ulNumDraws, unsigned int uiPower);
+      static RandomGenerator* CreatePRNG(PRNGType eType, unsigned long ulSeed, unsigned int uiStream);
+      double GetNextInitRand();
+      double GetNextCessRand();
+      double GetNextLifeTabRand();
+      double GetNextRandForIndiv();
+
+   public:
+      SimulationContext(unsigned long ulInitPRNGSeed, unsigned long ulCessPRNGSeed,
+                        unsigned long ulLifeTabSeed,  unsigned long ulIndivRndsSeed);
+
+      ~SimulationContext();
+
+      void CopyPRNGs(const SimulationContext& source);
+      void CopyOutcomePRNGs(const SimulationContext& source);
+      void CopyPerson(const SimulationContext& source);
+      void CopyPersonResults(const SimulationContext& source);
+      void JumpPRNGs(unsigned long ulNumDraws, unsigned int uiPower = 0);
+      bool AlignPRNGs(unsigned int uiBudgetPower);
+      void SeekPRNGs(unsigned long ulPersonIndex, unsigned int uiBudgetPower);
+      void SetPRNGType(PRNGType eType);
+      PRNGType GetPRNGType() { return gpInitiationPRNG->GetType();};
+};
+
+// The random number functions are called for every age of every person, only refilling
+// a buffer goes through the PRNG (and checks that it has been created).
+inline double SimulationContext::GetNextInitRand() {
+   if (gInitRands.wNext == gInitRands.wCount)
+      RefillRands(gpInitiationPRNG, gInitRands, "GetNextInitRand()");
+   gulInitDraws++;
+   return gInitRands.dValues[gInitRands.wNext++];
+}
+
+inline double SimulationContext::GetNextCessRand() {
+   if (gCessRands.wNext == gCessRands.wCount)
+      RefillRands(gpCessationPRNG, gCessRands, "GetNextCessRand()");
+   gulCessDraws++;
+   return gCessRands.dValues[gCessRands.wNext++];
+}
+
+inline double SimulationContext::GetNextLifeTabRand() {
+   if (gLifeTabRands.wNext == gLifeTabRands.wCount)
+      RefillRands(gpLifeTablePRNG, gLifeTabRands, "GetNextLifeTabRand()");
+   gulLifeTabDraws++;
+   return gLifeTabRands.dValues[gLifeTabRands.wNext++];
+}
+
+inline double SimulationContext::GetNextRandForIndiv() {
+   if (gIndivRands.wNext == gIndivRands.wCount)
+      RefillRands(gpIndivRndsPRNG, gIndivRands, "GetNextRandForIndiv()");
+   gulIndivDraws++;
+   return gIndivRands.dValues[gIndivRands.wNext++];
+}
+
+#endif
+
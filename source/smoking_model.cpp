@@ -0,0 +1,1939 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: smoking_model.cpp
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contact: Rocky Feuer
+// Version 6.2.3
+
+#include "smoking_model.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// A data bundle is the header below followed by the tables, each starting on a multiple of
+// SHG_BUNDLE_ALIGN bytes and stored exactly as they are laid out in memory. A bundle can only be
+// read by a build with the same type sizes and byte order, the header records both.
+#define SHG_BUNDLE_MAGIC      "SHGBNDL"
+#define SHG_BUNDLE_VERSION    1
+#define SHG_BUNDLE_ALIGN      16
+#define SHG_BUNDLE_BYTE_ORDER 0x01020304
+
+enum BundleTable {BT_Initiation = 0, BT_Cessation, BT_LifeTable, BT_Intensity, BT_CigarettesPerDay,
+                  BT_CpdGroupCumProbs, BT_CpdSwitchCumProbs, BT_CohortStartYrs, BT_CohortEndYrs,
+                  BT_CohortIndex, BT_NumTables};
+
+struct SmokingModelBundleHeader {
+   char               sMagic[8];
+   unsigned int       uiVersion;
+   unsigned int       uiHeaderSize;      // sizeof(SmokingModelBundleHeader) of the build that wrote it
+   unsigned long long ullChecksum;       // BundleChecksum of the rest of the file (everything after this field)
+   unsigned long long ullFileSize;
+   unsigned int       uiByteOrder;       // SHG_BUNDLE_BYTE_ORDER as stored by the build that wrote it
+   unsigned int       uiLongDoubleSize;  // Size of the cigarettes per day values
+   unsigned long long ullDataHash;       // Hash of the text data files the bundle was compiled from
+
+   // SmokingModel data limits and offsets
+   short wNumBirthCohorts, wNumRaceValues, wNumSexValues;
+   short wMinInitiationAge, wMinCessationAge, wMaxInitiationAge, wMaxCessationAge;
+   short wMinLifeTableAge, wMaxLifeTableAge, wMinLifeTableYear, wMaxLifeTableYear;
+   short wNumIntensityGrps, wIntensityMinAge, wIntensityMaxAge, wCpdMinAge, wCpdMaxAge;
+   short wInitProbRaceOffset, wInitProbSexOffset, wInitProbYOBOffset;
+   short wCessProbRaceOffset, wCessProbSexOffset, wCessProbYOBOffset;
+   short wNumSmokingGrps;
+   long  lLifeTabAgeOffset, lLifeTabRaceOffset, lLifeTabSexOffset, lLifeTabYOBOffset;
+   long  lIntensityAgeOffset, lIntensitySexOffset, lIntensityRaceOffset;
+   long  lCpdAgeOffset, lCpdRaceOffset, lCpdSexOffset, lCpdYOBOffset;
+
+   unsigned long long ullTableOffset[BT_NumTables];  // Start of each table from the start of the file
+   unsigned long long ullTableBytes[BT_NumTables];
+};
+
+// 64 bit FNV-1a over 8 byte words (nBytes must be a multiple of 8)
+static unsigned long long BundleChecksum(const unsigned char *pData, size_t nBytes) {
+   unsigned long long ullHash = 14695981039346656037ULL,
+                      ullWord;
+   size_t             i;
+
+   for (i = 0; i + 8 <= nBytes; i += 8) {
+      memcpy(&ullWord, pData + i, 8);
+      ullHash ^= ullWord;
+      ullHash *= 1099511628211ULL;
+   }
+   return ullHash;
+}
+
+// Constructor, loads all of the data tables
+SmokingModel::SmokingModel(const char* sInitiationProbFile, const char* sCessationProbFile,
+                           const char* sLifeTableFile,      const char* sCpdIntensityProbFile,
+                           const char* sCpdDataFile) {
+   try {
+      Init();
+      SetDataFileName(FILE_Initiation, sInitiationProbFile);
+      SetDataFileName(FILE_Cessation, sCessationProbFile);
+      SetDataFileName(FILE_LifeTable, sLifeTableFile);
+      SetDataFileName(FILE_CpdIntensity, sCpdIntensityProbFile);
+      SetDataFileName(FILE_Cpd, sCpdDataFile);
+      LoadProbabilityData(sInitiationProbFile, SmokingModel::DATA_Initiation);
+      LoadProbabilityData(sCessationProbFile, SmokingModel::DATA_Cessation);
+      LoadCPDIntensityProbs(sCpdIntensityProbFile);
+      LoadCPDFile(sCpdDataFile);
+      LoadOtherCODFile(sLifeTableFile);
+      HashDataFile(FILE_Initiation);
+      HashDataFile(FILE_Cessation);
+      HashDataFile(FILE_LifeTable);
+      HashDataFile(FILE_CpdIntensity);
+      HashDataFile(FILE_Cpd);
+      BuildSlices();
+   } catch (SimException ex) {
+      ex.AddCallPath("SmokingModel()");
+      Free();
+      throw ex;
+   }
+}
+
+// Constructor for a scenario of a multi-scenario run, shares the tables of files that are already loaded
+SmokingModel::SmokingModel(const char* sInitiationProbFile, const char* sCessationProbFile,
+                           const char* sLifeTableFile,      const char* sCpdIntensityProbFile,
+                           const char* sCpdDataFile,        const SmokingModel* const* pLoadedModels,
+                           short wNumModels) {
+   try {
+      Init();
+      SetDataFileName(FILE_Initiation, sInitiationProbFile);
+      SetDataFileName(FILE_Cessation, sCessationProbFile);
+      SetDataFileName(FILE_LifeTable, sLifeTableFile);
+      SetDataFileName(FILE_CpdIntensity, sCpdIntensityProbFile);
+      SetDataFileName(FILE_Cpd, sCpdDataFile);
+      LoadSharedFiles(pLoadedModels, wNumModels);
+      BuildSlices();
+   } catch (SimException ex) {
+      ex.AddCallPath("SmokingModel(const SmokingModel**)");
+      Free();
+      throw ex;
+   }
+}
+
+// Constructor used by Reload, the tables are filled in by LoadChangedFiles
+SmokingModel::SmokingModel() {
+   Init();
+}
+
+// Constructor, maps the tables of a data bundle
+SmokingModel::SmokingModel(const char* sBundleFile) {
+   try {
+      Init();
+      LoadBundle(sBundleFile);
+      BuildSlices();
+   } catch (SimException ex) {
+      ex.AddCallPath("SmokingModel(const char*)");
+      Free();
+      throw ex;
+   }
+}
+
+// Constructor for an overlay scenario, shares the tables of base and applies the transforms of the overlay file.
+// The model has no data file names (it can not be reloaded or shared by the scenario constructor).
+SmokingModel::SmokingModel(const SmokingModel& base, const char* sOverlayFile) {
+   short i;
+
+   try {
+      Init();
+      for (i = 0; i < FILE_NumFiles; i++) {
+         CopyTables(base, (DataFile) i, true);
+         gullFileHashes[i] = base.gullFileHashes[i];
+      }
+      gullDataHash = base.gullDataHash;
+      BuildSlices();
+      ApplyOverlay(sOverlayFile);
+   } catch (SimException ex) {
+      ex.AddCallPath("SmokingModel(const SmokingModel&, const char*)");
+      Free();
+      throw ex;
+   }
+}
+
+// Destructor
+SmokingModel::~SmokingModel() {
+   Free();
+}
+
+//Free the dynamically allocated memory
+void SmokingModel::Free()
+{
+   short i;
+
+   // The slices point into the tables, free the overlay copies while the tables are still known
+   FreeSlices();
+   for (i = 0; i < FILE_NumFiles; i++) {
+      delete [] gsDataFiles[i];
+      gsDataFiles[i] = 0;
+      // Shared tables are freed by the model they belong to
+      if (gbSharedTables[i])
+         ForgetTables((DataFile) i);
+      gbSharedTables[i] = false;
+   }
+
+   // Tables in a mapped bundle go away with the mapping
+   if (gpBundleData != 0) {
+      munmap(gpBundleData, gnBundleSize);
+      gpBundleData         = 0;
+      gdInitiationProbs    = 0;
+      gdCessationProbs     = 0;
+      gdLifeTableProbs     = 0;
+      gdIntensityProbs     = 0;
+      gdCigarettesPerDay   = 0;
+      gdCpdGroupCumProbs   = 0;
+      gdCpdSwitchCumProbs  = 0;
+      gwYOBCohortStartYrs  = 0;
+      gwYOBCohortEndYrs    = 0;
+      gwYOBCohortIndex     = 0;
+   }
+   delete [] gdInitiationProbs;    gdInitiationProbs    = 0;
+   delete [] gdCessationProbs;     gdCessationProbs     = 0;
+   delete [] gdLifeTableProbs;     gdLifeTableProbs     = 0;
+   delete [] gdIntensityProbs;     gdIntensityProbs     = 0;
+   delete [] gdCigarettesPerDay;   gdCigarettesPerDay   = 0;
+   delete [] gdCpdGroupCumProbs;   gdCpdGroupCumProbs   = 0;
+   delete [] gdCpdSwitchCumProbs;  gdCpdSwitchCumProbs  = 0;
+   delete [] gwYOBCohortStartYrs;  gwYOBCohortStartYrs  = 0;
+   delete [] gwYOBCohortEndYrs;    gwYOBCohortEndYrs    = 0;
+   delete [] gwYOBCohortIndex;     gwYOBCohortIndex     = 0;
+}
+
+// Get the minimum year of birth value
+short SmokingModel::GetMinYearOfBirth() const {
+   if (gwYOBCohortStartYrs== NULL)
+      throw SimException("GetMinYearOfBirth()", 
+         "Call to start year of birth cohort values (gwYOBCohortStartYrs) prior to initialization.");
+   return gwYOBCohortStartYrs[0];
+}
+
+// Get the maximum year of birth value
+short SmokingModel::GetMaxYearOfBirth() const {
+   if (gwYOBCohortEndYrs == NULL)
+      throw SimException("GetMaxYearOfBirth()", 
+         "Call to end year of birth cohort values (gwYOBCohortEndYrs) prior to initialization.");
+   return gwYOBCohortEndYrs[gwNumBirthCohorts-1];
+}
+
+// Get the birth cohort group that the year of birth corresponds to.
+short SmokingModel::GetYOBCohortGroup(short wYearBirth) const {
+
+   char  sErrorMessage[500];
+
+   if (wYearBirth < gwYOBCohortStartYrs[0]) {
+      sprintf( sErrorMessage, "Year of Birth - %d is less than the minimum year of birth allowed - %d", \
+         wYearBirth, gwYOBCohortStartYrs[0] );
+      throw SimException("GetYOBCohortGroup(short)", sErrorMessage);
+   }
+
+   if ( wYearBirth > gwYOBCohortEndYrs[gwNumBirthCohorts - 1] ) {
+      sprintf(sErrorMessage, "Year of Birth - %d is greater than the maximum year of birth allowed - %d", \
+         wYearBirth, gwYOBCohortEndYrs[gwNumBirthCohorts - 1]);
+      throw SimException("GetYOBCohortGroup(short)", sErrorMessage);
+   }
+
+   return gwYOBCohortIndex[wYearBirth - gwYOBCohortStartYrs[0]];
+}
+
+// Build the direct lookup of the birth cohort group for every year of birth in the cohorts.
+// Called once the cohort ranges have been read from the initiation file.
+void SmokingModel::BuildYOBCohortIndex() {
+   short wNumYears = gwYOBCohortEndYrs[gwNumBirthCohorts - 1] - gwYOBCohortStartYrs[0] + 1,
+         wYear,
+         i;
+
+   delete [] gwYOBCohortIndex;
+   gwYOBCohortIndex = new short[wNumYears];
+   for (i = 0; i < wNumYears; i++) {
+      gwYOBCohortIndex[i] = -1;
+   }
+   for (i = 0; i < gwNumBirthCohorts; i++) {
+      for (wYear = gwYOBCohortStartYrs[i]; wYear <= gwYOBCohortEndYrs[i]; wYear++) {
+         if (wYear >= gwYOBCohortStartYrs[0] && wYear <= gwYOBCohortEndYrs[gwNumBirthCohorts - 1])
+            gwYOBCohortIndex[wYear - gwYOBCohortStartYrs[0]] = i;
+      }
+   }
+}
+
+// Initialize the private variables, set pointers to zero
+void SmokingModel::Init() {
+   short i;
+
+   for (i = 0; i < FILE_NumFiles; i++) {
+      gullFileHashes[i] = 0;
+      gsDataFiles[i]    = 0;
+      gbSharedTables[i] = false;
+   }
+   gwNumSexValues       = 0;
+   gwNumRaceValues      = 0;
+   gwNumBirthCohorts    = 0;
+   gullDataHash         = 14695981039346656037ULL;  // FNV-1a offset basis
+
+   //Set pointers to zero
+   gdInitiationProbs    = 0;
+   gdCessationProbs     = 0;
+   gdLifeTableProbs     = 0;
+   gdIntensityProbs     = 0;
+   gdCigarettesPerDay   = 0;
+   gdCpdGroupCumProbs   = 0;
+   gdCpdSwitchCumProbs  = 0;
+   gwYOBCohortStartYrs  = 0;
+   gwYOBCohortEndYrs    = 0;
+   gwYOBCohortIndex     = 0;
+   gpInitiationSlices   = 0;
+   gpCessationSlices    = 0;
+   gpCpdSlices          = 0;
+   gpCpdGroupCumSlices  = 0;
+   gpCpdSwitchCumSlices = 0;
+   gpBundleData         = 0;
+   gnBundleSize         = 0;
+}
+
+// Add the contents of a data file to gullDataHash and hash it on its own into gullFileHashes (64 bit FNV-1a)
+void SmokingModel::HashDataFile(DataFile eFile) {
+   FILE              *pDataFile;
+   unsigned char      sBuffer[65536];
+   unsigned long long ullFileHash = 14695981039346656037ULL;  // FNV-1a offset basis
+   size_t             nBytes, i;
+
+   pDataFile = fopen(gsDataFiles[eFile], "rb");
+   if (pDataFile == NULL) {
+      throw SimException("HashDataFile()", "Unable to open data file to compute its hash.");
+   }
+   while ((nBytes = fread(sBuffer, 1, sizeof(sBuffer), pDataFile)) > 0) {
+      for (i = 0; i < nBytes; i++) {
+         gullDataHash ^= sBuffer[i];
+         gullDataHash *= 1099511628211ULL;
+         ullFileHash  ^= sBuffer[i];
+         ullFileHash  *= 1099511628211ULL;
+      }
+   }
+   fclose(pDataFile);
+   gullFileHashes[eFile] = ullFileHash;
+}
+
+// Remember the name of a data file so the model can be reloaded
+void SmokingModel::SetDataFileName(DataFile eFile, const char* sDataFileName) {
+   delete [] gsDataFiles[eFile];
+   gsDataFiles[eFile] = new char[strlen(sDataFileName) + 1];
+   strcpy(gsDataFiles[eFile], sDataFileName);
+}
+
+// Copy of a table of a model (the size is in bytes)
+template <class T> static T* CopyTable(const T* pSource, unsigned long long ullBytes) {
+   T *pCopy = new T[ullBytes / sizeof(T)];
+   memcpy(pCopy, pSource, ullBytes);
+   return pCopy;
+}
+
+// A table of another model, copied or shared (the size is in bytes)
+template <class T> static T* ShareOrCopyTable(const T* pSource, unsigned long long ullBytes, bool bShare) {
+   return bShare ? (T*)pSource : CopyTable(pSource, ullBytes);
+}
+
+// Copy the tables loaded from one of the data files of another model, along with their data limits and offsets.
+// If bShare is true this model points to the tables of source instead, source must outlive this model.
+void SmokingModel::CopyTables(const SmokingModel& source, DataFile eFile, bool bShare) {
+   unsigned long long ullTableBytes[BT_NumTables];
+
+   source.GetBundleTableSizes(ullTableBytes);
+   gbSharedTables[eFile] = bShare;
+   switch (eFile) {
+      case FILE_Initiation:
+         gwNumRaceValues      = source.gwNumRaceValues;
+         gwNumSexValues       = source.gwNumSexValues;
+         gwNumBirthCohorts    = source.gwNumBirthCohorts;
+         gwMinInitiationAge   = source.gwMinInitiationAge;
+         gwMaxInitiationAge   = source.gwMaxInitiationAge;
+         gwInitProbYOBOffset  = source.gwInitProbYOBOffset;
+         gwInitProbSexOffset  = source.gwInitProbSexOffset;
+         gwInitProbRaceOffset = source.gwInitProbRaceOffset;
+         gdInitiationProbs    = ShareOrCopyTable(source.gdInitiationProbs, ullTableBytes[BT_Initiation], bShare);
+         gwYOBCohortStartYrs  = ShareOrCopyTable(source.gwYOBCohortStartYrs, ullTableBytes[BT_CohortStartYrs], bShare);
+         gwYOBCohortEndYrs    = ShareOrCopyTable(source.gwYOBCohortEndYrs, ullTableBytes[BT_CohortEndYrs], bShare);
+         gwYOBCohortIndex     = ShareOrCopyTable(source.gwYOBCohortIndex, ullTableBytes[BT_CohortIndex], bShare);
+         break;
+      case FILE_Cessation:
+         gwMinCessationAge    = source.gwMinCessationAge;
+         gwMaxCessationAge    = source.gwMaxCessationAge;
+         gwCessProbYOBOffset  = source.gwCessProbYOBOffset;
+         gwCessProbSexOffset  = source.gwCessProbSexOffset;
+         gwCessProbRaceOffset = source.gwCessProbRaceOffset;
+         gdCessationProbs     = ShareOrCopyTable(source.gdCessationProbs, ullTableBytes[BT_Cessation], bShare);
+         break;
+      case FILE_LifeTable:
+         gwMinLifeTableAge    = source.gwMinLifeTableAge;
+         gwMaxLifeTableAge    = source.gwMaxLifeTableAge;
+         gwMinLifeTableYear   = source.gwMinLifeTableYear;
+         gwMaxLifeTableYear   = source.gwMaxLifeTableYear;
+         glLifeTabAgeOffset   = source.glLifeTabAgeOffset;
+         glLifeTabYOBOffset   = source.glLifeTabYOBOffset;
+         glLifeTabSexOffset   = source.glLifeTabSexOffset;
+         glLifeTabRaceOffset  = source.glLifeTabRaceOffset;
+         gdLifeTableProbs     = ShareOrCopyTable(source.gdLifeTableProbs, ullTableBytes[BT_LifeTable], bShare);
+         break;
+      case FILE_CpdIntensity:
+         gwNumIntensityGrps    = source.gwNumIntensityGrps;
+         gwIntensityMinAge     = source.gwIntensityMinAge;
+         gwIntensityMaxAge     = source.gwIntensityMaxAge;
+         gwIntensityAgeOffset  = source.gwIntensityAgeOffset;
+         gwIntensitySexOffset  = source.gwIntensitySexOffset;
+         gwIntensityRaceOffset = source.gwIntensityRaceOffset;
+         gdIntensityProbs      = ShareOrCopyTable(source.gdIntensityProbs, ullTableBytes[BT_Intensity], bShare);
+         break;
+      case FILE_Cpd:
+         gwNumSmokingGrps     = source.gwNumSmokingGrps;
+         gwCpdMinAge          = source.gwCpdMinAge;
+         gwCpdMaxAge          = source.gwCpdMaxAge;
+         glCpdAgeOffset       = source.glCpdAgeOffset;
+         glCpdYOBOffset       = source.glCpdYOBOffset;
+         glCpdSexOffset       = source.glCpdSexOffset;
+         glCpdRaceOffset      = source.glCpdRaceOffset;
+         gdCigarettesPerDay   = ShareOrCopyTable(source.gdCigarettesPerDay, ullTableBytes[BT_CigarettesPerDay], bShare);
+         gdCpdGroupCumProbs   = ShareOrCopyTable(source.gdCpdGroupCumProbs, ullTableBytes[BT_CpdGroupCumProbs], bShare);
+         gdCpdSwitchCumProbs  = ShareOrCopyTable(source.gdCpdSwitchCumProbs, ullTableBytes[BT_CpdSwitchCumProbs], bShare);
+         break;
+      default:
+         throw SimException("CopyTables()", "Invalid data file supplied to function.");
+   }
+}
+
+// Load the data files of a previous model again. Files with the same contents are copied from the previous
+// model, the others are parsed. Each file is checked against the tables loaded before it, so a file is also
+// parsed when a file it depends on changed (all of them depend on the initiation file, the CPD file on the
+// intensity file).
+void SmokingModel::LoadChangedFiles(const SmokingModel& previous, short& wNumFilesParsed) {
+   bool  bParse[FILE_NumFiles];
+   short i;
+
+   for (i = 0; i < FILE_NumFiles; i++) {
+      SetDataFileName((DataFile) i, previous.gsDataFiles[i]);
+      HashDataFile((DataFile) i);
+      bParse[i] = (gullFileHashes[i] != previous.gullFileHashes[i]);
+   }
+   bParse[FILE_Cessation]    = bParse[FILE_Cessation] || bParse[FILE_Initiation];
+   bParse[FILE_LifeTable]    = bParse[FILE_LifeTable] || bParse[FILE_Initiation];
+   bParse[FILE_CpdIntensity] = bParse[FILE_CpdIntensity] || bParse[FILE_Initiation];
+   bParse[FILE_Cpd]          = bParse[FILE_Cpd] || bParse[FILE_CpdIntensity];
+
+   wNumFilesParsed = 0;
+   for (i = 0; i < FILE_NumFiles; i++) {
+      if (bParse[i])
+         wNumFilesParsed++;
+   }
+   if (wNumFilesParsed == 0)
+      return;
+
+   // Same order as the constructor
+   if (bParse[FILE_Initiation])
+      LoadProbabilityData(gsDataFiles[FILE_Initiation], DATA_Initiation);
+   else
+      CopyTables(previous, FILE_Initiation);
+   if (bParse[FILE_Cessation])
+      LoadProbabilityData(gsDataFiles[FILE_Cessation], DATA_Cessation);
+   else
+      CopyTables(previous, FILE_Cessation);
+   if (bParse[FILE_CpdIntensity])
+      LoadCPDIntensityProbs(gsDataFiles[FILE_CpdIntensity]);
+   else
+      CopyTables(previous, FILE_CpdIntensity);
+   if (bParse[FILE_Cpd])
+      LoadCPDFile(gsDataFiles[FILE_Cpd]);
+   else
+      CopyTables(previous, FILE_Cpd);
+   if (bParse[FILE_LifeTable])
+      LoadOtherCODFile(gsDataFiles[FILE_LifeTable]);
+   else
+      CopyTables(previous, FILE_LifeTable);
+   BuildSlices();
+}
+
+// Drop the pointers to the tables loaded from one of the data files without freeing them
+void SmokingModel::ForgetTables(DataFile eFile) {
+   switch (eFile) {
+      case FILE_Initiation:
+         gdInitiationProbs    = 0;
+         gwYOBCohortStartYrs  = 0;
+         gwYOBCohortEndYrs    = 0;
+         gwYOBCohortIndex     = 0;
+         break;
+      case FILE_Cessation:
+         gdCessationProbs     = 0;
+         break;
+      case FILE_LifeTable:
+         gdLifeTableProbs     = 0;
+         break;
+      case FILE_CpdIntensity:
+         gdIntensityProbs     = 0;
+         break;
+      case FILE_Cpd:
+         gdCigarettesPerDay   = 0;
+         gdCpdGroupCumProbs   = 0;
+         gdCpdSwitchCumProbs  = 0;
+         break;
+      default:
+         break;
+   }
+}
+
+// True if the other model has the same races, sexes, birth cohorts and initiation ages,
+// the parts of the initiation file the other data files are checked against when they are parsed
+bool SmokingModel::HasSameCohorts(const SmokingModel& other) const {
+   return gwNumRaceValues    == other.gwNumRaceValues    && gwNumSexValues     == other.gwNumSexValues &&
+          gwNumBirthCohorts  == other.gwNumBirthCohorts  && gwMinInitiationAge == other.gwMinInitiationAge &&
+          gwMaxInitiationAge == other.gwMaxInitiationAge &&
+          memcmp(gwYOBCohortStartYrs, other.gwYOBCohortStartYrs, gwNumBirthCohorts * sizeof(short)) == 0 &&
+          memcmp(gwYOBCohortEndYrs, other.gwYOBCohortEndYrs, gwNumBirthCohorts * sizeof(short)) == 0;
+}
+
+// First of the loaded models whose tables for eFile can be used by this model: the file had the same contents
+// and it was parsed against the same birth cohorts (and the CPD file against the same intensity probabilities).
+// Returns 0 if there is none, the files this model depends on must already be loaded.
+const SmokingModel* SmokingModel::FindLoadedFile(DataFile eFile, const SmokingModel* const* pLoadedModels, short wNumModels) const {
+   const SmokingModel *pModel;
+   short               i;
+
+   for (i = 0; i < wNumModels; i++) {
+      pModel = pLoadedModels[i];
+      if (pModel == 0 || pModel->gsDataFiles[eFile] == 0 || pModel->gullFileHashes[eFile] != gullFileHashes[eFile])
+         continue;
+      if (eFile != FILE_Initiation && !HasSameCohorts(*pModel))
+         continue;
+      if (eFile == FILE_Cpd && pModel->gullFileHashes[FILE_CpdIntensity] != gullFileHashes[FILE_CpdIntensity])
+         continue;
+      return pModel;
+   }
+   return 0;
+}
+
+// Load the data files named in gsDataFiles, using the tables of the loaded models for the files they already loaded
+void SmokingModel::LoadSharedFiles(const SmokingModel* const* pLoadedModels, short wNumModels) {
+   const SmokingModel *pSource;
+   short               i;
+
+   for (i = 0; i < FILE_NumFiles; i++)
+      HashDataFile((DataFile) i);
+
+   // Same order as the constructor
+   if ((pSource = FindLoadedFile(FILE_Initiation, pLoadedModels, wNumModels)) != 0)
+      CopyTables(*pSource, FILE_Initiation, true);
+   else
+      LoadProbabilityData(gsDataFiles[FILE_Initiation], DATA_Initiation);
+   if ((pSource = FindLoadedFile(FILE_Cessation, pLoadedModels, wNumModels)) != 0)
+      CopyTables(*pSource, FILE_Cessation, true);
+   else
+      LoadProbabilityData(gsDataFiles[FILE_Cessation], DATA_Cessation);
+   if ((pSource = FindLoadedFile(FILE_CpdIntensity, pLoadedModels, wNumModels)) != 0)
+      CopyTables(*pSource, FILE_CpdIntensity, true);
+   else
+      LoadCPDIntensityProbs(gsDataFiles[FILE_CpdIntensity]);
+   if ((pSource = FindLoadedFile(FILE_Cpd, pLoadedModels, wNumModels)) != 0)
+      CopyTables(*pSource, FILE_Cpd, true);
+   else
+      LoadCPDFile(gsDataFiles[FILE_Cpd]);
+   if ((pSource = FindLoadedFile(FILE_LifeTable, pLoadedModels, wNumModels)) != 0)
+      CopyTables(*pSource, FILE_LifeTable, true);
+   else
+      LoadOtherCODFile(gsDataFiles[FILE_LifeTable]);
+}
+
+// Point the slices of the initiation, cessation and cigarettes per day tables into the tables, called once all
+// of the data files are loaded. Overlays replace the slices they change with copies (see ApplyOverlay).
+void SmokingModel::BuildSlices() {
+   long lNumSlices = long(gwNumRaceValues) * gwNumSexValues * gwNumBirthCohorts,
+        i;
+
+   FreeSlices();
+   gpInitiationSlices   = new double*[lNumSlices];
+   gpCessationSlices    = new double*[lNumSlices];
+   gpCpdSlices          = new long double*[lNumSlices];
+   gpCpdGroupCumSlices  = new double*[lNumSlices];
+   gpCpdSwitchCumSlices = new double*[lNumSlices];
+   for (i = 0; i < lNumSlices; i++) {
+      gpInitiationSlices[i]   = gdInitiationProbs + i * gwInitProbYOBOffset;
+      gpCessationSlices[i]    = gdCessationProbs + i * gwCessProbYOBOffset;
+      gpCpdSlices[i]          = gdCigarettesPerDay + i * glCpdYOBOffset;
+      gpCpdGroupCumSlices[i]  = gdCpdGroupCumProbs + i * glCpdYOBOffset;
+      gpCpdSwitchCumSlices[i] = gdCpdSwitchCumProbs + i * glCpdYOBOffset;
+   }
+}
+
+// A slice of a table that no longer points into the table is an overlay copy owned by this model
+template <class T> static void FreeSliceCopies(T** pSlices, const T* pTable, long lSliceSize, long lNumSlices) {
+   long i;
+
+   for (i = 0; pSlices != 0 && i < lNumSlices; i++) {
+      if (pSlices[i] != pTable + i * lSliceSize)
+         delete [] pSlices[i];
+   }
+   delete [] pSlices;
+}
+
+void SmokingModel::FreeSlices() {
+   long lNumSlices = long(gwNumRaceValues) * gwNumSexValues * gwNumBirthCohorts;
+
+   FreeSliceCopies(gpInitiationSlices, gdInitiationProbs, gwInitProbYOBOffset, lNumSlices);
+   FreeSliceCopies(gpCessationSlices, gdCessationProbs, gwCessProbYOBOffset, lNumSlices);
+   FreeSliceCopies(gpCpdSlices, gdCigarettesPerDay, glCpdYOBOffset, lNumSlices);
+   FreeSliceCopies(gpCpdGroupCumSlices, gdCpdGroupCumProbs, glCpdYOBOffset, lNumSlices);
+   FreeSliceCopies(gpCpdSwitchCumSlices, gdCpdSwitchCumProbs, glCpdYOBOffset, lNumSlices);
+   gpInitiationSlices   = 0;
+   gpCessationSlices    = 0;
+   gpCpdSlices          = 0;
+   gpCpdGroupCumSlices  = 0;
+   gpCpdSwitchCumSlices = 0;
+}
+
+// The slice of a table for an overlay to change, copied from the table the first time it is changed
+template <class T> static T* CopySliceOnWrite(T** pSlices, const T* pTable, long lSlice, long lSliceSize) {
+   if (pSlices[lSlice] == pTable + lSlice * lSliceSize)
+      pSlices[lSlice] = CopyTable(pSlices[lSlice], lSliceSize * sizeof(T));
+   return pSlices[lSlice];
+}
+
+// Read a value "A" or a range "A-B" of an overlay line
+static bool ReadOverlayRange(const char* sValue, short& wStart, short& wEnd) {
+   char *pEnd;
+
+   wStart = (short) strtol(sValue, &pEnd, 10);
+   if (pEnd == sValue)
+      return false;
+   if (*pEnd == '-') {
+      sValue = pEnd + 1;
+      wEnd = (short) strtol(sValue, &pEnd, 10);
+      if (pEnd == sValue)
+         return false;
+   } else {
+      wEnd = wStart;
+   }
+   return *pEnd == 0 && wStart <= wEnd;
+}
+
+// Apply the transforms of an overlay file to the tables. Each line other than blank lines and comments
+// (starting with *) is one transform, TABLE;KEY=VALUE;KEY=VALUE... applied in the order of the file:
+//  INITIATION or CESSATION with SCALE=F - multiply the probabilities by F (capped at 1)
+//  CPD with MAX_GROUP=G                 - move the probability of the intensity groups above G to group G
+// and the optional filters RACE=, SEX=, YOB=, AGE= and YEAR= (calendar year YOB + age), each a value or a
+// range A-B. A birth cohort is changed if it overlaps YOB, YEAR uses the first year of birth of the cohort.
+void SmokingModel::ApplyOverlay(const char* sOverlayFile) {
+   char          sInputLine[1001],
+                 sErrorMessage[500],
+                *pTokenPtr,
+                *pValue;
+   long          lNumLinesRead = 0,
+                 lSlice,
+                 lRow;
+   short         wRaces[2], wSexes[2], wYOBs[2], wAges[2], wYears[2],
+                 wFirstAge,
+                 wLastAge,
+                 wMaxGroup,
+                 wRace, wSex, wCohort, wAge,
+                 i;
+   double        dScale,
+                 dProb,
+                *pProbs;
+   long double  *pCpd,
+                 ldMovedProb;
+   DataType      eTable;
+   bool          bCpdTable;
+   size_t        j;
+   FILE         *pOverlayFile = 0;
+
+   try {
+      pOverlayFile = fopen(sOverlayFile, "r");
+      if (pOverlayFile == NULL) {
+         sprintf(sErrorMessage, "The specified overlay file '%s' does not exist\n or could not be opened.\n\n", sOverlayFile);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      while (fgets(sInputLine, 1000, pOverlayFile) != NULL) {
+         lNumLinesRead++;
+
+         // The transforms are part of the inputs of the scenario
+         for (j = 0; sInputLine[j] != 0; j++) {
+            gullDataHash ^= (unsigned char) sInputLine[j];
+            gullDataHash *= 1099511628211ULL;
+         }
+         sInputLine[strcspn(sInputLine, "\r\n")] = 0;
+         for (j = 0; sInputLine[j] != 0; j++)
+            sInputLine[j] = toupper(sInputLine[j]);
+         pTokenPtr = strtok(sInputLine, "; \t");
+         if (pTokenPtr == NULL || pTokenPtr[0] == '*')
+            continue;
+
+         if (strcmp(pTokenPtr, "INITIATION") == 0) {
+            eTable    = DATA_Initiation;
+            bCpdTable = false;
+         } else if (strcmp(pTokenPtr, "CESSATION") == 0) {
+            eTable    = DATA_Cessation;
+            bCpdTable = false;
+         } else if (strcmp(pTokenPtr, "CPD") == 0) {
+            eTable    = DATA_Initiation;
+            bCpdTable = true;
+         } else {
+            sprintf(sErrorMessage, "Unknown table %s at line %ld of overlay file %s.\nValid tables are INITIATION, CESSATION and CPD.",
+                    pTokenPtr, lNumLinesRead, sOverlayFile);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         // Everything unless a filter is given
+         wRaces[0] = 0;   wRaces[1] = gwNumRaceValues - 1;
+         wSexes[0] = 0;   wSexes[1] = gwNumSexValues - 1;
+         wYOBs[0]  = GetMinYearOfBirth();   wYOBs[1]  = GetMaxYearOfBirth();
+         wAges[0]  = 0;   wAges[1]  = 9999;
+         wYears[0] = 0;   wYears[1] = 9999;
+         dScale    = -1;
+         wMaxGroup = -1;
+
+         while ((pTokenPtr = strtok(NULL, "; \t")) != NULL) {
+            pValue = strchr(pTokenPtr, '=');
+            if (pValue == NULL) {
+               sprintf(sErrorMessage, "Expected KEY=VALUE, found %s at line %ld of overlay file %s.", pTokenPtr, lNumLinesRead, sOverlayFile);
+               throw SimException("Error", sErrorMessage);
+            }
+            *pValue++ = 0;
+            if ((strcmp(pTokenPtr, "RACE") == 0 && ReadOverlayRange(pValue, wRaces[0], wRaces[1])) ||
+                (strcmp(pTokenPtr, "SEX") == 0 && ReadOverlayRange(pValue, wSexes[0], wSexes[1])) ||
+                (strcmp(pTokenPtr, "YOB") == 0 && ReadOverlayRange(pValue, wYOBs[0], wYOBs[1])) ||
+                (strcmp(pTokenPtr, "AGE") == 0 && ReadOverlayRange(pValue, wAges[0], wAges[1])) ||
+                (strcmp(pTokenPtr, "YEAR") == 0 && ReadOverlayRange(pValue, wYears[0], wYears[1]))) {
+               continue;
+            } else if (strcmp(pTokenPtr, "SCALE") == 0 && !bCpdTable && pValue[0] != 0 &&
+                       strspn(pValue, "0123456789.") == strlen(pValue)) {
+               dScale = atof(pValue);
+            } else if (strcmp(pTokenPtr, "MAX_GROUP") == 0 && bCpdTable && pValue[0] != 0 &&
+                       strspn(pValue, "0123456789") == strlen(pValue) && atoi(pValue) < gwNumSmokingGrps) {
+               wMaxGroup = (short) atoi(pValue);
+            } else {
+               sprintf(sErrorMessage, "Invalid value %s for %s at line %ld of overlay file %s.", pValue, pTokenPtr,
+                       lNumLinesRead, sOverlayFile);
+               throw SimException("Error", sErrorMessage);
+            }
+         }
+         if ((!bCpdTable && dScale < 0) || (bCpdTable && wMaxGroup < 0)) {
+            sprintf(sErrorMessage, "Missing %s at line %ld of overlay file %s.", bCpdTable ? "MAX_GROUP" : "SCALE",
+                    lNumLinesRead, sOverlayFile);
+            throw SimException("Error", sErrorMessage);
+         }
+         if (wRaces[0] < 0 || wRaces[1] >= gwNumRaceValues || wSexes[0] < 0 || wSexes[1] >= gwNumSexValues) {
+            sprintf(sErrorMessage, "Invalid RACE or SEX at line %ld of overlay file %s.", lNumLinesRead, sOverlayFile);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         for (wRace = wRaces[0]; wRace <= wRaces[1]; wRace++) {
+            for (wSex = wSexes[0]; wSex <= wSexes[1]; wSex++) {
+               for (wCohort = 0; wCohort < gwNumBirthCohorts; wCohort++) {
+                  if (gwYOBCohortStartYrs[wCohort] > wYOBs[1] || gwYOBCohortEndYrs[wCohort] < wYOBs[0])
+                     continue;
+
+                  // Ages of the table in the age and calendar year ranges
+                  wFirstAge = max(wAges[0], (short)(wYears[0] - gwYOBCohortStartYrs[wCohort]));
+                  wLastAge  = min(wAges[1], (short)(wYears[1] - gwYOBCohortStartYrs[wCohort]));
+                  if (bCpdTable) {
+                     wFirstAge = max(wFirstAge, gwCpdMinAge);
+                     wLastAge  = min(wLastAge, gwCpdMaxAge);
+                  } else if (eTable == DATA_Initiation) {
+                     wFirstAge = max(wFirstAge, gwMinInitiationAge);
+                     wLastAge  = min(wLastAge, gwMaxInitiationAge);
+                  } else {
+                     wFirstAge = max(wFirstAge, gwMinCessationAge);
+                     wLastAge  = min(wLastAge, gwMaxCessationAge);
+                  }
+                  if (wFirstAge > wLastAge)
+                     continue;
+
+                  lSlice = GetCohortSlice(wRace, wSex, wCohort);
+                  if (bCpdTable) {
+                     pCpd = CopySliceOnWrite(gpCpdSlices, gdCigarettesPerDay, lSlice, glCpdYOBOffset);
+                     for (wAge = wFirstAge; wAge <= wLastAge; wAge++) {
+                        lRow = (wAge - gwCpdMinAge) * glCpdAgeOffset;
+                        ldMovedProb = 0;
+                        for (i = wMaxGroup + 1; i < gwNumSmokingGrps; i++) {
+                           if (pCpd[lRow + i] > 0) {
+                              ldMovedProb += pCpd[lRow + i];
+                              pCpd[lRow + i] = 0;
+                           }
+                        }
+                        if (ldMovedProb > 0)
+                           pCpd[lRow + wMaxGroup] = max(pCpd[lRow + wMaxGroup], (long double) 0) + ldMovedProb;
+                     }
+                     BuildCPDSwitchSlice(pCpd,
+                                         CopySliceOnWrite(gpCpdGroupCumSlices, gdCpdGroupCumProbs, lSlice, glCpdYOBOffset),
+                                         CopySliceOnWrite(gpCpdSwitchCumSlices, gdCpdSwitchCumProbs, lSlice, glCpdYOBOffset));
+                  } else {
+                     if (eTable == DATA_Initiation)
+                        pProbs = CopySliceOnWrite(gpInitiationSlices, gdInitiationProbs, lSlice, gwInitProbYOBOffset) - gwMinInitiationAge;
+                     else
+                        pProbs = CopySliceOnWrite(gpCessationSlices, gdCessationProbs, lSlice, gwCessProbYOBOffset) - gwMinCessationAge;
+                     // Missing probabilities (-1) stay missing
+                     for (wAge = wFirstAge; wAge <= wLastAge; wAge++) {
+                        dProb = pProbs[wAge];
+                        if (dProb >= 0)
+                           pProbs[wAge] = min(dProb * dScale, 1.0);
+                     }
+                  }
+               }
+            }
+         }
+      }
+      fclose(pOverlayFile);
+   } catch (SimException ex) {
+      if (pOverlayFile != NULL)
+         fclose(pOverlayFile);
+      ex.AddCallPath("ApplyOverlay()");
+      throw ex;
+   }
+}
+
+SmokingModel* SmokingModel::Reload(short& wNumFilesParsed) const {
+   SmokingModel *pModel = 0;
+
+   try {
+      if (gsDataFiles[FILE_Initiation] == 0)
+         throw SimException("Error", "A model mapped from a data bundle can not be reloaded, compile the bundle again.\n");
+
+      pModel = new SmokingModel();
+      pModel->LoadChangedFiles(*this, wNumFilesParsed);
+      if (wNumFilesParsed == 0) {
+         delete pModel;
+         pModel = 0;
+      }
+   } catch (SimException ex) {
+      delete pModel;
+      ex.AddCallPath("Reload()");
+      throw ex;
+   }
+   return pModel;
+}
+
+// Read in the cigarettes per day data file, this function assumes the data
+// is sorted by race, sex , YOB cohort, age and intensity group
+// The data will be stored in an array that is offset by race, sex, year of birth
+// age and smoking intensity level
+void SmokingModel::LoadCPDFile(const char* sCpdFile) {
+
+   char     sInputLine[3001],
+            sErrorMessage[500],
+           *pTokenPtr            = 0;
+   long     lMaxLinesExpected,
+            lNumLinesRead,
+            lCurrArrayLocation,
+            lCpdArraySize,
+            j;
+   double   dCigarettesPerDay;
+   short    wFirstDataLine,
+            wRaceValue,
+            wSexValue,
+            wNumCohorts,
+            wMinAgeValue,
+            wMaxAgeValue,
+            wCohortEndValue,
+            wCohortStartValue,
+            wCurrCohort,
+            wNumSmokingGrps,       //Number of Smoking Intensity Groups
+            wAgeValue,
+            i;
+   FILE    *pCpdFile     = 0;
+
+   try {
+
+      if (gdInitiationProbs == NULL) 
+         throw SimException("Error", "The initiation probability file must be loaded before the Cigarettes per day data file.\n");
+      if (gdIntensityProbs == NULL)
+         throw SimException("Error", "The smoking intensity probability file must be loaded before the Cigarettes per day data file.\n");
+
+      pCpdFile = fopen(sCpdFile, "r");
+      if (pCpdFile == NULL) {
+	      sprintf(sErrorMessage, "The specified input file '%s' does not exist\n or could not be opened.\n\n", sCpdFile);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   // Read in the first line of the file. Line contains the line number where the data in the file begins
+      // This is to allow documentation to be placed in the input file
+	   fgets(sInputLine, 1000, pCpdFile);
+	   if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sCpdFile);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   pTokenPtr = strtok(sInputLine, ",");
+      wFirstDataLine = atoi(pTokenPtr);
+
+      if (wFirstDataLine <= 1) {
+	      sprintf(sErrorMessage, "Invalid value: %d for location of first data line read in from file %s", \
+            wFirstDataLine, sCpdFile);
+	      throw SimException("Error", sErrorMessage);
+      }
+
+      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
+      for (i = 2; i < wFirstDataLine; i++) {
+         if ( fgets(sInputLine, 1000, pCpdFile) == NULL) {
+     	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line \
+               as specified in line 1\n", sCpdFile);
+   	      throw SimException("Error", sErrorMessage);
+         }
+      }
+
+      // Read in the First data line which contains the # of race values, # of sex values,
+      // # of birth cohort group values, the minimum age in the data, the maximum age age in the data
+      // and the number of smoking intensity groups, in the order they are listed here.
+      fgets(sInputLine, 1000, pCpdFile);
+
+      if (sInputLine == NULL) {
+	      sprintf(sErrorMessage,"Error reading first DATA line of file %s", sCpdFile);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+      pTokenPtr       = strtok(sInputLine, ",");
+      wRaceValue      = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+      wSexValue       = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+      wNumCohorts     = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+      wMinAgeValue    = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+      wMaxAgeValue    = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+      wNumSmokingGrps = atoi(pTokenPtr);
+
+      gwNumSmokingGrps = wNumSmokingGrps;
+
+      if ((wRaceValue != gwNumRaceValues) || (wSexValue != gwNumSexValues) || (wNumCohorts != gwNumBirthCohorts)) {
+         sprintf(sErrorMessage, "Mismatch between values defined from Initiation Prob Data file and this file.\n\
+            Race: Init = %d, CPD = %d\nSex: Init = %d, CPD = %d\nNum Cohorts: Init = %d, CPD = %d\n", gwNumRaceValues, \
+            wRaceValue, gwNumSexValues, wSexValue, gwNumBirthCohorts, wNumCohorts);
+	      throw SimException("Error", sErrorMessage);
+      }
+      if (wNumSmokingGrps != gwNumIntensityGrps) {
+         sprintf(sErrorMessage, "Mismatch between the number of smoking intensity groups defined in the Intensity \
+            Prob Data file and this file.\nIntensity file has %d groups, this file indicates %d groups.\n", gwNumIntensityGrps, \
+            wNumSmokingGrps);
+	      throw SimException("Error", sErrorMessage);
+      }
+      if (wMinAgeValue < 0 || wMaxAgeValue <= 0 || wMinAgeValue >=  wMaxAgeValue) {
+	      sprintf(sErrorMessage,"Invalid value(s) for minimum and maximum initiation ages\n read in from file %s",sCpdFile);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      gwCpdMinAge        = wMinAgeValue;
+      gwCpdMaxAge        = wMaxAgeValue;
+      glCpdAgeOffset     = (long)gwNumIntensityGrps;
+      glCpdYOBOffset     = glCpdAgeOffset * ((gwCpdMaxAge   - gwCpdMinAge) + 1);
+      glCpdSexOffset     = glCpdYOBOffset * gwNumBirthCohorts;
+      glCpdRaceOffset    = glCpdSexOffset * gwNumSexValues;
+      lCpdArraySize      = glCpdRaceOffset * gwNumRaceValues;
+      gdCigarettesPerDay = new long double[lCpdArraySize];
+      lMaxLinesExpected  = lCpdArraySize/gwNumIntensityGrps;  //All of the intesity groups are on a single line per by-group
+
+      // 
+      for (j = 0; j < lCpdArraySize; j++) {
+         gdCigarettesPerDay[j] = -1;
+      }
+
+      // Read in the Probability Data Lines
+      // This subroutine will
+      // - read in the variable values for the line
+      // - verify the values are valid (including checking the cohorts)   
+      // - add the CPD value to the appropriate array location
+      lNumLinesRead = 0;
+
+      while (fgets(sInputLine, 1000, pCpdFile) != NULL) {
+
+         lNumLinesRead++;
+
+         pTokenPtr          = strtok(sInputLine, ",");
+         wRaceValue         = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+         wSexValue          = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+         wCohortStartValue  = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+         wCohortEndValue    = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+         wAgeValue          = atoi(pTokenPtr);
+         wCurrCohort        = GetYOBCohortGroup(wCohortStartValue);
+
+         if (wCohortStartValue != gwYOBCohortStartYrs[wCurrCohort] || 
+             wCohortEndValue != gwYOBCohortEndYrs[wCurrCohort]) {
+            sprintf(sErrorMessage, "The cohort range %d - %d in the Cigarettes per day file does not match the cohort \
+               range set by the initiation file.\n", wCohortStartValue, wCohortEndValue);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         // Validate values read in
+         if (wAgeValue  < gwCpdMinAge  || wAgeValue > gwCpdMaxAge ||
+             wRaceValue >= gwNumRaceValues || wRaceValue < 0 ||
+             wSexValue  >= gwNumSexValues || wSexValue  < 0) {
+            sprintf(sErrorMessage, "Invalid By-Variable Combination, Race = %d, Sex = %d, Age = %d\n Read form file %s \
+               at line number %d", wRaceValue, wSexValue, wAgeValue, sCpdFile, lNumLinesRead);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         // Probabilities are read in by smoking intesity group
+         // Value assignment within the array is based on the offset formula
+         // fprintf(stdout, "%d\n", lNumLinesRead);
+         // if (lNumLinesRead == 1101)
+            // int r = 9;
+
+         for (i = 0; i < gwNumIntensityGrps; i++) {
+            pTokenPtr = strtok(NULL, ",");
+            if (strcmp(pTokenPtr, ".") != 0) {
+               dCigarettesPerDay  = atof(pTokenPtr);
+               lCurrArrayLocation = (glCpdRaceOffset * wRaceValue) +
+                                    (glCpdSexOffset * wSexValue) +
+                                    (glCpdYOBOffset * wCurrCohort) +
+                                    (glCpdAgeOffset * (wAgeValue - gwCpdMinAge)) +
+                                    i;
+
+               gdCigarettesPerDay[lCurrArrayLocation] = dCigarettesPerDay;
+            }
+         }
+      }
+
+      if (lNumLinesRead > lMaxLinesExpected) {
+         sprintf(sErrorMessage, "Too many lines read from file %s.\n%d were expected based on sex, race, birth cohort and \
+            age values specified in first line of file.", sCpdFile, lNumLinesRead,lMaxLinesExpected);
+         throw SimException("Error", sErrorMessage);
+      }
+      // End Reading in the Probabilities File
+      fclose(pCpdFile);
+      pCpdFile = 0;
+
+      BuildCPDSwitchTables();
+   } catch (SimException ex) {
+      if (pCpdFile != NULL)
+         fclose(pCpdFile);
+      ex.AddCallPath("LoadCPDFile()");
+      throw ex;
+   } catch (...) {
+      if (pCpdFile != NULL)
+         fclose(pCpdFile);
+      throw SimException("LoadCPDFile()", "Unkown Error Occurred.\n");
+   }
+}
+
+// Build the tables used to assign and switch smoking intensity groups (see CalcCigarettesPerDaySwitch).
+// They only depend on race, sex and birth cohort so they are built once for every combination.
+// For each age i and group j:
+//  - gdCpdGroupCumProbs  = sum of the group probs for groups 0 to j at age i
+//  - gdCpdSwitchCumProbs = sum over groups 0 to j of (group prob at age i+1 - group prob at age i).
+//    A positive value is the chance of moving to a lower group, a negative value to a higher group.
+//    The last age and the heaviest group are 0 (no change), the differences over all groups sum to 0.
+void SmokingModel::BuildCPDSwitchTables() {
+   long     lCpdArraySize,
+            lSliceStart;
+
+   lCpdArraySize       = glCpdRaceOffset * gwNumRaceValues;
+   gdCpdGroupCumProbs  = new double[lCpdArraySize];
+   gdCpdSwitchCumProbs = new double[lCpdArraySize];
+
+   for (lSliceStart = 0; lSliceStart < lCpdArraySize; lSliceStart += glCpdYOBOffset) {
+      BuildCPDSwitchSlice(gdCigarettesPerDay + lSliceStart, gdCpdGroupCumProbs + lSliceStart, gdCpdSwitchCumProbs + lSliceStart);
+   }
+}
+
+// Build the group tables of one race/sex/cohort slice of the cigarettes per day table (pCpd)
+void SmokingModel::BuildCPDSwitchSlice(const long double* pCpd, double* pGroupCumProbs, double* pSwitchCumProbs) {
+   long     lRowStart,
+            lNumAges,
+            i;
+   short    j;
+   double   dGroupSum,
+            dSwitchSum;
+
+   lNumAges = glCpdYOBOffset / glCpdAgeOffset;
+   for (i = 0; i < lNumAges; i++) {
+      lRowStart  = i * glCpdAgeOffset;
+      dGroupSum  = 0;
+      dSwitchSum = 0;
+      for (j = 0; j < gwNumSmokingGrps; j++) {
+         dGroupSum += (double)pCpd[lRowStart + j];
+         pGroupCumProbs[lRowStart + j] = dGroupSum;
+
+         if (i < lNumAges - 1 && j < gwNumSmokingGrps - 1) {
+            dSwitchSum += (double)pCpd[lRowStart + glCpdAgeOffset + j] - (double)pCpd[lRowStart + j];
+            pSwitchCumProbs[lRowStart + j] = dSwitchSum;
+         } else {
+            pSwitchCumProbs[lRowStart + j] = 0;
+         }
+      }
+   }
+}
+
+// Load the smoking intensity group probabilities
+// The data will be stored in an array that is offset by age and smoking intensity level
+void SmokingModel::LoadCPDIntensityProbs(const char* sDataFileName) {
+
+   char     sInputLine[1001],
+            sErrorMessage[500],
+           *pTokenPtr            = 0;
+   long     lNumLinesExpected,
+            lNumLinesRead,
+            lCurrArrayLocation;
+   double   dCurrProbability;
+   short    wFirstDataLine,
+            wAgeValue,
+            wRaceValue,
+            wSexValue,
+            wNumGroups,       //Number of Smoking Intensity Groups
+            wNumRaces,
+            wNumSexes,
+            wMinAgeValue,
+            wMaxAgeValue,
+            i;
+   FILE    *pProbabilityFile     = 0;
+
+   try {
+      pProbabilityFile = fopen(sDataFileName, "r");
+      if (pProbabilityFile == NULL) {
+	      sprintf(sErrorMessage, "The specified input file '%s' does not exist\n or could not be opened.\n\n", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   // Read in the first line of the file.  Line contains the line number where the data in the file begins
+      // This is to allow documentation to be placed in the input file
+	   fgets(sInputLine, 1000, pProbabilityFile);
+	   if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+	   pTokenPtr = strtok(sInputLine, ",");
+      wFirstDataLine = atoi(pTokenPtr);
+      if (wFirstDataLine <= 1) {
+	      sprintf(sErrorMessage,  "Invalid value: %d for location of first data line read in from file %s", \
+            wFirstDataLine, sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+      }
+
+      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
+      for (i = 2; i < wFirstDataLine; i++) {
+         if ( fgets(sInputLine, 1000, pProbabilityFile) == NULL) {
+     	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line as \
+               specified in line 1\n", sDataFileName);
+   	      throw SimException("Error", sErrorMessage);
+         }
+      }
+
+      // Read in the First data line which contains the # of race values, # of sex values,
+      // # of birth cohort group values, the minimum inititaion age and the maximum initiation age
+      // in the order they are listed here.
+      fgets(sInputLine, 1000, pProbabilityFile);
+
+      if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+      pTokenPtr      = strtok(sInputLine, ",");
+      wNumRaces      = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
+      wNumSexes      = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
+      wMinAgeValue   = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
+      wMaxAgeValue   = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
+      wNumGroups     = atoi(pTokenPtr);
+
+      if (wNumGroups <= 0 )
+         throw SimException("Error", "Invalid value read in for # of smoking intensity groups.");
+
+      if (wMinAgeValue < 0 || wMaxAgeValue <= 0 || wMinAgeValue >=  wMaxAgeValue) {
+	      sprintf(sErrorMessage, "Invalid value(s) for minimum and maximum initiation ages\n read in from file %s", \
+            sDataFileName);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      if ((wNumRaces != gwNumRaceValues) || (wNumSexes != gwNumSexValues)) {
+         sprintf(sErrorMessage, "Mismatch between number of races and number of sexes in initiation file and cohorts from CPD Intensity \
+            file.\nRace: Init = %d, CPD = %d\nSex: Init = %d, CPD = %d\n", gwNumRaceValues, wRaceValue, gwNumSexValues, wSexValue);
+	      throw SimException("Error", sErrorMessage);
+      }
+
+      gwNumIntensityGrps = wNumGroups;
+      gwIntensityMinAge = wMinAgeValue;
+      gwIntensityMaxAge = wMaxAgeValue;
+
+      gwIntensityAgeOffset = wNumGroups;
+      gwIntensitySexOffset = ((wMaxAgeValue - wMinAgeValue) + 1) * gwIntensityAgeOffset;
+      gwIntensityRaceOffset = (wNumSexes * gwIntensitySexOffset);
+
+      gdIntensityProbs = new double[long(wNumRaces) * long(gwIntensityRaceOffset)];
+      lNumLinesExpected = long((gwIntensityMaxAge - gwIntensityMinAge) + 1);
+
+      // Read in the Probability Data Lines
+      lNumLinesRead = 0;
+      while (fgets(sInputLine, 1000, pProbabilityFile) != NULL) {
+         lNumLinesRead++;
+         pTokenPtr = strtok(sInputLine, ",");
+         wRaceValue = atoi(pTokenPtr);    pTokenPtr = strtok(NULL, ",");
+         wSexValue = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
+         wAgeValue = atoi(pTokenPtr);
+
+         // Validate values read in
+         if (wRaceValue > wNumRaces) {
+            sprintf(sErrorMessage, "Invalid Race Value: %d\n Read from file %s at line number %d", wRaceValue, 
+               sDataFileName, lNumLinesRead);
+            throw SimException("Error", sErrorMessage);
+         }
+         if (wSexValue > wNumSexes) {
+            sprintf(sErrorMessage, "Invalid Race Value: %d\n Read from file %s at line number %d", wSexValue, \
+               sDataFileName, lNumLinesRead);
+            throw SimException("Error", sErrorMessage);
+         }
+         if (wAgeValue < gwIntensityMinAge || wAgeValue > gwIntensityMaxAge) {
+            sprintf(sErrorMessage, "Invalid Age Value: %d\n Read from file %s at line number %d", wAgeValue, \
+               sDataFileName, lNumLinesRead);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         // Probabilities are read in by intensity group
+         // Value assignment within the array is based on the offset formula
+         for (i = 0; i < gwNumIntensityGrps; i++) {
+            pTokenPtr = strtok(NULL, ",");
+            if (strcmp(pTokenPtr, ".") != 0) {
+               dCurrProbability  = atof(pTokenPtr);
+               if ((dCurrProbability < 0) || (dCurrProbability > 1)) {
+                  sprintf(sErrorMessage, "Invalid Probability: %f read for Age : %d ,Intensity Group : %d\nRead \
+                     from file %s at line number %d.\n", dCurrProbability, wAgeValue, i, sDataFileName, lNumLinesRead);
+                  throw SimException("Error",sErrorMessage);
+               }
+            } else {
+               sprintf(sErrorMessage, "Value missing for Age : %d ,Intensity Group : %d\nValue must contain a decimal palce.\n", wAgeValue,i);
+               throw SimException("Error", sErrorMessage);
+            }
+
+            // Offset formula
+            lCurrArrayLocation = (wRaceValue * gwIntensityRaceOffset) + \
+                                 (wSexValue * gwIntensitySexOffset) + \
+                                 ((wAgeValue - gwIntensityMinAge) * gwIntensityAgeOffset) + \
+                                 i;
+
+            // Values stored as a cumulative probability
+            if (i == 0) {
+               gdIntensityProbs[lCurrArrayLocation] = dCurrProbability;
+            } else {
+               gdIntensityProbs[lCurrArrayLocation] = gdIntensityProbs[lCurrArrayLocation-1] + dCurrProbability;
+            }
+         }
+      }
+
+      if (lNumLinesRead < lNumLinesExpected) {
+         sprintf(sErrorMessage, "Not enough lines read from file %s.\n%d were expected based on sex, race, birth cohort \
+            and age values specified in first line of file.", sDataFileName, lNumLinesRead, lNumLinesExpected);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      // End Reading in the Probabilities File
+      fclose(pProbabilityFile);
+
+   } catch(SimException ex) {
+      if (pProbabilityFile != NULL) {
+         fclose(pProbabilityFile);
+      }
+      ex.AddCallPath("LoadCPDIntensityProbs()");
+      throw ex;
+   } catch (...) {
+      if (pProbabilityFile != NULL) {
+         fclose(pProbabilityFile);
+      }
+      throw SimException("LoadCPDIntensityProbs()", "Unkown Error Occurred.\n");
+   }
+}
+
+// Load the probability initiation/cessation data files.
+void SmokingModel::LoadProbabilityData(const char* sDataFileName, DataType eFileType) {
+
+   char     sInputLine[3001],
+            sErrorMessage[500],
+           *pTokenPtr            = 0;
+   long     lNumLinesExpected,
+            lNumLinesRead,
+            lCurrArrayLocation;
+   double   dCurrProbability;
+   short    wFirstDataLine,
+            wSexValue,
+            wRaceValue,
+            wAgeValue,
+            wCohortValue,
+            wMinAgeValue,
+            wMaxAgeValue,
+            i;
+   FILE     *pProbabilityFile     = 0;
+
+
+   try {
+
+      if ((eFileType != DATA_Initiation) && (eFileType != DATA_Cessation)) 
+         throw SimException("Error", "Invalid File Type supplied to function.");
+
+      if (eFileType == DATA_Cessation && (gdInitiationProbs==NULL)) {
+         throw SimException("Error", 
+            "Attempt to load Cessation Probabilities before Initiation probabilities.\nInitiation data must be loaded first.\n");
+      }
+
+      pProbabilityFile = fopen(sDataFileName, "r");
+      if (pProbabilityFile == NULL) {
+	      sprintf(sErrorMessage,"The specified input file '%s' does not exist\n or could not be opened.\n\n", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   //Read in the first line of the file. Line contains the line number where the data in the file begins
+     // This allows documentation to be placed in the input file
+	   fgets(sInputLine, 1000, pProbabilityFile);
+	   if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   pTokenPtr = strtok(sInputLine, ",");
+      wFirstDataLine = atoi(pTokenPtr);
+      if (wFirstDataLine <= 1) {
+	      sprintf(sErrorMessage, "Invalid value: %d for location of first data line read in from file %s", \
+            wFirstDataLine, sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+      }
+
+      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
+      for (i = 2; i < wFirstDataLine; i++) {
+         if ( fgets(sInputLine, 1000, pProbabilityFile) == NULL) {
+     	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line \
+               as specified in line 1\n", sDataFileName);
+   	      throw SimException("Error", sErrorMessage);
+         }
+      }
+
+      // Read in the First data line which contains the # of race values, # of sex values,
+      // # of birth cohort group values, the minimum inititaion age and the maximum initiation age
+      // in the order they are listed here.
+      fgets(sInputLine, 1000, pProbabilityFile);
+
+      if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+      pTokenPtr = strtok(sInputLine, ",");
+      wRaceValue = atoi(pTokenPtr);
+      pTokenPtr = strtok(NULL, ",");
+      wSexValue = atoi(pTokenPtr);
+      pTokenPtr = strtok(NULL, ",");
+      wCohortValue = atoi(pTokenPtr);
+      pTokenPtr = strtok(NULL, ",");
+      wMinAgeValue = atoi(pTokenPtr);
+      pTokenPtr = strtok(NULL, ",");
+      wMaxAgeValue = atoi(pTokenPtr);
+
+      if ((eFileType == DATA_Initiation) && (wRaceValue <= 0 || wSexValue <= 0 || wCohortValue <= 0))
+         throw SimException("Error", "Invalid value read in for # of sex values, # of race values or # of birth cohorts.");
+
+      if ((eFileType == DATA_Cessation) &&
+         ((wRaceValue != gwNumRaceValues) || (wSexValue != gwNumSexValues) || (wCohortValue != gwNumBirthCohorts))) {
+         sprintf(sErrorMessage, "Mismatch between cohort values from Initiation and Cessation Files.\n\
+            Race: Init = %d, Cess = %d\nSex: Init = %d, Cess = %d\nNum Cohorts: Init = %d, Cess = %d\n", \
+            gwNumRaceValues, wRaceValue, gwNumSexValues, wSexValue, gwNumBirthCohorts, wCohortValue);
+	      throw SimException("Error", sErrorMessage);
+      }
+
+      if (wMinAgeValue < 0 || wMaxAgeValue <= 0 || wMinAgeValue >=  wMaxAgeValue) {
+	      sprintf(sErrorMessage, "Invalid value(s) for minimum and maximum initiation ages\n read in from file %s", sDataFileName);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      // Load private members from Initiation data
+      if (eFileType == DATA_Initiation) {
+         gwNumRaceValues      = wRaceValue;
+         gwNumSexValues       = wSexValue;
+         gwNumBirthCohorts    = wCohortValue;
+         gwMinInitiationAge   = wMinAgeValue;
+         gwMaxInitiationAge   = wMaxAgeValue;
+         gwInitProbYOBOffset  = (gwMaxInitiationAge - gwMinInitiationAge) + 1;
+         gwInitProbSexOffset  = gwNumBirthCohorts * gwInitProbYOBOffset;
+         gwInitProbRaceOffset = gwNumSexValues * gwInitProbSexOffset;
+         gdInitiationProbs    = new double[(long(gwNumRaceValues) * long(gwInitProbRaceOffset))];
+         gwYOBCohortStartYrs  = new short [gwNumBirthCohorts];
+         gwYOBCohortEndYrs    = new short [gwNumBirthCohorts];
+         lNumLinesExpected    = long(gwNumSexValues * gwNumRaceValues *
+                                   ((gwMaxInitiationAge - gwMinInitiationAge) + 1));
+
+      // Load private members from Cessation data
+      } else {
+         gwMinCessationAge    = wMinAgeValue;
+         gwMaxCessationAge    = wMaxAgeValue;
+         gwCessProbYOBOffset  = (gwMaxCessationAge - gwMinCessationAge) + 1;
+         gwCessProbSexOffset  = gwNumBirthCohorts * gwCessProbYOBOffset;
+         gwCessProbRaceOffset = gwNumSexValues * gwCessProbSexOffset;
+         gdCessationProbs     = new double[(long(gwNumRaceValues) * long(gwCessProbRaceOffset))];
+         lNumLinesExpected    = long(gwNumSexValues * gwNumRaceValues *
+                                   ((gwMaxCessationAge - gwMinCessationAge) + 1));
+      }
+
+
+      // Read in the second dataline, this contains 3 column labels followed by the YOB cohort ranges
+      fgets(sInputLine, 1800, pProbabilityFile);
+
+      if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading second DATA line of file %s", sDataFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+      pTokenPtr= strtok(sInputLine, ",");
+      pTokenPtr= strtok(NULL, ",");
+      pTokenPtr= strtok(NULL, ",");
+
+      // // Read in the year of birth cohorts and assign the values to the appropriate Start/End year arrays
+      for (i = 0; i < gwNumBirthCohorts; i++) {
+
+         pTokenPtr     = strtok(NULL, "-");
+         wCohortValue  = atoi(pTokenPtr);
+
+         // If it's the initiation file, assign value to the array
+         if (eFileType == DATA_Initiation) {
+            gwYOBCohortStartYrs[i] = wCohortValue;
+
+         // Otherwise check the value against the value already in the array
+         } else if (wCohortValue != gwYOBCohortStartYrs[i]) {
+            sprintf(sErrorMessage, "Mismatching starting cohorts between Initiation and Cessation probability \
+               files\nFor range : 1\n%d read from initiation file.\n%d read from cessation file.", 
+               gwYOBCohortStartYrs[i], wCohortValue);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         pTokenPtr = strtok(NULL, ",");
+         wCohortValue = atoi(pTokenPtr);
+
+         if (eFileType == DATA_Initiation)  {
+            // If its the Initiation file, assign value to the array
+            gwYOBCohortEndYrs[i] = wCohortValue;
+         } else if (wCohortValue != gwYOBCohortEndYrs[i]) {
+            // Otherwise check the value against the value already in the array
+            sprintf(sErrorMessage, "Mismatching starting cohorts between Initiation and Cessation probability files\n\
+               For range : 1\n%d read from initiation file.\n%d read from cessation file.", gwYOBCohortEndYrs[i], wCohortValue);
+            throw SimException("Error", sErrorMessage);
+         }
+      
+         // If its the initiation file, verify the values
+         if ( (eFileType == DATA_Initiation) &&
+              (gwYOBCohortStartYrs[i] < 0 || gwYOBCohortEndYrs[i] <= 0 || gwYOBCohortStartYrs[i] > gwYOBCohortEndYrs[i]) ) {
+            sprintf(sErrorMessage, \
+              "Invalid Year of Birth Cohort value(s).\nStart Year = %d, End Year = %d.\nRead in from file %s for cohort range: %d\n\n\n", \
+              gwYOBCohortStartYrs[i], gwYOBCohortEndYrs[i], sDataFileName, i);
+            throw SimException("Error", sErrorMessage);
+         }
+      }
+      if (eFileType == DATA_Initiation)
+         BuildYOBCohortIndex();
+
+      // Read in the Probability Data Lines
+      lNumLinesRead = 0;
+      while (fgets(sInputLine, 2000, pProbabilityFile) != NULL) {
+         lNumLinesRead++;
+         pTokenPtr  = strtok(sInputLine, ",");
+         wRaceValue = atoi(pTokenPtr);
+         pTokenPtr = strtok(NULL, ",");
+         wSexValue = atoi(pTokenPtr);
+         pTokenPtr = strtok(NULL, ",");
+         wAgeValue = atoi(pTokenPtr);
+
+         // Validate values read in
+         if (wAgeValue  < wMinAgeValue || wAgeValue > wMaxAgeValue || wRaceValue >= gwNumRaceValues || wRaceValue < 0 ||
+            wSexValue  >= gwNumSexValues  || wSexValue  < 0) {
+            sprintf(sErrorMessage, "Invalid By-Variable Combination, Race = %d, Sex = %d, Age = %d\n Read form file %s at line \
+               number %d", wRaceValue, wSexValue, wAgeValue, sDataFileName, lNumLinesRead);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         // Probabilities are read in by year of birth cohorts
+         // Values will be assigned to the probability array that corresponds to eFileType,
+         // Value assignment within the array is based on the offset formula
+         for (i = 0; i < gwNumBirthCohorts; i++) {
+            pTokenPtr = strtok(NULL, ",");
+
+            if (strcmp(pTokenPtr, ".") != 0) {
+               dCurrProbability  = atof(pTokenPtr);
+               if ((dCurrProbability < 0) || (dCurrProbability > 1)) {
+                  sprintf(sErrorMessage, "Invalid Probability: %f read for Birth Cohort: %d - %d\nRead from file %s at line \
+                     number %d.\n", dCurrProbability, gwYOBCohortStartYrs[i], gwYOBCohortEndYrs[i], sDataFileName, lNumLinesRead);
+                  throw SimException("Error", sErrorMessage);
+               }
+            } else {
+               dCurrProbability = -1;
+            }
+
+            if (eFileType == DATA_Initiation) {
+               lCurrArrayLocation = (wRaceValue * gwInitProbRaceOffset) + (wSexValue * gwInitProbSexOffset) +
+                                     (i * gwInitProbYOBOffset)                + (wAgeValue - gwMinInitiationAge);
+               gdInitiationProbs[lCurrArrayLocation] = dCurrProbability;
+            } else {
+               lCurrArrayLocation = (wRaceValue * gwCessProbRaceOffset) + (wSexValue * gwCessProbSexOffset) +
+                                     (i * gwCessProbYOBOffset)                + (wAgeValue - gwMinCessationAge);
+               gdCessationProbs[lCurrArrayLocation] = dCurrProbability;
+            }
+         }
+      }
+
+      if (lNumLinesRead < lNumLinesExpected) {
+         sprintf(sErrorMessage,"Not enough lines read from file %s.\n%d were expected based on sex, race, birth cohort and age values \
+            specified in first line of file.", sDataFileName, lNumLinesRead, lNumLinesExpected);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      // End Reading in the Probabilities File
+      fclose(pProbabilityFile);
+
+   } catch(SimException ex) {
+      if (pProbabilityFile != NULL)
+         fclose(pProbabilityFile);
+      ex.AddCallPath("LoadProbabilityData()");
+      throw ex;
+   } catch (...) {
+      if (pProbabilityFile != NULL)
+         fclose(pProbabilityFile);
+      throw SimException("LoadProbabilityData()", "Unkown Error Occurred.\n");
+   }
+}
+
+// Load the probability initiation/cessation data files.
+void SmokingModel::LoadOtherCODFile(const char* sLifeTableFileName) {
+
+   char     sInputLine[1001],
+            sErrorMessage[500],
+           *pTokenPtr            = 0;
+   long     lMaxNumLines,
+            lNumLinesRead,
+            lCurrArrayLocation,
+            lSizeOfLifeTable,
+            j;
+   double   dCurrProbability;
+   short    wFirstDataLine,
+            wSexValue,
+            wRaceValue,
+            wYearValue,
+            wAgeValue,
+            i;
+   FILE    *pLifeTableFile     = 0;
+
+   try {
+      if (gdInitiationProbs == NULL)
+         throw("Error", "Initiation Probabilies must be loaded before the Life Table Probabilities.\n");
+
+      pLifeTableFile = fopen(sLifeTableFileName, "r");
+      if (pLifeTableFile == NULL) {
+	      sprintf(sErrorMessage, "The specified input file '%s' does not exist\n or could not be opened.\n\n", sLifeTableFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   // Read in the first line of the file. Line contains the line number where the data in the file begins
+      // This is to allow documentation to be placed in the input file
+	   fgets(sInputLine, 1000, pLifeTableFile);
+
+	   if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sLifeTableFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+	   pTokenPtr      = strtok(sInputLine, ",");
+      wFirstDataLine = atoi(pTokenPtr);
+      if (wFirstDataLine <= 1) {
+	      sprintf(sErrorMessage, "Invalid value: %d for location of first data line to read in from file %s", \
+            wFirstDataLine, sLifeTableFileName);
+	      throw SimException("Error", sErrorMessage);
+      }
+
+      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
+      for (i = 2; i < wFirstDataLine; i++) {
+         if ( fgets(sInputLine, 1000, pLifeTableFile) == NULL) {
+   	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line as specified in line 1\n", \ 
+               sLifeTableFileName);
+   	      throw SimException("Error", sErrorMessage);
+         }
+      }
+
+      // Read in the First data line which contains the # of race values, # of sex values,
+      // the min year of birth, the max year of birth, the min age and the maximum age
+      // in the order they are listed here.
+      fgets(sInputLine, 1000, pLifeTableFile);
+
+      if (sInputLine == NULL) {
+	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sLifeTableFileName);
+	      throw SimException("Error", sErrorMessage);
+	   }
+
+      pTokenPtr          = strtok(sInputLine, ",");
+      wRaceValue         = atoi(pTokenPtr);
+      pTokenPtr          = strtok(NULL, ",");
+      wSexValue          = atoi(pTokenPtr);
+      pTokenPtr          = strtok(NULL, ",");
+      gwMinLifeTableYear = atoi(pTokenPtr);
+      pTokenPtr          = strtok(NULL, ",");
+      gwMaxLifeTableYear = atoi(pTokenPtr);
+      pTokenPtr          = strtok(NULL, ",");
+      gwMinLifeTableAge  = atoi(pTokenPtr);
+      pTokenPtr          = strtok(NULL, ",");
+      gwMaxLifeTableAge  = atoi(pTokenPtr);
+
+      gwMaxLifeTableYear = 2300;
+
+      /*
+      if ((wRaceValue != gwNumRaceValues) || (wSexValue != gwNumSexValues) ||
+         (gwMinLifeTableYear > GetMinYearOfBirth()) || (gwMaxLifeTableYear < GetMaxYearOfBirth())) {
+         sprintf(sErrorMessage, "Mismatch between cohort values from Life Table file and cohorts from Initiation file.\
+            \nRace: Init = %d, Life = %d\nSex: Init = %d, Life = %d\nMin Year Birth: Init = %d, Life = %d\nMax Year Birth: \
+            Init = %d, Life = %d\n", gwNumRaceValues, wRaceValue, gwNumSexValues, wSexValue, GetMinYearOfBirth(), \
+            gwMinLifeTableYear, GetMaxYearOfBirth(), gwMaxLifeTableYear);
+	      throw SimException("Error", sErrorMessage);
+      }
+      */
+
+      if (gwMinLifeTableAge < 0 || gwMaxLifeTableAge <= 0 || gwMinLifeTableAge >=  gwMaxLifeTableAge) {
+	      sprintf(sErrorMessage, "Invalid value(s) for minimum and maximum initiation ages\n read in from file %s", sLifeTableFileName);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      // Load private members from Life Table data
+      glLifeTabAgeOffset  = long(COL_NumColumns);
+      glLifeTabYOBOffset  = long(((gwMaxLifeTableAge - gwMinLifeTableAge) + 1) * glLifeTabAgeOffset);
+      glLifeTabSexOffset  = long(((gwMaxLifeTableYear - gwMinLifeTableYear) + 1) * glLifeTabYOBOffset);
+      glLifeTabRaceOffset = long(gwNumSexValues) * glLifeTabSexOffset;
+      lSizeOfLifeTable    = long(gwNumRaceValues) * long(glLifeTabRaceOffset);
+      gdLifeTableProbs    = new double[lSizeOfLifeTable];
+      lMaxNumLines        = long(gwNumRaceValues * gwNumSexValues *
+                                 ((gwMaxLifeTableYear - gwMinLifeTableYear)+1) *
+                                 ((gwMaxLifeTableAge - gwMinLifeTableAge) + 1));
+
+      // Fill in all gdLifeTableProbs entries with -1
+      for (j=0; j<lSizeOfLifeTable; j++) {
+         gdLifeTableProbs[j] = -1;
+      }
+
+      // Read in the Probability Data Lines
+      lNumLinesRead = 0;
+      while (fgets(sInputLine, 1000, pLifeTableFile)!=NULL) {
+
+         lNumLinesRead++;
+         pTokenPtr  = strtok(sInputLine, ",");
+         wRaceValue = atoi(pTokenPtr);
+         pTokenPtr  = strtok(NULL, ",");
+         wSexValue  = atoi(pTokenPtr);
+         pTokenPtr  = strtok(NULL, ",");
+         wYearValue  = atoi(pTokenPtr);
+         pTokenPtr  = strtok(NULL, ",");
+         wAgeValue  = atoi(pTokenPtr);
+
+         // Validate values read in
+         if (wAgeValue  < gwMinLifeTableAge    || wAgeValue > gwMaxLifeTableAge ||
+            wRaceValue >= gwNumRaceValues      || wRaceValue < 0                ||
+            wSexValue  >= gwNumSexValues       || wSexValue  < 0                ||
+            wYearValue > gwMaxLifeTableYear   || wYearValue < gwMinLifeTableYear) {
+            sprintf(sErrorMessage, "Invalid By-Variable Combination, Race = %d, Sex = %d, Year = %d, Age = %d\n Read form file %s \
+               at line number %d", wRaceValue, wSexValue, wYearValue, wAgeValue, sLifeTableFileName, lNumLinesRead);
+            throw SimException("Error", sErrorMessage);
+         }
+
+         // Probabilities are read in by smoking status type
+         // Value assignment within the array is based on the offset formula
+         for (i = 0; i < COL_NumColumns; i++) {
+            pTokenPtr = strtok(NULL, ",");
+            dCurrProbability  = atof(pTokenPtr);
+            if ((dCurrProbability < 0) || (dCurrProbability > 1)) {
+               sprintf(sErrorMessage, "Invalid Probability: %f read for Birth Cohort: %d - %d\nRead from file %s at line number %d.\n", \
+                  dCurrProbability, gwYOBCohortStartYrs[i], gwYOBCohortEndYrs[i], sLifeTableFileName, lNumLinesRead);
+               throw SimException("Error", sErrorMessage);
+            }
+            lCurrArrayLocation = (long(wRaceValue) * glLifeTabRaceOffset) +
+                                 (long(wSexValue) * glLifeTabSexOffset) +
+                                 (long(wYearValue - gwMinLifeTableYear) * glLifeTabYOBOffset) +
+                                 (long(wAgeValue - gwMinLifeTableAge) * glLifeTabAgeOffset)   +
+                                  long(i);
+            gdLifeTableProbs[lCurrArrayLocation] = dCurrProbability;
+         }
+      }
+
+      if (lNumLinesRead > lMaxNumLines) {
+         sprintf(sErrorMessage, "Too many lines read from file %s.\n%ld max were expected based on sex, race, birth cohort and age\
+            values specified in first line of file.\n%ld were read in.\n", sLifeTableFileName, lMaxNumLines, lNumLinesRead);
+         throw SimException("Error", sErrorMessage);
+      }
+
+      // End Reading in the Probabilities File
+      fclose(pLifeTableFile);
+
+   } catch (SimException ex) {
+      if (pLifeTableFile != NULL)
+         fclose(pLifeTableFile);
+      ex.AddCallPath("LoadLifeTableFile()");
+      throw ex;
+   } catch (...) {
+      if (pLifeTableFile != NULL)
+         fclose(pLifeTableFile);
+      throw SimException("LoadLifeTableFile()", "Unkown Error Occurred.\n");
+   }
+}
+
+// Size in bytes of each table stored in a data bundle, from the data limits and offsets
+void SmokingModel::GetBundleTableSizes(unsigned long long *ullTableBytes) const {
+   unsigned long long ullNumRaces = (unsigned long long) gwNumRaceValues;
+
+   ullTableBytes[BT_Initiation]        = ullNumRaces * gwInitProbRaceOffset * sizeof(double);
+   ullTableBytes[BT_Cessation]         = ullNumRaces * gwCessProbRaceOffset * sizeof(double);
+   ullTableBytes[BT_LifeTable]         = ullNumRaces * glLifeTabRaceOffset * sizeof(double);
+   ullTableBytes[BT_Intensity]         = ullNumRaces * gwIntensityRaceOffset * sizeof(double);
+   ullTableBytes[BT_CigarettesPerDay]  = ullNumRaces * glCpdRaceOffset * sizeof(long double);
+   ullTableBytes[BT_CpdGroupCumProbs]  = ullNumRaces * glCpdRaceOffset * sizeof(double);
+   ullTableBytes[BT_CpdSwitchCumProbs] = ullNumRaces * glCpdRaceOffset * sizeof(double);
+   ullTableBytes[BT_CohortStartYrs]    = (unsigned long long) gwNumBirthCohorts * sizeof(short);
+   ullTableBytes[BT_CohortEndYrs]      = (unsigned long long) gwNumBirthCohorts * sizeof(short);
+   ullTableBytes[BT_CohortIndex]       = (gwNumBirthCohorts <= 0) ? 0 :
+      (unsigned long long)(gwYOBCohortEndYrs[gwNumBirthCohorts - 1] - gwYOBCohortStartYrs[0] + 1) * sizeof(short);
+}
+
+// Write the loaded tables to a data bundle that SmokingModel(const char*) maps without parsing the text files
+void SmokingModel::WriteBundle(const char* sBundleFile) const {
+
+   char                      sErrorMessage[500];
+   const void               *pTables[BT_NumTables];
+   unsigned char            *pImage = 0;
+   unsigned long long        ullOffset;
+   SmokingModelBundleHeader  header;
+   FILE                     *pBundleFile = 0;
+   short                     i;
+
+   try {
+      memset(&header, 0, sizeof(header));
+      memcpy(header.sMagic, SHG_BUNDLE_MAGIC, sizeof(header.sMagic));
+      header.uiVersion            = SHG_BUNDLE_VERSION;
+      header.uiHeaderSize         = sizeof(SmokingModelBundleHeader);
+      header.uiByteOrder          = SHG_BUNDLE_BYTE_ORDER;
+      header.uiLongDoubleSize     = sizeof(long double);
+      header.ullDataHash          = gullDataHash;
+
+      header.wNumBirthCohorts     = gwNumBirthCohorts;
+      header.wNumRaceValues       = gwNumRaceValues;
+      header.wNumSexValues        = gwNumSexValues;
+      header.wMinInitiationAge    = gwMinInitiationAge;
+      header.wMinCessationAge     = gwMinCessationAge;
+      header.wMaxInitiationAge    = gwMaxInitiationAge;
+      header.wMaxCessationAge     = gwMaxCessationAge;
+      header.wMinLifeTableAge     = gwMinLifeTableAge;
+      header.wMaxLifeTableAge     = gwMaxLifeTableAge;
+      header.wMinLifeTableYear    = gwMinLifeTableYear;
+      header.wMaxLifeTableYear    = gwMaxLifeTableYear;
+      header.wNumIntensityGrps    = gwNumIntensityGrps;
+      header.wIntensityMinAge     = gwIntensityMinAge;
+      header.wIntensityMaxAge     = gwIntensityMaxAge;
+      header.wCpdMinAge           = gwCpdMinAge;
+      header.wCpdMaxAge           = gwCpdMaxAge;
+      header.wInitProbRaceOffset  = gwInitProbRaceOffset;
+      header.wInitProbSexOffset   = gwInitProbSexOffset;
+      header.wInitProbYOBOffset   = gwInitProbYOBOffset;
+      header.wCessProbRaceOffset  = gwCessProbRaceOffset;
+      header.wCessProbSexOffset   = gwCessProbSexOffset;
+      header.wCessProbYOBOffset   = gwCessProbYOBOffset;
+      header.wNumSmokingGrps      = gwNumSmokingGrps;
+      header.lLifeTabAgeOffset    = glLifeTabAgeOffset;
+      header.lLifeTabRaceOffset   = glLifeTabRaceOffset;
+      header.lLifeTabSexOffset    = glLifeTabSexOffset;
+      header.lLifeTabYOBOffset    = glLifeTabYOBOffset;
+      header.lIntensityAgeOffset  = gwIntensityAgeOffset;
+      header.lIntensitySexOffset  = gwIntensitySexOffset;
+      header.lIntensityRaceOffset = gwIntensityRaceOffset;
+      header.lCpdAgeOffset        = glCpdAgeOffset;
+      header.lCpdRaceOffset       = glCpdRaceOffset;
+      header.lCpdSexOffset        = glCpdSexOffset;
+      header.lCpdYOBOffset        = glCpdYOBOffset;
+
+      pTables[BT_Initiation]        = gdInitiationProbs;
+      pTables[BT_Cessation]         = gdCessationProbs;
+      pTables[BT_LifeTable]         = gdLifeTableProbs;
+      pTables[BT_Intensity]         = gdIntensityProbs;
+      pTables[BT_CigarettesPerDay]  = gdCigarettesPerDay;
+      pTables[BT_CpdGroupCumProbs]  = gdCpdGroupCumProbs;
+      pTables[BT_CpdSwitchCumProbs] = gdCpdSwitchCumProbs;
+      pTables[BT_CohortStartYrs]    = gwYOBCohortStartYrs;
+      pTables[BT_CohortEndYrs]      = gwYOBCohortEndYrs;
+      pTables[BT_CohortIndex]       = gwYOBCohortIndex;
+
+      for (i = 0; i < BT_NumTables; i++) {
+         if (pTables[i] == NULL)
+            throw SimException("Error", "All of the data files must be loaded before writing a data bundle.\n");
+      }
+
+      // Lay out the tables after the header
+      GetBundleTableSizes(header.ullTableBytes);
+      ullOffset = sizeof(SmokingModelBundleHeader);
+      for (i = 0; i < BT_NumTables; i++) {
+         ullOffset = (ullOffset + SHG_BUNDLE_ALIGN - 1) / SHG_BUNDLE_ALIGN * SHG_BUNDLE_ALIGN;
+         header.ullTableOffset[i] = ullOffset;
+         ullOffset += header.ullTableBytes[i];
+      }
+      header.ullFileSize = (ullOffset + SHG_BUNDLE_ALIGN - 1) / SHG_BUNDLE_ALIGN * SHG_BUNDLE_ALIGN;
+
+      // Build the whole file in memory so the checksum can go in the header
+      pImage = new unsigned char[header.ullFileSize];
+      memset(pImage, 0, header.ullFileSize);
+      for (i = 0; i < BT_NumTables; i++) {
+         memcpy(pImage + header.ullTableOffset[i], pTables[i], header.ullTableBytes[i]);
+      }
+      memcpy(pImage, &header, sizeof(header));
+      header.ullChecksum = BundleChecksum(pImage + offsetof(SmokingModelBundleHeader, ullFileSize),
+                                         header.ullFileSize - offsetof(SmokingModelBundleHeader, ullFileSize));
+      memcpy(pImage, &header, sizeof(header));
+
+      pBundleFile = fopen(sBundleFile, "wb");
+      if (pBundleFile == NULL) {
+         sprintf(sErrorMessage, "The data bundle '%s' could not be opened for writing.\n", sBundleFile);
+         throw SimException("Error", sErrorMessage);
+      }
+      if (fwrite(pImage, 1, header.ullFileSize, pBundleFile) != header.ullFileSize || fclose(pBundleFile) != 0) {
+         pBundleFile = 0;
+         remove(sBundleFile);
+         sprintf(sErrorMessage, "Unable to write the data bundle '%s'.\n", sBundleFile);
+         throw SimException("Error", sErrorMessage);
+      }
+      pBundleFile = 0;
+      delete [] pImage;
+
+   } catch (SimException ex) {
+      if (pBundleFile != NULL)
+         fclose(pBundleFile);
+      delete [] pImage;
+      ex.AddCallPath("WriteBundle()");
+      throw ex;
+   }
+}
+
+// Is the file a data bundle (rather than a data directory)
+bool SmokingModel::IsBundleFile(const char* sFileName) {
+   char  sMagic[8];
+   bool  bReturnValue = false;
+   FILE *pBundleFile;
+
+   pBundleFile = fopen(sFileName, "rb");
+   if (pBundleFile != NULL) {
+      bReturnValue = (fread(sMagic, 1, sizeof(sMagic), pBundleFile) == sizeof(sMagic) &&
+                      memcmp(sMagic, SHG_BUNDLE_MAGIC, sizeof(sMagic)) == 0);
+      fclose(pBundleFile);
+   }
+   return bReturnValue;
+}
+
+// Map a data bundle written by WriteBundle and point the tables into it.
+// The checksum and the table sizes are verified, the values were validated when the bundle was compiled.
+void SmokingModel::LoadBundle(const char* sBundleFile) {
+
+   char                            sErrorMessage[500];
+   const SmokingModelBundleHeader *pHeader;
+   const unsigned char            *pData;
+   unsigned long long              ullExpectedBytes[BT_NumTables];
+   struct stat                     fileStatus;
+   void                           *pMapping;
+   int                             iFileDesc;
+   short                           i;
+
+   iFileDesc = open(sBundleFile, O_RDONLY);
+   if (iFileDesc < 0) {
+      sprintf(sErrorMessage, "The data bundle '%s' does not exist\n or could not be opened.\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+   if (fstat(iFileDesc, &fileStatus) != 0 || fileStatus.st_size < (off_t) sizeof(SmokingModelBundleHeader)) {
+      close(iFileDesc);
+      sprintf(sErrorMessage, "The file '%s' is not a data bundle.\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+   pMapping = mmap(0, (size_t) fileStatus.st_size, PROT_READ, MAP_PRIVATE, iFileDesc, 0);
+   close(iFileDesc);
+   if (pMapping == MAP_FAILED) {
+      sprintf(sErrorMessage, "Unable to map the data bundle '%s'.\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+   gpBundleData = pMapping;
+   gnBundleSize = (size_t) fileStatus.st_size;
+   pData        = (const unsigned char*) pMapping;
+   pHeader      = (const SmokingModelBundleHeader*) pMapping;
+
+   if (memcmp(pHeader->sMagic, SHG_BUNDLE_MAGIC, sizeof(pHeader->sMagic)) != 0) {
+      sprintf(sErrorMessage, "The file '%s' is not a data bundle.\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+   if (pHeader->uiVersion != SHG_BUNDLE_VERSION || pHeader->uiHeaderSize != sizeof(SmokingModelBundleHeader) ||
+       pHeader->uiByteOrder != SHG_BUNDLE_BYTE_ORDER || pHeader->uiLongDoubleSize != sizeof(long double)) {
+      sprintf(sErrorMessage, "The data bundle '%s' was written by a different version or build of the application.\n\
+Compile the bundle again from the data files with compile-data.\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+   if (pHeader->ullFileSize != (unsigned long long) gnBundleSize || gnBundleSize % 8 != 0 ||
+       pHeader->ullChecksum != BundleChecksum(pData + offsetof(SmokingModelBundleHeader, ullFileSize),
+                                              gnBundleSize - offsetof(SmokingModelBundleHeader, ullFileSize))) {
+      sprintf(sErrorMessage, "The data bundle '%s' is damaged (checksum mismatch).\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+
+   gullDataHash          = pHeader->ullDataHash;
+   gwNumBirthCohorts     = pHeader->wNumBirthCohorts;
+   gwNumRaceValues       = pHeader->wNumRaceValues;
+   gwNumSexValues        = pHeader->wNumSexValues;
+   gwMinInitiationAge    = pHeader->wMinInitiationAge;
+   gwMinCessationAge     = pHeader->wMinCessationAge;
+   gwMaxInitiationAge    = pHeader->wMaxInitiationAge;
+   gwMaxCessationAge     = pHeader->wMaxCessationAge;
+   gwMinLifeTableAge     = pHeader->wMinLifeTableAge;
+   gwMaxLifeTableAge     = pHeader->wMaxLifeTableAge;
+   gwMinLifeTableYear    = pHeader->wMinLifeTableYear;
+   gwMaxLifeTableYear    = pHeader->wMaxLifeTableYear;
+   gwNumIntensityGrps    = pHeader->wNumIntensityGrps;
+   gwIntensityMinAge     = pHeader->wIntensityMinAge;
+   gwIntensityMaxAge     = pHeader->wIntensityMaxAge;
+   gwCpdMinAge           = pHeader->wCpdMinAge;
+   gwCpdMaxAge           = pHeader->wCpdMaxAge;
+   gwInitProbRaceOffset  = pHeader->wInitProbRaceOffset;
+   gwInitProbSexOffset   = pHeader->wInitProbSexOffset;
+   gwInitProbYOBOffset   = pHeader->wInitProbYOBOffset;
+   gwCessProbRaceOffset  = pHeader->wCessProbRaceOffset;
+   gwCessProbSexOffset   = pHeader->wCessProbSexOffset;
+   gwCessProbYOBOffset   = pHeader->wCessProbYOBOffset;
+   gwNumSmokingGrps      = pHeader->wNumSmokingGrps;
+   glLifeTabAgeOffset    = pHeader->lLifeTabAgeOffset;
+   glLifeTabRaceOffset   = pHeader->lLifeTabRaceOffset;
+   glLifeTabSexOffset    = pHeader->lLifeTabSexOffset;
+   glLifeTabYOBOffset    = pHeader->lLifeTabYOBOffset;
+   gwIntensityAgeOffset  = pHeader->lIntensityAgeOffset;
+   gwIntensitySexOffset  = pHeader->lIntensitySexOffset;
+   gwIntensityRaceOffset = pHeader->lIntensityRaceOffset;
+   glCpdAgeOffset        = pHeader->lCpdAgeOffset;
+   glCpdRaceOffset       = pHeader->lCpdRaceOffset;
+   glCpdSexOffset        = pHeader->lCpdSexOffset;
+   glCpdYOBOffset        = pHeader->lCpdYOBOffset;
+
+   // The cohort years are needed to size the cohort index, check they are in the file before using them
+   for (i = 0; i < BT_NumTables; i++) {
+      if (pHeader->ullTableOffset[i] % SHG_BUNDLE_ALIGN != 0 || pHeader->ullTableOffset[i] > gnBundleSize ||
+          pHeader->ullTableBytes[i] > gnBundleSize - pHeader->ullTableOffset[i]) {
+         sprintf(sErrorMessage, "The data bundle '%s' has an invalid table layout.\n", sBundleFile);
+         throw SimException("LoadBundle()", sErrorMessage);
+      }
+   }
+   gwYOBCohortStartYrs = (short*)(pData + pHeader->ullTableOffset[BT_CohortStartYrs]);
+   gwYOBCohortEndYrs   = (short*)(pData + pHeader->ullTableOffset[BT_CohortEndYrs]);
+   if (gwNumBirthCohorts <= 0 || pHeader->ullTableBytes[BT_CohortStartYrs] != gwNumBirthCohorts * sizeof(short) ||
+       pHeader->ullTableBytes[BT_CohortEndYrs] != gwNumBirthCohorts * sizeof(short)) {
+      sprintf(sErrorMessage, "The data bundle '%s' has an invalid table layout.\n", sBundleFile);
+      throw SimException("LoadBundle()", sErrorMessage);
+   }
+   GetBundleTableSizes(ullExpectedBytes);
+   for (i = 0; i < BT_NumTables; i++) {
+      if (pHeader->ullTableBytes[i] != ullExpectedBytes[i]) {
+         sprintf(sErrorMessage, "The data bundle '%s' has an invalid table layout.\n", sBundleFile);
+         throw SimException("LoadBundle()", sErrorMessage);
+      }
+   }
+
+   // The model is never modified after loading, the tables are used in place (read only)
+   gdInitiationProbs   = (double*)(pData + pHeader->ullTableOffset[BT_Initiation]);
+   gdCessationProbs    = (double*)(pData + pHeader->ullTableOffset[BT_Cessation]);
+   gdLifeTableProbs    = (double*)(pData + pHeader->ullTableOffset[BT_LifeTable]);
+   gdIntensityProbs    = (double*)(pData + pHeader->ullTableOffset[BT_Intensity]);
+   gdCigarettesPerDay  = (long double*)(pData + pHeader->ullTableOffset[BT_CigarettesPerDay]);
+   gdCpdGroupCumProbs  = (double*)(pData + pHeader->ullTableOffset[BT_CpdGroupCumProbs]);
+   gdCpdSwitchCumProbs = (double*)(pData + pHeader->ullTableOffset[BT_CpdSwitchCumProbs]);
+   gwYOBCohortIndex    = (short*)(pData + pHeader->ullTableOffset[BT_CohortIndex]);
+}
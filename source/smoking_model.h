@@ -0,0 +1,177 @@
+// CISNET (www.cisnet.cancer.gov)
+// Lung Cancer Base Case Group
+// Smoking History Simulation Application
+// Application to Simulate Initiation and Cessation Ages of individuals based on sex, race and year of birth.
+// File: smoking_model.h
+// Author: Martin Krapcho & Ben Racine
+// E-Mail: KrapchoM@imsweb.com & ben.racine@cornerstonenw.com
+// NCI Contacts: Rocky Feuer
+// Version 6.2.3
+
+#ifndef _SMOKING_MODEL_H
+#define _SMOKING_MODEL_H
+
+#include "sim_exception.h"
+#include <stddef.h>
+
+// The probability and cigarettes per day tables used by the Smoking History Simulator.
+// The tables are loaded from the data files when the model is constructed and are never
+// modified afterwards, so a single model can be shared (const) by any number of
+// Smoking_Simulator objects, including simulators running on different threads.
+class SmokingModel {
+
+   friend class Smoking_Simulator;
+
+   // Labels and Enumerated Data Types for the class
+   public:
+
+      enum DataType {DATA_Initiation = 1, DATA_Cessation};
+
+      // The data files, in the order they are passed to the constructor
+      enum DataFile {FILE_Initiation = 0, FILE_Cessation, FILE_LifeTable, FILE_CpdIntensity, FILE_Cpd, FILE_NumFiles};
+
+      // Columns of data in the other COD Life Table file
+      enum LifeTableColumns {COL_Never = 0, COL_Current_Q1, COL_Current_Q2, COL_Current_Q3, COL_Current_Q4, COL_Current_Q5, COL_NumColumns};
+
+ 	// Private Member Variables
+   private:
+
+      // Probability Arrays
+      double *gdInitiationProbs;  // Prob of initiation by race/sex/year of birth and age
+      double *gdCessationProbs;   // Prob of cessation by race/sex/year of birth and age
+      double *gdLifeTableProbs;   // Prob of COD other than lung cancer by race/sex/year of birth/age and smoking status
+      double *gdIntensityProbs;   // Prob of being a light to heavy smoker (for individuals that begin smoking)
+
+      // Cigarettes per day by race, sex, YOB and age (and smoking intensity? %bjr)
+      long double *gdCigarettesPerDay;
+
+      // Smoking intensity group tables built from gdCigarettesPerDay (same offsets) when it is loaded
+      double *gdCpdGroupCumProbs;   // Cumulative prob of being in intensity group 0..j at each age
+      double *gdCpdSwitchCumProbs;  // Cumulative change in the group probs from each age to the next
+
+      // Start of the ages of each race/sex/birth cohort slice of the tables above, the simulator reads the
+      // tables through these. A slice points into its table unless an overlay changed it (then it is a copy).
+      double      **gpInitiationSlices;
+      double      **gpCessationSlices;
+      long double **gpCpdSlices;
+      double      **gpCpdGroupCumSlices;
+      double      **gpCpdSwitchCumSlices;
+
+      // Data limit variables
+      short gwNumBirthCohorts;    // Number of birth cohorts Available
+      short *gwYOBCohortStartYrs; // Starting year for each of the birth cohort groups
+      short *gwYOBCohortEndYrs;   // Ending year for each of the birth cohort groups
+      short *gwYOBCohortIndex;    // Birth cohort group by year of birth (from gwYOBCohortStartYrs[0]), -1 between cohorts
+      short gwNumRaceValues;      // Number of Races Available
+      short gwNumSexValues;       // Number of Sexes Available
+      short gwMinInitiationAge;   // Min initiation age (assumed constant for all cohort groups)
+      short gwMinCessationAge;    // Min cessation age (assumed constant for all cohort groups)
+      short gwMaxInitiationAge;   // Max initiation age (Max possible age, data may quit before max age)
+      short gwMaxCessationAge;    // Max cessation age (Max possible age, data may quit before max age)
+      short gwMinLifeTableAge;
+      short gwMaxLifeTableAge;
+      short gwMinLifeTableYear;
+      short gwMaxLifeTableYear;
+      short gwNumIntensityGrps;   // Number of CPD Intesity groups
+      short gwIntensityMinAge;    // Minimum age among the smoking intensity group probabilities
+      short gwIntensityMaxAge;    // Maximum age among the smoking intensity group probabilities
+      short gwCpdMinAge;          // Minimum age in the cigarettes per day data
+      short gwCpdMaxAge;          // Maximum age in the cigarettes per day data
+
+      // Offset values for Probability Arrays
+      short gwInitProbRaceOffset; // Initiation Array - Race Offset
+      short gwInitProbSexOffset;  // Initiation Array - Sex Offset
+      short gwInitProbYOBOffset;  // Initiation Array - YOB Offset
+      short gwCessProbRaceOffset; // Cessation Array  - Race Offset
+      short gwCessProbSexOffset;  // Cessation Array  - Sex Offset
+      short gwCessProbYOBOffset;  // Cessation Array  - YOB Offset
+      long  glLifeTabAgeOffset;   // Other COD Array  - Age Offset
+      long  glLifeTabRaceOffset;  // Other COD Array  - Race Offset
+      long  glLifeTabSexOffset;   // Other COD Array  - Sex Offset
+      long  glLifeTabYOBOffset;   // Other COD Array  - YOB Offset
+      long  gwIntensityAgeOffset; // Smoking Intesity Array - Age Offset
+      long  gwIntensitySexOffset;
+      long  gwIntensityRaceOffset;
+      long  glCpdAgeOffset;       // Cigarettes per Day Array  - Age Offset
+      long  glCpdRaceOffset;      // Cigarettes per Day Array  - Race Offset
+      long  glCpdSexOffset;       // Cigarettes per Day Array  - Sex Offset
+      long  glCpdYOBOffset;       // Cigarettes per Day Array  - YOB Offset
+
+      short gwNumSmokingGrps;
+
+      unsigned long long gullDataHash;  // FNV-1a hash of the contents of the data files (identifies the inputs in binary output)
+      unsigned long long gullFileHashes[FILE_NumFiles];  // FNV-1a hash of each data file on its own (used by Reload)
+      char *gsDataFiles[FILE_NumFiles];  // Names of the data files the tables were loaded from (0 when mapped from a bundle)
+      bool  gbSharedTables[FILE_NumFiles];  // Tables of the file belong to another model (see the scenario constructor)
+
+      void   *gpBundleData;       // Mapped data bundle the tables point into (0 = tables loaded from the text files)
+      size_t  gnBundleSize;       // Size of the mapped data bundle in bytes
+
+      SmokingModel();
+
+      void Init();
+      void Free();
+      void ApplyOverlay(const char* sOverlayFile);
+      void BuildSlices();
+      void FreeSlices();
+      void CopyTables(const SmokingModel& source, DataFile eFile, bool bShare = false);
+      void ForgetTables(DataFile eFile);
+      void LoadChangedFiles(const SmokingModel& previous, short& wNumFilesParsed);
+      void LoadSharedFiles(const SmokingModel* const* pLoadedModels, short wNumModels);
+      const SmokingModel* FindLoadedFile(DataFile eFile, const SmokingModel* const* pLoadedModels, short wNumModels) const;
+      bool HasSameCohorts(const SmokingModel& other) const;
+      void SetDataFileName(DataFile eFile, const char* sDataFileName);
+      void LoadCPDIntensityProbs(const char* sDataFileName);
+      void LoadCPDFile(const char* sCpdDataFile);
+      void BuildCPDSwitchTables();
+      void BuildCPDSwitchSlice(const long double* pCpd, double* pGroupCumProbs, double* pSwitchCumProbs);
+      void BuildYOBCohortIndex();
+      void LoadOtherCODFile(const char* sLifeTableFileName);
+      void LoadProbabilityData(const char* sDataFileName, DataType eFileType);
+      void HashDataFile(DataFile eFile);
+      void LoadBundle(const char* sBundleFile);
+      void GetBundleTableSizes(unsigned long long *ullTableBytes) const;
+
+   public:
+      SmokingModel(const char* sInitiationProbFile, const char* sCessationProbFile,
+                   const char* sLifeTableFile,      const char* sCpdIntensityProbFile,
+                   const char* sCpdDataFile);
+
+      // Load the data files of one scenario of a multi-scenario run. A file with the same contents as a file already
+      // loaded by one of the wNumModels models in pLoadedModels is not parsed, this model uses that model's tables.
+      // The models in pLoadedModels must not be deleted before this one.
+      SmokingModel(const char* sInitiationProbFile, const char* sCessationProbFile,
+                   const char* sLifeTableFile,      const char* sCpdIntensityProbFile,
+                   const char* sCpdDataFile,        const SmokingModel* const* pLoadedModels,
+                   short wNumModels);
+
+      // A scenario made by applying the transforms of an overlay file to the tables of base. Only the
+      // race/sex/cohort slices the transforms change are copied, the rest of the tables belong to base.
+      // base must not be deleted before this model.
+      SmokingModel(const SmokingModel& base, const char* sOverlayFile);
+
+      // Map the tables of a data bundle written by WriteBundle
+      SmokingModel(const char* sBundleFile);
+
+      ~SmokingModel();
+
+      short GetMaxYearOfBirth() const;
+      short GetMinYearOfBirth() const;
+      short GetNumRaceValues() const { return gwNumRaceValues;};
+      short GetNumSexValues() const { return gwNumSexValues;};
+      short GetYOBCohortGroup(short wYearBirth) const;
+      long GetCohortSlice(short wRace, short wSex, short wCohort) const
+         { return (long(wRace) * gwNumSexValues + wSex) * gwNumBirthCohorts + wCohort;};
+      unsigned long long GetDataHash() const { return gullDataHash;};
+      bool IsSharedFile(DataFile eFile) const { return gbSharedTables[eFile];};
+      void WriteBundle(const char* sBundleFile) const;
+
+      // Load the data files again, parsing only the files whose contents changed since this model was loaded
+      // (and the files checked against them). Returns a new model, or 0 if none of the files changed.
+      // This model is not modified, simulators using it can finish before it is deleted.
+      SmokingModel* Reload(short& wNumFilesParsed) const;
+      static bool IsBundleFile(const char* sFileName);
+};
+
+#endif
+
@@ -14,38 +14,153 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
+#include <pthread.h>
 
 using namespace std;
 
-// Constructor
+// Processing states for a block of individuals in the multi-threaded engine
+enum SimChunkState {CHUNK_Empty = 0, CHUNK_Ready, CHUNK_Running, CHUNK_Done};
+
+// A block of consecutive records from the input file.
+// Formatted results are written to a temporary file so they can be copied
+// to the output file in input order once the block is finished.
+struct SimChunk {
+   long           lChunkIndex;                // Position of the block within the input file
+   long           lNumRecords;                // Number of individuals in the block
+   short          wRace[SIM_CHUNK_SIZE];
+   short          wSex[SIM_CHUNK_SIZE];
+   short          wYOB[SIM_CHUNK_SIZE];
+   SimulationContext *pStartState;            // PRNG states at the start of the block
+   FILE          *pResults;                   // Temporary file holding the formatted results
+   long           lResultsLength;             // Bytes written to pResults for the current block
+   SimException  *pError;                     // Error raised while simulating the block (0 = none)
+   SimChunkState  eState;
+};
+
+// Work queue shared by the calling thread and the worker threads.
+// Blocks are placed in a ring of wNumSlots slots, block i uses slot (i % wNumSlots).
+struct SimThreadPool {
+   pthread_mutex_t   mutex;
+   pthread_cond_t    condWorkReady;           // Signalled when a block is queued or the pool is shut down
+   pthread_cond_t    condWorkDone;            // Signalled when a worker finishes a block
+   SimChunk         *pChunks;
+   short             wNumSlots;
+   long              lNumQueued;              // Number of blocks placed in the ring so far
+   long              lNextToRun;              // Index of the next block to hand to a worker
+   bool              bShutdown;
+};
+
+// A worker thread and the simulator it owns
+struct SimWorker {
+   SimThreadPool     *pPool;
+   Smoking_Simulator *pSimulator;
+   pthread_t          thread;
+   bool               bStarted;
+};
+
+// Reads the input file one person at a time.
+// A record is "Race;Sex;YOB" or "Race;Sex;YOB;Count" for Count people with the same values, the people
+// of a record are handed out without reading the file again. A file whose first line is "PYRAMID;Year"
+// is a population pyramid, its records are "Race;Sex;Age;Count" for people of that age in Year.
+struct SimInputReader {
+   FILE          *pFile;
+   short          wRace;                      // Values of the current record
+   short          wSex;
+   short          wYOB;
+   long           lRemaining;                 // People of the current record not handed out yet
+   short          wPyramidYear;               // Year of the population pyramid (0 = not a pyramid)
+   long           lLineNumber;
+};
+
+static void InitInputReader(SimInputReader& input, FILE* pFile) {
+   input.pFile        = pFile;
+   input.lRemaining   = 0;
+   input.wPyramidYear = 0;
+   input.lLineNumber  = 0;
+}
+
+// Get the next person from the input, returns false at the end of the file
+static bool ReadNextPerson(SimInputReader& input, short& wRace, short& wSex, short& wYOB) {
+   char  sCurrInputLine[101],
+         sErrorMessage[200],
+        *pTokenPtr,
+        *pEndPtr;
+   short wValues[3],
+         i;
+   long  lCount;
+
+   while (input.lRemaining == 0) {
+      if (!fgets(sCurrInputLine, 100, input.pFile))
+         return false;
+      input.lLineNumber++;
+
+      if (input.lLineNumber == 1 && (strncmp(sCurrInputLine, "PYRAMID;", 8) == 0 || strncmp(sCurrInputLine, "pyramid;", 8) == 0)) {
+         lCount = strtol(sCurrInputLine + 8, &pEndPtr, 10);
+         if (pEndPtr == sCurrInputLine + 8 || lCount <= 0 || lCount > 32767 ||
+             strspn(pEndPtr, " \t\r\n") != strlen(pEndPtr)) {
+            throw SimException("ERROR", "The first line of a population pyramid input file must be PYRAMID;Year.\n");
+         }
+         input.wPyramidYear = (short) lCount;
+         continue;
+      }
+
+      pTokenPtr = strtok(sCurrInputLine, ";");
+      if (pTokenPtr == 0 || strspn(pTokenPtr, " \t\r\n") == strlen(pTokenPtr))
+         continue;   // Blank line
+      for (i = 0; i < 3; i++) {
+         if (pTokenPtr == 0) {
+            sprintf(sErrorMessage, "Line %ld of the input file does not have 3 values.\n", input.lLineNumber);
+            throw SimException("ERROR", sErrorMessage);
+         }
+         wValues[i] = atoi(pTokenPtr);
+         pTokenPtr  = strtok(NULL, ";");
+      }
+
+      // Optional count, a record without one (or with a blank one, "Race;Sex;YOB;") is a single person
+      lCount = 1;
+      if (pTokenPtr != 0 && strspn(pTokenPtr, " \t\r\n") != strlen(pTokenPtr)) {
+         lCount = strtol(pTokenPtr, &pEndPtr, 10);
+         if (pEndPtr == pTokenPtr || lCount < 0 || strspn(pEndPtr, " \t\r\n") != strlen(pEndPtr)) {
+            sprintf(sErrorMessage, "Invalid count on line %ld of the input file.\n", input.lLineNumber);
+            throw SimException("ERROR", sErrorMessage);
+         }
+         pTokenPtr = strtok(NULL, ";");
+         if (pTokenPtr != 0 && strspn(pTokenPtr, " \t\r\n") != strlen(pTokenPtr)) {
+            sprintf(sErrorMessage, "Line %ld of the input file has more than 4 values.\n", input.lLineNumber);
+            throw SimException("ERROR", sErrorMessage);
+         }
+      }
+
+      input.wRace      = wValues[0];
+      input.wSex       = wValues[1];
+      input.wYOB       = (input.wPyramidYear > 0) ? input.wPyramidYear - wValues[2] : wValues[2];
+      input.lRemaining = lCount;
+   }
+
+   wRace = input.wRace;
+   wSex  = input.wSex;
+   wYOB  = input.wYOB;
+   input.lRemaining--;
+   return true;
+}
+
+// Constructor, loads the data tables from the files provided
 Smoking_Simulator::Smoking_Simulator(const char* sInitiationProbFile, const char* sCessationProbFile,
                                      const char* sLifeTableFile,      const char* sCpdIntensityProbFile,
                                      const char* sCpdDataFile,        unsigned long ulInitPRNGSeed,
                                      unsigned long ulCessPRNGSeed,    unsigned long ulLifeTabSeed,
                                      unsigned long ulIndivRndsSeed,   short wOutputType,
                                      short wCessationYear) {
-   char sErrorMessage[300];
-
    try {
       Init();
-      LoadProbabilityData(sInitiationProbFile, Smoking_Simulator::DATA_Initiation);
-      LoadProbabilityData(sCessationProbFile, Smoking_Simulator::DATA_Cessation);
-      LoadCPDIntensityProbs(sCpdIntensityProbFile);
-      LoadCPDFile(sCpdDataFile);
-      LoadOtherCODFile(sLifeTableFile);
-      InitPRNGs(ulInitPRNGSeed, ulCessPRNGSeed, ulLifeTabSeed, ulIndivRndsSeed);
+      gpOwnedModel = new SmokingModel(sInitiationProbFile, sCessationProbFile, sLifeTableFile,
+                                      sCpdIntensityProbFile, sCpdDataFile);
+      gpModel      = gpOwnedModel;
+      gpContext    = new SimulationContext(ulInitPRNGSeed, ulCessPRNGSeed, ulLifeTabSeed, ulIndivRndsSeed);
+      gpWriter     = new OutputWriter();
+      BuildExcessRiskTable();
       SetOutputType(wOutputType);
-
-      // Immediate Cessation Values are initialized to 0 and false respectively, 
-      // Check to see if they need to be changed.
-      if ((wCessationYear != 0) || (wCessationYear >= wMIN_IMMEDIATE_CESSATION_YEAR && wCessationYear <= wSIM_CUTOFF_YEAR)) {
-         gwImmediateCessYear = wCessationYear;
-         gbImmediateCessation = true;
-      } else if ( wCessationYear != 0) {
-         sprintf(sErrorMessage, "Invalid Value for Immediate Cessation Year.\n \
-            Valid values are 0 and the range %d to %d.\n", wMIN_IMMEDIATE_CESSATION_YEAR, wSIM_CUTOFF_YEAR);
-         throw SimException("Error", sErrorMessage);
-      }
+      SetImmediateCessation(wCessationYear);
     } catch (SimException ex) {
       ex.AddCallPath("Smoking_Simulator()");
       Free();
@@ -53,6 +168,29 @@ Smoking_Simulator::Smoking_Simulator(const char* sInitiationProbFile, const char
     }
 }
 
+// Constructor, shares a model that has already been loaded.
+// Only the PRNGs and person variables are created, so this is cheap enough to do once per thread.
+Smoking_Simulator::Smoking_Simulator(const SmokingModel* pModel,      unsigned long ulInitPRNGSeed,
+                                     unsigned long ulCessPRNGSeed,    unsigned long ulLifeTabSeed,
+                                     unsigned long ulIndivRndsSeed,   short wOutputType,
+                                     short wCessationYear) {
+   try {
+      Init();
+      if (pModel == NULL)
+         throw SimException("Error", "The smoking model supplied to the simulator has not been loaded.\n");
+      gpModel   = pModel;
+      gpContext = new SimulationContext(ulInitPRNGSeed, ulCessPRNGSeed, ulLifeTabSeed, ulIndivRndsSeed);
+      gpWriter  = new OutputWriter();
+      BuildExcessRiskTable();
+      SetOutputType(wOutputType);
+      SetImmediateCessation(wCessationYear);
+    } catch (SimException ex) {
+      ex.AddCallPath("Smoking_Simulator(const SmokingModel*)");
+      Free();
+      throw ex;
+    }
+}
+
 // Destructor
 Smoking_Simulator::~Smoking_Simulator() {
    Free();
@@ -80,6 +218,7 @@ void Smoking_Simulator::CalcCigarettesPerDay() {
             i;
    long     lCpdStartIndex,       // Index to start at for look up of cigarettes per day
             lCurrCpdIndex;        // Current index in cigarettes per day array
+   const long double *pCigarettesPerDay;  // Cigarettes per day table slice for the person's race, sex and cohort
    double   dIntensityProb,       // Probability to find in the lookup tables
             dCpsForStartAge,      // The cigarettes per day for first age (in birth cohort) that has Cigarettes per day data
             dUptake,              // Uptake formula results for persons current age
@@ -90,118 +229,116 @@ void Smoking_Simulator::CalcCigarettesPerDay() {
 
    try {
 
-      if (gdCigarettesPerDay == 0 || gdIntensityProbs == 0 || gpIndivRndsPRNG == 0) {
+      if (gpModel->gdCigarettesPerDay == 0 || gpModel->gdIntensityProbs == 0 || gpContext->gpIndivRndsPRNG == 0) {
          throw SimException("Error", "One or more of the data components for cigarettes \nper \
             day calculation has not been initialized.\n");
       }
-      if (gwPersonsInitAge == -999) {
+      if (gpContext->gwPersonsInitAge == -999) {
          throw SimException("Error", "CalcCigarettesPerDay should not be called for \nindividuals \
             that do not initiate smoking.\n");
       }
 
       // Get the probability for the quintile lookup
-      dIntensityProb = GetNextRandForIndiv();
+      dIntensityProb = gpContext->GetNextRandForIndiv();
 
       // Get the age for intensity probabilities lookup
       // Initiation Ages below the min age use the min intensity age probabilities
-      if (gwPersonsInitAge < gwIntensityMinAge) {      
-         wIntensityLookupAge = gwIntensityMinAge;
+      if (gpContext->gwPersonsInitAge < gpModel->gwIntensityMinAge) {      
+         wIntensityLookupAge = gpModel->gwIntensityMinAge;
       // Initiation Ages above the max age use the max intensity age probabilities
-      } else if (gwPersonsInitAge > gwIntensityMaxAge) {
-         wIntensityLookupAge = gwIntensityMaxAge;
+      } else if (gpContext->gwPersonsInitAge > gpModel->gwIntensityMaxAge) {
+         wIntensityLookupAge = gpModel->gwIntensityMaxAge;
       // Otherwise look up the initiation age
       } else {
-         wIntensityLookupAge = gwPersonsInitAge;
+         wIntensityLookupAge = gpContext->gwPersonsInitAge;
       }
 
       // Set the starting point for the lookup (Age - min age) * age offset
       bValueFound = false;
-      wIntensityIndex = (wIntensityLookupAge - gwIntensityMinAge) * gwIntensityAgeOffset;
+      wIntensityIndex = (wIntensityLookupAge - gpModel->gwIntensityMinAge) * gpModel->gwIntensityAgeOffset;
 
       // Loop through Intensity probabilities to find quintile for person
-      for (i = 0; i < (gwNumIntensityGrps - 1) && !bValueFound; i++) {
-         if (dIntensityProb <  gdIntensityProbs[i + wIntensityIndex]) {
-            gwPersonsSmkIntensity = (SmokingIntensity) i;
+      for (i = 0; i < (gpModel->gwNumIntensityGrps - 1) && !bValueFound; i++) {
+         if (dIntensityProb <  gpModel->gdIntensityProbs[i + wIntensityIndex]) {
+            gpContext->gwPersonsSmkIntensity = (SmokingIntensity) i;
             bValueFound = true;
          }
       }
       // If the value was not found, assume that the probabilties did not correctly sum to one, 
       // and assign the person to the last quintile
       if (!bValueFound) {
-         gwPersonsSmkIntensity = (SmokingIntensity)(SMKR_NumGroups - 1);
+         gpContext->gwPersonsSmkIntensity = (SmokingIntensity)(SMKR_NumGroups - 1);
       }
 
-      gdTempIntensityProb = dIntensityProb;
+      gpContext->gdTempIntensityProb = dIntensityProb;
 
       // Set up the array for storing the number of cigarettes smoked per day by age
-      if (gwPersonsCessAge == -999) { 
+      if (gpContext->gwPersonsCessAge == -999) { 
          // Person does not quit smoking
-         wYearsAsSmoker = (wSIM_CUTOFF_YEAR - (gwPersonsYOB + gwPersonsInitAge)) + 1;
+         wYearsAsSmoker = (wSIM_CUTOFF_YEAR - (gpContext->gwPersonsYOB + gpContext->gwPersonsInitAge)) + 1;
       } else {
          // Person will quit at some time
-         wYearsAsSmoker = (gwPersonsCessAge - gwPersonsInitAge) + 1;
+         wYearsAsSmoker = (gpContext->gwPersonsCessAge - gpContext->gwPersonsInitAge) + 1;
       }
-      gdPersonsCPDbyAge = new double[wYearsAsSmoker];
+      gpContext->ReserveCPDbyAge(wYearsAsSmoker);
       for ( i = 0; i < wYearsAsSmoker; i++) {
-         gdPersonsCPDbyAge[i] = 0;
+         gpContext->gdPersonsCPDbyAge[i] = 0;
       }
 
       // Find the age at which the cigarette per day numbers begin for the persons YOB
       // In most cases this is age 30, but for those born in 1975-1979 or 1980-1984, the ages are lower (26 and 21)
       bValueFound      = false;
-      lCpdStartIndex   = (glCpdRaceOffset * (gwPersonsRace)) +
-                         (glCpdSexOffset  * (gwPersonsSex))  +
-                         (glCpdYOBOffset  * GetYOBCohortGroup(gwPersonsYOB)) +
-                         (long)gwPersonsSmkIntensity;
+      pCigarettesPerDay = gpModel->gpCpdSlices[gpContext->glPersonsSlice];
+      lCpdStartIndex   = (long)gpContext->gwPersonsSmkIntensity;
       lCurrCpdIndex    = lCpdStartIndex;
 
       while (!bValueFound) {
-         if (gdCigarettesPerDay[lCurrCpdIndex] >= 0) {
+         if (pCigarettesPerDay[lCurrCpdIndex] >= 0) {
             bValueFound = true;
-            wStartAgeInCpdData = (short)(((lCurrCpdIndex - lCpdStartIndex) / glCpdAgeOffset) + gwCpdMinAge);
+            wStartAgeInCpdData = (short)(((lCurrCpdIndex - lCpdStartIndex) / gpModel->glCpdAgeOffset) + gpModel->gwCpdMinAge);
             lCpdStartIndex = lCurrCpdIndex;
          } else {
-            lCurrCpdIndex += glCpdAgeOffset;
+            lCurrCpdIndex += gpModel->glCpdAgeOffset;
          }
       }
 
       // Use the uptake formula to calculate the cigarettes per day before age 30
       // The age is lower (26 and 21) for the later birth cohorts (1975-1979 and 1980-1984)
       // In the notes below only age 30 will be referenced but it applies to ages 26 & 21 when necessary
-      if (gwPersonsInitAge < wStartAgeInCpdData) {
+      if (gpContext->gwPersonsInitAge < wStartAgeInCpdData) {
 
-         if ( gwPersonsYOB >= 1900) {
-            wPersonsYOB = gwPersonsYOB;
+         if ( gpContext->gwPersonsYOB >= 1900) {
+            wPersonsYOB = gpContext->gwPersonsYOB;
          } else {
             wPersonsYOB = 1900;
          }
 
          // Get age at which to stop the uptake loop
-         wEndLoop = min(wStartAgeInCpdData, (short)(gwPersonsInitAge + wYearsAsSmoker));
+         wEndLoop = min(wStartAgeInCpdData, (short)(gpContext->gwPersonsInitAge + wYearsAsSmoker));
 
          // Calculate the uptake formulas value at the age where the cigarette per day numbers begin
-         if (gwPersonsSex == SEX_Male) {
-            dUptakeAtCpdStart = -38.578 + (3.342 * (sqrt(wStartAgeInCpdData - gwPersonsInitAge))) -
+         if (gpContext->gwPersonsSex == SEX_Male) {
+            dUptakeAtCpdStart = -38.578 + (3.342 * (sqrt(wStartAgeInCpdData - gpContext->gwPersonsInitAge))) -
                                 (0.00168 * pow(max(79, ((wPersonsYOB + wStartAgeInCpdData) - 1900 )), 2)) -
                                 (17.538 * sqrt(wStartAgeInCpdData)) + (44.967 * log(wStartAgeInCpdData));
-         } else if (gwPersonsSex == SEX_Female) {
-            dUptakeAtCpdStart = -56.751 + (0.700*(wStartAgeInCpdData - gwPersonsInitAge)) -
+         } else if (gpContext->gwPersonsSex == SEX_Female) {
+            dUptakeAtCpdStart = -56.751 + (0.700*(wStartAgeInCpdData - gpContext->gwPersonsInitAge)) -
                                 (0.00163 * pow(max(79, ((wPersonsYOB + wStartAgeInCpdData) - 1900)), 2)) -
                                 (3.473 * wStartAgeInCpdData) + (32.800 * sqrt(wStartAgeInCpdData));
          }
 
          // Calculate the Quintile Scaling factor as (cigarettes per day at age 30)/(Uptake at age 30)
-         dScalingFactor = gdCigarettesPerDay[lCpdStartIndex] / dUptakeAtCpdStart;
+         dScalingFactor = pCigarettesPerDay[lCpdStartIndex] / dUptakeAtCpdStart;
 
-         for (i = gwPersonsInitAge; i < wEndLoop; i++) {
+         for (i = gpContext->gwPersonsInitAge; i < wEndLoop; i++) {
 
-            if (gwPersonsSex == SEX_Male) {
-               dUptake = -38.578 + (3.342 * (sqrt(i - gwPersonsInitAge))) -
+            if (gpContext->gwPersonsSex == SEX_Male) {
+               dUptake = -38.578 + (3.342 * (sqrt(i - gpContext->gwPersonsInitAge))) -
                          (0.00168 * pow(max(79, ((wPersonsYOB + i) - 1900)), 2)) -
                          (17.538 * sqrt(i)) + (44.967 * log(i));
 
-            } else if (gwPersonsSex == SEX_Female) {
-               dUptake = -56.751 + (0.700 * (i - gwPersonsInitAge)) -
+            } else if (gpContext->gwPersonsSex == SEX_Female) {
+               dUptake = -56.751 + (0.700 * (i - gpContext->gwPersonsInitAge)) -
                          (0.00163 * pow(max(79, ((wPersonsYOB + i) - 1900)), 2)) -
                          (3.473 * i) + (32.800 * sqrt(i));
             }
@@ -211,33 +348,33 @@ void Smoking_Simulator::CalcCigarettesPerDay() {
                dUptake = 0.10;
             }
 
-            gdPersonsCPDbyAge[i - gwPersonsInitAge] = dScalingFactor * dUptake;
-            dSumOfCpd += gdPersonsCPDbyAge[i - gwPersonsInitAge];
+            gpContext->gdPersonsCPDbyAge[i - gpContext->gwPersonsInitAge] = dScalingFactor * dUptake;
+            dSumOfCpd += gpContext->gdPersonsCPDbyAge[i - gpContext->gwPersonsInitAge];
          }
       }
 
       // If the persons started smoking before age 30, fill in the cig per day for ages 30+ (if they didn't quit before 30
       // Other wise if they started smoking after age 30, fill in the cigarettes per day array starting at that age.
-      if (gwPersonsInitAge <= wStartAgeInCpdData) {
+      if (gpContext->gwPersonsInitAge <= wStartAgeInCpdData) {
          wLookupStartAge = wStartAgeInCpdData;
       } else {
-         wLookupStartAge = gwPersonsInitAge;
+         wLookupStartAge = gpContext->gwPersonsInitAge;
       }
 
       // Fill in the Cigarettes per day for ages 30+ directly from the cpd table
-      for ( i = wLookupStartAge; i < (gwPersonsInitAge + wYearsAsSmoker); i++ ) {
-         lCurrCpdIndex = lCpdStartIndex + ((i - wStartAgeInCpdData)*glCpdAgeOffset);
-         if (gdCigarettesPerDay[lCurrCpdIndex] >= 0) {
-            gdPersonsCPDbyAge[i - gwPersonsInitAge] = gdCigarettesPerDay[lCurrCpdIndex];
+      for ( i = wLookupStartAge; i < (gpContext->gwPersonsInitAge + wYearsAsSmoker); i++ ) {
+         lCurrCpdIndex = lCpdStartIndex + ((i - wStartAgeInCpdData)*gpModel->glCpdAgeOffset);
+         if (pCigarettesPerDay[lCurrCpdIndex] >= 0) {
+            gpContext->gdPersonsCPDbyAge[i - gpContext->gwPersonsInitAge] = pCigarettesPerDay[lCurrCpdIndex];
          } else {
             //This is in case the persons age goes past the max cpd for the birth cohort
-            gdPersonsCPDbyAge[i - gwPersonsInitAge] = gdPersonsCPDbyAge[(i - 1) - gwPersonsInitAge];
+            gpContext->gdPersonsCPDbyAge[i - gpContext->gwPersonsInitAge] = gpContext->gdPersonsCPDbyAge[(i - 1) - gpContext->gwPersonsInitAge];
          }
-         dSumOfCpd += gdPersonsCPDbyAge[i - gwPersonsInitAge];
+         dSumOfCpd += gpContext->gdPersonsCPDbyAge[i - gpContext->gwPersonsInitAge];
       }
 
       // Calculate average cigarettes smoked per day for the individual  
-      gdPersonsAvgCPD = dSumOfCpd / (double)wYearsAsSmoker;
+      gpContext->gdPersonsAvgCPD = dSumOfCpd / (double)wYearsAsSmoker;
 
    } catch(SimException ex) {
       ex.AddCallPath("CalcCigarettesPerDay()");
@@ -258,13 +395,14 @@ void Smoking_Simulator::CalcCigarettesPerDaySwitch() {
             wEndLoop,             // Age at which to end the uptake formula calculation
             wLookupStartAge,      // Age to start at when getting the cigarettes per day directly from the data array
             wPersonsYOB,          // Copy of gwPersonsYOB, when the year of birth is less than 1900, 1900 is used in the equation
-            i, j, k,
+            i, j,
             group,
             nRows,
             finalAge,
             nColumns;
-   long     lCpdStartIndex,       // Index to start at for look up of cigarettes per day
-            lCurrCpdIndex;        // Current index in cigarettes per day array
+   long     lCurrCpdIndex;        // Current index in cigarettes per day array
+   const double *filteredCPDGroupsCumSum,  // Group tables for the person's race, sex and cohort
+                *pSwitchCPDGroupsCumSum;   // (see SmokingModel::BuildCPDSwitchTables)
    double   dIntensityProb,       // Probability to find in the lookup tables
             dCpsForStartAge,      // The cigarettes per day for first age (in birth cohort) that has Cigarettes per day data
             dUptake,              // Uptake formula results for persons current age
@@ -272,73 +410,39 @@ void Smoking_Simulator::CalcCigarettesPerDaySwitch() {
             dScalingFactor,       // (Cigarettes per day at age 30) / (Uptake formula at age 30)
             dSumOfCpd = 0,        // Sum of the annual cigarettes per day value (used to get average)
             prob,
-            roll,
-            tempSum;
+            roll;
    bool     bValueFound;
 
-   long     nValues = glCpdYOBOffset;
-   nColumns = gwNumSmokingGrps;
+   long     nValues = gpModel->glCpdYOBOffset;
+   nColumns = gpModel->gwNumSmokingGrps;
    nRows = nValues / nColumns;
 
    long     cpdGroupOverLife[nRows];
-   double   filteredCPDGroups[nValues],
-            filteredCPDGroupsCumSum[nValues], 
-            pSwitchCPDGroups[(nRows - 1) * nColumns],
-            pSwitchCPDGroupsCumSum[(nRows - 1) * nColumns];
 
    try {
 
-      if (gdCigarettesPerDay == 0 || gdIntensityProbs == 0 || gpIndivRndsPRNG == 0) {
+      if (gpModel->gdCpdGroupCumProbs == 0 || gpModel->gdCpdSwitchCumProbs == 0 || gpContext->gpIndivRndsPRNG == 0) {
          throw SimException("Error", "One or more of the data components for cigarettes \nper \
             day calculation has not been initialized.\n");
       }
 
-      if (gwPersonsInitAge == -999) {
+      if (gpContext->gwPersonsInitAge == -999) {
          throw SimException("Error", "CalcCigarettesPerDay should not be called for \nindividuals \
             that do not initiate smoking.\n");
       }
 
-      // Using the offset formula...
-      lCpdStartIndex = (glCpdRaceOffset * (gwPersonsRace)) +
-                       (glCpdSexOffset * (gwPersonsSex)) +
-                       (glCpdYOBOffset * GetYOBCohortGroup(gwPersonsYOB));
-
-      // "Filter" the gdCigarettesPerDay array based on race, gender, and cohort
-      // And gather a cumulative sum across the columns for the purposes of initial group assignment
-      for (i = 0; i < nRows; i++) {
-         for (j = 0; j < nColumns; j++) {
-            filteredCPDGroups[i * nColumns + j] = gdCigarettesPerDay[lCpdStartIndex + i * nColumns + j];
-            tempSum = 0;
-            for (k = 0; k <= j; k++) {
-               tempSum += filteredCPDGroups[i * nColumns + k];
-            }
-            filteredCPDGroupsCumSum[i * nColumns + j] = tempSum;
-         }
-      }
-
-      // Derive the probability of switching array by finding the difference between years
-      // This assumes one can only move one group per year
-      // And again, perform a cumulative sum across columns 
-      // for the purposes of determining whether or not an individual should switch groups
-      // between two given years
-      // Note the sign convention.  A positive probability indicates the chances of moving towards a lower
-      // smoking group and the opposite is true as well.  
-      for (i = 0; i < nRows - 1; i++) {
-         for (j = 0; j < nColumns - 1; j++) {
-            pSwitchCPDGroups[i * nColumns + j] = filteredCPDGroups[(i + 1) * nColumns + j] - filteredCPDGroups[i * nColumns + j];
-            tempSum = 0;
-            for (k = 0; k <= j; k++) {
-               tempSum += pSwitchCPDGroups[i * nColumns + k];
-            }
-            pSwitchCPDGroupsCumSum[i * nColumns + j] = tempSum;
-         }
-      }
+      // The cumulative group probabilities and the probabilities of switching groups from one year to the next
+      // only depend on race, gender and cohort, they are built when the model is loaded.
+      // A positive switching probability indicates the chances of moving towards a lower
+      // smoking group and the opposite is true as well.
+      filteredCPDGroupsCumSum = gpModel->gpCpdGroupCumSlices[gpContext->glPersonsSlice];
+      pSwitchCPDGroupsCumSum  = gpModel->gpCpdSwitchCumSlices[gpContext->glPersonsSlice];
 
       // Determine number of years as a smoker
-      if (gwPersonsCessAge == -999) {      // e.g. doesn't quit
-         wYearsAsSmoker = wSIM_CUTOFF_YEAR - (gwPersonsYOB + gwPersonsInitAge) + 1;
+      if (gpContext->gwPersonsCessAge == -999) {      // e.g. doesn't quit
+         wYearsAsSmoker = wSIM_CUTOFF_YEAR - (gpContext->gwPersonsYOB + gpContext->gwPersonsInitAge) + 1;
       } else {
-         wYearsAsSmoker = gwPersonsCessAge - gwPersonsInitAge + 1;
+         wYearsAsSmoker = gpContext->gwPersonsCessAge - gpContext->gwPersonsInitAge + 1;
       }
 
       // TODO: Is this an off-by-one error?
@@ -349,25 +453,25 @@ void Smoking_Simulator::CalcCigarettesPerDaySwitch() {
          cpdGroupOverLife[i] = -999;
       }
       // Perform the simulation
-      for (i = gwPersonsInitAge; i < nRows; i++) {
+      for (i = gpContext->gwPersonsInitAge; i < nRows; i++) {
 
          // Make an initial assignment
-         if (i == gwPersonsInitAge) {
-            roll = GetNextRandForIndiv();
+         if (i == gpContext->gwPersonsInitAge) {
+            roll = gpContext->GetNextRandForIndiv();
             for (j = 0; j < nColumns; j++) {
                prob = filteredCPDGroupsCumSum[i * nColumns + j];
                if (roll < prob) {
-                  cpdGroupOverLife[gwPersonsInitAge] = j;
+                  cpdGroupOverLife[gpContext->gwPersonsInitAge] = j;
                   break;
                }
             }
-            if (gwPersonsInitAge == 14 && gwPersonsCessAge == -999) {
+            if (gpContext->gwPersonsInitAge == 14 && gpContext->gwPersonsCessAge == -999) {
             }
          // Or see if they need to switch groups over subsequent years
-         } else if (i <= gwPersonsCessAge || gwPersonsCessAge == -999) {
+         } else if (i <= gpContext->gwPersonsCessAge || gpContext->gwPersonsCessAge == -999) {
             // TODO: ascertain whether it is "< gwPersonCessAge" or "<= gwPersonCessAge"
             group = cpdGroupOverLife[i - 1];
-            roll = GetNextRandForIndiv();
+            roll = gpContext->GetNextRandForIndiv();
             prob = pSwitchCPDGroupsCumSum[(i - 1) * nColumns + group];
             if (roll < fabs(prob)) {
                if (prob > 0) {
@@ -388,45 +492,47 @@ void Smoking_Simulator::CalcCigarettesPerDaySwitch() {
       // Convert to cigarettees per day rather than category
       // Record the new CPD by age vector as global
 
-      gdPersonsCPDbyAge = new double[wYearsAsSmoker];
-      for (i = 0; i < wYearsAsSmoker; i++) {
-         gdPersonsCPDbyAge[i] = -10;
-      }
-
       short m, endAge;
       dSumOfCpd = 0;
 
-      if (gwPersonsCessAge == -999) {
+      if (gpContext->gwPersonsCessAge == -999) {
          endAge = 99;
       } else {
-         endAge = gwPersonsCessAge;
+         endAge = gpContext->gwPersonsCessAge;
+      }
+
+      // Values are recorded up to endAge, which is past the cutoff year for people born after
+      // (cutoff year - 99) who never quit, so the buffer must hold the larger of the two
+      gpContext->ReserveCPDbyAge(max(wYearsAsSmoker, (short)(endAge - gpContext->gwPersonsInitAge + 1)));
+      for (i = 0; i < wYearsAsSmoker; i++) {
+         gpContext->gdPersonsCPDbyAge[i] = -10;
       }
 
-      for (i = gwPersonsInitAge; i <= endAge; i++) {
-         m = i - gwPersonsInitAge;
-         gdPersonsCPDbyAge[m] = cpdGroupOverLife[i];
+      for (i = gpContext->gwPersonsInitAge; i <= endAge; i++) {
+         m = i - gpContext->gwPersonsInitAge;
+         gpContext->gdPersonsCPDbyAge[m] = cpdGroupOverLife[i];
 
-         if (gwPersonsInitAge > 0 && gwPersonsCessAge == -999) {
+         if (gpContext->gwPersonsInitAge > 0 && gpContext->gwPersonsCessAge == -999) {
          }
 
-         if (gdPersonsCPDbyAge[m] == 5) {
-           gdPersonsCPDbyAge[m] = 60;
-         } else if (gdPersonsCPDbyAge[m] == 4) {
-           gdPersonsCPDbyAge[m] = 40;
-         } else if (gdPersonsCPDbyAge[m] == 3) {
-           gdPersonsCPDbyAge[m] = 30;
-         } else if (gdPersonsCPDbyAge[m] == 2) {
-           gdPersonsCPDbyAge[m] = 20;
-         } else if (gdPersonsCPDbyAge[m] == 1) {
-           gdPersonsCPDbyAge[m] = 10;
-         } else if (gdPersonsCPDbyAge[m] == 0) {
-           gdPersonsCPDbyAge[m] = 3;
+         if (gpContext->gdPersonsCPDbyAge[m] == 5) {
+           gpContext->gdPersonsCPDbyAge[m] = 60;
+         } else if (gpContext->gdPersonsCPDbyAge[m] == 4) {
+           gpContext->gdPersonsCPDbyAge[m] = 40;
+         } else if (gpContext->gdPersonsCPDbyAge[m] == 3) {
+           gpContext->gdPersonsCPDbyAge[m] = 30;
+         } else if (gpContext->gdPersonsCPDbyAge[m] == 2) {
+           gpContext->gdPersonsCPDbyAge[m] = 20;
+         } else if (gpContext->gdPersonsCPDbyAge[m] == 1) {
+           gpContext->gdPersonsCPDbyAge[m] = 10;
+         } else if (gpContext->gdPersonsCPDbyAge[m] == 0) {
+           gpContext->gdPersonsCPDbyAge[m] = 3;
          }
-         dSumOfCpd += gdPersonsCPDbyAge[m];
+         dSumOfCpd += gpContext->gdPersonsCPDbyAge[m];
       }
       
       // Calculate average cigarettes smoked per day for the individual  
-      gdPersonsAvgCPD = dSumOfCpd / (double)wYearsAsSmoker;
+      gpContext->gdPersonsAvgCPD = dSumOfCpd / (double)wYearsAsSmoker;
 
    } catch(SimException ex) {
       ex.AddCallPath("CalcCigarettesPerDay()");
@@ -434,21 +540,92 @@ void Smoking_Simulator::CalcCigarettesPerDaySwitch() {
    }
 }
 
+// Smallest power of two that covers the draws one person can take from any of the PRNGs:
+// one initiation draw per initiation age, one cessation draw per cessation age,
+// one life table draw per age of life and one individual draw per age in the cigarettes per day data.
+unsigned int Smoking_Simulator::CalcDrawBudgetPower() {
+   long         lMaxDraws, lDraws;
+   unsigned int uiPower = 0;
+
+   lMaxDraws = gpModel->gwMaxInitiationAge - gpModel->gwMinInitiationAge + 1;
+   lDraws = gpModel->gwMaxCessationAge - gpModel->gwMinCessationAge + 1;
+   if (lDraws > lMaxDraws)
+      lMaxDraws = lDraws;
+   lDraws = gpModel->gwMaxLifeTableAge + 1 - min(gpModel->gwMinLifeTableAge, gpModel->gwMinInitiationAge);
+   if (lDraws > lMaxDraws)
+      lMaxDraws = lDraws;
+   lDraws = gpModel->glCpdYOBOffset / gpModel->gwNumSmokingGrps;
+   if (lDraws > lMaxDraws)
+      lMaxDraws = lDraws;
+
+   while ((1L << uiPower) < lMaxDraws)
+      uiPower++;
+   return uiPower;
+}
+
 //Free the dynamically allocated memory
 void Smoking_Simulator::Free()
 {
-   delete [] gdInitiationProbs;    gdInitiationProbs    = 0;
-   delete [] gdCessationProbs;     gdCessationProbs     = 0;
-   delete [] gdLifeTableProbs;     gdLifeTableProbs     = 0;
-   delete [] gdIntensityProbs;     gdIntensityProbs     = 0;
-   delete [] gdCigarettesPerDay;   gdCigarettesPerDay   = 0;
-   delete [] gwYOBCohortStartYrs;  gwYOBCohortStartYrs  = 0;
-   delete [] gwYOBCohortEndYrs;    gwYOBCohortEndYrs    = 0;
-   delete [] gdPersonsCPDbyAge;    gdPersonsCPDbyAge    = 0;
-   delete gpInitiationPRNG;        gpInitiationPRNG     = 0;
-   delete gpCessationPRNG;         gpCessationPRNG      = 0;
-   delete gpLifeTablePRNG;         gpLifeTablePRNG      = 0;
-   delete gpIndivRndsPRNG;         gpIndivRndsPRNG      = 0;
+   delete gpContext;               gpContext            = 0;
+   delete gpWriter;                gpWriter             = 0;
+   delete gpBinaryWriter;          gpBinaryWriter       = 0;
+   delete gpArrowWriter;           gpArrowWriter        = 0;
+   delete gpAggregates;            gpAggregates         = 0;
+   delete [] gdYearsQuitPow;       gdYearsQuitPow       = 0;
+   delete [] gdFormerOCDProbs;     gdFormerOCDProbs     = 0;
+   delete [] gdInitAgeCumProbs;    gdInitAgeCumProbs    = 0;
+   delete [] gbInitAgeRowBuilt;    gbInitAgeRowBuilt    = 0;
+   delete [] gdOCDSurvival;        gdOCDSurvival        = 0;
+   delete [] gwOCDNextMissing;     gwOCDNextMissing     = 0;
+   delete [] gbOCDRowBuilt;        gbOCDRowBuilt        = 0;
+   delete gpOwnedModel;            gpOwnedModel         = 0;
+   gpModel = 0;
+}
+
+// Tabulate pow(years since quitting, B3) used by the excess risk of former smokers,
+// former smokers can't be older than gwMaxLifeTableAge.
+void Smoking_Simulator::BuildExcessRiskTable() {
+   short wNumYears = gpModel->gwMaxLifeTableAge + 1,
+         i;
+
+   if (gdYearsQuitPow == 0) {
+      gdYearsQuitPow   = new double[wNumYears];
+      gdFormerOCDProbs = new double[wNumYears];
+   }
+   for (i = 0; i < wNumYears; i++) {
+      gdYearsQuitPow[i] = pow(i, gdFormerRiskCoefs[3]);
+   }
+}
+
+// Former smoker risk kernel: fill gdFormerOCDProbs[age - wStartAge] with the prob of dying from other COD at each
+// age wStartAge to wEndAge - 1 for the current person (lLifeTableOffset selects their race/sex/YOB in the life table).
+// Stops after the first missing (negative) prob, the draws stop there too.
+void Smoking_Simulator::CalcFormerSmokerOCDProbs(short wStartAge, short wEndAge, long lLifeTableOffset) {
+   short  wCurrentAge;
+   int    iCurrentColumn = (int)gpContext->gwPersonsSmkIntensity + 1;
+   long   lLifeTableLocation;
+   double dRiskFactor,
+          dExcessRisk,
+          dNeverProb;
+
+   // Use Excess Risk for Former Smokers formula (Davis Burns et al.)
+   // New in Version 3.0, program now uses the average cigarettes smoked per day for a person.
+   dRiskFactor = gdFormerRiskCoefs[0] + gdFormerRiskCoefs[1] * gpContext->gdPersonsAvgCPD
+                                      + gdFormerRiskCoefs[2] * gpContext->gwPersonsCessAge;
+
+   for (wCurrentAge = wStartAge; wCurrentAge < wEndAge; wCurrentAge++) {
+      lLifeTableLocation = (long(wCurrentAge-gpModel->gwMinLifeTableAge)*gpModel->glLifeTabAgeOffset) + lLifeTableOffset;
+      dExcessRisk        = exp(dRiskFactor * gdYearsQuitPow[wCurrentAge - gpContext->gwPersonsCessAge]);
+
+      // Multiply Excessive risk by difference between Current (for their smoking intenity) and Never probability
+      // then add that result to the Never Probability to get the Probability the Person will die that year
+      dNeverProb = gpModel->gdLifeTableProbs[lLifeTableLocation + SmokingModel::COL_Never];
+      gdFormerOCDProbs[wCurrentAge - wStartAge] = dNeverProb +
+                                                  ((gpModel->gdLifeTableProbs[lLifeTableLocation + iCurrentColumn] - dNeverProb)
+                                                   * dExcessRisk);
+      if (gdFormerOCDProbs[wCurrentAge - wStartAge] < 0)
+         break;
+   }
 }
 
 // Get the age at death from a cause of death other than lung cancer.
@@ -462,41 +639,41 @@ short Smoking_Simulator::GetAgeOfDeathFromOtherCOD(short wStartAge, short wEndAg
    long   lLifeTableOffset,
           lLifeTableLocation;
    double dCurrLifeTabRand,
-          dCurrLifeTabProb,
-          dExcessRisk;
+          dCurrLifeTabProb;
    char   sErrorMessage[300];
 
    try {
+      // Never and current smokers use a single life table column, sample their age of death from its survival curve
+      if (gbFastOtherCOD && eStatus == SMKST_Never)
+         return SampleAgeOfDeathFromOtherCOD(wStartAge, wEndAge, SmokingModel::COL_Never, bWentPastData);
+      if (gbFastOtherCOD && eStatus == SMKST_Current)
+         return SampleAgeOfDeathFromOtherCOD(wStartAge, wEndAge, (int)gpContext->gwPersonsSmkIntensity + 1, bWentPastData);
+
       bWentPastData = false;
-      lLifeTableOffset  = (long(gwPersonsRace) * glLifeTabRaceOffset) +
-                          (long(gwPersonsSex) * glLifeTabSexOffset) +
-                          (long(gwPersonsYOB - GetMinYearOfBirth()) * glLifeTabYOBOffset);
+      lLifeTableOffset  = gpContext->glPersonsLifeTabOffset;
+
+      // Former smoker probs for all of the ages are computed in one pass before the draws
+      if (eStatus == SMKST_Former)
+         CalcFormerSmokerOCDProbs(wStartAge, wEndAge, lLifeTableOffset);
 
       for (wCurrentAge = wStartAge; wCurrentAge < wEndAge && bPersonAlive && !bWentPastData; wCurrentAge++) {
 
-         lLifeTableLocation = (long(wCurrentAge-gwMinLifeTableAge)*glLifeTabAgeOffset) + lLifeTableOffset;
-         dCurrLifeTabRand = GetNextLifeTabRand(); //Get random value from 0 to 1 range.
+         lLifeTableLocation = (long(wCurrentAge-gpModel->gwMinLifeTableAge)*gpModel->glLifeTabAgeOffset) + lLifeTableOffset;
+         dCurrLifeTabRand = gpContext->GetNextLifeTabRand(); //Get random value from 0 to 1 range.
 
          switch (eStatus) {
 
             case SMKST_Never:
                // Person has not initiated, get prob of dying from other COD for person who has never smoked
-               dCurrLifeTabProb = gdLifeTableProbs[lLifeTableLocation + COL_Never]; break;
+               dCurrLifeTabProb = gpModel->gdLifeTableProbs[lLifeTableLocation + SmokingModel::COL_Never]; break;
 
             case SMKST_Current:
                // Person is a current smoker, get their other COD prob based on their smoking status
-               dCurrLifeTabProb = gdLifeTableProbs[lLifeTableLocation + ((int)gwPersonsSmkIntensity + 1)]; break;
+               dCurrLifeTabProb = gpModel->gdLifeTableProbs[lLifeTableLocation + ((int)gpContext->gwPersonsSmkIntensity + 1)]; break;
 
             case SMKST_Former:
-               // Use Excess Risk for Former Smokers formula (Davis Burns et al.)
-               // New in Version 3.0, program now uses the average cigarettes smoked per day for a person.
-               dExcessRisk = exp((B0 + B1 * gdPersonsAvgCPD + B2 * gwPersonsCessAge) * pow((wCurrentAge - gwPersonsCessAge), B3));
-               // Multiply Excessive risk by difference between Current (for their smoking intenity) and Never probability
-               // then add that result to the Never Probability to get the Probability the Person will die that year
-               dCurrLifeTabProb = gdLifeTableProbs[lLifeTableLocation + COL_Never] +
-                                  ((gdLifeTableProbs[lLifeTableLocation + ((int)gwPersonsSmkIntensity + 1)] -
-                                    gdLifeTableProbs[lLifeTableLocation + COL_Never])
-                                    * dExcessRisk); break;
+               // Excess Risk for Former Smokers (see CalcFormerSmokerOCDProbs)
+               dCurrLifeTabProb = gdFormerOCDProbs[wCurrentAge - wStartAge]; break;
 
             default:
                sprintf(sErrorMessage, "Invalid Smoking Status: %d.\n", eStatus);
@@ -523,1187 +700,1200 @@ short Smoking_Simulator::GetAgeOfDeathFromOtherCOD(short wStartAge, short wEndAg
 }
 
 
-// Get the minimum year of birth value
-short Smoking_Simulator::GetMinYearOfBirth() {
-   if (gwYOBCohortStartYrs== NULL)
-      throw SimException("GetMinYearOfBirth()", 
-         "Call to start year of birth cohort values (gwYOBCohortStartYrs) prior to initialization.");
-   return gwYOBCohortStartYrs[0];
-}
+// Initialize the private variables, set pointers to zero
+void Smoking_Simulator::Init() {
+   gpModel              = 0;
+   gpOwnedModel         = 0;
+   gpContext            = 0;
+   gpWriter             = 0;
+   gpBinaryWriter       = 0;
+   gpArrowWriter        = 0;
+   glArrowBatchSize     = ARROW_DEFAULT_BATCH_SIZE;
+   gpAggregates         = 0;
+   gdYearsQuitPow       = 0;
+   gdFormerOCDProbs     = 0;
+   gdFormerRiskCoefs[0] = B0;
+   gdFormerRiskCoefs[1] = B1;
+   gdFormerRiskCoefs[2] = B2;
+   gdFormerRiskCoefs[3] = B3;
 
-// Get the maximum year of birth value
-short Smoking_Simulator::GetMaxYearOfBirth() {
-   if (gwYOBCohortEndYrs == NULL)
-      throw SimException("GetMaxYearOfBirth()", 
-         "Call to end year of birth cohort values (gwYOBCohortEndYrs) prior to initialization.");
-   return gwYOBCohortEndYrs[gwNumBirthCohorts-1];
-}
+   geOutputType         = OUT_DataOnly;
+   gbBufferOutput       = false;
 
-double Smoking_Simulator::GetNextCessRand() {
-   double dReturnValue;
-   if (gpCessationPRNG == NULL)
-      throw SimException("GetNextCessRand()", 
-         "Call to PRNG before PRNG has been initialized with a seed.");
-   dReturnValue = gpCessationPRNG->genrand_real1();
-   return dReturnValue;
-}
+   gbImmediateCessation = false;
+   gwImmediateCessYear  = 0;
 
-double Smoking_Simulator::GetNextInitRand() {
-   double dReturnValue;
-   if (gpInitiationPRNG == NULL)
-      throw SimException("GetNextInitRand()", "Call to PRNG before PRNG has been initialized with a seed.");
-   dReturnValue = gpInitiationPRNG->genrand_real1();
-   return dReturnValue;
-}
+   gbIndexedMode        = false;
+   guiDrawBudgetPower   = 0;
 
-double Smoking_Simulator::GetNextLifeTabRand() {
-   double dReturnValue;
-   if (gpLifeTablePRNG == NULL)
-      throw SimException("GetNextLifeTabRand()", "Call to PRNG before PRNG has been initialized with a seed.");
-   dReturnValue = gpLifeTablePRNG->genrand_real1();
-   return dReturnValue;
-}
+   gbFastInitiation     = false;
+   gdInitAgeCumProbs    = 0;
+   gbInitAgeRowBuilt    = 0;
+   gwInitAgeCutoffYear  = 0;
 
-double Smoking_Simulator::GetNextRandForIndiv() {
-   double dReturnValue;
-   if (gpIndivRndsPRNG == NULL)
-      throw SimException("GetNextRandForIndiv()", "Call to PRNG before PRNG has been initialized with a seed.");
-   dReturnValue = gpIndivRndsPRNG->genrand_real1();
-   return dReturnValue;
+   gbFastOtherCOD       = false;
+   gdOCDSurvival        = 0;
+   gwOCDNextMissing     = 0;
+   gbOCDRowBuilt        = 0;
 }
 
-// Get the birth cohort group that the year of birth corresponds to.
-short Smoking_Simulator::GetYOBCohortGroup(short wYearBirth) {
-
-   short wReturnValue         = -1,
-         wSearchLow           = 0,
-         wSearchMid,
-         wSearchHigh;
-   char  sErrorMessage[500];
-   bool  bValueFound          = false;
-
-   if (wYearBirth < gwYOBCohortStartYrs[0]) {
-      sprintf( sErrorMessage, "Year of Birth - %d is less than the minimum year of birth allowed - %d", \
-         wYearBirth, gwYOBCohortStartYrs[0] );
-      throw SimException("GetYOBCohortGroup(short)", sErrorMessage);
+// This function oversamples the PRNG that creates the random numbers for the individual
+// If any of the other PRNGs are to be oversampled, that should be added in here
+void Smoking_Simulator::OversamplePRNGs() {
+   short  i, wLoopEnd;
+   if (gpContext->gwPersonsInitAge == -999) //Person did not start smoking, oversample 20 numbers
+      wLoopEnd = 20;
+   else //Person was a smoker so a random was used to find their smoking intensity group
+      wLoopEnd = 19;
+   for (i=0; i < wLoopEnd; i++) {
+      gpContext->GetNextRandForIndiv();
    }
+}
 
-   if ( wYearBirth > gwYOBCohortEndYrs[gwNumBirthCohorts - 1] ) {
-      sprintf(sErrorMessage, "Year of Birth - %d is greater than the maximum year of birth allowed - %d", \
-         wYearBirth, gwYOBCohortEndYrs[gwNumBirthCohorts - 1]);
-      throw SimException("GetYOBCohortGroup(short)", sErrorMessage);
-   }
 
-   wSearchHigh = gwNumBirthCohorts - 1;
-
-   // Binary Search routine, constructed to look for the location where wYearBirth
-   // is > gwYOBCohortStartYrs[wSearchMid] and < gwYOBCohortEndYrs[wSearchMid].
-   while ((wSearchLow <= wSearchHigh) && !bValueFound) {
-      wSearchMid = ( wSearchLow + wSearchHigh ) / 2;
-      if ( gwYOBCohortEndYrs[wSearchMid] < wYearBirth) { //Searching too low, go higher
-         wSearchLow  = wSearchMid + 1;
-      } else if ( gwYOBCohortStartYrs[wSearchMid] > wYearBirth) {
-         //Searching too high, go lower
-         wSearchHigh = wSearchMid - 1;
-      } else if ((gwYOBCohortStartYrs[wSearchMid] <= wYearBirth) && (gwYOBCohortEndYrs[wSearchMid]   >= wYearBirth)) {
-         wReturnValue = wSearchMid;
-         bValueFound  = true;
-      }
-   }
+// Run the simulations from an input file (see SimInputReader for the record formats)
+// If wNumThreads is greater than 0 the input is split into blocks that are simulated by
+// wNumThreads worker threads (see RunSimulationThreaded), otherwise the file is run line by line.
+void Smoking_Simulator::RunSimulation(const char* sInputFileName, const char* sOutputFileName,
+                                      bool bPrintToScreen, short wNumThreads) {
 
-   return wReturnValue;
-}
+   FILE    *pInputFile  = 0,
+           *pOutputFile = 0;
 
-// Initialize the private variables, set pointers to zero
-void Smoking_Simulator::Init() {
-   gwNumSexValues       = 0;
-   gwNumRaceValues      = 0;
-   gwNumBirthCohorts    = 0;
-
-   //Set pointers to zero
-   gpInitiationPRNG     = 0;
-   gpCessationPRNG      = 0;
-   gpLifeTablePRNG      = 0;
-   gpIndivRndsPRNG      = 0;
-   gdInitiationProbs    = 0;
-   gdCessationProbs     = 0;
-   gdLifeTableProbs     = 0;
-   gdIntensityProbs     = 0;
-   gdCigarettesPerDay   = 0;
-   gwYOBCohortStartYrs  = 0;
-   gwYOBCohortEndYrs    = 0;
-   gdPersonsCPDbyAge    = 0;
+   try {
 
-   geOutputType         = OUT_DataOnly;
+      pInputFile = fopen(sInputFileName, "r");
 
-   gbImmediateCessation = false;
-   gwImmediateCessYear  = 0;
-}
+      if (pInputFile == NULL) {
+         throw SimException("ERROR",
+            "Problem opening input file. Please verify file exists and is not in use by another program.\n");
+      }
+
+      if (sOutputFileName != NULL) {
+         pOutputFile = fopen(sOutputFileName, (geOutputType == OUT_Binary || geOutputType == OUT_Arrow) ? "wb" : "w");
+         if (pOutputFile == NULL) {
+            throw SimException("ERROR",
+               "Problem opening output file. Please verify file exists and is not in use by another program.\n");
+         }
+      }
 
+      RunSimulation(pInputFile, pOutputFile, bPrintToScreen, wNumThreads);
 
-void Smoking_Simulator::InitPRNGs(unsigned long ulInitSeed,    unsigned long ulCessSeed,
-                                  unsigned long ulLifeTabSeed, unsigned long ulIndRndsSeed) {
+      fclose(pInputFile);
+      if (pOutputFile!=0)
+         fclose(pOutputFile);
 
-   if (gpInitiationPRNG != NULL)
-      throw SimException("InitPRNGs()", "Initiation PRNG is already initialized.\n");
-   if (gpCessationPRNG != NULL)
-      throw SimException("InitPRNGs()", "Cessation PRNG is already initialized.\n");
-   if (gpLifeTablePRNG != NULL)
-      throw SimException("InitPRNGs()","Life Table PRNG is already initialized.\n");
-   if (gpIndivRndsPRNG != NULL) {
-      throw SimException("InitPRNGs()","The PRNG that generates random numbers for the \nindividual \
-         person is already initialized.\n");
+   } catch (SimException ex) {
+      ex.AddCallPath("RunSimulation(char*,char*,bool)");
+      if (pInputFile != NULL)
+         fclose(pInputFile);
+      if (pOutputFile!=0)
+         fclose(pOutputFile);
+      throw ex;
    }
-   gpInitiationPRNG = new MersenneTwister(ulInitSeed);
-   gpCessationPRNG  = new MersenneTwister(ulCessSeed);
-   gpLifeTablePRNG  = new MersenneTwister(ulLifeTabSeed);
-   gpIndivRndsPRNG  = new MersenneTwister(ulIndRndsSeed);
-}
 
-// Read in the cigarettes per day data file, this function assumes the data
-// is sorted by race, sex , YOB cohort, age and intensity group
-// The data will be stored in an array that is offset by race, sex, year of birth
-// age and smoking intensity level
-void Smoking_Simulator::LoadCPDFile(const char* sCpdFile) {
-
-   char     sInputLine[3001],
-            sErrorMessage[500],
-           *pTokenPtr            = 0;
-   long     lMaxLinesExpected,
-            lNumLinesRead,
-            lCurrArrayLocation,
-            lCpdArraySize,
-            j;
-   double   dCigarettesPerDay;
-   short    wFirstDataLine,
-            wRaceValue,
-            wSexValue,
-            wNumCohorts,
-            wMinAgeValue,
-            wMaxAgeValue,
-            wCohortEndValue,
-            wCohortStartValue,
-            wCurrCohort,
-            wNumSmokingGrps,       //Number of Smoking Intensity Groups
-            wAgeValue,
-            i;
-   FILE    *pCpdFile     = 0;
+}
 
-   try {
+// Run the simulations from an input file that is already open (see SimInputReader for the record formats),
+// writing the results to pOutputFile (may be 0). The streams are left open.
+void Smoking_Simulator::RunSimulation(FILE* pInputFile, FILE* pOutputFile, bool bPrintToScreen, short wNumThreads) {
 
-      if (gdInitiationProbs == NULL) 
-         throw SimException("Error", "The initiation probability file must be loaded before the Cigarettes per day data file.\n");
-      if (gdIntensityProbs == NULL)
-         throw SimException("Error", "The smoking intensity probability file must be loaded before the Cigarettes per day data file.\n");
-
-      pCpdFile = fopen(sCpdFile, "r");
-      if (pCpdFile == NULL) {
-	      sprintf(sErrorMessage, "The specified input file '%s' does not exist\n or could not be opened.\n\n", sCpdFile);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   // Read in the first line of the file. Line contains the line number where the data in the file begins
-      // This is to allow documentation to be placed in the input file
-	   fgets(sInputLine, 1000, pCpdFile);
-	   if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sCpdFile);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   pTokenPtr = strtok(sInputLine, ",");
-      wFirstDataLine = atoi(pTokenPtr);
-
-      if (wFirstDataLine <= 1) {
-	      sprintf(sErrorMessage, "Invalid value: %d for location of first data line read in from file %s", \
-            wFirstDataLine, sCpdFile);
-	      throw SimException("Error", sErrorMessage);
-      }
+   FILE    *pTablesFile = 0;
+   short    wSex,
+            wRace,
+            wYOB;
+   long     lNumPeople;
+   SimInputReader input;
 
-      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
-      for (i = 2; i < wFirstDataLine; i++) {
-         if ( fgets(sInputLine, 1000, pCpdFile) == NULL) {
-     	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line \
-               as specified in line 1\n", sCpdFile);
-   	      throw SimException("Error", sErrorMessage);
-         }
-      }
+   try {
 
-      // Read in the First data line which contains the # of race values, # of sex values,
-      // # of birth cohort group values, the minimum age in the data, the maximum age age in the data
-      // and the number of smoking intensity groups, in the order they are listed here.
-      fgets(sInputLine, 1000, pCpdFile);
-
-      if (sInputLine == NULL) {
-	      sprintf(sErrorMessage,"Error reading first DATA line of file %s", sCpdFile);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-      pTokenPtr       = strtok(sInputLine, ",");
-      wRaceValue      = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-      wSexValue       = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-      wNumCohorts     = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-      wMinAgeValue    = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-      wMaxAgeValue    = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-      wNumSmokingGrps = atoi(pTokenPtr);
-
-      gwNumSmokingGrps = wNumSmokingGrps;
-
-      if ((wRaceValue != gwNumRaceValues) || (wSexValue != gwNumSexValues) || (wNumCohorts != gwNumBirthCohorts)) {
-         sprintf(sErrorMessage, "Mismatch between values defined from Initiation Prob Data file and this file.\n\
-            Race: Init = %d, CPD = %d\nSex: Init = %d, CPD = %d\nNum Cohorts: Init = %d, CPD = %d\n", gwNumRaceValues, \
-            wRaceValue, gwNumSexValues, wSexValue, gwNumBirthCohorts, wNumCohorts);
-	      throw SimException("Error", sErrorMessage);
-      }
-      if (wNumSmokingGrps != gwNumIntensityGrps) {
-         sprintf(sErrorMessage, "Mismatch between the number of smoking intensity groups defined in the Intensity \
-            Prob Data file and this file.\nIntensity file has %d groups, this file indicates %d groups.\n", gwNumIntensityGrps, \
-            wNumSmokingGrps);
-	      throw SimException("Error", sErrorMessage);
-      }
-      if (wMinAgeValue < 0 || wMaxAgeValue <= 0 || wMinAgeValue >=  wMaxAgeValue) {
-	      sprintf(sErrorMessage,"Invalid value(s) for minimum and maximum initiation ages\n read in from file %s",sCpdFile);
-         throw SimException("Error", sErrorMessage);
+      // Binary and Arrow output are only written to the output file
+      if (geOutputType == OUT_Binary || geOutputType == OUT_Arrow) {
+         bPrintToScreen = false;
+         if (pOutputFile != 0 && geOutputType == OUT_Binary)
+            WriteBinaryHeader(pOutputFile);
+         if (pOutputFile != 0 && geOutputType == OUT_Arrow)
+            WriteArrowSchema(pOutputFile);
       }
 
-      gwCpdMinAge        = wMinAgeValue;
-      gwCpdMaxAge        = wMaxAgeValue;
-      glCpdAgeOffset     = (long)gwNumIntensityGrps;
-      glCpdYOBOffset     = glCpdAgeOffset * ((gwCpdMaxAge   - gwCpdMinAge) + 1);
-      glCpdSexOffset     = glCpdYOBOffset * gwNumBirthCohorts;
-      glCpdRaceOffset    = glCpdSexOffset * gwNumSexValues;
-      lCpdArraySize      = glCpdRaceOffset * gwNumRaceValues;
-      gdCigarettesPerDay = new long double[lCpdArraySize];
-      lMaxLinesExpected  = lCpdArraySize/gwNumIntensityGrps;  //All of the intesity groups are on a single line per by-group
-
-      // 
-      for (j = 0; j < lCpdArraySize; j++) {
-         gdCigarettesPerDay[j] = -1;
+      // Aggregate output counts the people in the tables, the tables are written once all of them are simulated
+      if (geOutputType == OUT_Aggregate) {
+         ClearAggregates();
+         pTablesFile    = (pOutputFile != 0) ? pOutputFile : (bPrintToScreen ? stdout : 0);
+         bPrintToScreen = false;
       }
 
-      // Read in the Probability Data Lines
-      // This subroutine will
-      // - read in the variable values for the line
-      // - verify the values are valid (including checking the cohorts)   
-      // - add the CPD value to the appropriate array location
-      lNumLinesRead = 0;
-
-      while (fgets(sInputLine, 1000, pCpdFile) != NULL) {
-
-         lNumLinesRead++;
-
-         pTokenPtr          = strtok(sInputLine, ",");
-         wRaceValue         = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-         wSexValue          = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-         wCohortStartValue  = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-         wCohortEndValue    = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-         wAgeValue          = atoi(pTokenPtr);
-         wCurrCohort        = GetYOBCohortGroup(wCohortStartValue);
-
-         if (wCohortStartValue != gwYOBCohortStartYrs[wCurrCohort] || 
-             wCohortEndValue != gwYOBCohortEndYrs[wCurrCohort]) {
-            sprintf(sErrorMessage, "The cohort range %d - %d in the Cigarettes per day file does not match the cohort \
-               range set by the initiation file.\n", wCohortStartValue, wCohortEndValue);
-            throw SimException("Error", sErrorMessage);
-         }
-
-         // Validate values read in
-         if (wAgeValue  < gwCpdMinAge  || wAgeValue > gwCpdMaxAge ||
-             wRaceValue >= gwNumRaceValues || wRaceValue < 0 ||
-             wSexValue  >= gwNumSexValues || wSexValue  < 0) {
-            sprintf(sErrorMessage, "Invalid By-Variable Combination, Race = %d, Sex = %d, Age = %d\n Read form file %s \
-               at line number %d", wRaceValue, wSexValue, wAgeValue, sCpdFile, lNumLinesRead);
-            throw SimException("Error", sErrorMessage);
-         }
-
-         // Probabilities are read in by smoking intesity group
-         // Value assignment within the array is based on the offset formula
-         // fprintf(stdout, "%d\n", lNumLinesRead);
-         // if (lNumLinesRead == 1101)
-            // int r = 9;
-
-         for (i = 0; i < gwNumIntensityGrps; i++) {
-            pTokenPtr = strtok(NULL, ",");
-            if (strcmp(pTokenPtr, ".") != 0) {
-               dCigarettesPerDay  = atof(pTokenPtr);
-               lCurrArrayLocation = (glCpdRaceOffset * wRaceValue) +
-                                    (glCpdSexOffset * wSexValue) +
-                                    (glCpdYOBOffset * wCurrCohort) +
-                                    (glCpdAgeOffset * (wAgeValue - gwCpdMinAge)) +
-                                    i;
-
-               gdCigarettesPerDay[lCurrArrayLocation] = dCigarettesPerDay;
+      InitInputReader(input, pInputFile);
+      if (wNumThreads > 0) {
+         RunSimulationThreaded(input, pOutputFile, bPrintToScreen, wNumThreads);
+      } else {
+         gbBufferOutput = true;
+         lNumPeople = 0;
+         while (ReadNextPerson(input, wRace, wSex, wYOB)) {
+            RunSimulation(wRace, wSex, wYOB, pOutputFile);
+            if (bPrintToScreen) 
+               WriteToStream(stdout);
+
+            // Stop once the output can not be written (disk full, server client disconnected)
+            if (++lNumPeople % SIM_CHUNK_SIZE == 0 && pOutputFile != 0 && ferror(pOutputFile)) {
+               throw SimException("ERROR", "Unable to write the simulation results to the output file.\n");
             }
          }
+         FlushOutput();
       }
 
-      if (lNumLinesRead > lMaxLinesExpected) {
-         sprintf(sErrorMessage, "Too many lines read from file %s.\n%d were expected based on sex, race, birth cohort and \
-            age values specified in first line of file.", sCpdFile, lNumLinesRead,lMaxLinesExpected);
-         throw SimException("Error", sErrorMessage);
-      }
-      // End Reading in the Probabilities File
-      fclose(pCpdFile);
+      if (pOutputFile != 0 && geOutputType == OUT_Arrow)
+         ArrowStreamWriter::WriteEndOfStream(pOutputFile);
+      if (pTablesFile != 0)
+         WriteAggregates(pTablesFile);
+
    } catch (SimException ex) {
-      if (pCpdFile != NULL)
-         fclose(pCpdFile);
-      ex.AddCallPath("LoadCPDFile()");
+      ex.AddCallPath("RunSimulation(FILE*,FILE*,bool)");
+      FlushOutput();
       throw ex;
-   } catch (...) {
-      if (pCpdFile != NULL)
-         fclose(pCpdFile);
-      throw SimException("LoadCPDFile()", "Unkown Error Occurred.\n");
    }
+
 }
 
-// Load the smoking intensity group probabilities
-// The data will be stored in an array that is offset by age and smoking intensity level
-void Smoking_Simulator::LoadCPDIntensityProbs(const char* sDataFileName) {
-
-   char     sInputLine[1001],
-            sErrorMessage[500],
-           *pTokenPtr            = 0;
-   long     lNumLinesExpected,
-            lNumLinesRead,
-            lCurrArrayLocation;
-   double   dCurrProbability;
-   short    wFirstDataLine,
-            wAgeValue,
-            wRaceValue,
-            wSexValue,
-            wNumGroups,       //Number of Smoking Intensity Groups
-            wNumRaces,
-            wNumSexes,
-            wMinAgeValue,
-            wMaxAgeValue,
-            i;
-   FILE    *pProbabilityFile     = 0;
+// Run the simulations from an open input file using wNumThreads worker threads.
+// The calling thread reads the input in blocks of SIM_CHUNK_SIZE records and writes the
+// finished blocks back out in input order, the workers simulate the blocks.
+// Each worker has its own simulator (PRNGs and person variables) sharing this simulator's model.
+// Block b starts each PRNG b * 2^SIM_CHUNK_STREAM_POWER draws after where this simulator's PRNGs
+// currently are, so the blocks use separate parts of each sequence and the results do not depend
+// on the number of threads used. The first block draws exactly what a single threaded run would.
+// In indexed mode block b starts at person b * SIM_CHUNK_SIZE instead, so every block matches a single threaded run.
+void Smoking_Simulator::RunSimulationThreaded(SimInputReader& input, FILE* pOutputFile,
+                                              bool bPrintToScreen, short wNumThreads) {
+
+   SimThreadPool  pool;
+   SimWorker     *pWorkers      = 0;
+   SimChunk      *pChunk        = 0;
+   SimException  *pError        = 0;
+   SimulationContext *pCursor   = 0;
+   long           lNextToWrite  = 0,
+                  lRemaining;
+   size_t         nBytes;
+   bool           bEndOfInput   = false;
+   char           sCopyBuffer[65536],
+                  sErrorMessage[300];
+   short          i;
+
+   // Outside indexed mode the blocks only stay apart if SIM_CHUNK_SIZE people can not use more than
+   // 2^SIM_CHUNK_STREAM_POWER draws from a PRNG (twice the budget leaves room for the oversampled individual PRNG)
+   if (!gbIndexedMode && ((unsigned long)SIM_CHUNK_SIZE << (CalcDrawBudgetPower() + 1)) > (1UL << SIM_CHUNK_STREAM_POWER)) {
+      sprintf(sErrorMessage, "The age ranges of the data need up to 2^%u draws per person, too many for blocks of %d people "
+              "2^%d draws apart. Use --indexed or no threads.\n", CalcDrawBudgetPower(), SIM_CHUNK_SIZE, SIM_CHUNK_STREAM_POWER);
+      throw SimException("RunSimulationThreaded()", sErrorMessage);
+   }
+
+   pool.wNumSlots  = 2 * wNumThreads;
+   pool.lNumQueued = 0;
+   pool.lNextToRun = 0;
+   pool.bShutdown  = false;
+   pool.pChunks    = new SimChunk[pool.wNumSlots];
+   pthread_mutex_init(&pool.mutex, NULL);
+   pthread_cond_init(&pool.condWorkReady, NULL);
+   pthread_cond_init(&pool.condWorkDone, NULL);
+
+   for (i = 0; i < pool.wNumSlots; i++) {
+      pool.pChunks[i].pResults = 0;
+      pool.pChunks[i].pStartState = 0;
+      pool.pChunks[i].pError   = 0;
+      pool.pChunks[i].eState   = CHUNK_Empty;
+   }
+
+   pWorkers = new SimWorker[wNumThreads];
+   for (i = 0; i < wNumThreads; i++) {
+      pWorkers[i].pPool      = &pool;
+      pWorkers[i].pSimulator = 0;
+      pWorkers[i].bStarted   = false;
+   }
 
    try {
-      pProbabilityFile = fopen(sDataFileName, "r");
-      if (pProbabilityFile == NULL) {
-	      sprintf(sErrorMessage, "The specified input file '%s' does not exist\n or could not be opened.\n\n", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   // Read in the first line of the file.  Line contains the line number where the data in the file begins
-      // This is to allow documentation to be placed in the input file
-	   fgets(sInputLine, 1000, pProbabilityFile);
-	   if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-	   pTokenPtr = strtok(sInputLine, ",");
-      wFirstDataLine = atoi(pTokenPtr);
-      if (wFirstDataLine <= 1) {
-	      sprintf(sErrorMessage,  "Invalid value: %d for location of first data line read in from file %s", \
-            wFirstDataLine, sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-      }
 
-      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
-      for (i = 2; i < wFirstDataLine; i++) {
-         if ( fgets(sInputLine, 1000, pProbabilityFile) == NULL) {
-     	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line as \
-               specified in line 1\n", sDataFileName);
-   	      throw SimException("Error", sErrorMessage);
+      // PRNG states for the start of the next block to queue
+      pCursor = new SimulationContext(gpContext->gpInitiationPRNG->GetSeed(), gpContext->gpCessationPRNG->GetSeed(),
+                                      gpContext->gpLifeTablePRNG->GetSeed(), gpContext->gpIndivRndsPRNG->GetSeed());
+      pCursor->CopyPRNGs(*gpContext);
+
+      for (i = 0; i < pool.wNumSlots; i++) {
+         pool.pChunks[i].pStartState = new SimulationContext(gpContext->gpInitiationPRNG->GetSeed(),
+                                                             gpContext->gpCessationPRNG->GetSeed(),
+                                                             gpContext->gpLifeTablePRNG->GetSeed(),
+                                                             gpContext->gpIndivRndsPRNG->GetSeed());
+         pool.pChunks[i].pResults = tmpfile();
+         if (pool.pChunks[i].pResults == NULL) {
+            throw SimException("ERROR", "Unable to create a temporary file for the simulation results.\n");
          }
       }
 
-      // Read in the First data line which contains the # of race values, # of sex values,
-      // # of birth cohort group values, the minimum inititaion age and the maximum initiation age
-      // in the order they are listed here.
-      fgets(sInputLine, 1000, pProbabilityFile);
-
-      if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-      pTokenPtr      = strtok(sInputLine, ",");
-      wNumRaces      = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
-      wNumSexes      = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
-      wMinAgeValue   = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
-      wMaxAgeValue   = atoi(pTokenPtr);   pTokenPtr = strtok(NULL, ",");
-      wNumGroups     = atoi(pTokenPtr);
-
-      if (wNumGroups <= 0 )
-         throw SimException("Error", "Invalid value read in for # of smoking intensity groups.");
-
-      if (wMinAgeValue < 0 || wMaxAgeValue <= 0 || wMinAgeValue >=  wMaxAgeValue) {
-	      sprintf(sErrorMessage, "Invalid value(s) for minimum and maximum initiation ages\n read in from file %s", \
-            sDataFileName);
-         throw SimException("Error", sErrorMessage);
+      for (i = 0; i < wNumThreads; i++) {
+         pWorkers[i].pSimulator = new Smoking_Simulator(gpModel,
+                                                        gpContext->gpInitiationPRNG->GetSeed(), gpContext->gpCessationPRNG->GetSeed(),
+                                                        gpContext->gpLifeTablePRNG->GetSeed(), gpContext->gpIndivRndsPRNG->GetSeed(),
+                                                        geOutputType, gwImmediateCessYear);
+         pWorkers[i].pSimulator->gbIndexedMode      = gbIndexedMode;
+         pWorkers[i].pSimulator->guiDrawBudgetPower = guiDrawBudgetPower;
+         pWorkers[i].pSimulator->glArrowBatchSize   = glArrowBatchSize;
+         pWorkers[i].pSimulator->gbFastInitiation   = gbFastInitiation;
+         pWorkers[i].pSimulator->gbFastOtherCOD     = gbFastOtherCOD;
+         pWorkers[i].pSimulator->SetFormerRiskCoefficients(gdFormerRiskCoefs);
+         if (pthread_create(&pWorkers[i].thread, NULL, WorkerThread, &pWorkers[i]) != 0) {
+            throw SimException("ERROR", "Unable to start a simulation thread.\n");
+         }
+         pWorkers[i].bStarted = true;
       }
 
-      if ((wNumRaces != gwNumRaceValues) || (wNumSexes != gwNumSexValues)) {
-         sprintf(sErrorMessage, "Mismatch between number of races and number of sexes in initiation file and cohorts from CPD Intensity \
-            file.\nRace: Init = %d, CPD = %d\nSex: Init = %d, CPD = %d\n", gwNumRaceValues, wRaceValue, gwNumSexValues, wSexValue);
-	      throw SimException("Error", sErrorMessage);
-      }
+      while (true) {
 
-      gwNumIntensityGrps = wNumGroups;
-      gwIntensityMinAge = wMinAgeValue;
-      gwIntensityMaxAge = wMaxAgeValue;
-
-      gwIntensityAgeOffset = wNumGroups;
-      gwIntensitySexOffset = ((wMaxAgeValue - wMinAgeValue) + 1) * gwIntensityAgeOffset;
-      gwIntensityRaceOffset = (wNumSexes * gwIntensitySexOffset);
-
-      gdIntensityProbs = new double[long(wNumRaces) * long(gwIntensityRaceOffset)];
-      lNumLinesExpected = long((gwIntensityMaxAge - gwIntensityMinAge) + 1);
-
-      // Read in the Probability Data Lines
-      lNumLinesRead = 0;
-      while (fgets(sInputLine, 1000, pProbabilityFile) != NULL) {
-         lNumLinesRead++;
-         pTokenPtr = strtok(sInputLine, ",");
-         wRaceValue = atoi(pTokenPtr);    pTokenPtr = strtok(NULL, ",");
-         wSexValue = atoi(pTokenPtr);     pTokenPtr = strtok(NULL, ",");
-         wAgeValue = atoi(pTokenPtr);
-
-         // Validate values read in
-         if (wRaceValue > wNumRaces) {
-            sprintf(sErrorMessage, "Invalid Race Value: %d\n Read from file %s at line number %d", wRaceValue, 
-               sDataFileName, lNumLinesRead);
-            throw SimException("Error", sErrorMessage);
-         }
-         if (wSexValue > wNumSexes) {
-            sprintf(sErrorMessage, "Invalid Race Value: %d\n Read from file %s at line number %d", wSexValue, \
-               sDataFileName, lNumLinesRead);
-            throw SimException("Error", sErrorMessage);
+         // Queue blocks of input records while there are free slots in the ring
+         while (!bEndOfInput && (pool.lNumQueued - lNextToWrite) < pool.wNumSlots) {
+            pChunk = &pool.pChunks[pool.lNumQueued % pool.wNumSlots];
+            pChunk->lChunkIndex = pool.lNumQueued;
+            pChunk->lNumRecords = 0;
+            while (pChunk->lNumRecords < SIM_CHUNK_SIZE &&
+                   ReadNextPerson(input, pChunk->wRace[pChunk->lNumRecords], pChunk->wSex[pChunk->lNumRecords],
+                                  pChunk->wYOB[pChunk->lNumRecords])) {
+               pChunk->lNumRecords++;
+            }
+            if (pChunk->lNumRecords < SIM_CHUNK_SIZE) {
+               bEndOfInput = true;
+            }
+            if (pChunk->lNumRecords > 0) {
+               pChunk->pStartState->CopyPRNGs(*pCursor);
+               if (gbIndexedMode)
+                  pCursor->JumpPRNGs(pChunk->lNumRecords, guiDrawBudgetPower);
+               else
+                  pCursor->JumpPRNGs(1, SIM_CHUNK_STREAM_POWER);
+               pthread_mutex_lock(&pool.mutex);
+               pChunk->eState = CHUNK_Ready;
+               pool.lNumQueued++;
+               pthread_cond_broadcast(&pool.condWorkReady);
+               pthread_mutex_unlock(&pool.mutex);
+            }
          }
-         if (wAgeValue < gwIntensityMinAge || wAgeValue > gwIntensityMaxAge) {
-            sprintf(sErrorMessage, "Invalid Age Value: %d\n Read from file %s at line number %d", wAgeValue, \
-               sDataFileName, lNumLinesRead);
-            throw SimException("Error", sErrorMessage);
+
+         if (lNextToWrite == pool.lNumQueued) {
+            break;
          }
 
-         // Probabilities are read in by intensity group
-         // Value assignment within the array is based on the offset formula
-         for (i = 0; i < gwNumIntensityGrps; i++) {
-            pTokenPtr = strtok(NULL, ",");
-            if (strcmp(pTokenPtr, ".") != 0) {
-               dCurrProbability  = atof(pTokenPtr);
-               if ((dCurrProbability < 0) || (dCurrProbability > 1)) {
-                  sprintf(sErrorMessage, "Invalid Probability: %f read for Age : %d ,Intensity Group : %d\nRead \
-                     from file %s at line number %d.\n", dCurrProbability, wAgeValue, i, sDataFileName, lNumLinesRead);
-                  throw SimException("Error",sErrorMessage);
+         // Wait for the oldest block and copy its results to the output
+         pChunk = &pool.pChunks[lNextToWrite % pool.wNumSlots];
+         pthread_mutex_lock(&pool.mutex);
+         while (pChunk->eState != CHUNK_Done) {
+            pthread_cond_wait(&pool.condWorkDone, &pool.mutex);
+         }
+         pthread_mutex_unlock(&pool.mutex);
+
+         if (pOutputFile != 0 || bPrintToScreen) {
+            rewind(pChunk->pResults);
+            lRemaining = pChunk->lResultsLength;
+            while (lRemaining > 0) {
+               nBytes = fread(sCopyBuffer, 1, min(lRemaining, (long)sizeof(sCopyBuffer)), pChunk->pResults);
+               if (nBytes == 0) {
+                  throw SimException("ERROR", "Unable to read the simulation results from a temporary file.\n");
                }
-            } else {
-               sprintf(sErrorMessage, "Value missing for Age : %d ,Intensity Group : %d\nValue must contain a decimal palce.\n", wAgeValue,i);
-               throw SimException("Error", sErrorMessage);
+               if (pOutputFile != 0 && fwrite(sCopyBuffer, 1, nBytes, pOutputFile) != nBytes) {
+                  throw SimException("ERROR", "Unable to write the simulation results to the output file.\n");
+               }
+               if (bPrintToScreen)
+                  fwrite(sCopyBuffer, 1, nBytes, stdout);
+               lRemaining -= (long)nBytes;
             }
+         }
 
-            // Offset formula
-            lCurrArrayLocation = (wRaceValue * gwIntensityRaceOffset) + \
-                                 (wSexValue * gwIntensitySexOffset) + \
-                                 ((wAgeValue - gwIntensityMinAge) * gwIntensityAgeOffset) + \
-                                 i;
-
-            // Values stored as a cumulative probability
-            if (i == 0) {
-               gdIntensityProbs[lCurrArrayLocation] = dCurrProbability;
-            } else {
-               gdIntensityProbs[lCurrArrayLocation] = gdIntensityProbs[lCurrArrayLocation-1] + dCurrProbability;
-            }
+         // Results before the failing record have been written, same as a single threaded run
+         if (pChunk->pError != 0) {
+            throw SimException(*pChunk->pError);
          }
-      }
 
-      if (lNumLinesRead < lNumLinesExpected) {
-         sprintf(sErrorMessage, "Not enough lines read from file %s.\n%d were expected based on sex, race, birth cohort \
-            and age values specified in first line of file.", sDataFileName, lNumLinesRead, lNumLinesExpected);
-         throw SimException("Error", sErrorMessage);
+         pChunk->eState = CHUNK_Empty;
+         lNextToWrite++;
       }
 
-      // End Reading in the Probabilities File
-      fclose(pProbabilityFile);
+      // Later simulations continue after the last block
+      gpContext->CopyPRNGs(*pCursor);
 
-   } catch(SimException ex) {
-      if (pProbabilityFile != NULL) {
-         fclose(pProbabilityFile);
-      }
-      ex.AddCallPath("LoadCPDIntensityProbs()");
+   } catch (SimException ex) {
+      ex.AddCallPath("RunSimulationThreaded()");
+      pError = new SimException(ex);
+   }
+
+   // Shut down the workers and release the pool
+   pthread_mutex_lock(&pool.mutex);
+   pool.bShutdown = true;
+   pthread_cond_broadcast(&pool.condWorkReady);
+   pthread_mutex_unlock(&pool.mutex);
+
+   for (i = 0; i < wNumThreads; i++) {
+      if (pWorkers[i].bStarted)
+         pthread_join(pWorkers[i].thread, NULL);
+      // Counters are integers, so the totals do not depend on which worker simulated which block
+      if (pError == 0 && pWorkers[i].pSimulator != 0 && pWorkers[i].pSimulator->gpAggregates != 0)
+         AddToAggregates(*pWorkers[i].pSimulator->gpAggregates);
+      delete pWorkers[i].pSimulator;
+   }
+   for (i = 0; i < pool.wNumSlots; i++) {
+      if (pool.pChunks[i].pResults != 0)
+         fclose(pool.pChunks[i].pResults);
+      delete pool.pChunks[i].pStartState;
+      delete pool.pChunks[i].pError;
+   }
+   delete pCursor;
+   delete [] pWorkers;
+   delete [] pool.pChunks;
+   pthread_cond_destroy(&pool.condWorkDone);
+   pthread_cond_destroy(&pool.condWorkReady);
+   pthread_mutex_destroy(&pool.mutex);
+
+   if (pError != 0) {
+      SimException ex(*pError);
+      delete pError;
       throw ex;
-   } catch (...) {
-      if (pProbabilityFile != NULL) {
-         fclose(pProbabilityFile);
-      }
-      throw SimException("LoadCPDIntensityProbs()", "Unkown Error Occurred.\n");
    }
 }
 
-// Load the probability initiation/cessation data files.
-void Smoking_Simulator::LoadProbabilityData(const char* sDataFileName, DataType eFileType) {
-
-   char     sInputLine[3001],
-            sErrorMessage[500],
-           *pTokenPtr            = 0;
-   long     lNumLinesExpected,
-            lNumLinesRead,
-            lCurrArrayLocation;
-   double   dCurrProbability;
-   short    wFirstDataLine,
-            wSexValue,
-            wRaceValue,
-            wAgeValue,
-            wCohortValue,
-            wMinAgeValue,
-            wMaxAgeValue,
-            i;
-   FILE     *pProbabilityFile     = 0;
+// Run the simulation for the race, sex and year of birth values provided.
+// Results are stored in the private members gwPersonsInitAge gwPersonsCessAge
+// If File* is supplied, results will be written to the stream specified.
+void Smoking_Simulator::RunSimulation(short wRace, short wSex, short wYearBirth, FILE* pOutStream) {
 
+   short    wLastCessationAge;
 
    try {
 
-      if ((eFileType != DATA_Initiation) && (eFileType != DATA_Cessation)) 
-         throw SimException("Error", "Invalid File Type supplied to function.");
+      StartPerson(wRace, wSex, wYearBirth);
+      SimulateSmokingHistory(wLastCessationAge);
+      SimulateCPDAndOtherCOD();
 
-      if (eFileType == DATA_Cessation && (gdInitiationProbs==NULL)) {
-         throw SimException("Error", 
-            "Attempt to load Cessation Probabilities before Initiation probabilities.\nInitiation data must be loaded first.\n");
-      }
+      if (geOutputType == OUT_Aggregate)
+         AddToAggregates();
+      else if (pOutStream != 0)
+         WriteToStream(pOutStream);
 
-      pProbabilityFile = fopen(sDataFileName, "r");
-      if (pProbabilityFile == NULL) {
-	      sprintf(sErrorMessage,"The specified input file '%s' does not exist\n or could not be opened.\n\n", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   //Read in the first line of the file. Line contains the line number where the data in the file begins
-     // This allows documentation to be placed in the input file
-	   fgets(sInputLine, 1000, pProbabilityFile);
-	   if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   pTokenPtr = strtok(sInputLine, ",");
-      wFirstDataLine = atoi(pTokenPtr);
-      if (wFirstDataLine <= 1) {
-	      sprintf(sErrorMessage, "Invalid value: %d for location of first data line read in from file %s", \
-            wFirstDataLine, sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-      }
+      NextPerson();
 
-      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
-      for (i = 2; i < wFirstDataLine; i++) {
-         if ( fgets(sInputLine, 1000, pProbabilityFile) == NULL) {
-     	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line \
-               as specified in line 1\n", sDataFileName);
-   	      throw SimException("Error", sErrorMessage);
-         }
-      }
+   } catch (SimException ex) {
+      ex.AddCallPath("RunSimulation(short,short,short)");
+      // Keep the next person on their own budget when this person is rejected
+      if (gbIndexedMode)
+         gpContext->AlignPRNGs(guiDrawBudgetPower);
+      throw ex;
+   }
+}
 
-      // Read in the First data line which contains the # of race values, # of sex values,
-      // # of birth cohort group values, the minimum inititaion age and the maximum initiation age
-      // in the order they are listed here.
-      fgets(sInputLine, 1000, pProbabilityFile);
-
-      if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-      pTokenPtr = strtok(sInputLine, ",");
-      wRaceValue = atoi(pTokenPtr);
-      pTokenPtr = strtok(NULL, ",");
-      wSexValue = atoi(pTokenPtr);
-      pTokenPtr = strtok(NULL, ",");
-      wCohortValue = atoi(pTokenPtr);
-      pTokenPtr = strtok(NULL, ",");
-      wMinAgeValue = atoi(pTokenPtr);
-      pTokenPtr = strtok(NULL, ",");
-      wMaxAgeValue = atoi(pTokenPtr);
-
-      if ((eFileType == DATA_Initiation) && (wRaceValue <= 0 || wSexValue <= 0 || wCohortValue <= 0))
-         throw SimException("Error", "Invalid value read in for # of sex values, # of race values or # of birth cohorts.");
-
-      if ((eFileType == DATA_Cessation) &&
-         ((wRaceValue != gwNumRaceValues) || (wSexValue != gwNumSexValues) || (wCohortValue != gwNumBirthCohorts))) {
-         sprintf(sErrorMessage, "Mismatch between cohort values from Initiation and Cessation Files.\n\
-            Race: Init = %d, Cess = %d\nSex: Init = %d, Cess = %d\nNum Cohorts: Init = %d, Cess = %d\n", \
-            gwNumRaceValues, wRaceValue, gwNumSexValues, wSexValue, gwNumBirthCohorts, wCohortValue);
-	      throw SimException("Error", sErrorMessage);
-      }
+// Validate a person's race, sex and YOB and set up the person variables of the context
+// (cohort and array offsets, no smoking history yet)
+void Smoking_Simulator::StartPerson(short wRace, short wSex, short wYearBirth) {
 
-      if (wMinAgeValue < 0 || wMaxAgeValue <= 0 || wMinAgeValue >=  wMaxAgeValue) {
-	      sprintf(sErrorMessage, "Invalid value(s) for minimum and maximum initiation ages\n read in from file %s", sDataFileName);
-         throw SimException("Error", sErrorMessage);
-      }
+   char     sErrorMessage[500];
 
-      // Load private members from Initiation data
-      if (eFileType == DATA_Initiation) {
-         gwNumRaceValues      = wRaceValue;
-         gwNumSexValues       = wSexValue;
-         gwNumBirthCohorts    = wCohortValue;
-         gwMinInitiationAge   = wMinAgeValue;
-         gwMaxInitiationAge   = wMaxAgeValue;
-         gwInitProbYOBOffset  = (gwMaxInitiationAge - gwMinInitiationAge) + 1;
-         gwInitProbSexOffset  = gwNumBirthCohorts * gwInitProbYOBOffset;
-         gwInitProbRaceOffset = gwNumSexValues * gwInitProbSexOffset;
-         gdInitiationProbs    = new double[(long(gwNumRaceValues) * long(gwInitProbRaceOffset))];
-         gwYOBCohortStartYrs  = new short [gwNumBirthCohorts];
-         gwYOBCohortEndYrs    = new short [gwNumBirthCohorts];
-         lNumLinesExpected    = long(gwNumSexValues * gwNumRaceValues *
-                                   ((gwMaxInitiationAge - gwMinInitiationAge) + 1));
-
-      // Load private members from Cessation data
-      } else {
-         gwMinCessationAge    = wMinAgeValue;
-         gwMaxCessationAge    = wMaxAgeValue;
-         gwCessProbYOBOffset  = (gwMaxCessationAge - gwMinCessationAge) + 1;
-         gwCessProbSexOffset  = gwNumBirthCohorts * gwCessProbYOBOffset;
-         gwCessProbRaceOffset = gwNumSexValues * gwCessProbSexOffset;
-         gdCessationProbs     = new double[(long(gwNumRaceValues) * long(gwCessProbRaceOffset))];
-         lNumLinesExpected    = long(gwNumSexValues * gwNumRaceValues *
-                                   ((gwMaxCessationAge - gwMinCessationAge) + 1));
-      }
+   // Validate Input
+   if ((wYearBirth < GetMinYearOfBirth()) || (wYearBirth > 2020)) { // GetMaxYearOfBirth())) {
+      sprintf(sErrorMessage, "Invalid Year of Birth: %d, supplied to Smoking History Simulator.", wYearBirth);
+      throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+   }
 
+   if ( (wSex < 0) || (wSex >= gpModel->gwNumSexValues) ) {
+      sprintf(sErrorMessage, "Invalid Sex Value: %d, supplied to Smoking History Simulator.", wSex);
+      throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+   }
 
-      // Read in the second dataline, this contains 3 column labels followed by the YOB cohort ranges
-      fgets(sInputLine, 1800, pProbabilityFile);
+   if ( (wRace < 0) || (wRace >= gpModel->gwNumRaceValues) ) {
+      sprintf(sErrorMessage, "Invalid Race Value: %d, supplied to Smoking History Simulator.", wRace);
+      throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+   }
 
-      if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading second DATA line of file %s", sDataFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
+   if ( (wRace == 1) && (wSex == 1) ) {
+      sprintf(sErrorMessage, "Invalid Race/Sex Combination: %d/%d, supplied to Smoking History Simulator.", wRace, wSex);
+      throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+   }
 
-      pTokenPtr= strtok(sInputLine, ",");
-      pTokenPtr= strtok(NULL, ",");
-      pTokenPtr= strtok(NULL, ",");
 
-      // // Read in the year of birth cohorts and assign the values to the appropriate Start/End year arrays
-      for (i = 0; i < gwNumBirthCohorts; i++) {
+   gpContext->gwPersonsRace         = wRace;
+   gpContext->gwPersonsSex          = wSex;
+   gpContext->gwPersonsYOB          = wYearBirth;
+   gpContext->gwPersonsInitAge      = -999;
+   gpContext->gwPersonsCessAge      = -999;
+   gpContext->gwPersonsAgeAtDeath   = -999;
+   gpContext->gwPersonsSmkIntensity = SMKR_Uninitialized;
+   gpContext->gdPersonsAvgCPD       = 0;
 
-         pTokenPtr     = strtok(NULL, "-");
-         wCohortValue  = atoi(pTokenPtr);
 
-         // If it's the initiation file, assign value to the array
-         if (eFileType == DATA_Initiation) {
-            gwYOBCohortStartYrs[i] = wCohortValue;
+   // Cohort and array offsets of the person, looked up once and used by all of the routines below
+   gpContext->gwPersonsCohort        = gpModel->GetYOBCohortGroup(gpContext->gwPersonsYOB);
+   gpContext->glPersonsSlice         = gpModel->GetCohortSlice(wRace, wSex, gpContext->gwPersonsCohort);
+   gpContext->glPersonsLifeTabOffset = (long(wRace) * gpModel->glLifeTabRaceOffset) + (long(wSex) * gpModel->glLifeTabSexOffset) +
+                                       (long(wYearBirth - gpModel->gwYOBCohortStartYrs[0]) * gpModel->glLifeTabYOBOffset);
+}
 
-         // Otherwise check the value against the value already in the array
-         } else if (wCohortValue != gwYOBCohortStartYrs[i]) {
-            sprintf(sErrorMessage, "Mismatching starting cohorts between Initiation and Cessation probability \
-               files\nFor range : 1\n%d read from initiation file.\n%d read from cessation file.", 
-               gwYOBCohortStartYrs[i], wCohortValue);
-            throw SimException("Error", sErrorMessage);
-         }
+// Simulate the initiation and cessation ages of the person set up by StartPerson.
+// wLastCessationAge is set to the last age the cessation routine checked (-999 if the person never initiated).
+void Smoking_Simulator::SimulateSmokingHistory(short& wLastCessationAge) {
 
-         pTokenPtr = strtok(NULL, ",");
-         wCohortValue = atoi(pTokenPtr);
-
-         if (eFileType == DATA_Initiation)  {
-            // If its the Initiation file, assign value to the array
-            gwYOBCohortEndYrs[i] = wCohortValue;
-         } else if (wCohortValue != gwYOBCohortEndYrs[i]) {
-            // Otherwise check the value against the value already in the array
-            sprintf(sErrorMessage, "Mismatching starting cohorts between Initiation and Cessation probability files\n\
-               For range : 1\n%d read from initiation file.\n%d read from cessation file.", gwYOBCohortEndYrs[i], wCohortValue);
-            throw SimException("Error", sErrorMessage);
-         }
-      
-         // If its the initiation file, verify the values
-         if ( (eFileType == DATA_Initiation) &&
-              (gwYOBCohortStartYrs[i] < 0 || gwYOBCohortEndYrs[i] <= 0 || gwYOBCohortStartYrs[i] > gwYOBCohortEndYrs[i]) ) {
-            sprintf(sErrorMessage, \
-              "Invalid Year of Birth Cohort value(s).\nStart Year = %d, End Year = %d.\nRead in from file %s for cohort range: %d\n\n\n", \
-              gwYOBCohortStartYrs[i], gwYOBCohortEndYrs[i], sDataFileName, i);
-            throw SimException("Error", sErrorMessage);
-         }
+   short    wCurrentAge          = gpModel->gwMinInitiationAge;
+   bool     bCanInitiate         = true,
+            bForceCessation      = false,
+            bPersonInitiated     = false,
+            bPersonQuit          = false,
+            bPassedCohortMaxAge  = false;
+   double   dCurrInitiationRand,
+            dCurrInitiationProb,
+            dCurrCessationRand,
+            dCurrCessationProb;
+   const double *pInitiationProbs,    // Initiation and cessation table slices for the person's race, sex and cohort
+                *pCessationProbs;
+
+   wLastCessationAge = -999;
+   pInitiationProbs  = gpModel->gpInitiationSlices[gpContext->glPersonsSlice];
+
+   if (gbFastInitiation) {
+      // Initiation age sampled with one draw from the distribution the initiation loop below follows
+      gpContext->gwPersonsInitAge = SampleInitiationAge(gpContext->gwPersonsRace, gpContext->gwPersonsSex, gpContext->gwPersonsYOB, pInitiationProbs);
+      if (gpContext->gwPersonsInitAge != -999) {
+         wCurrentAge      = gpContext->gwPersonsInitAge;
+         bPersonInitiated = true;
       }
+   } else {
+      // Smoking Initiation Routine
+      // 3 instances in which scanning the initiation loop stops
+      // Person initiates smoking, person surpasses max initiation age for their cohort,
+      // person surpasses overall max initiation age,
+      while (!bPersonInitiated && !bPassedCohortMaxAge && (wCurrentAge <= gpModel->gwMaxInitiationAge)) {
+
+         // Get Initiation Probabilities
+         dCurrInitiationRand = gpContext->GetNextInitRand(); //Get random value from 0 to 1 range.
+         dCurrInitiationProb = pInitiationProbs[wCurrentAge - gpModel->gwMinInitiationAge];
 
-      // Read in the Probability Data Lines
-      lNumLinesRead = 0;
-      while (fgets(sInputLine, 2000, pProbabilityFile) != NULL) {
-         lNumLinesRead++;
-         pTokenPtr  = strtok(sInputLine, ",");
-         wRaceValue = atoi(pTokenPtr);
-         pTokenPtr = strtok(NULL, ",");
-         wSexValue = atoi(pTokenPtr);
-         pTokenPtr = strtok(NULL, ",");
-         wAgeValue = atoi(pTokenPtr);
-
-         // Validate values read in
-         if (wAgeValue  < wMinAgeValue || wAgeValue > wMaxAgeValue || wRaceValue >= gwNumRaceValues || wRaceValue < 0 ||
-            wSexValue  >= gwNumSexValues  || wSexValue  < 0) {
-            sprintf(sErrorMessage, "Invalid By-Variable Combination, Race = %d, Sex = %d, Age = %d\n Read form file %s at line \
-               number %d", wRaceValue, wSexValue, wAgeValue, sDataFileName, lNumLinesRead);
-            throw SimException("Error", sErrorMessage);
+         // If ImmediateCessation is turned on, check if the current year (birth year + current age) 
+         // is equal to or greater than the last year before cessation begins.
+         if (gbImmediateCessation && ((gpContext->gwPersonsYOB + wCurrentAge) >= (gwImmediateCessYear-1))) {
+            bCanInitiate = false;
          }
 
-         // Probabilities are read in by year of birth cohorts
-         // Values will be assigned to the probability array that corresponds to eFileType,
-         // Value assignment within the array is based on the offset formula
-         for (i = 0; i < gwNumBirthCohorts; i++) {
-            pTokenPtr = strtok(NULL, ",");
-
-            if (strcmp(pTokenPtr, ".") != 0) {
-               dCurrProbability  = atof(pTokenPtr);
-               if ((dCurrProbability < 0) || (dCurrProbability > 1)) {
-                  sprintf(sErrorMessage, "Invalid Probability: %f read for Birth Cohort: %d - %d\nRead from file %s at line \
-                     number %d.\n", dCurrProbability, gwYOBCohortStartYrs[i], gwYOBCohortEndYrs[i], sDataFileName, lNumLinesRead);
-                  throw SimException("Error", sErrorMessage);
-               }
-            } else {
-               dCurrProbability = -1;
-            }
+         if (dCurrInitiationRand <= dCurrInitiationProb && bCanInitiate) {
+            gpContext->gwPersonsInitAge = wCurrentAge;
+            bPersonInitiated = true;
+         }
 
-            if (eFileType == DATA_Initiation) {
-               lCurrArrayLocation = (wRaceValue * gwInitProbRaceOffset) + (wSexValue * gwInitProbSexOffset) +
-                                     (i * gwInitProbYOBOffset)                + (wAgeValue - gwMinInitiationAge);
-               gdInitiationProbs[lCurrArrayLocation] = dCurrProbability;
-            } else {
-               lCurrArrayLocation = (wRaceValue * gwCessProbRaceOffset) + (wSexValue * gwCessProbSexOffset) +
-                                     (i * gwCessProbYOBOffset)                + (wAgeValue - gwMinCessationAge);
-               gdCessationProbs[lCurrArrayLocation] = dCurrProbability;
-            }
+         // If the probability was missing, it was coded as -1, sim can 
+         // stop once one of these values are reached.
+         if (dCurrInitiationProb < 0 || (((wCurrentAge+1) + gpContext->gwPersonsYOB) > wSIM_CUTOFF_YEAR)) {
+            bPassedCohortMaxAge = true;
          }
-      }
 
-      if (lNumLinesRead < lNumLinesExpected) {
-         sprintf(sErrorMessage,"Not enough lines read from file %s.\n%d were expected based on sex, race, birth cohort and age values \
-            specified in first line of file.", sDataFileName, lNumLinesRead, lNumLinesExpected);
-         throw SimException("Error", sErrorMessage);
+         // Increment the age if they did not initiate
+         if (!bPersonInitiated) {
+            wCurrentAge++;
+         } 
       }
+   }
 
-      // End Reading in the Probabilities File
-      fclose(pProbabilityFile);
+   // Smoking Cessation Routine
+   // Only Occurs after a Person Initiates Smoking
+   bPassedCohortMaxAge = false;
 
-   } catch(SimException ex) {
-      if (pProbabilityFile != NULL)
-         fclose(pProbabilityFile);
-      ex.AddCallPath("LoadProbabilityData()");
-      throw ex;
-   } catch (...) {
-      if (pProbabilityFile != NULL)
-         fclose(pProbabilityFile);
-      throw SimException("LoadProbabilityData()", "Unkown Error Occurred.\n");
-   }
-}
+   if (bPersonInitiated) {
 
-// Load the probability initiation/cessation data files.
-void Smoking_Simulator::LoadOtherCODFile(const char* sLifeTableFileName) {
-
-   char     sInputLine[1001],
-            sErrorMessage[500],
-           *pTokenPtr            = 0;
-   long     lMaxNumLines,
-            lNumLinesRead,
-            lCurrArrayLocation,
-            lSizeOfLifeTable,
-            j;
-   double   dCurrProbability;
-   short    wFirstDataLine,
-            wSexValue,
-            wRaceValue,
-            wYearValue,
-            wAgeValue,
-            i;
-   FILE    *pLifeTableFile     = 0;
+      // Increment the persons current age(also initiation age) if less than the minimum cessation age.
+      while ( wCurrentAge < gpModel->gwMinCessationAge )
+         wCurrentAge++;
 
-   try {
-      if (gdInitiationProbs == NULL)
-         throw("Error", "Initiation Probabilies must be loaded before the Life Table Probabilities.\n");
-
-      pLifeTableFile = fopen(sLifeTableFileName, "r");
-      if (pLifeTableFile == NULL) {
-	      sprintf(sErrorMessage, "The specified input file '%s' does not exist\n or could not be opened.\n\n", sLifeTableFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   // Read in the first line of the file. Line contains the line number where the data in the file begins
-      // This is to allow documentation to be placed in the input file
-	   fgets(sInputLine, 1000, pLifeTableFile);
-
-	   if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sLifeTableFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-	   pTokenPtr      = strtok(sInputLine, ",");
-      wFirstDataLine = atoi(pTokenPtr);
-      if (wFirstDataLine <= 1) {
-	      sprintf(sErrorMessage, "Invalid value: %d for location of first data line to read in from file %s", \
-            wFirstDataLine, sLifeTableFileName);
-	      throw SimException("Error", sErrorMessage);
-      }
+      pCessationProbs = gpModel->gpCessationSlices[gpContext->glPersonsSlice];
 
-      // Read in the Documentation lines, If the tag Version= is found, store it in the Version Num string for the file
-      for (i = 2; i < wFirstDataLine; i++) {
-         if ( fgets(sInputLine, 1000, pLifeTableFile) == NULL) {
-   	      sprintf(sErrorMessage, "Error in  file %s, End of File reached before location of first data line as specified in line 1\n", \ 
-               sLifeTableFileName);
-   	      throw SimException("Error", sErrorMessage);
+      while (!bPersonQuit && !bPassedCohortMaxAge && (wCurrentAge <= gpModel->gwMaxCessationAge)) {
+
+         // If ImmediateCessation is turned on, check if the current year (birth year + current age) is 
+         // equal to or greater than the last year before cessation begins.
+         if (gbImmediateCessation && ((gpContext->gwPersonsYOB + wCurrentAge) >= (gwImmediateCessYear-1))) {
+            bForceCessation = true;
          }
-      }
 
-      // Read in the First data line which contains the # of race values, # of sex values,
-      // the min year of birth, the max year of birth, the min age and the maximum age
-      // in the order they are listed here.
-      fgets(sInputLine, 1000, pLifeTableFile);
-
-      if (sInputLine == NULL) {
-	      sprintf(sErrorMessage, "Error reading first DATA line of file %s", sLifeTableFileName);
-	      throw SimException("Error", sErrorMessage);
-	   }
-
-      pTokenPtr          = strtok(sInputLine, ",");
-      wRaceValue         = atoi(pTokenPtr);
-      pTokenPtr          = strtok(NULL, ",");
-      wSexValue          = atoi(pTokenPtr);
-      pTokenPtr          = strtok(NULL, ",");
-      gwMinLifeTableYear = atoi(pTokenPtr);
-      pTokenPtr          = strtok(NULL, ",");
-      gwMaxLifeTableYear = atoi(pTokenPtr);
-      pTokenPtr          = strtok(NULL, ",");
-      gwMinLifeTableAge  = atoi(pTokenPtr);
-      pTokenPtr          = strtok(NULL, ",");
-      gwMaxLifeTableAge  = atoi(pTokenPtr);
-
-      gwMaxLifeTableYear = 2300;
-
-      /*
-      if ((wRaceValue != gwNumRaceValues) || (wSexValue != gwNumSexValues) ||
-         (gwMinLifeTableYear > GetMinYearOfBirth()) || (gwMaxLifeTableYear < GetMaxYearOfBirth())) {
-         sprintf(sErrorMessage, "Mismatch between cohort values from Life Table file and cohorts from Initiation file.\
-            \nRace: Init = %d, Life = %d\nSex: Init = %d, Life = %d\nMin Year Birth: Init = %d, Life = %d\nMax Year Birth: \
-            Init = %d, Life = %d\n", gwNumRaceValues, wRaceValue, gwNumSexValues, wSexValue, GetMinYearOfBirth(), \
-            gwMinLifeTableYear, GetMaxYearOfBirth(), gwMaxLifeTableYear);
-	      throw SimException("Error", sErrorMessage);
-      }
-      */
+         dCurrCessationRand = gpContext->GetNextCessRand();
+         dCurrCessationProb = pCessationProbs[wCurrentAge-gpModel->gwMinCessationAge];
 
-      if (gwMinLifeTableAge < 0 || gwMaxLifeTableAge <= 0 || gwMinLifeTableAge >=  gwMaxLifeTableAge) {
-	      sprintf(sErrorMessage, "Invalid value(s) for minimum and maximum initiation ages\n read in from file %s", sLifeTableFileName);
-         throw SimException("Error", sErrorMessage);
-      }
+         if (dCurrCessationRand <= dCurrCessationProb || bForceCessation) {
+            gpContext->gwPersonsCessAge  = wCurrentAge;
+            bPersonQuit = true;
+         }
 
-      // Load private members from Life Table data
-      glLifeTabAgeOffset  = long(COL_NumColumns);
-      glLifeTabYOBOffset  = long(((gwMaxLifeTableAge - gwMinLifeTableAge) + 1) * glLifeTabAgeOffset);
-      glLifeTabSexOffset  = long(((gwMaxLifeTableYear - gwMinLifeTableYear) + 1) * glLifeTabYOBOffset);
-      glLifeTabRaceOffset = long(gwNumSexValues) * glLifeTabSexOffset;
-      lSizeOfLifeTable    = long(gwNumRaceValues) * long(glLifeTabRaceOffset);
-      gdLifeTableProbs    = new double[lSizeOfLifeTable];
-      lMaxNumLines        = long(gwNumRaceValues * gwNumSexValues *
-                                 ((gwMaxLifeTableYear - gwMinLifeTableYear)+1) *
-                                 ((gwMaxLifeTableAge - gwMinLifeTableAge) + 1));
-
-      // Fill in all gdLifeTableProbs entries with -1
-      for (j=0; j<lSizeOfLifeTable; j++) {
-         gdLifeTableProbs[j] = -1;
+         // If the probability was missing, it was coded as -1, 
+         // simulation can stop once one of these values are reached.
+         if (dCurrCessationProb < 0 || (((wCurrentAge+1) + gpContext->gwPersonsYOB) > wSIM_CUTOFF_YEAR)) 
+            bPassedCohortMaxAge = true;
+         //Age can be incremented either way here, unlike initiation
+         wLastCessationAge = wCurrentAge;
+         wCurrentAge++;
+         }
       }
+}
 
-      // Read in the Probability Data Lines
-      lNumLinesRead = 0;
-      while (fgets(sInputLine, 1000, pLifeTableFile)!=NULL) {
-
-         lNumLinesRead++;
-         pTokenPtr  = strtok(sInputLine, ",");
-         wRaceValue = atoi(pTokenPtr);
-         pTokenPtr  = strtok(NULL, ",");
-         wSexValue  = atoi(pTokenPtr);
-         pTokenPtr  = strtok(NULL, ",");
-         wYearValue  = atoi(pTokenPtr);
-         pTokenPtr  = strtok(NULL, ",");
-         wAgeValue  = atoi(pTokenPtr);
-
-         // Validate values read in
-         if (wAgeValue  < gwMinLifeTableAge    || wAgeValue > gwMaxLifeTableAge ||
-            wRaceValue >= gwNumRaceValues      || wRaceValue < 0                ||
-            wSexValue  >= gwNumSexValues       || wSexValue  < 0                ||
-            wYearValue > gwMaxLifeTableYear   || wYearValue < gwMinLifeTableYear) {
-            sprintf(sErrorMessage, "Invalid By-Variable Combination, Race = %d, Sex = %d, Year = %d, Age = %d\n Read form file %s \
-               at line number %d", wRaceValue, wSexValue, wYearValue, wAgeValue, sLifeTableFileName, lNumLinesRead);
-            throw SimException("Error", sErrorMessage);
-         }
+// Simulate the cigarettes per day and the age of death from other causes of the person,
+// based on the initiation and cessation ages in the context
+void Smoking_Simulator::SimulateCPDAndOtherCOD() {
+   if (SimulateUntilFormerSmoker())
+      SimulateFormerSmokerOCD();
+}
 
-         // Probabilities are read in by smoking status type
-         // Value assignment within the array is based on the offset formula
-         for (i = 0; i < COL_NumColumns; i++) {
-            pTokenPtr = strtok(NULL, ",");
-            dCurrProbability  = atof(pTokenPtr);
-            if ((dCurrProbability < 0) || (dCurrProbability > 1)) {
-               sprintf(sErrorMessage, "Invalid Probability: %f read for Birth Cohort: %d - %d\nRead from file %s at line number %d.\n", \
-                  dCurrProbability, gwYOBCohortStartYrs[i], gwYOBCohortEndYrs[i], sLifeTableFileName, lNumLinesRead);
-               throw SimException("Error", sErrorMessage);
-            }
-            lCurrArrayLocation = (long(wRaceValue) * glLifeTabRaceOffset) +
-                                 (long(wSexValue) * glLifeTabSexOffset) +
-                                 (long(wYearValue - gwMinLifeTableYear) * glLifeTabYOBOffset) +
-                                 (long(wAgeValue - gwMinLifeTableAge) * glLifeTabAgeOffset)   +
-                                  long(i);
-            gdLifeTableProbs[lCurrArrayLocation] = dCurrProbability;
-         }
+// Simulate the cigarettes per day and the age of death from other causes of the person up to their cessation age.
+// Returns true if the person quit smoking and is still alive at the cessation age with life table data left,
+// SimulateFormerSmokerOCD then finishes the person (the life table PRNG is at the start of their former smoker draws).
+bool Smoking_Simulator::SimulateUntilFormerSmoker() {
+
+   short    wAgeAtDeath;
+   bool     bPersonInitiated     = (gpContext->gwPersonsInitAge != -999),
+            bPersonQuit          = (gpContext->gwPersonsCessAge != -999),
+            bPassedLifeTabMaxAge = false;
+
+   // Calculate the number of cigarettes smoked per day by people who initiate smoking
+   if (bPersonInitiated) {
+      CalcCigarettesPerDaySwitch();
+   }
+
+   // Calculate if person dies from a Cause of Death other than lung cancer
+   // Loop through their entire life and check the probablility that the
+   // person will die that year based on their smoking status in that year
+   // Routine to use varies based on persons smoking history
+
+   // People who never smoke
+   if (!bPersonInitiated) {
+      gpContext->gwPersonsAgeAtDeath = GetAgeOfDeathFromOtherCOD(gpModel->gwMinLifeTableAge, gpModel->gwMaxLifeTableAge + 1, SMKST_Never, bPassedLifeTabMaxAge);
+
+   // People who start smoking, and never quit
+   } else if (bPersonInitiated && !bPersonQuit) {
+      wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gpModel->gwMinLifeTableAge, gpContext->gwPersonsInitAge, SMKST_Never, bPassedLifeTabMaxAge);
+      if ( (wAgeAtDeath == -999) && !bPassedLifeTabMaxAge ) {
+         wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gpContext->gwPersonsInitAge,gpModel->gwMaxLifeTableAge+1, SMKST_Current, bPassedLifeTabMaxAge);
       }
+      gpContext->gwPersonsAgeAtDeath = wAgeAtDeath;
 
-      if (lNumLinesRead > lMaxNumLines) {
-         sprintf(sErrorMessage, "Too many lines read from file %s.\n%ld max were expected based on sex, race, birth cohort and age\
-            values specified in first line of file.\n%ld were read in.\n", sLifeTableFileName, lMaxNumLines, lNumLinesRead);
-         throw SimException("Error", sErrorMessage);
+   // People who start smoking and quit smoking
+   } else if (bPersonInitiated && bPersonQuit) {
+      wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gpModel->gwMinLifeTableAge,gpContext->gwPersonsInitAge, SMKST_Never, bPassedLifeTabMaxAge);
+      if ((wAgeAtDeath == -999) && !bPassedLifeTabMaxAge) {
+         wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gpContext->gwPersonsInitAge,gpContext->gwPersonsCessAge, SMKST_Current, bPassedLifeTabMaxAge);
       }
+      gpContext->gwPersonsAgeAtDeath = wAgeAtDeath;
+      return (wAgeAtDeath == -999) && !bPassedLifeTabMaxAge;
+   }
+   return false;
+}
 
-      // End Reading in the Probabilities File
-      fclose(pLifeTableFile);
+// Age of death from other causes of a person who quit smoking, from their cessation age on
+// (after SimulateUntilFormerSmoker returned true for the person)
+void Smoking_Simulator::SimulateFormerSmokerOCD() {
+   bool bPassedLifeTabMaxAge = false;
 
-   } catch (SimException ex) {
-      if (pLifeTableFile != NULL)
-         fclose(pLifeTableFile);
-      ex.AddCallPath("LoadLifeTableFile()");
-      throw ex;
-   } catch (...) {
-      if (pLifeTableFile != NULL)
-         fclose(pLifeTableFile);
-      throw SimException("LoadLifeTableFile()", "Unkown Error Occurred.\n");
-   }
+   gpContext->gwPersonsAgeAtDeath = GetAgeOfDeathFromOtherCOD(gpContext->gwPersonsCessAge, gpModel->gwMaxLifeTableAge + 1,
+                                                              SMKST_Former, bPassedLifeTabMaxAge);
 }
 
-// This function oversamples the PRNG that creates the random numbers for the individual
-// If any of the other PRNGs are to be oversampled, that should be added in here
-void Smoking_Simulator::OversamplePRNGs() {
-   short  i, wLoopEnd;
-   if (gwPersonsInitAge == -999) //Person did not start smoking, oversample 20 numbers
-      wLoopEnd = 20;
-   else //Person was a smoker so a random was used to find their smoking intensity group
-      wLoopEnd = 19;
-   for (i=0; i < wLoopEnd; i++) {
-      GetNextRandForIndiv();
+// Move the PRNGs past the person just simulated.
+// Indexed mode moves every PRNG to the start of the next person's budget, otherwise
+// oversample the PRNGs (only does the PRNG that generates Randoms for the individual)
+// More oversampling can be added if desired.
+void Smoking_Simulator::NextPerson() {
+   char     sErrorMessage[500];
+   if (gbIndexedMode) {
+      if (!gpContext->AlignPRNGs(guiDrawBudgetPower)) {
+         sprintf(sErrorMessage, "Person used more than the %lu random numbers per PRNG allowed in indexed mode.", 1UL << guiDrawBudgetPower);
+         throw SimException("Error", sErrorMessage);
+      }
+   } else {
+      OversamplePRNGs();
    }
 }
 
+// Initiation and cessation ages the person in the context would have with immediate cessation in wCessationYear
+// (0 = none), given the ages simulated without immediate cessation. wLastCessationAge is the last age the
+// cessation routine checked (see SimulateSmokingHistory). Follows the immediate cessation rules of
+// SimulateSmokingHistory, which only stop initiation and force cessation without changing the draws before them.
+void Smoking_Simulator::GetCessationScenario(short wCessationYear, short wLastCessationAge, short& wInitAge, short& wCessAge) {
+   short wForcedAge;
+
+   wInitAge = gpContext->gwPersonsInitAge;
+   wCessAge = gpContext->gwPersonsCessAge;
+   if (wCessationYear == 0 || wInitAge == -999)
+      return;
+
+   // Nobody initiates from the year before immediate cessation on
+   wForcedAge = wCessationYear - 1 - gpContext->gwPersonsYOB;
+   if (wInitAge >= wForcedAge) {
+      wInitAge = -999;
+      wCessAge = -999;
+      return;
+   }
 
-// Run the simulations from an input file
-void Smoking_Simulator::RunSimulation(const char* sInputFileName, const char* sOutputFileName,
-                                      bool bPrintToScreen) {
+   // Smokers quit at the first age checked from that year on, if they have not quit already
+   wForcedAge = max(wForcedAge, max(wInitAge, gpModel->gwMinCessationAge));
+   if ((wCessAge == -999 || wCessAge > wForcedAge) && wForcedAge <= wLastCessationAge)
+      wCessAge = wForcedAge;
+}
 
-   FILE    *pInputFile  = 0,
-           *pOutputFile = 0;
-   short    wSex,
-            wRace,
-            wYOB;
-   char     sCurrInputLine[101],
-           *pTokenPtr = 0;
+// Simulate the input file for each of the wNumYears immediate cessation years in wCessationYears (0 = no immediate
+// cessation) with common random numbers. Each person's smoking history is simulated once without immediate
+// cessation and changed for each year (GetCessationScenario), the cigarettes per day and other COD are only
+// simulated for each different history, every one starting from the same PRNG states. The simulator must not
+// use immediate cessation and is put in indexed mode, the results for each year are the same as an indexed
+// mode run with that cessation year. The results for year Y are written to sOutputFileName with "_Y" added
+// before the extension (results.txt -> results_1990.txt).
+void Smoking_Simulator::RunCessationSweep(const char* sInputFileName, const char* sOutputFileName,
+                                          const short* wCessationYears, short wNumYears) {
+
+   Smoking_Simulator **pScenarios   = 0;
+   SimulationContext  *pScenario;
+   FILE               *pInputFile   = 0,
+                     **pOutputFiles = 0;
+   char                sErrorMessage[500];
+   short               wRace,
+                       wSex,
+                       wYOB,
+                       wLastCessationAge,
+                       wInitAge,
+                       wCessAge,
+                       i,
+                       j;
+   long                lNumPeople   = 0;
+   unsigned long       ulBudget;
+   SimInputReader      input;
 
    try {
 
-      pInputFile = fopen(sInputFileName, "r");
+      if (gbImmediateCessation || wNumYears < 1 || sOutputFileName == 0) {
+         throw SimException("Error", "The cessation sweep needs a list of years, an output file and a simulator without immediate cessation.\n");
+      }
+      if (!gbIndexedMode)
+         SetIndexedMode(true);
+      ulBudget = 1UL << guiDrawBudgetPower;
 
+      pInputFile = fopen(sInputFileName, "r");
       if (pInputFile == NULL) {
          throw SimException("ERROR",
             "Problem opening input file. Please verify file exists and is not in use by another program.\n");
       }
 
-      if (sOutputFileName != NULL) {
-         pOutputFile = fopen(sOutputFileName,"w");
-         if (pOutputFile == NULL) {
-            throw SimException("ERROR",
-               "Problem opening output file. Please verify file exists and is not in use by another program.\n");
+      // A simulator and output file for each year, sharing the model and seeds
+      CreateSweepScenarios(sOutputFileName, wCessationYears, 0, wNumYears, pScenarios, pOutputFiles);
+
+      InitInputReader(input, pInputFile);
+      while (ReadNextPerson(input, wRace, wSex, wYOB)) {
+
+         StartPerson(wRace, wSex, wYOB);
+         SimulateSmokingHistory(wLastCessationAge);
+
+         for (i = 0; i < wNumYears; i++) {
+            pScenario = pScenarios[i]->gpContext;
+            GetCessationScenario(wCessationYears[i], wLastCessationAge, wInitAge, wCessAge);
+
+            // Years that give the person the same smoking history have the same results
+            for (j = 0; j < i; j++) {
+               if (pScenarios[j]->gpContext->gwPersonsInitAge == wInitAge && pScenarios[j]->gpContext->gwPersonsCessAge == wCessAge)
+                  break;
+            }
+
+            if (j < i) {
+               pScenario->CopyPersonResults(*pScenarios[j]->gpContext);
+            } else {
+               pScenario->CopyPerson(*gpContext);
+               pScenario->gwPersonsInitAge      = wInitAge;
+               pScenario->gwPersonsCessAge      = wCessAge;
+               pScenario->gwPersonsAgeAtDeath   = -999;
+               pScenario->gwPersonsSmkIntensity = SMKR_Uninitialized;
+               pScenario->gdPersonsAvgCPD       = 0;
+               pScenario->CopyOutcomePRNGs(*gpContext);
+               pScenarios[i]->SimulateCPDAndOtherCOD();
+               if (pScenario->gulLifeTabDraws > ulBudget || pScenario->gulIndivDraws > ulBudget) {
+                  sprintf(sErrorMessage, "Person used more than the %lu random numbers per PRNG allowed in indexed mode.", ulBudget);
+                  throw SimException("Error", sErrorMessage);
+               }
+            }
+
+            if (geOutputType == OUT_Aggregate)
+               pScenarios[i]->AddToAggregates();
+            else
+               pScenarios[i]->WriteToStream(pOutputFiles[i]);
          }
-      }
 
-      while (fgets(sCurrInputLine, 100, pInputFile)) {
-         pTokenPtr= strtok(sCurrInputLine, ";");
-         wRace = atoi(pTokenPtr);
-         pTokenPtr= strtok(NULL, ";");
-         wSex = atoi(pTokenPtr);
-         pTokenPtr= strtok(NULL, ";");
-         wYOB = atoi(pTokenPtr);
-
-         RunSimulation(wRace, wSex, wYOB, pOutputFile);
-         if (bPrintToScreen) 
-            WriteToStream(stdout);
+         // This simulator only used the initiation and cessation PRNGs, the others skip the whole budget
+         NextPerson();
+
+         // Stop once the output can not be written (disk full)
+         if (++lNumPeople % SIM_CHUNK_SIZE == 0)
+            CheckSweepOutputs(pOutputFiles, wNumYears);
       }
 
+      CloseSweepScenarios(pScenarios, pOutputFiles, wNumYears, true);
       fclose(pInputFile);
-      if (pOutputFile!=0)
-         fclose(pOutputFile);
 
    } catch (SimException ex) {
-      ex.AddCallPath("RunSimulation(char*,char*,bool)");
+      ex.AddCallPath("RunCessationSweep()");
+      if (gbIndexedMode)
+         gpContext->AlignPRNGs(guiDrawBudgetPower);
       if (pInputFile != NULL)
          fclose(pInputFile);
-      if (pOutputFile!=0)
-         fclose(pOutputFile);
+      CloseSweepScenarios(pScenarios, pOutputFiles, wNumYears, false);
       throw ex;
    }
-
 }
 
-// Run the simulation for the race, sex and year of birth values provided.
-// Results are stored in the private members gwPersonsInitAge gwPersonsCessAge
-// If File* is supplied, results will be written to the stream specified.
-void Smoking_Simulator::RunSimulation(short wRace, short wSex, short wYearBirth, FILE* pOutStream) {
-
-   short    wYOBCohortGroup,
-            wSearchOffset,
-            wCurrentAge          = gwMinInitiationAge,
-            wAgeAtDeath;
-   bool     bCanInitiate         = true,
-            bForceCessation      = false,
-            bPersonInitiated     = false,
-            bPersonQuit          = false,
-            bPassedCohortMaxAge  = false,
-            bPassedLifeTabMaxAge = false;
-   double   dCurrInitiationRand,
-            dCurrInitiationProb,
-            dCurrCessationRand,
-            dCurrCessationProb;
-   char     sErrorMessage[500];
+// Simulate the input file for each of the wNumSets sets of former smoker excess risk coefficients in dCoefSets
+// (B0 to B3 of each set one after the other, see SetFormerRiskCoefficients) with common random numbers. Each person's
+// smoking history, cigarettes per day and other COD up to their cessation age are simulated once, only the other COD
+// of former smokers is simulated again for each set, every set starting from the same life table PRNG state. The
+// simulator is put in indexed mode, the results for each set are the same as an indexed mode run with those
+// coefficients. The results for set K are written to sOutputFileName with "_rK" added before the extension
+// (results.txt -> results_r0.txt).
+void Smoking_Simulator::RunFormerRiskSweep(const char* sInputFileName, const char* sOutputFileName,
+                                           const double* dCoefSets, short wNumSets) {
+
+   Smoking_Simulator **pScenarios   = 0;
+   SimulationContext  *pScenario;
+   FILE               *pInputFile   = 0,
+                     **pOutputFiles = 0;
+   char                sErrorMessage[500];
+   short               wRace,
+                       wSex,
+                       wYOB,
+                       wLastCessationAge,
+                       i;
+   bool                bFormerSmoker;
+   long                lNumPeople   = 0;
+   unsigned long       ulBudget;
+   SimInputReader      input;
 
    try {
 
-      // Validate Input
-      if ((wYearBirth < GetMinYearOfBirth()) || (wYearBirth > 2020)) { // GetMaxYearOfBirth())) {
-         sprintf(sErrorMessage, "Invalid Year of Birth: %d, supplied to Smoking History Simulator.", wYearBirth);
-         throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+      if (wNumSets < 1 || sOutputFileName == 0) {
+         throw SimException("Error", "The former smoker risk sweep needs a list of coefficient sets and an output file.\n");
       }
+      if (!gbIndexedMode)
+         SetIndexedMode(true);
+      ulBudget = 1UL << guiDrawBudgetPower;
 
-      if ( (wSex < 0) || (wSex >= gwNumSexValues) ) {
-         sprintf(sErrorMessage, "Invalid Sex Value: %d, supplied to Smoking History Simulator.", wSex);
-         throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+      pInputFile = fopen(sInputFileName, "r");
+      if (pInputFile == NULL) {
+         throw SimException("ERROR",
+            "Problem opening input file. Please verify file exists and is not in use by another program.\n");
       }
 
-      if ( (wRace < 0) || (wRace >= gwNumRaceValues) ) {
-         sprintf(sErrorMessage, "Invalid Race Value: %d, supplied to Smoking History Simulator.", wRace);
-         throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
-      }
+      // A simulator and output file for each set, sharing the model and seeds
+      CreateSweepScenarios(sOutputFileName, 0, dCoefSets, wNumSets, pScenarios, pOutputFiles);
 
-      if ( (wRace == 1) && (wSex == 1) ) {
-         sprintf(sErrorMessage, "Invalid Race/Sex Combination: %d/%d, supplied to Smoking History Simulator.", wRace, wSex);
-         throw SimException("Error", sErrorMessage, SimException::NON_FATAL);
+      InitInputReader(input, pInputFile);
+      while (ReadNextPerson(input, wRace, wSex, wYOB)) {
+
+         StartPerson(wRace, wSex, wYOB);
+         SimulateSmokingHistory(wLastCessationAge);
+         bFormerSmoker = SimulateUntilFormerSmoker();
+
+         // Only former smokers depend on the coefficients, each set continues from this simulator's life table PRNG
+         for (i = 0; i < wNumSets; i++) {
+            pScenario = pScenarios[i]->gpContext;
+            pScenario->CopyPersonResults(*gpContext);
+            if (bFormerSmoker) {
+               pScenario->CopyOutcomePRNGs(*gpContext);
+               pScenarios[i]->SimulateFormerSmokerOCD();
+               if (gpContext->gulLifeTabDraws + pScenario->gulLifeTabDraws > ulBudget) {
+                  sprintf(sErrorMessage, "Person used more than the %lu random numbers per PRNG allowed in indexed mode.", ulBudget);
+                  throw SimException("Error", sErrorMessage);
+               }
+            }
+
+            if (geOutputType == OUT_Aggregate)
+               pScenarios[i]->AddToAggregates();
+            else
+               pScenarios[i]->WriteToStream(pOutputFiles[i]);
+         }
+
+         NextPerson();
+
+         // Stop once the output can not be written (disk full)
+         if (++lNumPeople % SIM_CHUNK_SIZE == 0)
+            CheckSweepOutputs(pOutputFiles, wNumSets);
       }
 
+      CloseSweepScenarios(pScenarios, pOutputFiles, wNumSets, true);
+      fclose(pInputFile);
+
+   } catch (SimException ex) {
+      ex.AddCallPath("RunFormerRiskSweep()");
+      if (gbIndexedMode)
+         gpContext->AlignPRNGs(guiDrawBudgetPower);
+      if (pInputFile != NULL)
+         fclose(pInputFile);
+      CloseSweepScenarios(pScenarios, pOutputFiles, wNumSets, false);
+      throw ex;
+   }
+}
+
+// Create the simulator and output file of each of the wNumScenarios result sets of a sweep, sharing the model and
+// seeds. Set i uses the immediate cessation year wCessationYears[i] and is labeled with the year, or when
+// wCessationYears is 0 it uses this simulator's year with the former smoker coefficients
+// dCoefSets + i * NUM_FORMER_RISK_COEFS and is labeled "r" and i.
+// pScenarios and pOutputFiles are set before anything can throw, so CloseSweepScenarios can clean up.
+void Smoking_Simulator::CreateSweepScenarios(const char* sOutputFileName, const short* wCessationYears,
+                                             const double* dCoefSets, short wNumScenarios,
+                                             Smoking_Simulator**& pScenarios, FILE**& pOutputFiles) {
+   char  sLabel[20];
+   short i;
+
+   pScenarios   = new Smoking_Simulator*[wNumScenarios];
+   pOutputFiles = new FILE*[wNumScenarios];
+   for (i = 0; i < wNumScenarios; i++) {
+      pScenarios[i]   = 0;
+      pOutputFiles[i] = 0;
+   }
 
-      gwPersonsRace         = wRace;
-      gwPersonsSex          = wSex;
-      gwPersonsYOB          = wYearBirth;
-      gwPersonsInitAge      = -999;
-		gwPersonsCessAge      = -999;
-      gwPersonsAgeAtDeath   = -999;
-      gwPersonsSmkIntensity = SMKR_Uninitialized;
-      gdPersonsAvgCPD       = 0;
+   for (i = 0; i < wNumScenarios; i++) {
+      pScenarios[i] = new Smoking_Simulator(gpModel, gpContext->gpInitiationPRNG->GetSeed(), gpContext->gpCessationPRNG->GetSeed(),
+                                            gpContext->gpLifeTablePRNG->GetSeed(), gpContext->gpIndivRndsPRNG->GetSeed(),
+                                            geOutputType, (wCessationYears != 0) ? wCessationYears[i] : gwImmediateCessYear);
+      pScenarios[i]->SetPRNGType(gpContext->GetPRNGType());
+      pScenarios[i]->SetIndexedMode(true);
+      pScenarios[i]->SetArrowBatchSize(glArrowBatchSize);
+      pScenarios[i]->SetFastOtherCOD(gbFastOtherCOD);
+      pScenarios[i]->SetFormerRiskCoefficients((wCessationYears != 0) ? gdFormerRiskCoefs : dCoefSets + i * NUM_FORMER_RISK_COEFS);
+      pScenarios[i]->gbBufferOutput = true;
+
+      if (wCessationYears != 0)
+         sprintf(sLabel, "%d", wCessationYears[i]);
+      else
+         sprintf(sLabel, "r%d", i);
+      pOutputFiles[i] = pScenarios[i]->OpenSweepOutput(sOutputFileName, sLabel);
+   }
+}
 
+// Throw when the output of a sweep can not be written (disk full)
+void Smoking_Simulator::CheckSweepOutputs(FILE** pOutputFiles, short wNumScenarios) {
+   short i;
 
-      wYOBCohortGroup   = GetYOBCohortGroup(gwPersonsYOB);
-      wSearchOffset     = ((gwPersonsRace)*gwInitProbRaceOffset) + ((gwPersonsSex)*gwInitProbSexOffset) +
-                           (wYOBCohortGroup*gwInitProbYOBOffset);
+   for (i = 0; i < wNumScenarios; i++) {
+      if (ferror(pOutputFiles[i]))
+         throw SimException("ERROR", "Unable to write the simulation results to the output file.\n");
+   }
+}
 
-      // Smoking Initiation Routine
-      // 3 instances in which scanning the initiation loop stops
-      // Person initiates smoking, person surpasses max initiation age for their cohort,
-      // person surpasses overall max initiation age,
-      while (!bPersonInitiated && !bPassedCohortMaxAge && (wCurrentAge <= gwMaxInitiationAge)) {
+// Close the output files and delete the simulators made by CreateSweepScenarios (either may be partly made).
+// When bComplete the files are ended first (the Arrow end of stream, or the aggregate tables).
+void Smoking_Simulator::CloseSweepScenarios(Smoking_Simulator**& pScenarios, FILE**& pOutputFiles, short wNumScenarios,
+                                            bool bComplete) {
+   short i;
+
+   for (i = 0; pScenarios != 0 && i < wNumScenarios; i++) {
+      if (pScenarios[i] != 0)
+         pScenarios[i]->FlushOutput();
+      if (bComplete && geOutputType == OUT_Arrow)
+         ArrowStreamWriter::WriteEndOfStream(pOutputFiles[i]);
+      else if (bComplete && geOutputType == OUT_Aggregate)
+         pScenarios[i]->WriteAggregates(pOutputFiles[i]);
+      if (pOutputFiles[i] != 0)
+         fclose(pOutputFiles[i]);
+      delete pScenarios[i];
+   }
+   delete [] pScenarios;
+   delete [] pOutputFiles;
+   pScenarios   = 0;
+   pOutputFiles = 0;
+}
 
-         // Get Initiation Probabilities
-         dCurrInitiationRand = GetNextInitRand(); //Get random value from 0 to 1 range.
-         dCurrInitiationProb = gdInitiationProbs[(wCurrentAge - gwMinInitiationAge) + wSearchOffset];
+// Open the output file of one result set of a sweep, sOutputFileName with "_" and sLabel added before the
+// extension (results.txt -> results_1990.txt), and start it the way RunSimulation starts its output file
+FILE* Smoking_Simulator::OpenSweepOutput(const char* sOutputFileName, const char* sLabel) {
+   FILE       *pOutputFile;
+   char       *sFileName;
+   const char *sExtension;
+
+   sFileName  = new char[strlen(sOutputFileName) + strlen(sLabel) + 2];
+   sExtension = strrchr(sOutputFileName, '.');
+   if (sExtension != 0 && strchr(sExtension, '/') != 0)
+      sExtension = 0;
+   if (sExtension != 0)
+      sprintf(sFileName, "%.*s_%s%s", (int)(sExtension - sOutputFileName), sOutputFileName, sLabel, sExtension);
+   else
+      sprintf(sFileName, "%s_%s", sOutputFileName, sLabel);
+   pOutputFile = fopen(sFileName, (geOutputType == OUT_Binary || geOutputType == OUT_Arrow) ? "wb" : "w");
+   delete [] sFileName;
+   if (pOutputFile == NULL) {
+      throw SimException("ERROR",
+         "Problem opening output file. Please verify file exists and is not in use by another program.\n");
+   }
 
-         // If ImmediateCessation is turned on, check if the current year (birth year + current age) 
-         // is equal to or greater than the last year before cessation begins.
-         if (gbImmediateCessation && ((gwPersonsYOB + wCurrentAge) >= (gwImmediateCessYear-1))) {
-            bCanInitiate = false;
-         }
+   if (geOutputType == OUT_Binary)
+      WriteBinaryHeader(pOutputFile);
+   else if (geOutputType == OUT_Arrow)
+      WriteArrowSchema(pOutputFile);
+   else if (geOutputType == OUT_Aggregate)
+      ClearAggregates();
+   return pOutputFile;
+}
 
-         if (dCurrInitiationRand <= dCurrInitiationProb && bCanInitiate) {
-            gwPersonsInitAge = wCurrentAge;
-            bPersonInitiated = true;
-         }
+// Set the number of people in each Arrow record batch.
+// The multi-threaded engine also ends a batch at the end of each block of SIM_CHUNK_SIZE people.
+void Smoking_Simulator::SetArrowBatchSize(long lBatchSize) {
+   if (lBatchSize < 1)
+      throw SimException("SetArrowBatchSize(long)", "The Arrow batch size must be at least 1.");
+   glArrowBatchSize = lBatchSize;
+   delete gpArrowWriter;
+   gpArrowWriter = 0;
+}
 
-         // If the probability was missing, it was coded as -1, sim can 
-         // stop once one of these values are reached.
-         if (dCurrInitiationProb < 0 || (((wCurrentAge+1) + gwPersonsYOB) > wSIM_CUTOFF_YEAR)) {
-            bPassedCohortMaxAge = true;
+// Turn the fast initiation mode on or off.
+// The fast mode samples the initiation age with a single draw from the initiation PRNG instead of one draw
+// per year of age. The initiation ages have the same distribution but the results differ from the default mode.
+void Smoking_Simulator::SetFastInitiation(bool bFast) {
+   gbFastInitiation = bFast;
+}
+
+// Build the distribution of the initiation age for people born in wYOB (pInitiationProbs is the slice of their
+// race/sex/cohort in the initiation table). dCumProbs[i] is the prob of initiating at or before age
+// gwMinInitiationAge + i, following the rules of the initiation loop in RunSimulation(short,short,short).
+void Smoking_Simulator::BuildInitAgeDistribution(short wYOB, const double *pInitiationProbs, double *dCumProbs) {
+   short  wNumAges    = gpModel->gwMaxInitiationAge - gpModel->gwMinInitiationAge + 1,
+          wAge,
+          i;
+   double dProb,
+          dNoInitProb = 1.0;
+   bool   bStopped    = false;
+
+   for (i = 0; i < wNumAges; i++) {
+      if (!bStopped) {
+         wAge  = gpModel->gwMinInitiationAge + i;
+         dProb = pInitiationProbs[i];
+
+         // Nobody initiates from the year before immediate cessation on
+         if (!(gbImmediateCessation && ((wYOB + wAge) >= (gwImmediateCessYear-1)))) {
+            if (dProb >= 1)
+               dNoInitProb = 0;
+            else if (dProb > 0)
+               dNoInitProb *= 1.0 - dProb;
          }
 
-         // Increment the age if they did not initiate
-         if (!bPersonInitiated) {
-            wCurrentAge++;
-         } 
+         // Missing probabilities (coded as -1) and the cutoff year end the scan
+         if (dProb < 0 || ((wAge+1) + wYOB) > wSIM_CUTOFF_YEAR)
+            bStopped = true;
       }
+      dCumProbs[i] = 1.0 - dNoInitProb;
+   }
+}
 
-      // Smoking Cessation Routine
-      // Only Occurs after a Person Initiates Smoking
-      bPassedCohortMaxAge = false;
+// Sample a person's initiation age from their initiation age distribution, returns -999 if they never initiate.
+// The distributions are built the first time each race/sex/YOB is used and rebuilt when the cutoff year changes.
+short Smoking_Simulator::SampleInitiationAge(short wRace, short wSex, short wYOB, const double *pInitiationProbs) {
+   short   wNumAges = gpModel->gwMaxInitiationAge - gpModel->gwMinInitiationAge + 1,
+           wLow,
+           wHigh,
+           wMid;
+   long    lRow,
+           lNumRows = GetNumCohortRows();
+   double *dCumProbs,
+           dRand;
+
+   if (gdInitAgeCumProbs == 0) {
+      gdInitAgeCumProbs = new double[lNumRows * wNumAges];
+      gbInitAgeRowBuilt = new bool[lNumRows];
+      gwInitAgeCutoffYear = 0;
+   }
+   if (gwInitAgeCutoffYear != wSIM_CUTOFF_YEAR) {
+      memset(gbInitAgeRowBuilt, 0, lNumRows * sizeof(bool));
+      gwInitAgeCutoffYear = wSIM_CUTOFF_YEAR;
+   }
 
-      if (bPersonInitiated) {
+   lRow      = GetCohortRow(wRace, wSex, wYOB);
+   dCumProbs = gdInitAgeCumProbs + lRow * wNumAges;
+   if (!gbInitAgeRowBuilt[lRow]) {
+      BuildInitAgeDistribution(wYOB, pInitiationProbs, dCumProbs);
+      gbInitAgeRowBuilt[lRow] = true;
+   }
 
-         // Increment the persons current age(also initiation age) if less than the minimum cessation age.
-         while ( wCurrentAge < gwMinCessationAge )
-            wCurrentAge++;
+   dRand = gpContext->GetNextInitRand();
+   if (dRand >= dCumProbs[wNumAges-1])
+      return -999;
+
+   // First age whose cumulative prob exceeds the draw
+   wLow  = 0;
+   wHigh = wNumAges - 1;
+   while (wLow < wHigh) {
+      wMid = (wLow + wHigh) / 2;
+      if (dRand < dCumProbs[wMid])
+         wHigh = wMid;
+      else
+         wLow = wMid + 1;
+   }
+   return gpModel->gwMinInitiationAge + wLow;
+}
 
-         wSearchOffset = ((gwPersonsRace)*gwCessProbRaceOffset) + ((gwPersonsSex)*gwCessProbSexOffset) +
-                          ((wYOBCohortGroup)*(gwCessProbYOBOffset));
+// Turn the fast other COD mode on or off.
+// The fast mode samples the age of death of never and current smokers with a single draw from the life table PRNG
+// for each smoking status instead of one draw per year of age. Former smokers still draw every year (their
+// probabilities depend on their own history). The ages have the same distribution but the results differ.
+void Smoking_Simulator::SetFastOtherCOD(bool bFast) {
+   gbFastOtherCOD = bFast;
+}
 
-         while (!bPersonQuit && !bPassedCohortMaxAge && (wCurrentAge <= gwMaxCessationAge)) {
+// Set the coefficients B0, B1, B2 and B3 of the excess risk formula for former smokers (Davis Burns et al.),
+// dCoefficients holds NUM_FORMER_RISK_COEFS values. The defaults are the B0 to B3 constants.
+void Smoking_Simulator::SetFormerRiskCoefficients(const double* dCoefficients) {
+   short i;
 
-            // If ImmediateCessation is turned on, check if the current year (birth year + current age) is 
-            // equal to or greater than the last year before cessation begins.
-            if (gbImmediateCessation && ((gwPersonsYOB + wCurrentAge) >= (gwImmediateCessYear-1))) {
-               bForceCessation = true;
-            }
+   for (i = 0; i < NUM_FORMER_RISK_COEFS; i++)
+      gdFormerRiskCoefs[i] = dCoefficients[i];
+   BuildExcessRiskTable();
+}
 
-            dCurrCessationRand = GetNextCessRand();
-            dCurrCessationProb = gdCessationProbs[(wCurrentAge-gwMinCessationAge)+wSearchOffset];
+// Number of race/sex/YOB rows in the tables of the fast initiation and other COD modes
+// (years of birth accepted by RunSimulation(short,short,short))
+long Smoking_Simulator::GetNumCohortRows() {
+   return (long) gpModel->gwNumRaceValues * gpModel->gwNumSexValues * (2020 - GetMinYearOfBirth() + 1);
+}
 
-            if (dCurrCessationRand <= dCurrCessationProb || bForceCessation) {
-               gwPersonsCessAge  = wCurrentAge;
-               bPersonQuit = true;
-            }
+// Row of the fast initiation and other COD mode tables for a person
+long Smoking_Simulator::GetCohortRow(short wRace, short wSex, short wYOB) {
+   return ((long) wRace * gpModel->gwNumSexValues + wSex) * (2020 - GetMinYearOfBirth() + 1) + (wYOB - GetMinYearOfBirth());
+}
 
-            // If the probability was missing, it was coded as -1, 
-            // simulation can stop once one of these values are reached.
-            if (dCurrCessationProb < 0 || (((wCurrentAge+1) + gwPersonsYOB) > wSIM_CUTOFF_YEAR)) 
-               bPassedCohortMaxAge = true;
-            //Age can be incremented either way here, unlike initiation
-            wCurrentAge++;
-            }
-         }
+// Build the other COD survival curve of one life table column for the current person's race, sex and YOB.
+// dSurvival[i] is the prob of not dying from other COD at ages gwMinLifeTableAge to gwMinLifeTableAge + i
+// (missing probs count as 0), wNextMissing[i] is the first age from gwMinLifeTableAge + i on with a missing prob.
+void Smoking_Simulator::BuildOCDSurvival(short wColumn, double *dSurvival, short *wNextMissing) {
+   short  wNumAges = gpModel->gwMaxLifeTableAge - gpModel->gwMinLifeTableAge + 1,
+          wMissingAge,
+          i;
+   long   lLifeTableOffset;
+   double dProb,
+          dAlive = 1.0;
+
+   lLifeTableOffset = gpContext->glPersonsLifeTabOffset + wColumn;
+
+   for (i = 0; i < wNumAges; i++) {
+      dProb = gpModel->gdLifeTableProbs[lLifeTableOffset + long(i) * gpModel->glLifeTabAgeOffset];
+      if (dProb >= 1)
+         dAlive = 0;
+      else if (dProb > 0)
+         dAlive *= 1.0 - dProb;
+      dSurvival[i] = dAlive;
+   }
 
-      // Calculate the number of cigarettes smoked per day by people who initiate smoking
-      if (bPersonInitiated) {
-         CalcCigarettesPerDaySwitch();
-      }
+   wMissingAge = gpModel->gwMaxLifeTableAge + 1;
+   for (i = wNumAges - 1; i >= 0; i--) {
+      if (gpModel->gdLifeTableProbs[lLifeTableOffset + long(i) * gpModel->glLifeTabAgeOffset] < 0)
+         wMissingAge = gpModel->gwMinLifeTableAge + i;
+      wNextMissing[i] = wMissingAge;
+   }
+}
 
-      // Calculate if person dies from a Cause of Death other than lung cancer
-      // Loop through their entire life and check the probablility that the
-      // person will die that year based on their smoking status in that year
-      // Routine to use varies based on persons smoking history
+// Sample the age of death from other COD in ages wStartAge to wEndAge - 1 from the survival curve of a life table
+// column, using one draw from the life table PRNG. Gives the same distribution as the loop in
+// GetAgeOfDeathFromOtherCOD: returns -999 if the person survives the ages, bWentPastData is set when a missing
+// prob is reached first.
+short Smoking_Simulator::SampleAgeOfDeathFromOtherCOD(short wStartAge, short wEndAge, short wColumn, bool &bWentPastData) {
+   short   wNumAges = gpModel->gwMaxLifeTableAge - gpModel->gwMinLifeTableAge + 1,
+           wStart,
+           wLimit,
+           wLow,
+           wHigh,
+           wMid,
+           i;
+   long    lRow,
+           lNumRows = GetNumCohortRows() * SmokingModel::COL_NumColumns,
+           lLifeTableOffset;
+   double *dSurvival,
+           dTarget,
+           dAlive,
+           dProb;
+   short  *wNextMissing;
+
+   bWentPastData = false;
+   if (wStartAge >= wEndAge)
+      return -999;
+
+   if (gdOCDSurvival == 0) {
+      gdOCDSurvival    = new double[lNumRows * wNumAges];
+      gwOCDNextMissing = new short[lNumRows * wNumAges];
+      gbOCDRowBuilt    = new bool[lNumRows];
+      memset(gbOCDRowBuilt, 0, lNumRows * sizeof(bool));
+   }
 
-      // People who never smoke
-      if (!bPersonInitiated) {
-         gwPersonsAgeAtDeath = GetAgeOfDeathFromOtherCOD(gwMinLifeTableAge, gwMaxLifeTableAge + 1, SMKST_Never, bPassedLifeTabMaxAge);
+   lRow         = GetCohortRow(gpContext->gwPersonsRace, gpContext->gwPersonsSex, gpContext->gwPersonsYOB) * SmokingModel::COL_NumColumns + wColumn;
+   dSurvival    = gdOCDSurvival + lRow * wNumAges;
+   wNextMissing = gwOCDNextMissing + lRow * wNumAges;
+   if (!gbOCDRowBuilt[lRow]) {
+      BuildOCDSurvival(wColumn, dSurvival, wNextMissing);
+      gbOCDRowBuilt[lRow] = true;
+   }
 
-      // People who start smoking, and never quit
-      } else if (bPersonInitiated && !bPersonQuit) {
-         wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gwMinLifeTableAge, gwPersonsInitAge, SMKST_Never, bPassedLifeTabMaxAge);
-         if ( (wAgeAtDeath == -999) && !bPassedLifeTabMaxAge ) {
-            wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gwPersonsInitAge,gwMaxLifeTableAge+1, SMKST_Current, bPassedLifeTabMaxAge);
-         }
-         gwPersonsAgeAtDeath = wAgeAtDeath;
-
-      // People who start smoking and quit smoking
-      } else if (bPersonInitiated && bPersonQuit) {
-         wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gwMinLifeTableAge,gwPersonsInitAge, SMKST_Never, bPassedLifeTabMaxAge);
-         if ((wAgeAtDeath == -999) && !bPassedLifeTabMaxAge) {
-            wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gwPersonsInitAge,gwPersonsCessAge, SMKST_Current, bPassedLifeTabMaxAge);
-            if ((wAgeAtDeath == -999) && !bPassedLifeTabMaxAge) {
-               wAgeAtDeath = GetAgeOfDeathFromOtherCOD(gwPersonsCessAge,gwMaxLifeTableAge+1, SMKST_Former, bPassedLifeTabMaxAge);
-            }
+   // The person dies at the first age where the prob of surviving from wStartAge falls below 1 - draw
+   wStart  = wStartAge - gpModel->gwMinLifeTableAge;
+   wLimit  = ((wEndAge < wNextMissing[wStart]) ? wEndAge : wNextMissing[wStart]) - gpModel->gwMinLifeTableAge;
+   dTarget = 1.0 - gpContext->GetNextLifeTabRand();
+
+   if (wStart < wLimit && wStart > 0 && dSurvival[wStart-1] <= 0) {
+      // A prob of 1 before wStartAge leaves nothing of the curve, follow the probs from wStartAge instead
+      lLifeTableOffset = gpContext->glPersonsLifeTabOffset + wColumn;
+      dAlive = 1.0;
+      for (i = wStart; i < wLimit; i++) {
+         dProb = gpModel->gdLifeTableProbs[lLifeTableOffset + long(i) * gpModel->glLifeTabAgeOffset];
+         if (dProb >= 1)
+            dAlive = 0;
+         else if (dProb > 0)
+            dAlive *= 1.0 - dProb;
+         if (dAlive < dTarget)
+            return gpModel->gwMinLifeTableAge + i;
+      }
+   } else if (wStart < wLimit) {
+      dTarget *= (wStart > 0) ? dSurvival[wStart-1] : 1.0;
+      if (dSurvival[wLimit-1] < dTarget) {
+         wLow  = wStart;
+         wHigh = wLimit - 1;
+         while (wLow < wHigh) {
+            wMid = (wLow + wHigh) / 2;
+            if (dSurvival[wMid] < dTarget)
+               wHigh = wMid;
+            else
+               wLow = wMid + 1;
          }
-         gwPersonsAgeAtDeath = wAgeAtDeath;
+         return gpModel->gwMinLifeTableAge + wLow;
       }
+   }
 
-      if (pOutStream != 0)
-         WriteToStream(pOutStream);
+   if (wNextMissing[wStart] < wEndAge)
+      bWentPastData = true;
+   return -999;
+}
 
-      // Oversample the PRNGs (only does the PRNG that generates Randoms for the individual)
-      // More oversampling can be added if desired.
-      OversamplePRNGs();
+// Indexed mode only: position the PRNGs so the next call to RunSimulation(short,short,short)
+// simulates person ulPersonIndex, the same as running persons 0 to ulPersonIndex in order
+// after SetIndexedMode(true).
+void Smoking_Simulator::SeekPerson(unsigned long ulPersonIndex) {
+   if (!gbIndexedMode)
+      throw SimException("SeekPerson(unsigned long)", "Persons can only be selected by index in indexed mode.");
+   gpContext->SeekPRNGs(ulPersonIndex, guiDrawBudgetPower);
+}
 
-   } catch (SimException ex) {
-      ex.AddCallPath("RunSimulation(short,short,short)");
-      throw ex;
+// Turn indexed mode on or off.
+// In indexed mode person i uses draws i*B to (i+1)*B - 1 of every PRNG, where B is a fixed budget
+// large enough for any person, so any person can be simulated without simulating the ones before it.
+// Turning the mode on positions the PRNGs at person 0.
+void Smoking_Simulator::SetIndexedMode(bool bIndexed) {
+   gbIndexedMode = bIndexed;
+   if (bIndexed) {
+      guiDrawBudgetPower = CalcDrawBudgetPower();
+      SeekPerson(0);
+   }
+}
+
+// Immediate Cessation Values are initialized to 0 and false respectively,
+// Check to see if they need to be changed.
+void Smoking_Simulator::SetImmediateCessation(short wCessationYear) {
+   char sErrorMessage[300];
+   if ((wCessationYear != 0) || (wCessationYear >= wMIN_IMMEDIATE_CESSATION_YEAR && wCessationYear <= wSIM_CUTOFF_YEAR)) {
+      gwImmediateCessYear = wCessationYear;
+      gbImmediateCessation = true;
+      gwInitAgeCutoffYear = 0;   // Initiation age distributions depend on the cessation year
+   } else if ( wCessationYear != 0) {
+      sprintf(sErrorMessage, "Invalid Value for Immediate Cessation Year.\n \
+         Valid values are 0 and the range %d to %d.\n", wMIN_IMMEDIATE_CESSATION_YEAR, wSIM_CUTOFF_YEAR);
+      throw SimException("Error", sErrorMessage);
    }
 }
 
@@ -1719,6 +1909,112 @@ void  Smoking_Simulator::SetOutputType(short wOutputType) {
    geOutputType = eOutputType;
 }
 
+// Choose the generator used by the four PRNGs (PRNGType in random_generator.h).
+// The PRNGs keep their seeds and restart at the first draw (person 0 in indexed mode).
+void  Smoking_Simulator::SetPRNGType(short wPRNGType) {
+   char        sErrorMessage[500];
+   if ( (wPRNGType < PRNG_MersenneTwister) || (wPRNGType >= PRNG_NumTypes)) {
+      sprintf(sErrorMessage, "Invalid Value supplied for PRNG Type : %d", wPRNGType);
+      throw SimException("SetPRNGType(short)", sErrorMessage);
+   }
+   gpContext->SetPRNGType((PRNGType)wPRNGType);
+}
+
+// Body of a worker thread for RunSimulationThreaded.
+// Takes the next queued block, simulates it with the worker's own simulator and marks it done.
+void* Smoking_Simulator::WorkerThread(void* pArg) {
+
+   SimWorker     *pWorker = (SimWorker*)pArg;
+   SimThreadPool *pPool   = pWorker->pPool;
+   SimChunk      *pChunk;
+   long           i;
+
+   pthread_mutex_lock(&pPool->mutex);
+   while (true) {
+      while (!pPool->bShutdown && pPool->lNextToRun >= pPool->lNumQueued) {
+         pthread_cond_wait(&pPool->condWorkReady, &pPool->mutex);
+      }
+      if (pPool->bShutdown) {
+         break;
+      }
+      pChunk = &pPool->pChunks[pPool->lNextToRun % pPool->wNumSlots];
+      pPool->lNextToRun++;
+      pChunk->eState = CHUNK_Running;
+      pthread_mutex_unlock(&pPool->mutex);
+
+      delete pChunk->pError;
+      pChunk->pError = 0;
+      rewind(pChunk->pResults);
+      try {
+         pWorker->pSimulator->gpContext->CopyPRNGs(*pChunk->pStartState);
+         pWorker->pSimulator->gbBufferOutput = true;
+         for (i = 0; i < pChunk->lNumRecords; i++) {
+            pWorker->pSimulator->RunSimulation(pChunk->wRace[i], pChunk->wSex[i], pChunk->wYOB[i], pChunk->pResults);
+         }
+      } catch (SimException ex) {
+         ex.AddCallPath("WorkerThread()");
+         pChunk->pError = new SimException(ex);
+      }
+      pWorker->pSimulator->FlushOutput();
+      fflush(pChunk->pResults);
+      pChunk->lResultsLength = ftell(pChunk->pResults);
+
+      pthread_mutex_lock(&pPool->mutex);
+      pChunk->eState = CHUNK_Done;
+      pthread_cond_broadcast(&pPool->condWorkDone);
+   }
+   pthread_mutex_unlock(&pPool->mutex);
+
+   return 0;
+}
+
+// Write the data style output held by the writer and go back to writing each person as they are simulated
+void Smoking_Simulator::FlushOutput() {
+   gbBufferOutput = false;
+   if (gpWriter != 0)
+      gpWriter->Flush();
+   if (gpBinaryWriter != 0)
+      gpBinaryWriter->Flush();
+   if (gpArrowWriter != 0)
+      gpArrowWriter->Flush();
+}
+
+// Write the Arrow schema that starts the Arrow output, the run settings are stored as schema metadata
+void Smoking_Simulator::WriteArrowSchema(FILE *pOutStream) {
+   char        sSeeds[100], sDataHash[20], sCutoffYear[10], sCessationYear[10];
+   const char *sMetadata[6][2];
+
+   sprintf(sSeeds, "%lu,%lu,%lu,%lu", gpContext->gpInitiationPRNG->GetSeed(), gpContext->gpCessationPRNG->GetSeed(),
+                                      gpContext->gpLifeTablePRNG->GetSeed(), gpContext->gpIndivRndsPRNG->GetSeed());
+   sprintf(sDataHash, "%016llx", gpModel->GetDataHash());
+   sprintf(sCutoffYear, "%d", wSIM_CUTOFF_YEAR);
+   sprintf(sCessationYear, "%d", gwImmediateCessYear);
+   sMetadata[0][0] = "seeds";            sMetadata[0][1] = sSeeds;
+   sMetadata[1][0] = "data_hash";        sMetadata[1][1] = sDataHash;
+   sMetadata[2][0] = "prng";             sMetadata[2][1] = (gpContext->GetPRNGType() == PRNG_Philox) ? "philox" : "mt";
+   sMetadata[3][0] = "cutoff_year";      sMetadata[3][1] = sCutoffYear;
+   sMetadata[4][0] = "cessation_year";   sMetadata[4][1] = sCessationYear;
+   sMetadata[5][0] = "indexed";          sMetadata[5][1] = gbIndexedMode ? "1" : "0";
+   ArrowStreamWriter::WriteSchema(pOutStream, sMetadata, 6);
+}
+
+// Write the file header of the binary output, identifies the seeds and data files used for the results
+void Smoking_Simulator::WriteBinaryHeader(FILE *pOutStream) {
+   BinaryOutputHeader header;
+
+   memset(&header, 0, sizeof(header));
+   header.ullSeeds[0]    = gpContext->gpInitiationPRNG->GetSeed();
+   header.ullSeeds[1]    = gpContext->gpCessationPRNG->GetSeed();
+   header.ullSeeds[2]    = gpContext->gpLifeTablePRNG->GetSeed();
+   header.ullSeeds[3]    = gpContext->gpIndivRndsPRNG->GetSeed();
+   header.ullDataHash    = gpModel->GetDataHash();
+   header.wPRNGType      = (short)gpContext->GetPRNGType();
+   header.wCutoffYear    = wSIM_CUTOFF_YEAR;
+   header.wCessationYear = gwImmediateCessYear;
+   header.wIndexedMode   = gbIndexedMode ? 1 : 0;
+   BinaryOutputWriter::WriteHeader(pOutStream, header);
+}
+
 // Write the output to pOutStream in the appropriate format
 void Smoking_Simulator::WriteToStream(FILE *pOutStream) {
    try {
@@ -1732,6 +2028,15 @@ void Smoking_Simulator::WriteToStream(FILE *pOutStream) {
          case OUT_XML_Tags:
             WriteAsXML(pOutStream); 
             break;
+         case OUT_Binary:
+            WriteAsBinary(pOutStream);
+            break;
+         case OUT_Arrow:
+            WriteAsArrow(pOutStream);
+            break;
+         case OUT_Aggregate:
+            // People are counted by RunSimulation, the tables are written by WriteAggregates
+            break;
          case OUT_DataOnly:
          default:
             WriteAsData(pOutStream); 
@@ -1751,38 +2056,38 @@ void Smoking_Simulator::WriteAsText(FILE *pOutStream) {
       throw SimException("WriteAsText(FILE *)","Supplied output File is not open for writing.");
 
    fprintf(pOutStream, "========================================================\n");
-   fprintf(pOutStream, " Race:            %s\n", sRACE_LABELS[gwPersonsRace]);
-   fprintf(pOutStream, " Sex:             %s\n", sSEX_LABELS[gwPersonsSex]);
-   fprintf(pOutStream, " Year Of Birth:   %d\n", gwPersonsYOB);
-
-   if (gwPersonsInitAge >= 0) {
-      fprintf(pOutStream," Initiation Age:  %d\n", gwPersonsInitAge);
-      if (gwPersonsCessAge >= 0)
-         fprintf(pOutStream, " Cessation Age:   %d\n", gwPersonsCessAge);
+   fprintf(pOutStream, " Race:            %s\n", sRACE_LABELS[gpContext->gwPersonsRace]);
+   fprintf(pOutStream, " Sex:             %s\n", sSEX_LABELS[gpContext->gwPersonsSex]);
+   fprintf(pOutStream, " Year Of Birth:   %d\n", gpContext->gwPersonsYOB);
+
+   if (gpContext->gwPersonsInitAge >= 0) {
+      fprintf(pOutStream," Initiation Age:  %d\n", gpContext->gwPersonsInitAge);
+      if (gpContext->gwPersonsCessAge >= 0)
+         fprintf(pOutStream, " Cessation Age:   %d\n", gpContext->gwPersonsCessAge);
       else fprintf(pOutStream, " Cessation Age:   Person Never Quit Smoking.\n"); } else {
       fprintf(pOutStream, " Initiation Age:  Person Never Initiated Smoking.\n");
    }
 
-   if (gwPersonsAgeAtDeath >= 0) {
-      fprintf(pOutStream, " Age At Death:    %d\n", gwPersonsAgeAtDeath);
+   if (gpContext->gwPersonsAgeAtDeath >= 0) {
+      fprintf(pOutStream, " Age At Death:    %d\n", gpContext->gwPersonsAgeAtDeath);
    } else {
       fprintf(pOutStream, " Age At Death:    Person alive through %d.\n", wSIM_CUTOFF_YEAR);
    }
 
-   if (gwPersonsInitAge >= 0) {
+   if (gpContext->gwPersonsInitAge >= 0) {
       fprintf(pOutStream, " People are not put into a smoker category for life in SHG v2.0.");
-      fprintf(pOutStream, " Intensity Probability : %f .\n", gdTempIntensityProb);
+      fprintf(pOutStream, " Intensity Probability : %f .\n", gpContext->gdTempIntensityProb);
 
-      if (gwPersonsCessAge == -999)
-         wYearsAsSmoker = (wSIM_CUTOFF_YEAR - (gwPersonsYOB+gwPersonsInitAge)) + 1;
+      if (gpContext->gwPersonsCessAge == -999)
+         wYearsAsSmoker = (wSIM_CUTOFF_YEAR - (gpContext->gwPersonsYOB+gpContext->gwPersonsInitAge)) + 1;
       else
-         wYearsAsSmoker = (gwPersonsCessAge - gwPersonsInitAge) + 1;
+         wYearsAsSmoker = (gpContext->gwPersonsCessAge - gpContext->gwPersonsInitAge) + 1;
 
       fprintf(pOutStream, " Age        Cigarettes per day\n");
 
       for (i=0; i<wYearsAsSmoker; i++) {
-         if (i + gwPersonsInitAge < 100) {
-            fprintf(pOutStream, " %d         %f\n", (i+gwPersonsInitAge), gdPersonsCPDbyAge[i]);
+         if (i + gpContext->gwPersonsInitAge < 100) {
+            fprintf(pOutStream, " %d         %f\n", (i+gpContext->gwPersonsInitAge), gpContext->gdPersonsCPDbyAge[i]);
          }
       }
    }
@@ -1798,17 +2103,17 @@ void  Smoking_Simulator::WriteAsTimeline(FILE *pOutStream) {
       throw SimException("WriteAsTimeline(FILE *)", \
          "Supplied output File is not open for writing.");
 
-   fprintf(pOutStream, "Hist !%c %c %d ", sRACE_LABELS[gwPersonsRace][0], sSEX_LABELS[gwPersonsSex][0], gwPersonsYOB);
+   fprintf(pOutStream, "Hist !%c %c %d ", sRACE_LABELS[gpContext->gwPersonsRace][0], sSEX_LABELS[gpContext->gwPersonsSex][0], gpContext->gwPersonsYOB);
 
-   if (gwPersonsInitAge >= 0 && gwPersonsCessAge >= 0)
-      fprintf(pOutStream, "%d %d ", gwPersonsInitAge, gwPersonsCessAge);
-   else if (gwPersonsInitAge >= 0)
-      fprintf(pOutStream, "%d - ", gwPersonsInitAge);
+   if (gpContext->gwPersonsInitAge >= 0 && gpContext->gwPersonsCessAge >= 0)
+      fprintf(pOutStream, "%d %d ", gpContext->gwPersonsInitAge, gpContext->gwPersonsCessAge);
+   else if (gpContext->gwPersonsInitAge >= 0)
+      fprintf(pOutStream, "%d - ", gpContext->gwPersonsInitAge);
    else
       fprintf(pOutStream, "- - ");
 
-   if (gwPersonsAgeAtDeath >= 0)
-      fprintf(pOutStream, "%d\n", gwPersonsAgeAtDeath);
+   if (gpContext->gwPersonsAgeAtDeath >= 0)
+      fprintf(pOutStream, "%d\n", gpContext->gwPersonsAgeAtDeath);
    else
       fprintf(pOutStream, "-\n");
 
@@ -1816,36 +2121,36 @@ void  Smoking_Simulator::WriteAsTimeline(FILE *pOutStream) {
 
    for (i = 0; i < 17; i++)
       fprintf(pOutStream, "----+");
-   wStopAge = wSIM_CUTOFF_YEAR - gwPersonsYOB;
+   wStopAge = wSIM_CUTOFF_YEAR - gpContext->gwPersonsYOB;
 
-   if (gwPersonsAgeAtDeath != 0)
-      fprintf(pOutStream, "\n%4d !", gwPersonsYOB);
+   if (gpContext->gwPersonsAgeAtDeath != 0)
+      fprintf(pOutStream, "\n%4d !", gpContext->gwPersonsYOB);
    else
-      fprintf(pOutStream, "\n%4d X", gwPersonsYOB);
+      fprintf(pOutStream, "\n%4d X", gpContext->gwPersonsYOB);
 
-   if ( gwPersonsInitAge >= 0) {
-      for (i = 1; i < gwPersonsInitAge; i++) {
-         if (i != gwPersonsAgeAtDeath)
+   if ( gpContext->gwPersonsInitAge >= 0) {
+      for (i = 1; i < gpContext->gwPersonsInitAge; i++) {
+         if (i != gpContext->gwPersonsAgeAtDeath)
             fprintf(pOutStream,"-");
          else
             fprintf(pOutStream,"X");
       }
-      if (gwPersonsCessAge >= 0) {
-         for (i = gwPersonsInitAge; i < gwPersonsCessAge; i++) {
-            if (i != gwPersonsAgeAtDeath)
+      if (gpContext->gwPersonsCessAge >= 0) {
+         for (i = gpContext->gwPersonsInitAge; i < gpContext->gwPersonsCessAge; i++) {
+            if (i != gpContext->gwPersonsAgeAtDeath)
                fprintf(pOutStream,"s");
             else
                fprintf(pOutStream,"X");
          }
-         for (i = gwPersonsCessAge; i <= wStopAge; i++) {
-            if (i != gwPersonsAgeAtDeath)
+         for (i = gpContext->gwPersonsCessAge; i <= wStopAge; i++) {
+            if (i != gpContext->gwPersonsAgeAtDeath)
                fprintf(pOutStream, "q");
             else
                fprintf(pOutStream, "X");
          }
       } else {
-         for (i = gwPersonsInitAge; i <= wStopAge; i++) {
-            if (i != gwPersonsAgeAtDeath)
+         for (i = gpContext->gwPersonsInitAge; i <= wStopAge; i++) {
+            if (i != gpContext->gwPersonsAgeAtDeath)
                fprintf(pOutStream, "s");
             else
                fprintf(pOutStream, "X");
@@ -1853,7 +2158,7 @@ void  Smoking_Simulator::WriteAsTimeline(FILE *pOutStream) {
       }
    } else {
       for (i = 1; i <= wStopAge; i++) {
-         if (i != gwPersonsAgeAtDeath)
+         if (i != gpContext->gwPersonsAgeAtDeath)
             fprintf(pOutStream, "-");
          else
             fprintf(pOutStream, "X");
@@ -1871,27 +2176,27 @@ void  Smoking_Simulator::WriteAsXML(FILE *pOutStream) {
       throw SimException("WriteAsTimeline(FILE *)", "Supplied output File is not open for writing.");
    }
    fprintf(pOutStream, "<RESULT>\n");
-   fprintf(pOutStream, "<INITIATION_AGE>\n%d\n</INITIATION_AGE>\n", gwPersonsInitAge);
-   fprintf(pOutStream, "<CESSATION_AGE>\n%d\n</CESSATION_AGE>\n", gwPersonsCessAge);
-   fprintf(pOutStream, "<OCD_AGE>\n%d\n</OCD_AGE>\n", gwPersonsAgeAtDeath);
-   if (gwPersonsInitAge >= 0) {
+   fprintf(pOutStream, "<INITIATION_AGE>\n%d\n</INITIATION_AGE>\n", gpContext->gwPersonsInitAge);
+   fprintf(pOutStream, "<CESSATION_AGE>\n%d\n</CESSATION_AGE>\n", gpContext->gwPersonsCessAge);
+   fprintf(pOutStream, "<OCD_AGE>\n%d\n</OCD_AGE>\n", gpContext->gwPersonsAgeAtDeath);
+   if (gpContext->gwPersonsInitAge >= 0) {
       fprintf(pOutStream, "<SMOKING_HIST>\n");
       fprintf(pOutStream, "<INTENSITY>\n");
       fprintf(pOutStream, "Not applicable in SHG v2\n"); 
       fprintf(pOutStream, "</INTENSITY>\n");
 
-      if (gwPersonsCessAge == -999) // Person does not quit smoking
-         wYearsAsSmoker = (wSIM_CUTOFF_YEAR - (gwPersonsYOB+gwPersonsInitAge))+1;
+      if (gpContext->gwPersonsCessAge == -999) // Person does not quit smoking
+         wYearsAsSmoker = (wSIM_CUTOFF_YEAR - (gpContext->gwPersonsYOB+gpContext->gwPersonsInitAge))+1;
       else
-         wYearsAsSmoker = (gwPersonsCessAge - gwPersonsInitAge) + 1;
+         wYearsAsSmoker = (gpContext->gwPersonsCessAge - gpContext->gwPersonsInitAge) + 1;
 
       // Print out number of age_CPD Combos to expect
       fprintf(pOutStream, "<AGE_CPD_COUNT>\n%d\n</AGE_CPD_COUNT>\n", wYearsAsSmoker);
       for (i = 0; i < wYearsAsSmoker; i++) {
-         if (i + gwPersonsInitAge < 100) {
+         if (i + gpContext->gwPersonsInitAge < 100) {
             fprintf(pOutStream, "<AGE_CPD>\n");
-            fprintf(pOutStream, "<AGE>\n%d\n</AGE>\n", (i+gwPersonsInitAge));
-            fprintf(pOutStream, "<CPD>\n%f\n</CPD>\n", gdPersonsCPDbyAge[i]);
+            fprintf(pOutStream, "<AGE>\n%d\n</AGE>\n", (i+gpContext->gwPersonsInitAge));
+            fprintf(pOutStream, "<CPD>\n%f\n</CPD>\n", gpContext->gdPersonsCPDbyAge[i]);
             fprintf(pOutStream, "</AGE_CPD>\n");
          }
       }
@@ -1900,6 +2205,84 @@ void  Smoking_Simulator::WriteAsXML(FILE *pOutStream) {
    fprintf(pOutStream, "</RESULT>\n");
 }
 
+// Count the last person simulated in the aggregate tables
+void Smoking_Simulator::AddToAggregates() {
+   if (gpAggregates == 0)
+      gpAggregates = new AggregateTables(GetNumRaceValues(), GetNumSexValues(), GetMinYearOfBirth(), GetMaxYearOfBirth());
+   gpAggregates->AddPerson(gpContext->gwPersonsRace, gpContext->gwPersonsSex, gpContext->gwPersonsYOB,
+                           gpContext->gwPersonsInitAge, gpContext->gwPersonsCessAge, gpContext->gwPersonsAgeAtDeath,
+                           gpContext->gdPersonsCPDbyAge, GetNumCPDValues(), wSIM_CUTOFF_YEAR);
+}
+
+// Add the aggregate tables of another simulator to this simulator's tables
+void Smoking_Simulator::AddToAggregates(const AggregateTables &tables) {
+   if (gpAggregates == 0)
+      gpAggregates = new AggregateTables(GetNumRaceValues(), GetNumSexValues(), GetMinYearOfBirth(), GetMaxYearOfBirth());
+   gpAggregates->Add(tables);
+}
+
+// Start new aggregate tables
+void Smoking_Simulator::ClearAggregates() {
+   if (gpAggregates != 0)
+      gpAggregates->Clear();
+}
+
+// Write the aggregate tables for the people simulated since the last ClearAggregates()
+void Smoking_Simulator::WriteAggregates(FILE *pOutStream) {
+   if (pOutStream == 0) {
+      throw SimException("WriteAggregates(FILE *)", "Supplied output File is not open for writing.");
+   }
+   if (gpAggregates == 0)
+      gpAggregates = new AggregateTables(GetNumRaceValues(), GetNumSexValues(), GetMinYearOfBirth(), GetMaxYearOfBirth());
+   gpAggregates->Write(pOutStream, wSIM_CUTOFF_YEAR);
+}
+
+// Number of values of gdPersonsCPDbyAge written by WriteAsData (ages InitAge up to 99)
+short Smoking_Simulator::GetNumCPDValues() {
+   short wYearsAsSmoker = 0;
+   if (gpContext->gwPersonsInitAge != -999) {
+      if (gpContext->gwPersonsCessAge == -999) 
+         wYearsAsSmoker = wSIM_CUTOFF_YEAR - (gpContext->gwPersonsYOB + gpContext->gwPersonsInitAge) + 1;
+      else 
+         wYearsAsSmoker = gpContext->gwPersonsCessAge - gpContext->gwPersonsInitAge + 1;
+      wYearsAsSmoker = min(wYearsAsSmoker, (short)(100 - gpContext->gwPersonsInitAge));
+   }
+   return max(wYearsAsSmoker, (short)0);
+}
+
+// Add the results to the Arrow output for pOutStream (see arrow_writer.h for the columns)
+void Smoking_Simulator::WriteAsArrow(FILE *pOutStream) {
+   if (pOutStream == 0) {
+      throw SimException("WriteAsArrow(FILE *)", "Supplied output File is not open for writing.");
+   }
+
+   if (gpArrowWriter == 0)
+      gpArrowWriter = new ArrowStreamWriter(glArrowBatchSize);
+   gpArrowWriter->SetStream(pOutStream);
+   gpArrowWriter->AddPerson(gpContext->gwPersonsRace, gpContext->gwPersonsSex, gpContext->gwPersonsYOB,
+                            gpContext->gwPersonsInitAge, gpContext->gwPersonsCessAge, gpContext->gwPersonsAgeAtDeath,
+                            gpContext->gdPersonsCPDbyAge, GetNumCPDValues());
+   if (!gbBufferOutput)
+      gpArrowWriter->Flush();
+}
+
+// Add the results to the binary output for pOutStream (see output_writer.h for the layout).
+// The CPD values are the ones written by WriteAsData.
+void Smoking_Simulator::WriteAsBinary(FILE *pOutStream) {
+   if (pOutStream == 0) {
+      throw SimException("WriteAsBinary(FILE *)", "Supplied output File is not open for writing.");
+   }
+
+   if (gpBinaryWriter == 0)
+      gpBinaryWriter = new BinaryOutputWriter(SIM_CHUNK_SIZE);
+   gpBinaryWriter->SetStream(pOutStream);
+   gpBinaryWriter->AddPerson(gpContext->gwPersonsRace, gpContext->gwPersonsSex, gpContext->gwPersonsYOB,
+                             gpContext->gwPersonsInitAge, gpContext->gwPersonsCessAge, gpContext->gwPersonsAgeAtDeath,
+                             gpContext->gdPersonsCPDbyAge, GetNumCPDValues());
+   if (!gbBufferOutput)
+      gpBinaryWriter->Flush();
+}
+
 // Write the results to pOutStream in a data style format
 void Smoking_Simulator::WriteAsData(FILE *pOutStream) {
    short wYearsAsSmoker, i;
@@ -1907,22 +2290,31 @@ void Smoking_Simulator::WriteAsData(FILE *pOutStream) {
       throw SimException("WriteAsData(FILE *)", "Supplied output File is not open for writing.");
    }
 
-   fprintf(pOutStream, "%d;%d;%d;%d;%d;%d;", gwPersonsRace, gwPersonsSex, gwPersonsYOB, \
-                       gwPersonsInitAge, gwPersonsCessAge, gwPersonsAgeAtDeath);
+   gpWriter->SetStream(pOutStream);
+   gpWriter->WriteInt(gpContext->gwPersonsRace);       gpWriter->WriteChar(';');
+   gpWriter->WriteInt(gpContext->gwPersonsSex);        gpWriter->WriteChar(';');
+   gpWriter->WriteInt(gpContext->gwPersonsYOB);        gpWriter->WriteChar(';');
+   gpWriter->WriteInt(gpContext->gwPersonsInitAge);    gpWriter->WriteChar(';');
+   gpWriter->WriteInt(gpContext->gwPersonsCessAge);    gpWriter->WriteChar(';');
+   gpWriter->WriteInt(gpContext->gwPersonsAgeAtDeath); gpWriter->WriteChar(';');
 
    // Print out the smoking intensity group for the person and the cigarettes smoked per day
    // Print the intensity group as +1 its value so range of values is from 1 to 5.
-   if (gwPersonsInitAge != -999) {
+   if (gpContext->gwPersonsInitAge != -999) {
       // fprintf(pOutStream, "%d;", 0);  //(short)gwPersonsSmkIntensity+1);
-      if (gwPersonsCessAge == -999) 
-         wYearsAsSmoker = wSIM_CUTOFF_YEAR - (gwPersonsYOB + gwPersonsInitAge) + 1;
+      if (gpContext->gwPersonsCessAge == -999) 
+         wYearsAsSmoker = wSIM_CUTOFF_YEAR - (gpContext->gwPersonsYOB + gpContext->gwPersonsInitAge) + 1;
       else 
-         wYearsAsSmoker = gwPersonsCessAge - gwPersonsInitAge + 1;
+         wYearsAsSmoker = gpContext->gwPersonsCessAge - gpContext->gwPersonsInitAge + 1;
       for (i = 0; i < wYearsAsSmoker; i++) {
-         if (i + gwPersonsInitAge < 100)
-            fprintf(pOutStream, "%d;%.2f;", i + gwPersonsInitAge, gdPersonsCPDbyAge[i]);
+         if (i + gpContext->gwPersonsInitAge < 100) {
+            gpWriter->WriteInt(i + gpContext->gwPersonsInitAge);  gpWriter->WriteChar(';');
+            gpWriter->WriteFixed2(gpContext->gdPersonsCPDbyAge[i]); gpWriter->WriteChar(';');
+         }
       }
    }
 
-   fprintf(pOutStream, "\n");
+   gpWriter->WriteChar('\n');
+   if (!gbBufferOutput)
+      gpWriter->Flush();
 }
@@ -11,12 +11,18 @@
 #ifndef _SMOKING_SIM_H
 #define _SMOKING_SIM_H
 
-#include "mersenne_class.h"
+#include "smoking_model.h"
+#include "simulation_context.h"
+#include "output_writer.h"
+#include "arrow_writer.h"
+#include "aggregate_tables.h"
 #include "sim_exception.h"
 #include <string.h>
+#include <stdio.h>
 #include <iostream>
 
-// Constants used in Excess Risk Former Smokers' formula
+// Default constants used in Excess Risk Former Smokers' formula (see SetFormerRiskCoefficients)
+#define NUM_FORMER_RISK_COEFS 4
 #define B0 -0.1711
 #define B1 0.00102
 #define B2 0.00171
@@ -27,14 +33,21 @@ extern const short wMIN_IMMEDIATE_CESSATION_YEAR;
 extern const char sSEX_LABELS[2][7];
 extern const char sRACE_LABELS[2][10];
 
+// Number of individuals handed to a worker thread at a time by the multi-threaded engine
+#define SIM_CHUNK_SIZE 4096
+
+// Each block of individuals in the multi-threaded engine starts its PRNGs 2^SIM_CHUNK_STREAM_POWER
+// draws after the previous block. Must exceed the draws SIM_CHUNK_SIZE individuals can use from one PRNG.
+#define SIM_CHUNK_STREAM_POWER 20
+
+struct SimInputReader;
 
 class Smoking_Simulator {
 
    // Labels and Enumerated Data Types for the class
    public:
 
-      enum DataType {DATA_Initiation = 1, DATA_Cessation};
-      enum OutputType {OUT_DataOnly = 1, OUT_TextReport, OUT_TimeLine, OUT_XML_Tags, OUT_Uninitialized};
+      enum OutputType {OUT_DataOnly = 1, OUT_TextReport, OUT_TimeLine, OUT_XML_Tags, OUT_Binary, OUT_Arrow, OUT_Aggregate, OUT_Uninitialized};
 
       // Individuals smoking status
       enum SmokingStatus {SMKST_Never = 0, SMKST_Current, SMKST_Former, SMKST_NumValues};
@@ -42,9 +55,6 @@ class Smoking_Simulator {
       // Individuals smoking frequency quintile (light to heavy)
       enum SmokingIntensity {SMKR_Light = 0, SMKR_LgtMed, SMKR_Medium, SMKR_MedHvy, SMKR_Heavy, SMKR_NumGroups, SMKR_Uninitialized};
 
-      // Columns of data in the other COD Life Table file
-      enum LifeTableColumns {COL_Never = 0, COL_Current_Q1, COL_Current_Q2, COL_Current_Q3, COL_Current_Q4, COL_Current_Q5, COL_NumColumns};
-
       // These 2 enums are used to write the input tag for the web version output
       enum Sex {SEX_Male = 0, SEX_Female, NUM_SEXES};
       enum Race {RACE_AllRaces = 0, NUM_RACES};
@@ -52,97 +62,74 @@ class Smoking_Simulator {
  	// Private Member Variables
    private:
 
-      // Psuedo Random Number Generator Variables
-      MersenneTwister *gpInitiationPRNG;  // PRNG for Initiation Probabilities
-      MersenneTwister *gpCessationPRNG;   // PRNG for Cessation Probabilities
-      MersenneTwister *gpLifeTablePRNG;   // PRNG for Other COD Probabilities
-      MersenneTwister *gpIndivRndsPRNG;   // PRNG for all "random" variables that only
-                                          // need one value per individual (ie smoking intensity quintile)
-                                          // Program will allow 20 of these values per individual
-
-      // Probability Arrays
-      double *gdInitiationProbs;  // Prob of initiation by race/sex/year of birth and age
-      double *gdCessationProbs;   // Prob of cessation by race/sex/year of birth and age
-      double *gdLifeTableProbs;   // Prob of COD other than lung cancer by race/sex/year of birth/age and smoking status
-      double *gdIntensityProbs;   // Prob of being a light to heavy smoker (for individuals that begin smoking)
-
-      // Cigarettes per day by race, sex, YOB and age (and smoking intensity? %bjr)
-      long double *gdCigarettesPerDay;
-      
-
-      // Data limit variables
-      short gwNumBirthCohorts;    // Number of birth cohorts Available
-      short *gwYOBCohortStartYrs; // Starting year for each of the birth cohort groups
-      short *gwYOBCohortEndYrs;   // Ending year for each of the birth cohort groups
-      short gwNumRaceValues;      // Number of Races Available
-      short gwNumSexValues;       // Number of Sexes Available
-      short gwMinInitiationAge;   // Min initiation age (assumed constant for all cohort groups)
-      short gwMinCessationAge;    // Min cessation age (assumed constant for all cohort groups)
-      short gwMaxInitiationAge;   // Max initiation age (Max possible age, data may quit before max age)
-      short gwMaxCessationAge;    // Max cessation age (Max possible age, data may quit before max age)
-      short gwMinLifeTableAge;
-      short gwMaxLifeTableAge;
-      short gwMinLifeTableYear;
-      short gwMaxLifeTableYear;
-      short gwNumIntensityGrps;   // Number of CPD Intesity groups
-      short gwIntensityMinAge;    // Minimum age among the smoking intensity group probabilities
-      short gwIntensityMaxAge;    // Maximum age among the smoking intensity group probabilities
-      short gwCpdMinAge;          // Minimum age in the cigarettes per day data
-      short gwCpdMaxAge;          // Maximum age in the cigarettes per day data
+      const SmokingModel  *gpModel;       // Data tables used by the simulation (may be shared with other simulators)
+      SmokingModel        *gpOwnedModel;  // Set when the simulator loaded the model itself and must delete it
+      SimulationContext   *gpContext;     // PRNGs and results for the last person simulated
+      OutputWriter        *gpWriter;      // Formats the data style output
+      BinaryOutputWriter  *gpBinaryWriter; // Batches the binary output (created when first used)
+      ArrowStreamWriter   *gpArrowWriter;  // Batches the Arrow output (created when first used)
+      long                 glArrowBatchSize; // People per Arrow record batch
+      AggregateTables     *gpAggregates;   // Cohort summary tables for aggregate output (created when first used)
+
+      double  gdFormerRiskCoefs[NUM_FORMER_RISK_COEFS]; // B0 to B3 of the former smoker excess risk formula
+      double *gdYearsQuitPow;       // pow(years since quitting, B3) for 0 to gwMaxLifeTableAge years (former smoker excess risk)
+      double *gdFormerOCDProbs;     // Other COD probs by age for the current former smoker (CalcFormerSmokerOCDProbs)
+
       short gwImmediateCessYear;  // Year when all smokers automatically quit smoking. 0 = option not used.
       bool gbImmediateCessation;  // Is immediatte Cessation turned on
 
-      // Person Variables, Store the results for the last person simulated
-      short gwPersonsYOB;          // Year Of Birth
-      short gwPersonsRace;         // Race
-      short gwPersonsSex;          // Sex
-      short gwPersonsInitAge;      // Age of Smoking Initiation
-      short gwPersonsCessAge;      // Age of Smoking Cessation
-      short gwPersonsAgeAtDeath;   // Age at death from COD other than lung cancer
-      SmokingIntensity     gwPersonsSmkIntensity; // The smoking intesity group for the person (smokers only)
-      double *gdPersonsCPDbyAge;   // Cigarettes smoked per day by age
-      double gdPersonsAvgCPD;      // Average num of Cigarettes smoked per day (used for COD in former smokers)
-
-      // Offset values for Probability Arrays
-      short gwInitProbRaceOffset; // Initiation Array - Race Offset
-      short gwInitProbSexOffset;  // Initiation Array - Sex Offset
-      short gwInitProbYOBOffset;  // Initiation Array - YOB Offset
-      short gwCessProbRaceOffset; // Cessation Array  - Race Offset
-      short gwCessProbSexOffset;  // Cessation Array  - Sex Offset
-      short gwCessProbYOBOffset;  // Cessation Array  - YOB Offset
-      long  glLifeTabAgeOffset;   // Other COD Array  - Age Offset
-      long  glLifeTabRaceOffset;  // Other COD Array  - Race Offset
-      long  glLifeTabSexOffset;   // Other COD Array  - Sex Offset
-      long  glLifeTabYOBOffset;   // Other COD Array  - YOB Offset
-      long  gwIntensityAgeOffset; // Smoking Intesity Array - Age Offset
-      long  gwIntensitySexOffset;
-      long  gwIntensityRaceOffset;
-      long  glCpdAgeOffset;       // Cigarettes per Day Array  - Age Offset
-      long  glCpdRaceOffset;      // Cigarettes per Day Array  - Race Offset
-      long  glCpdSexOffset;       // Cigarettes per Day Array  - Sex Offset
-      long  glCpdYOBOffset;       // Cigarettes per Day Array  - YOB Offset
-
-      short gwNumSmokingGrps;
+      bool gbIndexedMode;               // Each person uses a fixed budget of draws from every PRNG
+      unsigned int guiDrawBudgetPower;  // Indexed mode budget is 2^guiDrawBudgetPower draws per PRNG per person
 
-      OutputType           geOutputType;
+      bool    gbFastInitiation;         // Sample the initiation age from a precomputed distribution (one draw per person)
+      double *gdInitAgeCumProbs;        // Cumulative prob of initiating by each age, rows by race/sex/YOB (built when first used)
+      bool   *gbInitAgeRowBuilt;        // Rows of gdInitAgeCumProbs that have been built
+      short   gwInitAgeCutoffYear;      // Cutoff year the rows were built for (0 = rebuild all rows)
+
+      bool    gbFastOtherCOD;           // Sample never and current smoker ages of death with one draw per segment
+      double *gdOCDSurvival;            // Prob of surviving other COD to the end of each age, rows by race/sex/YOB/column (built when first used)
+      short  *gwOCDNextMissing;         // First age at or after each age with a missing other COD prob (same rows)
+      bool   *gbOCDRowBuilt;            // Rows of gdOCDSurvival that have been built
 
-      double      gdTempIntensityProb; // Persons intensity prob, remove from final
+      OutputType           geOutputType;
+      bool gbBufferOutput;        // Keep the data style and binary output in the writers between people (call FlushOutput when done)
 
       void Init();
       void Free();
+      void FlushOutput();
+      void NextPerson();
+      void StartPerson(short wRace, short wSex, short wYearBirth);
+      void SimulateSmokingHistory(short& wLastCessationAge);
+      void SimulateCPDAndOtherCOD();
+      bool SimulateUntilFormerSmoker();
+      void SimulateFormerSmokerOCD();
+      void GetCessationScenario(short wCessationYear, short wLastCessationAge, short& wInitAge, short& wCessAge);
+      void AddToAggregates();
+      void AddToAggregates(const AggregateTables &tables);
+      void BuildInitAgeDistribution(short wYOB, const double *pInitiationProbs, double *dCumProbs);
+      void BuildExcessRiskTable();
+      void BuildOCDSurvival(short wColumn, double *dSurvival, short *wNextMissing);
+      void CalcFormerSmokerOCDProbs(short wStartAge, short wEndAge, long lLifeTableOffset);
+      short GetNumCPDValues();
+      void WriteArrowSchema(FILE *pOutStream);
+      void WriteBinaryHeader(FILE *pOutStream);
       void CalcCigarettesPerDay();
       void CalcCigarettesPerDaySwitch();
+      unsigned int CalcDrawBudgetPower();
+      FILE* OpenSweepOutput(const char* sOutputFileName, const char* sLabel);
+      void CreateSweepScenarios(const char* sOutputFileName, const short* wCessationYears, const double* dCoefSets,
+                                short wNumScenarios, Smoking_Simulator**& pScenarios, FILE**& pOutputFiles);
+      void CheckSweepOutputs(FILE** pOutputFiles, short wNumScenarios);
+      void CloseSweepScenarios(Smoking_Simulator**& pScenarios, FILE**& pOutputFiles, short wNumScenarios, bool bComplete);
+      long GetCohortRow(short wRace, short wSex, short wYOB);
+      long GetNumCohortRows();
       short GetAgeOfDeathFromOtherCOD(short wStartAge, short wEndAge, SmokingStatus eStatus, bool &bWentPastData);
-      double GetNextInitRand();
-      double GetNextCessRand();
-      double GetNextLifeTabRand();
-      double GetNextRandForIndiv();
-      void InitPRNGs(unsigned long ulInitSeed, unsigned long ulCessSeed, unsigned long ulLifeTabSeed, unsigned long ulIndRndsSeed);
-      void LoadCPDIntensityProbs(const char* sDataFileName);
-      void LoadCPDFile(const char* sCpdDataFile);
-      void LoadOtherCODFile(const char* sLifeTableFileName);
-      void LoadProbabilityData(const char* sDataFileName, DataType eFileType);
       void OversamplePRNGs();
+      short SampleAgeOfDeathFromOtherCOD(short wStartAge, short wEndAge, short wColumn, bool &bWentPastData);
+      short SampleInitiationAge(short wRace, short wSex, short wYOB, const double *pInitiationProbs);
+      void RunSimulationThreaded(SimInputReader& input, FILE* pOutputFile, bool bPrintToScreen, short wNumThreads);
+      void SetImmediateCessation(short wCessationYear);
+      static void* WorkerThread(void* pArg);
 
    public:
       Smoking_Simulator(const char* sInitiationProbFile, const char* sCessationProbFile,
@@ -152,18 +139,45 @@ class Smoking_Simulator {
                         unsigned long ulIndivRndsSeed,   short wOutputType,
                         short wCessationYear);
 
-      ~Smoking_Simulator();
+      // Use a model that has already been loaded, the model must outlive the simulator
+      Smoking_Simulator(const SmokingModel* pModel,      unsigned long ulInitPRNGSeed,
+                        unsigned long ulCessPRNGSeed,    unsigned long ulLifeTabSeed,
+                        unsigned long ulIndivRndsSeed,   short wOutputType,
+                        short wCessationYear);
 
-      short GetMaxYearOfBirth();
-      short GetMinYearOfBirth();
-      short GetNumRaceValues() { return gwNumRaceValues;};
-      short GetNumSexValues() { return gwNumSexValues;};
-      short GetYOBCohortGroup(short wYearBirth);
+      ~Smoking_Simulator();
 
-      void RunSimulation(const char* sInputFileName, const char* sOutputFileName = 0, bool bPrintToScreen = true);
+      const SmokingModel* GetModel() { return gpModel;};
+      short GetMaxYearOfBirth() { return gpModel->GetMaxYearOfBirth();};
+      short GetMinYearOfBirth() { return gpModel->GetMinYearOfBirth();};
+      short GetNumRaceValues() { return gpModel->GetNumRaceValues();};
+      short GetNumSexValues() { return gpModel->GetNumSexValues();};
+      short GetYOBCohortGroup(short wYearBirth) { return gpModel->GetYOBCohortGroup(wYearBirth);};
+      bool IsIndexedMode() { return gbIndexedMode;};
+      bool IsFastInitiation() { return gbFastInitiation;};
+      bool IsFastOtherCOD() { return gbFastOtherCOD;};
+
+      void RunSimulation(const char* sInputFileName, const char* sOutputFileName = 0, bool bPrintToScreen = true,
+                         short wNumThreads = 0);
+      void RunSimulation(FILE* pInputFile, FILE* pOutputFile, bool bPrintToScreen, short wNumThreads);
       void RunSimulation(short wRace, short wSex, short wYearBirth, FILE* pOutStream = 0);
-
+      void RunCessationSweep(const char* sInputFileName, const char* sOutputFileName,
+                             const short* wCessationYears, short wNumYears);
+      void RunFormerRiskSweep(const char* sInputFileName, const char* sOutputFileName,
+                              const double* dCoefSets, short wNumSets);
+
+      void ClearAggregates();
+      void SeekPerson(unsigned long ulPersonIndex);
+      void SetArrowBatchSize(long lBatchSize);
+      void SetFastInitiation(bool bFast);
+      void SetFastOtherCOD(bool bFast);
+      void SetFormerRiskCoefficients(const double* dCoefficients);
+      void SetIndexedMode(bool bIndexed);
       void SetOutputType(short wOutputType);
+      void SetPRNGType(short wPRNGType);
+      void WriteAggregates(FILE *pOutStream);
+      void WriteAsArrow(FILE *pOutStream);
+      void WriteAsBinary(FILE *pOutStream);
       void WriteAsData(FILE *pOutStream);
       void WriteAsText(FILE *pOutStream);
       void WriteAsTimeline(FILE *pOutStream);